@@ -18,6 +18,10 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 // cmodel.c - collision model.
 
 #include "qwsvdef.h"
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <fcntl.h>
+#endif
 
 typedef struct cnode_s
 {
@@ -64,7 +68,7 @@ static cleaf_t		*map_leafs;
 static int			numleafs;
 static int			visleafs;
 
-static byte			map_novis[MAX_MAP_LEAFS/8];
+static unsigned		map_novis[(MAX_MAP_LEAFS+31)/32];
 
 static byte			*map_pvs;					// fully expanded and decompressed
 static byte			*map_phs;					// only valid if we are the server
@@ -385,7 +389,7 @@ cleaf_t *CM_PointInLeaf (const vec3_t p)
 byte *CM_LeafPVS (const cleaf_t *leaf)
 {
 	if (leaf == map_leafs)
-		return map_novis;
+		return (byte *) map_novis;
 
 	return map_pvs + (leaf - 1 - map_leafs) * map_vis_rowbytes;
 }
@@ -397,7 +401,7 @@ byte *CM_LeafPVS (const cleaf_t *leaf)
 byte *CM_LeafPHS (const cleaf_t *leaf)
 {
 	if (leaf == map_leafs)
-		return map_novis;
+		return (byte *) map_novis;
 
 	return map_phs + (leaf - 1 - map_leafs) * map_vis_rowbytes;
 }
@@ -413,15 +417,12 @@ crosses a waterline.
 =============================================================================
 */
 
-static int	fatbytes;
-static byte	fatpvs[MAX_MAP_LEAFS/8];
+static unsigned	fatpvs[(MAX_MAP_LEAFS+31)/32];
 static vec3_t	fatpvs_org;
 
 static void AddToFatPVS_r (cnode_t *node)
 {
-	int i;
 	float d;
-	byte *pvs;
 	mplane_t *plane;
 
 	while (1)
@@ -429,11 +430,7 @@ static void AddToFatPVS_r (cnode_t *node)
 		if (node->contents < 0)
 		{
 			if (node->contents != CONTENTS_SOLID)
-			{
-				pvs = CM_LeafPVS ( (cleaf_t *)node);
-				for (i=0 ; i<fatbytes ; i++)
-					fatpvs[i] |= pvs[i];
-			}
+				visrow.Or (fatpvs, (unsigned *) CM_LeafPVS ((cleaf_t *)node), map_vis_rowlongs);
 			return;
 		}
 
@@ -463,10 +460,9 @@ byte *CM_FatPVS (vec3_t org)
 {
 	VectorCopy (org, fatpvs_org);
 
-	fatbytes = (visleafs+31)>>3;
-	memset (fatpvs, 0, fatbytes);
+	memset (fatpvs, 0, map_vis_rowbytes);
 	AddToFatPVS_r (map_nodes);
-	return fatpvs;
+	return (byte *) fatpvs;
 }
 
 
@@ -813,25 +809,13 @@ static void CM_LoadPlanes (lump_t *l)
 
 /*
 ** DecompressVis
+**
+** writes 'row' bytes to out, out has to be MAX_MAP_LEAFS/8 big
 */
-static byte *DecompressVis (byte *in)
+static void DecompressVis (byte *in, byte *out, int row)
 {
-	static byte decompressed[MAX_MAP_LEAFS/8];
-	int c, row;
-	byte *out;
-
-	row = (visleafs + 7) >> 3;
-	out = decompressed;
-
-	if (!in)
-	{ // no vis info, so make all visible
-		while (row)
-		{
-			*out++ = 0xff;
-			row--;
-		}
-		return decompressed;
-	}
+	byte *start = out;
+	int c;
 
 	do
 	{
@@ -848,91 +832,847 @@ static byte *DecompressVis (byte *in)
 			*out++ = 0;
 			c--;
 		}
-	} while (out - decompressed < row);
-
-	return decompressed;
+	} while (out - start < row);
 }
 
 
 /*
-** CM_BuildPVS
+** CM_ExpandPVS
 **
-** Call after CM_LoadLeafs!
+** decompresses visibility of all leafs of bsp at base into pvs,
+** uses no globals but map_novis, so it works off the main thread too
 */
-static void CM_BuildPVS (lump_t *lump_vis, lump_t *lump_leafs)
+static void CM_ExpandPVS (byte *base, lump_t *lump_vis, lump_t *lump_leafs, int numvisleafs, int rowbytes, byte *pvs)
 {
+	byte decompressed[sizeof(map_novis)];
 	byte *visdata, *scan;
 	dleaf_t *in;
-	int i;
-
-	map_vis_rowlongs = (visleafs + 31) >> 5;
-	map_vis_rowbytes = map_vis_rowlongs * 4;
-	map_pvs = (byte *) Hunk_Alloc (map_vis_rowbytes * visleafs);
+	int i, p;
 
 	if (!lump_vis->filelen) {
-		memset (map_pvs, 0xff, map_vis_rowbytes * visleafs);
+		memset (pvs, 0xff, rowbytes * numvisleafs);
 		return;
 	}
 
 	// FIXME, add checks for lump_vis->filelen and leafs' visofs
 
-	visdata = cmod_base + lump_vis->fileofs;
+	visdata = base + lump_vis->fileofs;
+	memset (decompressed, 0, sizeof(decompressed));
 
 	// go through all leafs and decompress visibility data
-	in = (dleaf_t *)(cmod_base + lump_leafs->fileofs);
+	in = (dleaf_t *)(base + lump_leafs->fileofs);
 	in++; // pvs row 0 is leaf 1
-	scan = map_pvs;
-	for (i = 0; i < visleafs; i++, in++, scan += map_vis_rowbytes)
+	scan = pvs;
+	for (i = 0; i < numvisleafs; i++, in++, scan += rowbytes)
 	{
-		int p = LittleLong(in->visofs);
-		memcpy (scan, (p == -1) ? map_novis : DecompressVis (visdata + p), map_vis_rowbytes);
+		p = LittleLong(in->visofs);
+		if (p == -1)
+		{
+			memcpy (scan, map_novis, rowbytes);
+			continue;
+		}
+
+		DecompressVis (visdata + p, decompressed, (numvisleafs + 7) >> 3);
+		memcpy (scan, decompressed, rowbytes);
 	}
 }
 
+/*
+** PHS is built by rows, each row is its PVS row or'ed with PVS rows of all
+** leafs visible from it. big maps have rows split between threads, chunks
+** of rows go to threads in turn so that none gets all the open areas
+*/
+#define CM_PHS_MAXTHREADS	16
+#define CM_PHS_THREADLEAFS	1024	// not worth a thread for fewer leafs
+#define CM_PHS_CHUNK		64
+
+#ifdef _WIN32
+#define CM_BARRIER()		MemoryBarrier()
+#else
+#define CM_BARRIER()		__sync_synchronize()
+#endif
+
+cvar_t	sv_phsthreads = {"sv_phsthreads", "0"};	// threads building PHS, 0 is one per cpu
+
+typedef struct
+{
+	visrow_t		*ops;
+	unsigned		*pvs, *phs;
+	int				numvisleafs, rowlongs;
+	int				first, stride;		// chunks this job builds
+	volatile int	done;
+} phsjob_t;
+
+static void CM_ExpandPHSRows (phsjob_t *job)
+{
+	int c, i, j, k, index1, bitbyte, rowbytes = job->rowlongs * 4;
+	unsigned *dest, *scan;
+
+	for (c = job->first; c < job->numvisleafs; c += job->stride)
+	{
+		for (i = c; i < c + CM_PHS_CHUNK && i < job->numvisleafs; i++)
+		{
+			scan = job->pvs + i * job->rowlongs;
+			dest = job->phs + i * job->rowlongs;
+
+			// copy from pvs
+			memcpy (dest, scan, rowbytes);
+			if (!job->ops->Any (scan, job->rowlongs))
+				continue;
+
+			// or in hearable leafs
+			for (j = 0; j < rowbytes; j++)
+			{
+				// skip empty longs at once
+				if (!(j & 3) && !scan[j >> 2])
+				{
+					j += 3;
+					continue;
+				}
+
+				bitbyte = ((byte *) scan)[j];
+				for (k = 0; k < 8; k++)
+				{
+					if (! (bitbyte & (1<<k)) )
+						continue;
+					// or this pvs row into the phs
+					index1 = (j<<3) + k;
+					if (index1 >= job->numvisleafs)
+						break;
+					job->ops->Or (dest, job->pvs + index1 * job->rowlongs, job->rowlongs);
+				}
+			}
+		}
+	}
+}
+
+static DWORD WINAPI CM_PHSThread (void *param)
+{
+	phsjob_t *job = (phsjob_t *) param;
+
+	CM_ExpandPHSRows (job);
+
+	// rows have to be there before anyone sees we are done
+	CM_BARRIER ();
+	job->done = true;
+
+	return 0;
+}
+
+static int CM_PHSThreads (void)
+{
+	return (int)sv_phsthreads.value > 0 ? (int)sv_phsthreads.value : Sys_CPUCount ();
+}
+
+/*
+** CM_ExpandPHS
+**
+** calculates the PHS (potentially hearable set) from expanded pvs,
+** uses up to given number of threads, this one included
+*/
+static void CM_ExpandPHS (byte *pvs, byte *phs, int numvisleafs, int rowlongs, visrow_t *ops, int threads)
+{
+	phsjob_t jobs[CM_PHS_MAXTHREADS];
+	int i;
+
+	threads = bound (1, min (threads, numvisleafs / CM_PHS_THREADLEAFS), CM_PHS_MAXTHREADS);
+
+	for (i = 0; i < threads; i++)
+	{
+		jobs[i].ops = ops;
+		jobs[i].pvs = (unsigned *) pvs;
+		jobs[i].phs = (unsigned *) phs;
+		jobs[i].numvisleafs = numvisleafs;
+		jobs[i].rowlongs = rowlongs;
+		jobs[i].first = i * CM_PHS_CHUNK;
+		jobs[i].stride = threads * CM_PHS_CHUNK;
+		jobs[i].done = false;
+	}
+
+	// job of a thread which could not be started is done here
+	for (i = 1; i < threads; i++)
+	{
+		if (!Sys_CreateThread (CM_PHSThread, &jobs[i]))
+			CM_PHSThread (&jobs[i]);
+	}
+
+	CM_ExpandPHSRows (&jobs[0]);
+
+	for (i = 1; i < threads; i++)
+	{
+		while (!jobs[i].done)
+			Sys_Sleep (1);
+	}
+	CM_BARRIER ();
+}
+
+/*
+** CM_BuildPVS
+**
+** Call after CM_LoadLeafs!
+*/
+static void CM_BuildPVS (lump_t *lump_vis, lump_t *lump_leafs)
+{
+	map_vis_rowlongs = (visleafs + 31) >> 5;
+	map_vis_rowbytes = map_vis_rowlongs * 4;
+	map_pvs = (byte *) Hunk_Alloc (map_vis_rowbytes * visleafs);
+
+	CM_ExpandPVS (cmod_base, lump_vis, lump_leafs, visleafs, map_vis_rowbytes, map_pvs);
+}
+
 
 /*
 ** CM_BuildPHS
 **
-** Expands the PVS and calculates the PHS (potentially hearable set)
 ** Call after CM_BuildPVS (so that map_vis_rowbytes & map_vis_rowlongs are set)
 */
 static void CM_BuildPHS (void)
 {
-	int i, j, k, l, index1, bitbyte;
-	unsigned *dest, *src;
-	byte *scan;
-
 	map_phs = (byte *) Hunk_Alloc (map_vis_rowbytes * visleafs);
-	scan = map_pvs;
-	dest = (unsigned *)map_phs;
-	for (i = 0; i < visleafs; i++, dest += map_vis_rowlongs, scan += map_vis_rowbytes)
+
+	CM_ExpandPHS (map_pvs, map_phs, visleafs, map_vis_rowlongs, &visrow, CM_PHSThreads ());
+}
+
+/*
+** CM_Checksums
+**
+** checksum all of the map, except for entities
+*/
+static void CM_Checksums (byte *base, dheader_t *header, unsigned *checksum, unsigned *checksum2)
+{
+	int i;
+
+	*checksum = *checksum2 = 0;
+	for (i = 0; i < HEADER_LUMPS; i++) {
+		if (i == LUMP_ENTITIES)
+			continue;
+		*checksum ^= LittleLong(Com_BlockChecksum(base + header->lumps[i].fileofs, header->lumps[i].filelen));
+
+		if (i == LUMP_VISIBILITY || i == LUMP_LEAFS || i == LUMP_NODES)
+			continue;
+		*checksum2 ^= LittleLong(Com_BlockChecksum(base + header->lumps[i].fileofs, header->lumps[i].filelen));
+	}
+}
+
+
+
+/*
+===============================================================================
+
+COMPILED MAP CACHE
+
+<gamedir>/mapcache/<map>.cmc keeps what CM_LoadMap needs of a bsp along with
+what it computes: lumps collision code reads, checksums and expanded PVS/PHS.
+it is keyed by where the bsp is on disk (file, offset in pak, length, mtime)
+and mapped on load, lumps go through the same CM_Load* functions as they do
+from the bsp, PVS and PHS are used from the mapping in place.
+
+===============================================================================
+*/
+
+#define CM_CACHE_MAGIC		"MVCM"
+#define CM_CACHE_VERSION	1
+#define CM_CACHE_MAXMAPS	32
+#define CM_CACHE_BYTEORDER	0x01020304	// reads back differently on other byte order
+
+cvar_t	sv_mapcache = {"sv_mapcache", "1"};	// keep compiled maps on disk
+
+typedef struct
+{
+	char			magic[4];
+	int				version;
+	int				byteorder;		// CM_CACHE_BYTEORDER in native order, cache is not portable
+	int				structsizes;
+
+	// where bsp was loaded from
+	char			path[MAX_OSPATH];
+	unsigned long	offset;
+	unsigned long	len;
+	int				mtime;
+
+	unsigned int	checksum, checksum2;
+	int				halflife;
+	int				visleafs;
+	qbool			hasphs;
+
+	lump_t			lumps[HEADER_LUMPS];	// as in bsp, only those CM_Load* read
+	lump_t			pvs;
+	lump_t			phs;
+} cmcache_t;
+
+static struct
+{
+	byte			*map;			// mapped cache of current map
+	unsigned long	maplen;
+#ifdef _WIN32
+	HANDLE			file;
+	HANDLE			mapping;
+#endif
+
+	char			lastmap[MAX_QPATH];
+	qbool			lastwarm;
+	double			lastread, lastchecksum, lastvis, lastwrite;
+
+	struct
 	{
-		// copy from pvs
-		memcpy (dest, scan, map_vis_rowbytes);
+		char		name[MAX_QPATH];
+		double		cold, warm;		// last load times
+		int			numcold, numwarm;
+	} maps[CM_CACHE_MAXMAPS];
+	int				nummaps;
+} cmcache;
+
+#define CM_CACHE_STRUCTSIZES	(sizeof(mplane_t) | (sizeof(dclipnode_t) << 8) | (sizeof(dnode_t) << 16) | (sizeof(dmodel_t) << 24))
+
+static qbool CM_CacheName (char *name, char *out, int outlen)
+{
+	char base[MAX_QPATH], *s;
+
+	strlcpy (base, name, sizeof(base));
+	COM_StripExtension (base);
+	for (s = base; *s; s++)
+	{
+		if (*s == '/' || *s == '\\')
+			*s = '_';
+	}
+
+	return snprintf (out, outlen, "%s/mapcache/%s.cmc", fs_gamedir, base) < outlen;
+}
 
-		// or in hearable leafs
-		for (j = 0; j < map_vis_rowbytes; j++)
+static void CM_CacheHeader (cmcache_t *cache)
+{
+	memcpy (cache->magic, CM_CACHE_MAGIC, 4);
+	cache->version = CM_CACHE_VERSION;
+	cache->byteorder = CM_CACHE_BYTEORDER;
+	cache->structsizes = CM_CACHE_STRUCTSIZES;
+}
+
+// identity of bsp file, false if it is not a plain file or pak entry on disk
+static qbool CM_CacheKey (char *name, cmcache_t *key)
+{
+	qbool copyprotected;
+
+	memset (key, 0, sizeof(*key));
+	CM_CacheHeader (key);
+
+	if (!FS_DiskRange (name, key->path, sizeof(key->path), &key->offset, &key->len, &copyprotected))
+		return false;
+
+	return Sys_FileSizeTime (key->path, &key->mtime) > 0;
+}
+
+static void CM_CacheUnmap (void)
+{
+	if (!cmcache.map)
+		return;
+
+#ifdef _WIN32
+	UnmapViewOfFile (cmcache.map);
+	CloseHandle (cmcache.mapping);
+	CloseHandle (cmcache.file);
+#else
+	munmap (cmcache.map, cmcache.maplen);
+#endif
+	cmcache.map = NULL;
+}
+
+// private writable mapping, nothing we do to map data ever gets to the file
+static qbool CM_CacheMap (char *path)
+{
+	int len, mtime;
+#ifndef _WIN32
+	void *map;
+	int fd;
+#endif
+
+	if ((len = Sys_FileSizeTime (path, &mtime)) < (int) sizeof(cmcache_t))
+		return false;
+
+#ifdef _WIN32
+	cmcache.file = CreateFile (path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (cmcache.file == INVALID_HANDLE_VALUE)
+		return false;
+
+	if (!(cmcache.mapping = CreateFileMapping (cmcache.file, NULL, PAGE_WRITECOPY, 0, 0, NULL)))
+	{
+		CloseHandle (cmcache.file);
+		return false;
+	}
+
+	if (!(cmcache.map = (byte *) MapViewOfFile (cmcache.mapping, FILE_MAP_COPY, 0, 0, len)))
+	{
+		CloseHandle (cmcache.mapping);
+		CloseHandle (cmcache.file);
+		return false;
+	}
+#else
+	if ((fd = open (path, O_RDONLY)) < 0)
+		return false;
+
+	map = mmap (NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	close (fd);
+
+	if (map == MAP_FAILED)
+		return false;
+	cmcache.map = (byte *) map;
+#endif
+
+	cmcache.maplen = len;
+	return true;
+}
+
+static qbool CM_CacheLumpValid (lump_t *l)
+{
+	return l->fileofs >= 0 && l->filelen >= 0 && (unsigned long) l->fileofs + l->filelen <= cmcache.maplen;
+}
+
+/*
+=================
+CM_CacheLoad
+
+map cache of given bsp and set cmod_base to it, returns NULL if it is not
+there or is not of this very file
+=================
+*/
+static cmcache_t *CM_CacheLoad (char *name, qbool clientload)
+{
+	char path[MAX_OSPATH];
+	cmcache_t key, *cache;
+	int i;
+
+	CM_CacheUnmap ();
+
+	if (!(int)sv_mapcache.value || !CM_CacheKey (name, &key))
+		return NULL;
+
+	if (!CM_CacheName (name, path, sizeof(path)) || !CM_CacheMap (path))
+		return NULL;
+
+	cache = (cmcache_t *) cmcache.map;
+
+	// everything up to and including key has to match
+	if (memcmp (cache, &key, offsetof(cmcache_t, checksum)) || (!clientload && !cache->hasphs)
+		|| !CM_CacheLumpValid (&cache->pvs) || !CM_CacheLumpValid (&cache->phs)
+		|| cache->pvs.filelen != ((cache->visleafs + 31) >> 5) * 4 * cache->visleafs
+		|| (cache->hasphs && cache->phs.filelen != cache->pvs.filelen))
+	{
+		Con_DPrintf ("CM_LoadMap: %s is stale\n", path);
+		CM_CacheUnmap ();
+		return NULL;
+	}
+
+	for (i = 0; i < HEADER_LUMPS; i++)
+	{
+		if (!CM_CacheLumpValid (&cache->lumps[i]))
 		{
-			bitbyte = scan[j];
-			if (!bitbyte)
-				continue;
-			for (k = 0; k < 8; k++)
-			{
-				if (! (bitbyte & (1<<k)) )
-					continue;
-				// or this pvs row into the phs
-				index1 = (j<<3) + k;
-				if (index1 >= visleafs)
-					continue;
-				src = (unsigned *)map_pvs + index1 * map_vis_rowlongs;
-				for (l = 0; l < map_vis_rowlongs; l++)
-					dest[l] |= src[l];
-			}
+			CM_CacheUnmap ();
+			return NULL;
+		}
+	}
+
+	cmod_base = cmcache.map;
+	return cache;
+}
+
+static qbool CM_CacheWriteLump (FILE *f, lump_t *l, byte *data, int len)
+{
+	static byte zero[16];
+
+	l->fileofs = ftell (f);
+	l->filelen = len;
+
+	return (int) fwrite (data, 1, len, f) == len
+		&& (int) fwrite (zero, 1, (16 - (len & 15)) & 15, f) == ((16 - (len & 15)) & 15);
+}
+
+// write cache file at path, all data given, so it is fine off the main thread
+static qbool CM_CacheWriteFile (char *path, cmcache_t *cache, byte *base, dheader_t *header, byte *pvs, byte *phs)
+{
+	static int lumps[] = { LUMP_PLANES, LUMP_LEAFS, LUMP_NODES, LUMP_CLIPNODES, LUMP_ENTITIES, LUMP_MODELS };
+	char dir[MAX_OSPATH], tmppath[MAX_OSPATH], *s;
+	int i, pid, vissize = ((cache->visleafs + 31) >> 5) * 4 * cache->visleafs;
+	qbool ok;
+	FILE *f;
+
+	strlcpy (dir, path, sizeof(dir));
+	if ((s = strrchr (dir, '/')))
+	{
+		*s = 0;
+		Sys_mkdir (dir);
+	}
+
+	// servers sharing the gamedir may write the same cache at once
+#ifdef _WIN32
+	pid = _getpid ();
+#else
+	pid = getpid ();
+#endif
+	if (snprintf (tmppath, sizeof(tmppath), "%s.%d.tmp", path, pid) >= (int) sizeof(tmppath))
+		return false;
+	if (!(f = fopen (tmppath, "wb")))
+		return false;
+
+	// header goes again at the end when lumps are known
+	ok = fwrite (cache, sizeof(*cache), 1, f) == 1;
+
+	for (i = 0; ok && i < (int) (sizeof(lumps) / sizeof(lumps[0])); i++)
+		ok = CM_CacheWriteLump (f, &cache->lumps[lumps[i]], base + header->lumps[lumps[i]].fileofs, header->lumps[lumps[i]].filelen);
+
+	if (ok)
+		ok = CM_CacheWriteLump (f, &cache->pvs, pvs, vissize);
+	if (ok && phs)
+		ok = CM_CacheWriteLump (f, &cache->phs, phs, vissize);
+
+	if (ok)
+		ok = !fseek (f, 0, SEEK_SET) && fwrite (cache, sizeof(*cache), 1, f) == 1;
+
+	if (fclose (f))
+		ok = false;
+
+	// readers only ever see a complete file
+	Sys_remove (path);
+	if (!ok || rename (tmppath, path))
+	{
+		Sys_remove (tmppath);
+		return false;
+	}
+
+	return true;
+}
+
+/*
+=================
+CM_CacheWrite
+
+write cache of bsp just loaded, cmod_base still points to the bsp
+=================
+*/
+static void CM_CacheWrite (char *name, dheader_t *header)
+{
+	char path[MAX_OSPATH];
+	cmcache_t cache;
+
+	if (!(int)sv_mapcache.value || !CM_CacheKey (name, &cache))
+		return;
+
+	cache.checksum = map_checksum;
+	cache.checksum2 = map_checksum2;
+	cache.halflife = map_halflife;
+	cache.visleafs = visleafs;
+	cache.hasphs = (map_phs != NULL);
+
+	if (!CM_CacheName (name, path, sizeof(path)))
+		return;
+	if (!CM_CacheWriteFile (path, &cache, cmod_base, header, map_pvs, map_phs))
+		Con_Printf ("CM_LoadMap: failed to write %s\n", path);
+}
+
+/*
+=================
+CM_PreloadPrepare
+
+main thread half of preloading, finds where bsp is on disk. returns false
+if there is nothing to compile: cache is off, bsp is not a file on disk or
+its cache is fresh already, job->cached is set then
+=================
+*/
+qbool CM_PreloadPrepare (char *name, cmpreload_t *job)
+{
+	cmcache_t key, cache;
+	FILE *f;
+
+	memset (job, 0, sizeof(*job));
+	strlcpy (job->name, name, sizeof(job->name));
+	job->phsthreads = CM_PHSThreads ();
+
+	if (!(int)sv_mapcache.value || !CM_CacheKey (name, &key))
+		return false;
+
+	strlcpy (job->bsppath, key.path, sizeof(job->bsppath));
+	job->offset = key.offset;
+	job->len = key.len;
+	job->mtime = key.mtime;
+	if (!CM_CacheName (name, job->cachepath, sizeof(job->cachepath)))
+		return false;
+
+	if ((f = fopen (job->cachepath, "rb")))
+	{
+		job->cached = fread (&cache, sizeof(cache), 1, f) == 1 && cache.hasphs
+			&& !memcmp (&cache, &key, offsetof(cmcache_t, checksum));
+		fclose (f);
+	}
+
+	return !job->cached;
+}
+
+// read bsp range of file with header swapped, NULL if it is not a bsp
+// CM_LoadMap could load, works off the main thread
+static byte *CM_ReadBsp (char *path, unsigned long offset, unsigned long len, int *numvisleafs)
+{
+	dheader_t *header;
+	dmodel_t *models;
+	dleaf_t *leafs;
+	byte *base;
+	int i, p, numleafs;
+	qbool ok;
+	FILE *f;
+
+	if (len < sizeof(dheader_t) || !(f = fopen (path, "rb")))
+		return NULL;
+
+	base = (byte *) Q_malloc (len);
+	ok = !fseek (f, offset, SEEK_SET) && fread (base, 1, len, f) == len;
+	fclose (f);
+
+	header = (dheader_t *) base;
+	for (i = 0; ok && i < (int) (sizeof(dheader_t) / 4); i++)
+		((int *)header)[i] = LittleLong(((int *)header)[i]);
+
+	// CM_LoadMap can Host_Error on bad bsp, we have to check all we read
+	ok = ok && (header->version == Q1_BSPVERSION || header->version == HL_BSPVERSION);
+	for (i = 0; ok && i < HEADER_LUMPS; i++)
+		ok = header->lumps[i].fileofs >= 0 && header->lumps[i].filelen >= 0
+			&& (unsigned long) header->lumps[i].fileofs + header->lumps[i].filelen <= len;
+
+	if (!ok || header->lumps[LUMP_MODELS].filelen < (int) sizeof(dmodel_t) || header->lumps[LUMP_LEAFS].filelen % sizeof(dleaf_t))
+	{
+		Q_free (base);
+		return NULL;
+	}
+
+	models = (dmodel_t *)(base + header->lumps[LUMP_MODELS].fileofs);
+	*numvisleafs = LittleLong (models[0].visleafs);
+	numleafs = header->lumps[LUMP_LEAFS].filelen / sizeof(dleaf_t);
+
+	ok = *numvisleafs >= 1 && *numvisleafs < numleafs && ((*numvisleafs + 31) >> 5) * 4 <= (int) sizeof(map_novis);
+
+	leafs = (dleaf_t *)(base + header->lumps[LUMP_LEAFS].fileofs);
+	for (i = 1; ok && header->lumps[LUMP_VISIBILITY].filelen && i <= *numvisleafs; i++)
+	{
+		p = LittleLong (leafs[i].visofs);
+		ok = p == -1 || (p >= 0 && p < header->lumps[LUMP_VISIBILITY].filelen);
+	}
+
+	if (!ok)
+	{
+		Q_free (base);
+		return NULL;
+	}
+
+	return base;
+}
+
+/*
+=================
+CM_PreloadCompile
+
+does what CM_LoadMap does with a bsp that is not in the cache, except for
+loading it into the hunk, and writes the cache, so the next CM_LoadMap of it
+only maps the result. touches no globals, can run on any thread
+=================
+*/
+qbool CM_PreloadCompile (cmpreload_t *job)
+{
+	cmcache_t cache;
+	dheader_t *header;
+	byte *base, *pvs, *phs;
+	int rowlongs;
+	qbool written;
+
+	memset (&cache, 0, sizeof(cache));
+	if (!(base = CM_ReadBsp (job->bsppath, job->offset, job->len, &cache.visleafs)))
+		return false;
+
+	header = (dheader_t *) base;
+	rowlongs = (cache.visleafs + 31) >> 5;
+
+	pvs = (byte *) Q_malloc (rowlongs * 4 * cache.visleafs);
+	phs = (byte *) Q_malloc (rowlongs * 4 * cache.visleafs);
+	CM_ExpandPVS (base, &header->lumps[LUMP_VISIBILITY], &header->lumps[LUMP_LEAFS], cache.visleafs, rowlongs * 4, pvs);
+	CM_ExpandPHS (pvs, phs, cache.visleafs, rowlongs, &visrow, job->phsthreads);
+
+	CM_Checksums (base, header, &cache.checksum, &cache.checksum2);
+	cache.halflife = (header->version == HL_BSPVERSION);
+	cache.hasphs = true;
+
+	CM_CacheHeader (&cache);
+	strlcpy (cache.path, job->bsppath, sizeof(cache.path));
+	cache.offset = job->offset;
+	cache.len = job->len;
+	cache.mtime = job->mtime;
+
+	job->checksum = cache.checksum;
+	job->checksum2 = cache.checksum2;
+	written = CM_CacheWriteFile (job->cachepath, &cache, base, header, pvs, phs);
+
+	Q_free (phs);
+	Q_free (pvs);
+	Q_free (base);
+
+	return written;
+}
+
+static void CM_CacheStats (char *name, qbool warm, double time)
+{
+	int i;
+
+	strlcpy (cmcache.lastmap, name, sizeof(cmcache.lastmap));
+	cmcache.lastwarm = warm;
+
+	for (i = 0; i < cmcache.nummaps; i++)
+	{
+		if (!strcmp (cmcache.maps[i].name, name))
+			break;
+	}
+
+	if (i == cmcache.nummaps)
+	{
+		if (cmcache.nummaps == CM_CACHE_MAXMAPS)
+		{
+			memmove (cmcache.maps, cmcache.maps + 1, sizeof(cmcache.maps[0]) * (CM_CACHE_MAXMAPS - 1));
+			i--;
+		}
+		else
+		{
+			cmcache.nummaps++;
 		}
+
+		memset (&cmcache.maps[i], 0, sizeof(cmcache.maps[0]));
+		strlcpy (cmcache.maps[i].name, name, sizeof(cmcache.maps[0].name));
+	}
+
+	if (warm)
+	{
+		cmcache.maps[i].warm = time;
+		cmcache.maps[i].numwarm++;
 	}
+	else
+	{
+		cmcache.maps[i].cold = time;
+		cmcache.maps[i].numcold++;
+	}
+
+	Con_DPrintf ("CM_LoadMap: %s loaded %s in %.1f ms\n", name, warm ? "from cache" : "from bsp", time * 1000);
 }
 
+static void CM_MapStats_f (void)
+{
+	int i;
 
+	Con_Printf ("map cache : %s\n", (int)sv_mapcache.value ? "on" : "off");
+	if (cmcache.lastmap[0])
+	{
+		Con_Printf ("last load : %s %s", cmcache.lastmap, cmcache.lastwarm ? "from cache" : "from bsp");
+		if (!cmcache.lastwarm)
+			Con_Printf (", read %.1f ms, checksum %.1f ms, pvs/phs %.1f ms, cache write %.1f ms",
+			            cmcache.lastread * 1000, cmcache.lastchecksum * 1000, cmcache.lastvis * 1000, cmcache.lastwrite * 1000);
+		Con_Printf ("\n");
+	}
+
+	Con_Printf ("%-24s %8s %8s\n", "map", "cold ms", "warm ms");
+	for (i = 0; i < cmcache.nummaps; i++)
+	{
+		Con_Printf ("%-24s", cmcache.maps[i].name);
+		Con_Printf (cmcache.maps[i].numcold ? " %8.1f" : " %8s", cmcache.maps[i].numcold ? cmcache.maps[i].cold * 1000 : (double) 0);
+		Con_Printf (cmcache.maps[i].numwarm ? " %8.1f" : " %8s", cmcache.maps[i].numwarm ? cmcache.maps[i].warm * 1000 : (double) 0);
+		if (cmcache.maps[i].numcold && cmcache.maps[i].numwarm && cmcache.maps[i].warm > 0)
+			Con_Printf (" %6.1fx", cmcache.maps[i].cold / cmcache.maps[i].warm);
+		Con_Printf ("\n");
+	}
+}
+
+// best of a few runs of PHS build, in seconds
+static double CM_VisBenchPHS (byte *pvs, byte *phs, int numvisleafs, int rowlongs, visrow_t *ops, int threads)
+{
+	double t, best = 0;
+	int i;
+
+	for (i = 0; i < 3; i++)
+	{
+		t = Sys_DoubleTime ();
+		CM_ExpandPHS (pvs, phs, numvisleafs, rowlongs, ops, threads);
+		t = Sys_DoubleTime () - t;
+		if (!i || t < best)
+			best = t;
+	}
+
+	return best;
+}
+
+/*
+=================
+CM_VisBench_f
+
+sv_visbench [map ...]
+times PVS expansion and PHS build of given maps, current one by default,
+PHS with each row implementation this cpu has and with sv_phsthreads
+=================
+*/
+static void CM_VisBench_f (void)
+{
+	char name[MAX_QPATH];
+	cmcache_t key;
+	dheader_t *header;
+	visrow_t *impls;
+	byte *base, *pvs, *phs, *ref;
+	int i, j, numimpls, numvisleafs, size, threads = CM_PHSThreads ();
+	double t;
+
+	if (Cmd_Argc () < 2 && !map_name[0])
+	{
+		Con_Printf ("usage: %s [map ...]\n", Cmd_Argv (0));
+		return;
+	}
+
+	numimpls = VisRow_Available (&impls);
+
+	Con_Printf ("%-16s %6s %7s", "map", "leafs", "pvs ms");
+	for (j = 0; j < numimpls; j++)
+		Con_Printf (" %7s", impls[j].name);
+	Con_Printf (" %4s x%-2d\n", impls[numimpls - 1].name, threads);
+
+	for (i = 1; i < max (Cmd_Argc (), 2); i++)
+	{
+		if (Cmd_Argc () > 1)
+			snprintf (name, sizeof(name), "maps/%s.bsp", Cmd_Argv (i));
+		else
+			strlcpy (name, map_name, sizeof(name));
+
+		if (!CM_CacheKey (name, &key) || !(base = CM_ReadBsp (key.path, key.offset, key.len, &numvisleafs)))
+		{
+			Con_Printf ("%-16s can't load\n", name);
+			continue;
+		}
+
+		header = (dheader_t *) base;
+		size = ((numvisleafs + 31) >> 5) * 4 * numvisleafs;
+		pvs = (byte *) Q_malloc (size);
+		phs = (byte *) Q_malloc (size);
+		ref = (byte *) Q_malloc (size);
+
+		t = Sys_DoubleTime ();
+		CM_ExpandPVS (base, &header->lumps[LUMP_VISIBILITY], &header->lumps[LUMP_LEAFS], numvisleafs, ((numvisleafs + 31) >> 5) * 4, pvs);
+		Con_Printf ("%-16s %6d %7.2f", name, numvisleafs, (Sys_DoubleTime () - t) * 1000);
+
+		// results of all have to be the same as of the first one, scalar
+		for (j = 0; j < numimpls; j++)
+		{
+			Con_Printf (" %7.2f", CM_VisBenchPHS (pvs, j ? phs : ref, numvisleafs, (numvisleafs + 31) >> 5, &impls[j], 1) * 1000);
+			if (j && memcmp (phs, ref, size))
+				Con_Printf ("!");
+		}
+
+		Con_Printf (" %7.2f", CM_VisBenchPHS (pvs, phs, numvisleafs, (numvisleafs + 31) >> 5, &impls[numimpls - 1], threads) * 1000);
+		Con_Printf (memcmp (phs, ref, size) ? "!\n" : "\n");
+
+		Q_free (ref);
+		Q_free (phs);
+		Q_free (pvs);
+		Q_free (base);
+	}
+}
+
+//=============================================================================
 
 /*
 ** hunk was reset by host, so the data is no longer valid
@@ -941,6 +1681,8 @@ void CM_InvalidateMap (void)
 {
 	map_name[0] = 0;
 
+	CM_CacheUnmap ();
+
 	// null out the pointers to turn up any attempt to call CM functions
 	map_planes = NULL;
 	map_nodes = NULL;
@@ -960,6 +1702,8 @@ cmodel_t *CM_LoadMap (char *name, qbool clientload, unsigned *checksum, unsigned
 	unsigned int i;
 	dheader_t *header;
 	unsigned int *buf;
+	cmcache_t *cache;
+	double start = Sys_DoubleTime (), t;
 
 	if (map_name[0]) {
 		assert(!strcmp(name, map_name));
@@ -970,12 +1714,48 @@ cmodel_t *CM_LoadMap (char *name, qbool clientload, unsigned *checksum, unsigned
 		return &map_cmodels[0]; // still have the right version
 	}
 
+	COM_FileBase (name, loadname);
+
+	if ((cache = CM_CacheLoad (name, clientload)))
+	{
+		map_halflife = cache->halflife;
+		Cvar_SetROM(&sv_halflifebsp, map_halflife ? "1" : "0");
+
+		map_checksum = cache->checksum;
+		map_checksum2 = cache->checksum2;
+		if (checksum)
+			*checksum = map_checksum;
+		*checksum2 = map_checksum2;
+
+		CM_LoadPlanes (&cache->lumps[LUMP_PLANES]);
+		CM_LoadLeafs (&cache->lumps[LUMP_LEAFS]);
+		CM_LoadNodes (&cache->lumps[LUMP_NODES]);
+		CM_LoadClipnodes (&cache->lumps[LUMP_CLIPNODES]);
+		CM_LoadEntities (&cache->lumps[LUMP_ENTITIES]);
+		CM_LoadSubmodels (&cache->lumps[LUMP_MODELS]);
+
+		CM_MakeHull0 ();
+
+		if (visleafs != cache->visleafs)
+			Host_Error ("CM_LoadMap: %s cache is broken", name);
+
+		map_vis_rowlongs = (visleafs + 31) >> 5;
+		map_vis_rowbytes = map_vis_rowlongs * 4;
+		map_pvs = cmcache.map + cache->pvs.fileofs;
+		map_phs = cache->hasphs ? cmcache.map + cache->phs.fileofs : NULL;
+
+		strlcpy (map_name, name, sizeof(map_name));
+
+		CM_CacheStats (name, true, Sys_DoubleTime () - start);
+		return &map_cmodels[0];
+	}
+
 	// load the file
 	buf = (unsigned int *) FS_LoadTempFile (name, NULL);
 	if (!buf)
 		Host_Error ("CM_LoadMap: %s not found", name);
 
-	COM_FileBase (name, loadname);
+	cmcache.lastread = (t = Sys_DoubleTime ()) - start;
 
 	header = (dheader_t *)buf;
 
@@ -993,21 +1773,13 @@ cmodel_t *CM_LoadMap (char *name, qbool clientload, unsigned *checksum, unsigned
 	for (i = 0; i < sizeof(dheader_t) / 4; i++)
 		((int *)header)[i] = LittleLong(((int *)header)[i]);
 
-	// checksum all of the map, except for entities
-	map_checksum = map_checksum2 = 0;
-	for (i = 0; i < HEADER_LUMPS; i++) {
-		if (i == LUMP_ENTITIES)
-			continue;
-		map_checksum ^= LittleLong(Com_BlockChecksum(cmod_base + header->lumps[i].fileofs, header->lumps[i].filelen));
-
-		if (i == LUMP_VISIBILITY || i == LUMP_LEAFS || i == LUMP_NODES)
-			continue;
-		map_checksum2 ^= LittleLong(Com_BlockChecksum(cmod_base + header->lumps[i].fileofs, header->lumps[i].filelen));
-	}
+	CM_Checksums (cmod_base, header, &map_checksum, &map_checksum2);
 	if (checksum)
 		*checksum = map_checksum;
 	*checksum2 = map_checksum2;
 
+	cmcache.lastchecksum = Sys_DoubleTime () - t;
+
 	// load into heap
 	CM_LoadPlanes (&header->lumps[LUMP_PLANES]);
 	CM_LoadLeafs (&header->lumps[LUMP_LEAFS]);
@@ -1018,13 +1790,24 @@ cmodel_t *CM_LoadMap (char *name, qbool clientload, unsigned *checksum, unsigned
 
 	CM_MakeHull0 ();
 
+	t = Sys_DoubleTime ();
+
 	CM_BuildPVS (&header->lumps[LUMP_VISIBILITY], &header->lumps[LUMP_LEAFS]);
 
 	if (!clientload) // client doesn't need PHS
 		CM_BuildPHS ();
 
+	cmcache.lastvis = Sys_DoubleTime () - t;
+
 	strlcpy (map_name, name, sizeof(map_name));
 
+	CM_CacheStats (name, false, Sys_DoubleTime () - start);
+
+	// not part of the load time, it's what the next load saves
+	t = Sys_DoubleTime ();
+	CM_CacheWrite (name, header);
+	cmcache.lastwrite = Sys_DoubleTime () - t;
+
 	return &map_cmodels[0];
 }
 
@@ -1046,4 +1829,11 @@ void CM_Init (void)
 {
 	memset (map_novis, 0xff, sizeof(map_novis));
 	CM_InitBoxHull ();
+
+	VisRow_Init ();
+
+	Cvar_Register (&sv_mapcache);
+	Cvar_Register (&sv_phsthreads);
+	Cmd_AddCommand ("sv_mapstats", CM_MapStats_f);
+	Cmd_AddCommand ("sv_visbench", CM_VisBench_f);
 }
@@ -96,4 +96,19 @@ void CM_InvalidateMap (void);
 cmodel_t *CM_LoadMap (char *name, qbool clientload, unsigned *checksum, unsigned *checksum2);
 void CM_Init (void);
 
+// compiling next map into map cache off the main thread, see sv_preload.c
+typedef struct {
+	char			name[MAX_QPATH];
+	char			bsppath[MAX_OSPATH];	// file on disk, pak for pak entries
+	char			cachepath[MAX_OSPATH];
+	unsigned long	offset, len;
+	int				mtime;
+	int				phsthreads;
+	qbool			cached;					// cache was fresh already
+	unsigned		checksum, checksum2;	// set by CM_PreloadCompile
+} cmpreload_t;
+
+qbool CM_PreloadPrepare (char *name, cmpreload_t *job);
+qbool CM_PreloadCompile (cmpreload_t *job);
+
 #endif /* !__CMODEL_H__ */
@@ -165,6 +165,34 @@ void FS_FlushFSHash(void)
 	filesystemchanged = true;
 }
 
+/*
+============
+FS_AddFileToHash
+
+Tell hash about file just created in gamedir, so we don't have to flush
+whole hash. Removed files need nothing, stale entry just fails to open.
+============
+*/
+void FS_AddFileToHash(const char *filename)
+{
+	searchpath_t	*search;
+
+	if (!filesystemhash || filesystemchanged || Hash_GetInsensitive(filesystemhash, filename))
+		return;
+
+	for (search = fs_searchpaths ; search ; search = search->next)
+	{
+		if (search->funcs == &osfilefuncs && !strcmp((char *) search->handle, fs_gamedir))
+		{
+			Hash_AddInsensitive(filesystemhash, (char *) filename, search->handle);
+			fs_hash_files++;
+			return;
+		}
+	}
+
+	FS_FlushFSHash();
+}
+
 /*
 ============
 FS_RebuildFSHash
@@ -277,6 +305,28 @@ out:
 		return depth;
 }
 
+/*
+============
+FS_DiskRange
+
+Where on disk data of a file searched on path lies, for those who want to map it.
+============
+*/
+qbool FS_DiskRange(const char *filename, char *ospath, int ospathlen, unsigned long *offset, unsigned long *len, qbool *copyprotected)
+{
+	flocation_t loc;
+
+	if (!FS_FLocateFile(filename, FSLFRT_IFFOUND, &loc) || !loc.search->funcs->DiskRange)
+		return false;
+
+	if (!loc.search->funcs->DiskRange(loc.search->handle, &loc, ospath, ospathlen, offset))
+		return false;
+
+	*len = loc.len;
+	*copyprotected = loc.search->copyprotected;
+	return true;
+}
+
 // internal struct, no point to expose it outside.
 typedef struct
 {
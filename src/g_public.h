@@ -142,6 +142,9 @@ typedef enum
 	G_SETPAUSE,
 	G_SETUSERINFO,
 	G_MOVETOGOAL,
+	G_NAV_FINDPATH,
+	G_FINDINDEX,
+	G_PRELOADMAP,
 } gameImport_t;
 
 // !!! new things comes to end of list !!!
@@ -216,10 +219,11 @@ typedef struct
 
 typedef struct
 {
-	edict_t		*ents;
+	// pointers in VM address space, 32 bit for QVMs even on 64 bit hosts
+	int		ents;		// edict_t *
 	int		sizeofent;
-	globalvars_t	*global;
-	field_t		*fields;
+	int		global;		// globalvars_t *
+	int		fields;		// field_t *
 	int 		APIversion;
 } gameData_t;
 
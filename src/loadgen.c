@@ -0,0 +1,771 @@
+/*
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+//	loadgen.c - synthetic client load generator
+//
+//	a separate program, built with "make loadgen", which connects scripted
+//	clients to a server and has them play: it uses netchan and usercmd
+//	delta code of the server itself (net_chan.c, common.c), so what the
+//	server gets is what a real client sends. clients go through challenge,
+//	connect and signon, follow "cmd" lines the server stuffs and send a
+//	move every frame, download nothing and parse nothing but what signon
+//	needs. at the end it tells how long the server took to answer moves,
+//	how much it choked and how big packets were.
+//
+//	the server sees all clients come from one address, so it must allow
+//	that many (no per address limits), and sv_mapcheck 0 or -checksum.
+
+#include "qwsvdef.h"
+#include <sys/time.h>
+
+#define LG_MAX_CLIENTS		MAX_CLIENTS
+#define LG_RETRY			1.0			// seconds between handshake packets
+#define LG_TIMEOUT			10.0		// nothing from server that long, client is dropped
+#define LG_RTT_BUCKETS		10000		// 0.1 ms each, 1 s and longer in the last one
+
+typedef enum
+{
+	LG_CHALLENGE,		// getchallenge sent
+	LG_CONNECT,			// connect sent
+	LG_SIGNON,			// netchan is up, server leads through signon
+	LG_SPAWNED,			// playing
+	LG_DROPPED
+} lgstate_t;
+
+typedef struct
+{
+	int				num;
+	int				socket;
+	lgstate_t		state;
+	qbool			spectator;
+	int				qport;
+	int				challenge;
+	int				spawncount;
+	double			lastsend;		// handshake packet
+	double			nextframe;
+	double			lastrecv;
+	double			spawned;
+	float			msec;			// left over from last frame
+
+	netchan_t		netchan;
+	usercmd_t		cmds[UPDATE_BACKUP];
+	double			senttime[UPDATE_BACKUP];
+	int				lastack;
+
+	// what the bot is doing
+	float			yaw, pitch;
+	int				strafe;
+	double			nextturn;
+
+	// counted while spawned
+	unsigned int	packets_out, packets_in, lost_out, lost_in, missing;
+	double			bytes_out, bytes_in;
+	int				max_in;
+} lgclient_t;
+
+static lgclient_t	*lg_clients;
+static lgclient_t	*lg_current;	// NET_SendPacket sends from socket of this one
+static int			lg_numclients;
+static netadr_t		lg_server;
+static int			lg_fps = 77;
+static int			lg_loss;		// percent in each direction
+static int			lg_checksum;
+static int			lg_rate = 25000;
+
+static unsigned int	lg_rtt[LG_RTT_BUCKETS];
+static unsigned int	lg_rtt_count;
+static double		lg_rtt_total, lg_rtt_max;
+static int			lg_max_out;
+
+// net_chan.c and common.c need these from the server
+double			curtime;
+cvar_t			developer = {"developer", "0"};
+server_t		sv;
+netadr_t		net_from;
+sizebuf_t		net_message;
+static byte		net_message_buffer[MSG_BUF_SIZE];
+
+//============================================================
+
+static double LG_DoubleTime (void)
+{
+	struct timeval tp;
+	static int secbase;
+
+	gettimeofday (&tp, NULL);
+
+	if (!secbase)
+	{
+		secbase = tp.tv_sec;
+		return tp.tv_usec / 1000000.0;
+	}
+
+	return (tp.tv_sec - secbase) + tp.tv_usec / 1000000.0;
+}
+
+void Sys_Printf (char *fmt, ...)
+{
+	va_list argptr;
+
+	va_start (argptr, fmt);
+	vprintf (fmt, argptr);
+	va_end (argptr);
+	fflush (stdout);
+}
+
+void Sys_Error (const char *error, ...)
+{
+	va_list argptr;
+	char text[1024];
+
+	va_start (argptr, error);
+	vsnprintf (text, sizeof(text), error, argptr);
+	va_end (argptr);
+
+	fprintf (stderr, "ERROR: %s\n", text);
+	exit (1);
+}
+
+void Con_Printf (char *fmt, ...)
+{
+	va_list argptr;
+	char text[1024];
+
+	va_start (argptr, fmt);
+	vsnprintf (text, sizeof(text), fmt, argptr);
+	va_end (argptr);
+
+	Sys_Printf ("%s", text);
+}
+
+void Con_DPrintf (char *fmt, ...)
+{
+}
+
+void Cvar_Register (cvar_t *var)
+{
+	var->value = Q_atof (var->string);
+}
+
+qbool NET_CompareAdr (const netadr_t a, const netadr_t b)
+{
+	return !memcmp (a.ip, b.ip, sizeof(a.ip)) && a.port == b.port;
+}
+
+char *NET_AdrToString (const netadr_t a)
+{
+	static char s[32];
+
+	snprintf (s, sizeof(s), "%i.%i.%i.%i:%i", a.ip[0], a.ip[1], a.ip[2], a.ip[3], ntohs (a.port));
+	return s;
+}
+
+/*
+====================
+NET_SendPacket
+
+every client has its own socket, server tells clients apart by address.
+-loss drops packets here, as the network would
+====================
+*/
+void NET_SendPacket (netsrc_t sock, int length, void *data, netadr_t to)
+{
+	struct sockaddr_in addr;
+
+	if (lg_loss && rand () % 100 < lg_loss)
+	{
+		if (lg_current->state == LG_SPAWNED)
+			lg_current->lost_out++;
+		return;
+	}
+
+	memset (&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	memcpy (&addr.sin_addr, to.ip, 4);
+	addr.sin_port = to.port;
+
+	if (sendto (lg_current->socket, data, length, 0, (struct sockaddr *) &addr, sizeof(addr)) == -1 && errno != EWOULDBLOCK)
+		Sys_Printf ("client %d: sendto: %s\n", lg_current->num, strerror (errno));
+}
+
+//============================================================
+
+static void LG_StringCmd (lgclient_t *cl, char *cmd)
+{
+	MSG_WriteByte (&cl->netchan.message, clc_stringcmd);
+	MSG_WriteString (&cl->netchan.message, cmd);
+}
+
+static void LG_Drop (lgclient_t *cl, char *reason)
+{
+	if (cl->state == LG_DROPPED)
+		return;
+
+	Sys_Printf ("client %d: %s\n", cl->num, reason);
+	cl->state = LG_DROPPED;
+}
+
+static void LG_Connect (lgclient_t *cl, double now)
+{
+	char userinfo[MAX_EXT_INFO_STRING];
+
+	userinfo[0] = 0;
+	Info_SetValueForKey (userinfo, "name", va("%s%d", cl->spectator ? "spec" : "player", cl->num), sizeof(userinfo));
+	Info_SetValueForKey (userinfo, "team", cl->spectator ? "" : (cl->num & 1) ? "blue" : "red", sizeof(userinfo));
+	Info_SetValueForKey (userinfo, "topcolor", (cl->num & 1) ? "13" : "4", sizeof(userinfo));
+	Info_SetValueForKey (userinfo, "bottomcolor", (cl->num & 1) ? "13" : "4", sizeof(userinfo));
+	Info_SetValueForKey (userinfo, "rate", va("%d", lg_rate), sizeof(userinfo));
+	Info_SetValueForKey (userinfo, "msg", "1", sizeof(userinfo));
+	if (cl->spectator)
+		Info_SetValueForKey (userinfo, "spectator", "1", sizeof(userinfo));
+
+	Netchan_OutOfBandPrint (NS_CLIENT, lg_server, "connect %i %i %i \"%s\"\n",
+	                        PROTOCOL_VERSION, cl->qport, cl->challenge, userinfo);
+	cl->state = LG_CONNECT;
+	cl->lastsend = now;
+}
+
+// moves a player might make, changes every now and then
+static void LG_MakeCmd (lgclient_t *cl, usercmd_t *cmd, double now)
+{
+	memset (cmd, 0, sizeof(*cmd));
+
+	cl->msec += 1000.0 / lg_fps;
+	cmd->msec = (byte) bound(1, (int) cl->msec, 250);
+	cl->msec -= cmd->msec;
+
+	if (cl->state != LG_SPAWNED)
+		return;
+
+	if (now >= cl->nextturn)
+	{
+		cl->strafe = rand () % 3 - 1;
+		cl->nextturn = now + 0.2 + (rand () % 800) / 1000.0;
+	}
+
+	cl->yaw = anglemod (cl->yaw + (cl->strafe * 90 + rand () % 21 - 10) * cmd->msec / 1000.0);
+	cl->pitch = 15 * sin (now + cl->num);
+
+	cmd->angles[YAW] = cl->yaw;
+	cmd->angles[PITCH] = cl->pitch;
+	cmd->forwardmove = 400;
+	cmd->sidemove = cl->strafe * 400;
+
+	if (rand () % 100 < 3)
+		cmd->buttons |= BUTTON_JUMP;
+	if (!cl->spectator && ((int) now + cl->num) % 3 == 0)
+		cmd->buttons |= BUTTON_ATTACK;
+	if (!cl->spectator && rand () % 1000 < 5)
+		cmd->impulse = 1 + rand () % 8;
+}
+
+static void LG_SendMove (lgclient_t *cl, double now)
+{
+	byte data[128];
+	sizebuf_t buf;
+	usercmd_t nullcmd, *cmd, *oldcmd, *oldestcmd;
+	int seq = cl->netchan.outgoing_sequence, checksumIndex;
+
+	memset (&nullcmd, 0, sizeof(nullcmd));
+	cmd = &cl->cmds[seq & UPDATE_MASK];
+	oldcmd = &cl->cmds[(seq - 1) & UPDATE_MASK];
+	oldestcmd = &cl->cmds[(seq - 2) & UPDATE_MASK];
+	LG_MakeCmd (cl, cmd, now);
+
+	SZ_Init (&buf, data, sizeof(data));
+	MSG_WriteByte (&buf, clc_move);
+
+	checksumIndex = buf.cursize;
+	MSG_WriteByte (&buf, 0);
+	MSG_WriteByte (&buf, lg_loss);
+
+	MSG_WriteDeltaUsercmd (&buf, &nullcmd, oldestcmd);
+	MSG_WriteDeltaUsercmd (&buf, oldestcmd, oldcmd);
+	MSG_WriteDeltaUsercmd (&buf, oldcmd, cmd);
+
+	buf.data[checksumIndex] = COM_BlockSequenceCRCByte (buf.data + checksumIndex + 1, buf.cursize - checksumIndex - 1, seq);
+
+	// delta entities from last frame we got
+	if (cl->state == LG_SPAWNED && cl->netchan.incoming_sequence)
+	{
+		MSG_WriteByte (&buf, clc_delta);
+		MSG_WriteByte (&buf, cl->netchan.incoming_sequence & 255);
+	}
+
+	if (cl->state == LG_SPAWNED)
+	{
+		cl->packets_out++;
+		cl->bytes_out += buf.cursize + cl->netchan.message.cursize + 10;
+		lg_max_out = max(lg_max_out, buf.cursize + cl->netchan.message.cursize + 10);
+	}
+
+	cl->senttime[seq & UPDATE_MASK] = now;
+	Netchan_Transmit (&cl->netchan, buf.cursize, buf.data);
+}
+
+// line of text server stuffed, only what signon needs
+static void LG_StuffedLine (lgclient_t *cl, char *line)
+{
+	netadr_t adr;
+	char *s, *text;
+
+	if (!strncmp (line, "cmd ", 4))
+	{
+		// where spawn is sent begin has to follow
+		if (!strncmp (line + 4, "spawn ", 6))
+			cl->spawncount = Q_atoi (line + 10);
+		LG_StringCmd (cl, line + 4);
+	}
+	else if (!strcmp (line, "skins"))
+	{
+		LG_StringCmd (cl, va("begin %i", cl->spawncount));
+		cl->state = LG_SPAWNED;
+		cl->spawned = curtime;
+		cl->lastack = cl->netchan.outgoing_sequence;
+	}
+	else if (!strcmp (line, "reconnect") || !strcmp (line, "changing"))
+	{
+		// map changes, signon again
+		if (cl->state == LG_SPAWNED)
+			cl->state = LG_SIGNON;
+		if (line[0] == 'r')
+			LG_StringCmd (cl, "new");
+	}
+	else if (!strncmp (line, "packet ", 7))
+	{
+		// realip check: packet <address> "<text>"
+		if (!(text = strchr (line + 7, '"')) || !(s = strchr (line + 7, ' ')))
+			return;
+		*s = 0;
+		s = strchr (++text, '"');
+		if (s)
+			*s = 0;
+
+		memset (&adr, 0, sizeof(adr));
+		adr.type = NA_IP;
+		if ((s = strchr (line + 7, ':')))
+		{
+			*s = 0;
+			adr.port = htons ((unsigned short) Q_atoi (s + 1));
+		}
+		else
+			adr.port = lg_server.port;
+		if (inet_pton (AF_INET, line + 7, adr.ip) != 1)
+			memcpy (adr.ip, lg_server.ip, 4);
+
+		Netchan_OutOfBandPrint (NS_CLIENT, adr, "%s", text);
+	}
+}
+
+/*
+====================
+LG_Stuffed
+
+messages are not parsed, server data and stuffed text are found by their
+look: svc_serverdata with the protocol after it, svc_stufftext with one of
+the few commands signon uses
+====================
+*/
+static void LG_Stuffed (lgclient_t *cl, byte *data, int len)
+{
+	static char *commands[] = {"cmd ", "skins\n", "packet ", "reconnect\n", "changing\n", NULL};
+	char text[1024], *line, *next;
+	int i, j;
+
+	for (i = 0; i < len; i++)
+	{
+		if (data[i] == svc_serverdata && i + 9 <= len && LittleLong (*(int *)(data + i + 1)) == PROTOCOL_VERSION)
+		{
+			cl->spawncount = LittleLong (*(int *)(data + i + 5));
+			if (cl->state == LG_SIGNON)
+				LG_StringCmd (cl, va("prespawn %i 0 %i", cl->spawncount, lg_checksum));
+			i += 8;
+			continue;
+		}
+
+		if (data[i] != svc_stufftext)
+			continue;
+
+		for (j = 0; j < (int) sizeof(text) - 1 && i + 1 + j < len && data[i + 1 + j]; j++)
+			text[j] = data[i + 1 + j];
+		text[j] = 0;
+
+		for (line = NULL, j = 0; commands[j]; j++)
+		{
+			if (!strncmp (text, commands[j], strlen (commands[j])))
+				line = text;
+		}
+		if (!line)
+			continue;
+
+		i += strlen (text);
+
+		for ( ; *line; line = next)
+		{
+			if ((next = strchr (line, '\n')))
+				*next++ = 0;
+			else
+				next = line + strlen (line);
+
+			LG_StuffedLine (cl, line);
+		}
+	}
+}
+
+static void LG_ConnectionlessPacket (lgclient_t *cl, double now)
+{
+	char *s;
+	int c;
+
+	MSG_BeginReading ();
+	MSG_ReadLong ();
+	c = MSG_ReadByte ();
+
+	if (c == S2C_CHALLENGE && cl->state == LG_CHALLENGE)
+	{
+		cl->challenge = Q_atoi (MSG_ReadString ());
+		LG_Connect (cl, now);
+	}
+	else if (c == S2C_CONNECTION && cl->state == LG_CONNECT)
+	{
+		Netchan_Setup (NS_CLIENT, &cl->netchan, lg_server, cl->qport, 0);
+		cl->state = LG_SIGNON;
+		cl->nextframe = now;
+		LG_StringCmd (cl, "new");
+	}
+	else if (c == A2C_PRINT)
+	{
+		s = MSG_ReadString ();
+		while (*s == '\n')
+			s++;
+		Sys_Printf ("client %d: %s", cl->num, s);
+	}
+}
+
+static void LG_Packet (lgclient_t *cl, double now)
+{
+	int ack;
+
+	if (*(int *) net_message.data == -1)
+	{
+		LG_ConnectionlessPacket (cl, now);
+		return;
+	}
+
+	if (cl->state < LG_SIGNON || cl->state == LG_DROPPED)
+		return;
+
+	if (lg_loss && rand () % 100 < lg_loss)
+	{
+		if (cl->state == LG_SPAWNED)
+			cl->lost_in++;
+		return;
+	}
+
+	if (!Netchan_Process (&cl->netchan))
+		return;
+
+	cl->lastrecv = now;
+
+	if (cl->state == LG_SPAWNED)
+	{
+		ack = cl->netchan.incoming_acknowledged;
+		if (ack > cl->lastack)
+		{
+			// server answers every move it can, those it skipped are choked
+			if (ack - cl->lastack > 1)
+				cl->missing += ack - cl->lastack - 1;
+			cl->lastack = ack;
+
+			now -= cl->senttime[ack & UPDATE_MASK];
+			lg_rtt[min((int) (now * 10000), LG_RTT_BUCKETS - 1)]++;
+			lg_rtt_count++;
+			lg_rtt_total += now;
+			lg_rtt_max = max(lg_rtt_max, now);
+		}
+
+		cl->packets_in++;
+		cl->bytes_in += net_message.cursize;
+		cl->max_in = max(cl->max_in, net_message.cursize);
+	}
+
+	LG_Stuffed (cl, net_message.data + msg_readcount, net_message.cursize - msg_readcount);
+}
+
+static void LG_ClientFrame (lgclient_t *cl, double now)
+{
+	switch (cl->state)
+	{
+	case LG_CHALLENGE:
+		if (now - cl->lastsend >= LG_RETRY)
+		{
+			Netchan_OutOfBandPrint (NS_CLIENT, lg_server, "getchallenge\n");
+			cl->lastsend = now;
+		}
+		break;
+
+	case LG_CONNECT:
+		if (now - cl->lastsend >= LG_RETRY)
+			LG_Connect (cl, now);
+		break;
+
+	case LG_SIGNON:
+	case LG_SPAWNED:
+		if (now - cl->lastrecv > LG_TIMEOUT)
+		{
+			LG_Drop (cl, "timed out");
+			break;
+		}
+
+		if (now >= cl->nextframe)
+		{
+			LG_SendMove (cl, now);
+			cl->nextframe += 1.0 / lg_fps;
+			// fell behind, don't burst
+			if (cl->nextframe < now)
+				cl->nextframe = now + 1.0 / lg_fps;
+		}
+		break;
+
+	default:
+		break;
+	}
+}
+
+//============================================================
+
+static double LG_Percentile (double p)
+{
+	unsigned int rank = (unsigned int) ceil (lg_rtt_count * p), n = 0;
+	int i;
+
+	for (i = 0; i < LG_RTT_BUCKETS; i++)
+	{
+		n += lg_rtt[i];
+		if (n >= max(rank, 1))
+			return (i + 1) / 10.0;
+	}
+
+	return lg_rtt_max * 1000;
+}
+
+static void LG_Report (double seconds)
+{
+	unsigned int packets_out = 0, packets_in = 0, lost_out = 0, lost_in = 0, missing = 0;
+	double bytes_out = 0, bytes_in = 0, choked;
+	int i, spawned = 0, dropped = 0, max_in = 0;
+	lgclient_t *cl;
+
+	for (i = 0, cl = lg_clients; i < lg_numclients; i++, cl++)
+	{
+		if (cl->state == LG_SPAWNED)
+			spawned++;
+		else if (cl->state == LG_DROPPED)
+			dropped++;
+
+		packets_out += cl->packets_out;
+		packets_in += cl->packets_in;
+		lost_out += cl->lost_out;
+		lost_in += cl->lost_in;
+		missing += cl->missing;
+		bytes_out += cl->bytes_out;
+		bytes_in += cl->bytes_in;
+		max_in = max(max_in, cl->max_in);
+	}
+
+	// acks we never saw which are not explained by packets lost either way
+	choked = packets_out ? max(0, (double) missing - lost_out - lost_in) * 100 / packets_out : 0;
+
+	Sys_Printf ("\n%d clients for %.1f s: %d spawned, %d dropped, %d fps, %d%% loss\n",
+	            lg_numclients, seconds, spawned, dropped, lg_fps, lg_loss);
+	Sys_Printf ("to server  : %u packets, %.0f/s, %.1f bytes avg, %d max, %u lost\n",
+	            packets_out, packets_out / seconds, packets_out ? bytes_out / packets_out : 0, lg_max_out, lost_out);
+	Sys_Printf ("from server: %u packets, %.0f/s, %.1f bytes avg, %d max, %u lost, %.1f KB/s\n",
+	            packets_in, packets_in / seconds, packets_in ? bytes_in / packets_in : 0, max_in, lost_in, bytes_in / seconds / 1024);
+	Sys_Printf ("choke      : %.1f%%\n", choked);
+	Sys_Printf ("answer (ms): %.2f avg, %.1f p50, %.1f p90, %.1f p99, %.2f max, %u moves\n",
+	            lg_rtt_count ? lg_rtt_total * 1000 / lg_rtt_count : 0, LG_Percentile (0.5), LG_Percentile (0.9),
+	            LG_Percentile (0.99), lg_rtt_max * 1000, lg_rtt_count);
+}
+
+static int LG_IntParm (char *parm, int value)
+{
+	int i = COM_CheckParm (parm);
+
+	return (i && i + 1 < COM_Argc ()) ? Q_atoi (COM_Argv (i + 1)) : value;
+}
+
+static void LG_Usage (void)
+{
+	Sys_Printf ("usage: loadgen [options]\n"
+	            "  -port <port>          server on this computer, default %d\n"
+	            "  -players <n>          default 32\n"
+	            "  -spectators <n>       default 0\n"
+	            "  -fps <n>              moves per second of each client, default 77\n"
+	            "  -loss <percent>       packets lost in each direction, default 0\n"
+	            "  -rate <n>             default 25000\n"
+	            "  -time <seconds>       default 60\n"
+	            "  -checksum <n>         map checksum for sv_mapcheck, default 0\n"
+	            "  -stagger <ms>         between connects of clients, default 50\n", PORT_SERVER);
+}
+
+int main (int argc, char **argv)
+{
+	int i, players, spectators, maxfd, port, len;
+	double now, start, end, nextreport, stagger, next;
+	struct sockaddr_in addr;
+	socklen_t addrlen;
+	struct timeval timeout;
+	fd_set fdset;
+	lgclient_t *cl;
+
+	COM_InitArgv (argc, argv);
+
+	if (COM_CheckParm ("-help") || COM_CheckParm ("-h"))
+	{
+		LG_Usage ();
+		return 0;
+	}
+
+	players = LG_IntParm ("-players", 32);
+	spectators = LG_IntParm ("-spectators", 0);
+	lg_fps = bound(10, LG_IntParm ("-fps", lg_fps), 1000);
+	lg_loss = bound(0, LG_IntParm ("-loss", 0), 100);
+	lg_rate = LG_IntParm ("-rate", lg_rate);
+	lg_checksum = LG_IntParm ("-checksum", 0);
+	port = LG_IntParm ("-port", PORT_SERVER);
+	stagger = LG_IntParm ("-stagger", 50) / 1000.0;
+	end = LG_IntParm ("-time", 60);
+
+	lg_numclients = players + spectators;
+	if (lg_numclients < 1 || lg_numclients > LG_MAX_CLIENTS)
+		Sys_Error ("%d clients, can be 1 to %d", lg_numclients, LG_MAX_CLIENTS);
+
+	memset (&lg_server, 0, sizeof(lg_server));
+	lg_server.type = NA_IP;
+	lg_server.ip[0] = 127;
+	lg_server.ip[3] = 1;
+	lg_server.port = htons ((unsigned short) port);
+
+	SZ_Init (&net_message, net_message_buffer, sizeof(net_message_buffer));
+	srand ((unsigned int) time (NULL));
+
+	lg_clients = (lgclient_t *) Q_malloc (lg_numclients * sizeof(lgclient_t));
+	for (i = 0, cl = lg_clients; i < lg_numclients; i++, cl++)
+	{
+		cl->num = i;
+		cl->spectator = (i >= players);
+		cl->qport = (rand () & 0xffff) ^ i;
+		cl->yaw = rand () % 360;
+		cl->lastsend = -LG_RETRY;
+
+		if ((cl->socket = socket (PF_INET, SOCK_DGRAM, IPPROTO_UDP)) == -1)
+			Sys_Error ("socket: %s", strerror (errno));
+		if (fcntl (cl->socket, F_SETFL, O_NONBLOCK) == -1)
+			Sys_Error ("fcntl: %s", strerror (errno));
+	}
+
+	Sys_Printf ("%d players, %d spectators to %s, %d fps, %d%% loss, %.0f s\n",
+	            players, spectators, NET_AdrToString (lg_server), lg_fps, lg_loss, end);
+
+	start = LG_DoubleTime ();
+	end += start;
+	nextreport = start + 10;
+
+	while ((now = LG_DoubleTime ()) < end)
+	{
+		curtime = now;
+
+		next = now + 0.1;
+		maxfd = 0;
+		FD_ZERO (&fdset);
+
+		for (i = 0, cl = lg_clients; i < lg_numclients; i++, cl++)
+		{
+			// don't let them all knock at once
+			if (now - start < i * stagger)
+			{
+				next = min(next, start + i * stagger);
+				continue;
+			}
+
+			lg_current = cl;
+			LG_ClientFrame (cl, now);
+
+			if (cl->state == LG_SIGNON || cl->state == LG_SPAWNED)
+				next = min(next, cl->nextframe);
+
+			FD_SET (cl->socket, &fdset);
+			maxfd = max(maxfd, cl->socket);
+		}
+
+		if (now >= nextreport)
+		{
+			LG_Report (now - start);
+			nextreport += 10;
+		}
+
+		next = max(0, next - LG_DoubleTime ());
+		timeout.tv_sec = (long) next;
+		timeout.tv_usec = (long) ((next - timeout.tv_sec) * 1000000);
+
+		if (select (maxfd + 1, &fdset, NULL, NULL, &timeout) <= 0)
+			continue;
+
+		now = curtime = LG_DoubleTime ();
+
+		for (i = 0, cl = lg_clients; i < lg_numclients; i++, cl++)
+		{
+			if (!FD_ISSET (cl->socket, &fdset))
+				continue;
+
+			lg_current = cl;
+			for ( ; ; )
+			{
+				addrlen = sizeof(addr);
+				len = recvfrom (cl->socket, net_message.data, net_message.maxsize, 0, (struct sockaddr *) &addr, &addrlen);
+				if (len < 4)
+					break;
+
+				memset (&net_from, 0, sizeof(net_from));
+				net_from.type = NA_IP;
+				memcpy (net_from.ip, &addr.sin_addr, 4);
+				net_from.port = addr.sin_port;
+				net_message.cursize = len;
+
+				LG_Packet (cl, now);
+			}
+		}
+	}
+
+	LG_Report (LG_DoubleTime () - start);
+
+	// let the server know, it would wait for a timeout otherwise
+	for (i = 0, cl = lg_clients; i < lg_numclients; i++, cl++)
+	{
+		lg_current = cl;
+		if (cl->state == LG_SIGNON || cl->state == LG_SPAWNED)
+		{
+			LG_StringCmd (cl, "drop");
+			Netchan_Transmit (&cl->netchan, 0, NULL);
+		}
+		closesocket (cl->socket);
+	}
+
+	return 0;
+}
@@ -32,6 +32,8 @@ typedef struct log_s {
 	char		*message_on;
 	xcommand_t	function;
 	int			log_level;
+	long		file_size;		// counted by SV_LogAppend, for sv_maxlogsize
+	unsigned int	dropped;	// lines the log writer had no room for
 } log_t;
 
 extern	log_t	logs[MAX_LOG];
@@ -44,4 +46,11 @@ void	SV_LogPlayer(client_t *cl, char *msg, int level);
 //<-
 void	SV_Write_Log(int sv_log, int level, char *msg);
 
+// sv_log.c
+void	SV_LogInit (void);
+qbool	SV_LogAppend (int sv_log, char *prefix, char *msg);
+void	SV_LogFileOpened (int sv_log);
+void	SV_LogFileClose (int sv_log);
+void	SV_LogFlush (void);
+
 #endif /* !__LOG_H__ */
@@ -814,6 +814,21 @@ qbool NET_GetPacket (netsrc_t netsrc)
 	qbool delay = (netsrc == NS_CLIENT && cl_delay_packet.integer);
 #endif
 
+#ifndef CLIENTONLY
+	if (netsrc == NS_SERVER)
+	{
+		// replay gives captured packets instead of the sockets
+		if (SV_ReplayRunning ())
+			return SV_ReplayGetPacket (&net_from, &net_message);
+
+		if (!NET_GetPacketEx (netsrc, delay))
+			return false;
+
+		SV_CapturePacket (&net_from, &net_message);
+		return true;
+	}
+#endif
+
 	return NET_GetPacketEx (netsrc, delay);
 }
 
@@ -935,6 +950,11 @@ void NET_SendPacketEx (netsrc_t netsrc, int length, void *data, netadr_t to, qbo
 	}
 #endif
 
+#ifndef CLIENTONLY
+	if (netsrc == NS_SERVER && SV_CaptureSend (length, data, to))
+		return;
+#endif
+
 #ifndef SERVERONLY
 	if (to.type == NA_LOOPBACK)
 	{
@@ -1197,6 +1217,12 @@ qbool NET_Sleep(int msec, qbool stdinissocket)
 
 	FD_ZERO (&fdset);
 
+#ifndef CLIENTONLY
+	// replay runs frames as fast as it can
+	if (SV_ReplayRunning ())
+		msec = 0;
+#endif
+
 	if (stdinissocket)
 	{
 		FD_SET (0, &fdset); // stdin is processed too (tends to be socket 0)
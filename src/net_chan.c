@@ -279,11 +279,9 @@ void Netchan_Transmit (netchan_t *chan, int length, byte *data)
 	MSG_WriteLong (&send, w1);
 	MSG_WriteLong (&send, w2);
 
-#ifndef SERVERONLY
-	// send the qport if we are a client
+	// send the qport if we are a client, loadgen is one in server build
 	if (chan->sock == NS_CLIENT)
 		MSG_WriteShort (&send, chan->qport);
-#endif
 
 	// copy the reliable message to the packet first
 	if (send_reliable)
@@ -80,6 +80,8 @@ char*		PR2_GetString(intptr_t);
 #define		PR_GetString PR2_GetString
 intptr_t	PR2_SetString(char*s);
 #define PR_SetString PR2_SetString
+qbool		PR2_StringIsConst(intptr_t num);
+#define PR_StringIsConst PR2_StringIsConst
 void		PR2_RunError(char *error, ...);
 eval_t*		PR2_GetEdictFieldValue(edict_t *ed, char *field);
 #define PR_GetEdictFieldValue PR2_GetEdictFieldValue
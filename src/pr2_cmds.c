@@ -112,6 +112,7 @@ void PF2_precache_sound(byte* base, uintptr_t mask, pr2val_t* stack, pr2val_t*re
 		if (!sv.sound_precache[i])
 		{
 			sv.sound_precache[i] = s;
+			SV_GamestateInvalidate ();
 			return;
 		}
 		if (!strcmp(sv.sound_precache[i], s))
@@ -138,6 +139,7 @@ void PF2_precache_model(byte* base, uintptr_t mask, pr2val_t* stack, pr2val_t*re
 		if (!sv.model_precache[i])
 		{
 			sv.model_precache[i] = s;
+			SV_GamestateInvalidate ();
 			return;
 		}
 		if (!strcmp(sv.model_precache[i], s))
@@ -629,7 +631,7 @@ int PF2_newcheckclient(int check)
 		if (i == check)
 			break;	// didn't find anything else
 
-		if (ent->e->free)
+		if (EDICT_SV(ent)->free)
 			continue;
 		if (ent->v.health <= 0)
 			continue;
@@ -664,7 +666,7 @@ void PF2_checkclient(byte* base, uintptr_t mask, pr2val_t* stack, pr2val_t*retva
 
 	// return check if it might be visible
 	ent = EDICT_NUM(sv.lastcheck);
-	if (ent->e->free || ent->v.health <= 0)
+	if (EDICT_SV(ent)->free || ent->v.health <= 0)
 	{
 		// RETURN_EDICT(sv.edicts);
 		retval->_int = NUM_FOR_EDICT(sv.edicts);
@@ -961,34 +963,12 @@ gedict_t *findradius( gedict_t * start, vec3_t org, float rad );
 
 void PF2_FindRadius( byte * base, uintptr_t mask, pr2val_t * stack, pr2val_t * retval )
 {
-	int     e,j;
-
-	edict_t *ed;
-	float* org;
-	vec3_t	eorg;
-	float rad;
+	int     e;
 
 	e = NUM_FOR_EDICT( (edict_t *) VM_POINTER( base, mask, stack[0]._int ) );
-	org = (float *) VM_POINTER( base, mask, stack[1]._int );
-	rad = stack[2]._float;
-
-	for ( e++; e < sv.num_edicts; e++ )
-	{
-		ed = EDICT_NUM( e );
+	e = PR_FindRadiusNext( e, (float *) VM_POINTER( base, mask, stack[1]._int ), stack[2]._float );
 
-		if (ed->e->free)
-			continue;
-		if (ed->v.solid == SOLID_NOT)
-			continue;
-		for (j=0 ; j<3 ; j++)
-			eorg[j] = org[j] - (ed->v.origin[j] + (ed->v.mins[j] + ed->v.maxs[j])*0.5);			
-		if (VectorLength(eorg) > rad)
-			continue;
-		retval->_int = POINTER_TO_VM( base, mask, ed );
-		return;
-	}
-	retval->_int = 0;
-	return;
+	retval->_int = e ? POINTER_TO_VM( base, mask, EDICT_NUM( e ) ) : 0;
 }
 
 /*
@@ -1149,6 +1129,7 @@ void PF2_lightstyle(byte* base, uintptr_t mask, pr2val_t* stack, pr2val_t*retval
 
 	// change the string in sv
 	sv.lightstyles[style] = val;
+	SV_GamestateInvalidate ();
 
 	// send message to all clients on this server
 	if (sv.state != ss_active)
@@ -1219,7 +1200,7 @@ void PF2_nextent(byte* base, uintptr_t mask, pr2val_t* stack, pr2val_t*retval)
 			return;
 		}
 		ent = EDICT_NUM(i);
-		if (!ent->e->free)
+		if (!EDICT_SV(ent)->free)
 		{
 			retval->_int = i;
 			return;
@@ -1251,7 +1232,7 @@ void PF2_nextclient(byte* base, uintptr_t mask, pr2val_t* stack, pr2val_t*retval
 			return;
 		}
 		ent = EDICT_NUM(i);
-		if (!ent->e->free) // actually that always true for clients edicts
+		if (!EDICT_SV(ent)->free) // actually that always true for clients edicts
 		{
 			if (svs.clients[i-1].state == cs_spawned) // client in game
 			{
@@ -1284,16 +1265,23 @@ void PF2_Find (byte* base, uintptr_t mask, pr2val_t* stack, pr2val_t*retval)
 	if(!str)
 		PR2_RunError ("PF2_Find: bad search string");
 
+	if ((e = PR_FindString (e, fofs - (int) offsetof(edict_t, v), str)) >= 0)
+	{
+		retval->_int = e ? POINTER_TO_VM(base,mask,EDICT_NUM(e)) : 0;
+		return;
+	}
+	e = NUM_FOR_EDICT((edict_t *) VM_POINTER(base,mask,stack[0]._int));
+
 	for (e++ ; e < sv.num_edicts ; e++)
 	{
 		ed = EDICT_NUM(e);
-		if (ed->e->free)
+		if (EDICT_SV(ed)->free)
 			continue;
 
-		if (!(intptr_t*)((byte*)ed + fofs))
+		if (!*(string_t*)((byte*)ed + fofs))
 			continue;
 
-		t = (char *) VM_POINTER(base,mask,*(intptr_t*)((byte*)ed + fofs));
+		t = (char *) VM_POINTER(base,mask,*(string_t*)((byte*)ed + fofs));
 
 		if (!t)
 			continue;
@@ -2813,6 +2801,65 @@ void PF2_SetUserInfo( byte * base, uintptr_t mask, pr2val_t * stack, pr2val_t *
 	}
 }
 
+/*
+=================
+PF2_NavFindPath
+
+int nav_findpath(vec3_t start, vec3_t end, vec3_t *path, int maxpoints)
+
+returns number of waypoints written to path, 0 if there is no path,
+-1 if this frame's search budget is exhausted or the graph is still being
+built, the query should be repeated
+=================
+*/
+void PF2_NavFindPath(byte* base, uintptr_t mask, pr2val_t* stack, pr2val_t*retval)
+{
+	float	*start	= (float *) VM_POINTER(base,mask,stack[0]._int);
+	float	*end	= (float *) VM_POINTER(base,mask,stack[1]._int);
+	float	*path	= (float *) VM_POINTER(base,mask,stack[2]._int);
+	int		maxpoints = bound(0, stack[3]._int, 1024);
+
+	retval->_int = 0;
+
+	// path is written to, it has to be all inside qvm data
+	if (sv_vm->type == VM_BYTECODE && ((unsigned int) stack[2]._int & mask) + maxpoints * sizeof(vec3_t) > (uintptr_t) mask + 1)
+	{
+		Con_DPrintf("PF2_NavFindPath: path buffer out of qvm memory\n");
+		return;
+	}
+
+	retval->_int = SV_NavFindPath(start, end, path, maxpoints);
+}
+
+/*
+=================
+PF2_FindIndex
+
+int findindex(int fieldoff)
+
+ask engine to index string field for find(), classname always is.
+returns 0 if there is no room for another index
+=================
+*/
+void PF2_FindIndex(byte* base, uintptr_t mask, pr2val_t* stack, pr2val_t*retval)
+{
+	retval->_int = PR_FindAddField(stack[0]._int - (int) offsetof(edict_t, v));
+}
+
+/*
+=================
+PF2_PreloadMap
+
+int preloadmap(char *mapname)
+
+start loading next map in background, true if it is being or was preloaded
+=================
+*/
+void PF2_PreloadMap(byte* base, uintptr_t mask, pr2val_t* stack, pr2val_t*retval)
+{
+	retval->_int = SV_PreloadMap((char *) VM_POINTER(base,mask,stack[0].string));
+}
+
 //===========================================================================
 // SysCalls
 //===========================================================================
@@ -2912,42 +2959,28 @@ pr2_trapcall_t pr2_API[]=
 		PF2_setpause,		//G_SETPAUSE
 		PF2_SetUserInfo,	//G_SETUSERINFO
 		PF2_MoveToGoal,		//G_MOVETOGOAL
+		PF2_NavFindPath,	//G_NAV_FINDPATH
+		PF2_FindIndex,		//G_FINDINDEX
+		PF2_PreloadMap,		//G_PRELOADMAP
     };
 int pr2_numAPI = sizeof(pr2_API)/sizeof(pr2_API[0]);
 
 intptr_t sv_syscall(intptr_t arg, ...) //must passed ints
 {
-	intptr_t args[20];
+	pr2val_t args[20];
 	va_list argptr;
 	pr2val_t ret;
+	int i;
 
 	if( arg >= pr2_numAPI )
 		PR2_RunError ("sv_syscall: Bad API call number");
 
 	va_start(argptr, arg);
-	args[0] =va_arg(argptr, intptr_t);
-	args[1] =va_arg(argptr, intptr_t);
-	args[2] =va_arg(argptr, intptr_t);
-	args[3] =va_arg(argptr, intptr_t);
-	args[4] =va_arg(argptr, intptr_t);
-	args[5] =va_arg(argptr, intptr_t);
-	args[6] =va_arg(argptr, intptr_t);
-	args[7] =va_arg(argptr, intptr_t);
-	args[8] =va_arg(argptr, intptr_t);
-	args[9] =va_arg(argptr, intptr_t);
-	args[10]=va_arg(argptr, intptr_t);
-	args[11]=va_arg(argptr, intptr_t);
-	args[12]=va_arg(argptr, intptr_t);
-	args[13]=va_arg(argptr, intptr_t);
-	args[14]=va_arg(argptr, intptr_t);
-	args[15]=va_arg(argptr, intptr_t);
-	args[16]=va_arg(argptr, intptr_t);
-	args[17]=va_arg(argptr, intptr_t);
-	args[18]=va_arg(argptr, intptr_t);
-	args[19]=va_arg(argptr, intptr_t);
+	for (i = 0; i < 20; i++)
+		args[i]._int = (int) va_arg(argptr, intptr_t);
 	va_end(argptr);
 
-	pr2_API[arg] ( 0, (uintptr_t)~0, (pr2val_t*)args, &ret);
+	pr2_API[arg] ( 0, (uintptr_t)~0, args, &ret);
 
 	return ret._int;
 }
@@ -2979,7 +3012,7 @@ void PR2_InitProg()
 	PR2_FS_Restart();
 
 	gamedata = (gameData_t *) VM_Call(sv_vm, GAME_INIT, (int) (sv.time * 1000),
-	                                  (int) (Sys_DoubleTime() * 100000), 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+	                                  SV_CaptureSeed ((int) (Sys_DoubleTime() * 100000)), 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
 
 	if ( !gamedata )
 		SV_Error("PR2_InitProg gamedata == NULL");
@@ -2995,10 +3028,10 @@ void PR2_InitProg()
 				gamedata->APIversion, GAME_API_VERSION_MIN, GAME_API_VERSION);
 	}
 
-	sv.edicts = (edict_t *)PR2_GetString((intptr_t)gamedata->ents);
-	pr_global_struct = (globalvars_t*)PR2_GetString((intptr_t)gamedata->global);
+	sv.edicts = (edict_t *)PR2_GetString(gamedata->ents);
+	pr_global_struct = (globalvars_t*)PR2_GetString(gamedata->global);
 	pr_globals = (float *) pr_global_struct;
-	fields = (field_t*)PR2_GetString((intptr_t)gamedata->fields);
+	fields = (field_t*)PR2_GetString(gamedata->fields);
 	pr_edict_size = gamedata->sizeofent;
 }
 #endif /* USE_PR2 */
@@ -36,6 +36,7 @@ void ED2_PrintEdicts (void);
 void PR2_Profile_f (void);
 void ED2_PrintEdict_f (void);
 void ED_Count (void);
+void PR_ABICheck_f (void);
 void PR2_Init(void)
 {
 	int p;
@@ -64,9 +65,11 @@ void PR2_Init(void)
 	Cmd_AddCommand ("edicts", ED2_PrintEdicts);
 	Cmd_AddCommand ("edictcount", ED_Count);
 	Cmd_AddCommand ("profile", PR2_Profile_f);
+	Cmd_AddCommand ("pr_abicheck", PR_ABICheck_f);
 	Cmd_AddCommand ("mod", PR2_GameConsoleCommand);
 
-	memset(pr_newstrtbl, 0, sizeof(pr_newstrtbl));
+	PR_InitStrings();
+	PR_InitFind();
 }
 
 //===========================================================================
@@ -105,6 +108,31 @@ char *PR2_GetString(intptr_t num)
 	return NULL;
 }
 
+//===========================================================================
+// PR2_StringIsConst
+// text of the string can't change while num stays the same
+//===========================================================================
+qbool PR2_StringIsConst(intptr_t num)
+{
+	qvm_t *qvm;
+
+	if(!sv_vm)
+		return PR1_StringIsConst(num);
+
+	switch (sv_vm->type)
+	{
+	case VM_NONE:
+		return PR1_StringIsConst(num);
+
+	case VM_BYTECODE:
+		qvm = (qvm_t*)(sv_vm->hInst);
+		return num >= qvm->lit_start && num < qvm->lit_end;
+
+	default:
+		return false;
+	}
+}
+
 //===========================================================================
 // PR2_SetString
 // FIXME for VM
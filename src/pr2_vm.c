@@ -90,6 +90,8 @@ void PR2_Profile_f()
 		PR_Profile_f();
 		return;
 	}
+
+	PR_FindPrintStats();
 #ifdef QVM_PROFILE
 	if(sv_vm->type != VM_BYTECODE)
 		return;
@@ -434,6 +436,9 @@ qbool VM_LoadBytecode( vm_t * vm, sys_callex_t syscall1 )
 			*dst++ = LittleLong( *src++ );
 
 		memcpy( dst, src, header->litLength );
+
+		qvm->lit_start = header->dataLength;
+		qvm->lit_end = header->dataLength + header->litLength;
 	}
 
 	LoadMapFile( qvm, vm->name );
@@ -468,7 +473,10 @@ vm_t   *VM_Load( vm_t * vm, vm_type_t type, char *name, sys_call_t syscall1, sys
 	switch ( type )
 	{
 	case VM_NATIVE:
-		if ( VM_LoadNative( vm ) )
+		// native modules keep host pointers in 32 bit string_t/func_t fields
+		if ( sizeof( void * ) != sizeof( int ) )
+			Con_Printf( "VM_Load: native game modules need a 32 bit server, trying bytecode\n" );
+		else if ( VM_LoadNative( vm ) )
 			break;
 	case VM_BYTECODE:
 		if ( VM_LoadBytecode( vm, syscallex ) )
@@ -490,16 +498,24 @@ int     QVM_Exec( register qvm_t * qvm, int command, int arg0, int arg1, int arg
 intptr_t VM_Call( vm_t * vm, int command, int arg0, int arg1, int arg2, int arg3, int arg4, int arg5,
              int arg6, int arg7, int arg8, int arg9, int arg10, int arg11 )
 {
+	intptr_t ret;
+
 	if ( !vm )
 		Sys_Error( "VM_Call with NULL vm" );
 
 	switch ( vm->type )
 	{
 	case VM_NATIVE:
-		return vm->vmMain( command, arg0, arg1, arg2, arg3, arg4, arg5, arg6, arg7, arg8, arg9, arg10, arg11 );
+		SV_ProfileQCEnter();
+		ret = vm->vmMain( command, arg0, arg1, arg2, arg3, arg4, arg5, arg6, arg7, arg8, arg9, arg10, arg11 );
+		SV_ProfileQCLeave();
+		return ret;
 	case VM_BYTECODE:
-		return QVM_Exec( (qvm_t*) vm->hInst, command, arg0, arg1, arg2, arg3, arg4, arg5, arg6, arg7, arg8, arg9, arg10,
-		                 arg11 );
+		SV_ProfileQCEnter();
+		ret = QVM_Exec( (qvm_t*) vm->hInst, command, arg0, arg1, arg2, arg3, arg4, arg5, arg6, arg7, arg8, arg9, arg10,
+		                arg11 );
+		SV_ProfileQCLeave();
+		return ret;
 	case VM_NONE:
 		Sys_Error( "VM_Call with VM_NONE type vm" );
 	}
@@ -43,12 +43,13 @@
 #define VM_POINTER(base,mask,x)			((void*)((char *)base+((x)&mask)))
 #define POINTER_TO_VM(base,mask,x)		((x)?(intptr_t)((char *)(x) - (char*)base)&mask:0)
 
+// same size as a QVM stack slot, trap arguments are read straight from the QVM stack
 typedef union pr2val_s
 {
 	string_t	string;
 	float		_float;
-	intptr_t	_int;
-} pr2val_t;	
+	int			_int;
+} pr2val_t;
 
 typedef intptr_t (EXPORT_FN *sys_call_t) (intptr_t arg, ...);
 typedef int (*sys_callex_t) (byte *data, unsigned int mask, int fn,  pr2val_t* arg);
@@ -198,6 +199,8 @@ typedef struct {
 	int	len_ds;		// size of ds align up to power of 2
 	int	ds_mask;	// bit mask of len_ds
 	int	len_ss;		// size of ss
+	int	lit_start;	// string literals in ds, nothing writes to them
+	int	lit_end;
 
 	int	cycles;		// command cicles executed
 	int	reenter;
@@ -181,6 +181,7 @@ ok:
 
 	e->v.model = G_INT(OFS_PARM1);
 	e->v.modelindex = i;
+	PR_FindTouch (e);
 
 // if it is an inline model, get the size information for it
 	if (m[0] == '*')
@@ -723,7 +724,7 @@ int PF_newcheckclient (int check)
 		if (i == check)
 			break;	// didn't find anything else
 
-		if (ent->e->free)
+		if (EDICT_SV(ent)->free)
 			continue;
 		if (ent->v.health <= 0)
 			continue;
@@ -773,7 +774,7 @@ static void PF_checkclient (void)
 
 // return check if it might be visible	
 	ent = EDICT_NUM(sv.lastcheck);
-	if (ent->e->free || ent->v.health <= 0)
+	if (EDICT_SV(ent)->free || ent->v.health <= 0)
 	{
 		RETURN_EDICT(sv.edicts);
 		return;
@@ -890,18 +891,6 @@ void PF_localcmd (void)
 	Cbuf_AddText (str);
 }
 
-#define MAX_PR_STRING_SIZE	2048
-#define MAX_PR_STRINGS		64
-
-int		pr_string_index = 0;
-char	pr_string_buf[MAX_PR_STRINGS][MAX_PR_STRING_SIZE];
-char	*pr_string_temp = pr_string_buf[0];
-
-void PF_SetTempString(void)
-{
-	pr_string_temp = pr_string_buf[(++pr_string_index) & (MAX_PR_STRINGS - 1)];
-}
-
 
 /*
 =================
@@ -957,9 +946,7 @@ void PF_argv (void)
 	if (num < 0 || num >= Cmd_Argc())
 		RETURN_STRING("");
 	else {
-		snprintf (pr_string_temp, MAX_PR_STRING_SIZE, "%s", Cmd_Argv(num));
-		RETURN_STRING(pr_string_temp);
-		PF_SetTempString();
+		G_INT(OFS_RETURN) = PR_SetTmpString(Cmd_Argv(num));
 	}
 }
 
@@ -973,7 +960,7 @@ string substr(string str, float start, float len)
 
 void PF_substr (void)
 {
-	char *s;
+	char *s, *tmp;
 	int start, len, l;
 
 	s = G_STRING(OFS_PARM0);
@@ -993,11 +980,10 @@ void PF_substr (void)
 	if (len > l + 1)
 		len = l + 1;
 
-	strlcpy(pr_string_temp, s, len + 1);
-
-	G_INT(OFS_RETURN) = PR1_SetString(pr_string_temp);
+	tmp = PR_TmpAlloc(len + 1);
+	strlcpy(tmp, s, min(len + 1, MAX_PR_STRING_SIZE));
 
-	PF_SetTempString();
+	G_INT(OFS_RETURN) = PR1_SetString(tmp);
 }
 
 /*
@@ -1010,10 +996,7 @@ string strcat(string str1, string str2)
 
 void PF_strcat (void)
 {
-	strlcpy(pr_string_temp, PF_VarString(0), MAX_PR_STRING_SIZE);
-	G_INT(OFS_RETURN) = PR1_SetString(pr_string_temp);
-
-	PF_SetTempString();
+	G_INT(OFS_RETURN) = PR_SetTmpString(PF_VarString(0));
 }
 
 /*
@@ -1043,27 +1026,15 @@ The 'size' parameter is not QSG but an MVDSV extension
 void PF_strzone (void)
 {
 	char *s;
-	int i, size;
+	int size;
 
 	s = G_STRING(OFS_PARM0);
 
-	for (i = 0; i < MAX_PRSTR; i++)
-	{
-		if (!pr_newstrtbl[i] || pr_newstrtbl[i] == pr_strings)
-			break;
-	}
-
-	if (i == MAX_PRSTR)
-		PR_RunError("strzone: out of string memory");
-
 	size = strlen(s) + 1;
 	if (pr_argc == 2 && (int) G_FLOAT(OFS_PARM1) > size)
 		size = (int) G_FLOAT(OFS_PARM1);
 
-	pr_newstrtbl[i] = (char *) Q_malloc(size);
-	strlcpy(pr_newstrtbl[i], s, size);
-
-	G_INT(OFS_RETURN) = -(i+MAX_PRSTR);
+	G_INT(OFS_RETURN) = PR_StrZone(s, size);
 }
 
 /*
@@ -1077,36 +1048,7 @@ void strunzone (string str)
 
 void PF_strunzone (void)
 {
-	int num;
-
-	num = G_INT(OFS_PARM0);
-	if (num > - MAX_PRSTR)
-		PR_RunError("strunzone: not a dynamic string");
-
-	if (num <= -(MAX_PRSTR * 2))
-		PR_RunError ("strunzone: bad string");
-
-	num = - (num + MAX_PRSTR);
-
-	if (pr_newstrtbl[num] == pr_strings)
-		return;	// allow multiple strunzone on the same string (like free in C)
-
-	Q_free(pr_newstrtbl[num]);
-	pr_newstrtbl[num] = pr_strings;
-}
-
-void PF_clear_strtbl(void)
-{
-	int i;
-
-	for (i = 0; i < MAX_PRSTR; i++)
-	{
-		if (pr_newstrtbl[i] && pr_newstrtbl[i] != pr_strings)
-		{
-			Q_free(pr_newstrtbl[i]);
-			pr_newstrtbl[i] = NULL;
-		}
-	}
+	PR_StrUnzone(G_INT(OFS_PARM0));
 }
 
 //FTE_CALLTIMEOFDAY
@@ -1200,43 +1142,7 @@ findradius (origin, radius)
 */
 static void PF_findradius (void)
 {
-	int			i, j, numtouch;
-	edict_t		*touchlist[MAX_EDICTS], *ent, *chain;
-	float		rad, rad_2, *org;
-	vec3_t		mins, maxs, eorg;
-
-	org = G_VECTOR(OFS_PARM0);
-	rad = G_FLOAT(OFS_PARM1);
-	rad_2 = rad * rad;
-
-	for (i = 0; i < 3; i++)
-	{
-		mins[i] = org[i] - rad - 1;		// enlarge the bbox a bit
-		maxs[i] = org[i] + rad + 1;
-	}
-
-	numtouch = SV_AreaEdicts (mins, maxs, touchlist, MAX_EDICTS, AREA_SOLID);
-	numtouch += SV_AreaEdicts (mins, maxs, &touchlist[numtouch], MAX_EDICTS - numtouch, AREA_TRIGGERS);
-
-	chain = (edict_t *)sv.edicts;
-
-// touch linked edicts
-	for (i = 0; i < numtouch; i++)
-	{
-		ent = touchlist[i];
-		if (ent->v.solid == SOLID_NOT)
-			continue;	// FIXME?
-
-		for (j = 0; j < 3; j++)
-			eorg[j] = org[j] - (ent->v.origin[j] + (ent->v.mins[j] + ent->v.maxs[j]) * 0.5);
-		if (DotProduct(eorg, eorg) > rad_2)
-			continue;
-
-		ent->v.chain = EDICT_TO_PROG(chain);
-		chain = ent;
-	}
-
-	RETURN_EDICT(chain);
+	RETURN_EDICT(PR_FindRadiusChain (G_VECTOR(OFS_PARM0), G_FLOAT(OFS_PARM1)));
 }
 
 
@@ -1253,14 +1159,14 @@ void PF_dprint (void)
 void PF_ftos (void)
 {
 	float	v;
+	char	s[64];
 	v = G_FLOAT(OFS_PARM0);
 
 	if (v == (int)v)
-		snprintf (pr_string_temp, MAX_PR_STRING_SIZE, "%d",(int)v);
+		snprintf (s, sizeof(s), "%d",(int)v);
 	else
-		snprintf (pr_string_temp, MAX_PR_STRING_SIZE, "%5.1f",v);
-	G_INT(OFS_RETURN) = PR1_SetString(pr_string_temp);
-	PF_SetTempString();
+		snprintf (s, sizeof(s), "%5.1f",v);
+	G_INT(OFS_RETURN) = PR_SetTmpString(s);
 }
 
 void PF_fabs (void)
@@ -1272,10 +1178,10 @@ void PF_fabs (void)
 
 void PF_vtos (void)
 {
-	snprintf (pr_string_temp, MAX_PR_STRING_SIZE, "'%5.1f %5.1f %5.1f'", G_VECTOR(OFS_PARM0)[0], G_VECTOR(OFS_PARM0)[1], G_VECTOR(OFS_PARM0)[2]);
-	G_INT(OFS_RETURN) = PR1_SetString(pr_string_temp);
+	char	s[128];
 
-	PF_SetTempString();
+	snprintf (s, sizeof(s), "'%5.1f %5.1f %5.1f'", G_VECTOR(OFS_PARM0)[0], G_VECTOR(OFS_PARM0)[1], G_VECTOR(OFS_PARM0)[2]);
+	G_INT(OFS_RETURN) = PR_SetTmpString(s);
 }
 
 void PF_Spawn (void)
@@ -1308,10 +1214,16 @@ void PF_Find (void)
 	if (!s)
 		PR_RunError ("PF_Find: bad search string");
 
-	for (e++ ; e < sv.num_edicts ; e++)
+	if ((e = PR_FindString (e, PR_FIELDOFS(f) * 4, s)) >= 0)
+	{
+		RETURN_EDICT(EDICT_NUM(e));
+		return;
+	}
+
+	for (e = G_EDICTNUM(OFS_PARM0) + 1 ; e < sv.num_edicts ; e++)
 	{
 		ed = EDICT_NUM(e);
-		if (ed->e->free)
+		if (EDICT_SV(ed)->free)
 			continue;
 		t = E_STRING(ed,f);
 		if (!t)
@@ -1354,6 +1266,7 @@ void PF_precache_sound (void)
 		if (!sv.sound_precache[i])
 		{
 			sv.sound_precache[i] = s;
+			SV_GamestateInvalidate ();
 			return;
 		}
 		if (!strcmp(sv.sound_precache[i], s))
@@ -1379,6 +1292,7 @@ void PF_precache_model (void)
 		if (!sv.model_precache[i])
 		{
 			sv.model_precache[i] = s;
+			SV_GamestateInvalidate ();
 			return;
 		}
 		if (!strcmp(sv.model_precache[i], s))
@@ -1528,6 +1442,7 @@ void PF_lightstyle (void)
 
 	// change the string in sv
 	sv.lightstyles[style] = val;
+	SV_GamestateInvalidate ();
 
 	// send message to all clients on this server
 	if (sv.state != ss_active)
@@ -1620,7 +1535,7 @@ void PF_nextent (void)
 			return;
 		}
 		ent = EDICT_NUM(i);
-		if (!ent->e->free)
+		if (!EDICT_SV(ent)->free)
 		{
 			RETURN_EDICT(ent);
 			return;
@@ -2371,9 +2286,7 @@ void PF_infokey (void)
 	else
 		value = "";
 
-	strlcpy(pr_string_temp, value, MAX_PR_STRING_SIZE);
-	RETURN_STRING(pr_string_temp);
-	PF_SetTempString();
+	G_INT(OFS_RETURN) = PR_SetTmpString(value);
 }
 
 /*
@@ -2572,9 +2485,7 @@ static void PF_cvar_string (void)
 		return;
 	}
 
-	strlcpy (pr_string_temp, var->string, MAX_PR_STRING_SIZE);
-	RETURN_STRING(pr_string_temp);
-	PF_SetTempString();
+	G_INT(OFS_RETURN) = PR_SetTmpString(var->string);
 }
 
 // DP_REGISTERCVAR
@@ -2609,6 +2520,14 @@ void PF_setpause (void)
 		SV_TogglePause (NULL, 1);
 }
 
+// MVDSV_PRELOADMAP
+// float(string mapname) preloadmap = #533;
+// start loading next map in background, true if it is being or was preloaded
+static void PF_preloadmap (void)
+{
+	G_FLOAT(OFS_RETURN) = SV_PreloadMap (G_STRING(OFS_PARM0)) ? 1 : 0;
+}
+
 
 /*
 ==============
@@ -2628,6 +2547,7 @@ static void PF_checkextension (void)
 		"DP_QC_TRACEBOX",			// http://wiki.quakesrc.org/index.php/DP_QC_TRACEBOX
 		"DP_REGISTERCVAR",			// http://wiki.quakesrc.org/index.php/DP_REGISTERCVAR
 		"FTE_CALLTIMEOFDAY",        // http://wiki.quakesrc.org/index.php/FTE_CALLTIMEOFDAY
+		"MVDSV_PRELOADMAP",
 		"QSG_CVARSTRING",			// http://wiki.quakesrc.org/index.php/QSG_CVARSTRING
 		"ZQ_CLIENTCOMMAND",			// http://wiki.quakesrc.org/index.php/ZQ_CLIENTCOMMAND
 		"ZQ_ITEMS2",                // http://wiki.quakesrc.org/index.php/ZQ_ITEMS2
@@ -2794,6 +2714,7 @@ static struct { int num; builtin_t func; } ext_builtins[] =
 {448, PF_cvar_string},	// string(string varname) cvar_string
 {531, PF_setpause},		//void(float pause) setpause
 {532, PF_precache_vwep_model},	// float(string model) precache_vwep_model = #532;
+{533, PF_preloadmap},	// float(string mapname) preloadmap = #533;
 };
 
 #define num_ext_builtins (sizeof(ext_builtins)/sizeof(ext_builtins[0]))
@@ -23,8 +23,9 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 // this file is shared by quake and qcc
 
-typedef intptr_t func_t;
-typedef intptr_t string_t;
+// progs and QVMs both use 32 bit fields, keep these int on 64 bit builds
+typedef int func_t;
+typedef int string_t;
 
 typedef enum {ev_void, ev_string, ev_float, ev_vector, ev_entity, ev_field, ev_function, ev_pointer} etype_t;
 
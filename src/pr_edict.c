@@ -92,8 +92,9 @@ Sets everything to NULL
 void ED_ClearEdict (edict_t *e)
 {
 	memset(&e->v, 0, pr_edict_size - sizeof(edict_t) + sizeof(entvars_t));
-	e->e->lastruntime = 0;
-	e->e->free = false;
+	EDICT_SV(e)->lastruntime = 0;
+	EDICT_SV(e)->free = false;
+	PR_FindTouch (e);
 }
 
 /*
@@ -117,7 +118,7 @@ edict_t *ED_Alloc (void)
 		e = EDICT_NUM(i);
 		// the first couple seconds of server time can involve a lot of
 		// freeing and allocating, so relax the replacement policy
-		if (e->e->free && (e->e->freetime < 2 || sv.time - e->e->freetime > 0.5))
+		if (EDICT_SV(e)->free && (EDICT_SV(e)->freetime < 2 || sv.time - EDICT_SV(e)->freetime > 0.5))
 		{
 			ED_ClearEdict(e);
 			return e;
@@ -154,7 +155,7 @@ void ED_Free (edict_t *ed)
 {
 	SV_UnlinkEdict (ed);		// unlink from world bsp
 
-	ed->e->free = true;
+	EDICT_SV(ed)->free = true;
 	ed->v.model = 0;
 	ed->v.takedamage = 0;
 	ed->v.modelindex = 0;
@@ -168,7 +169,8 @@ void ED_Free (edict_t *ed)
 	ed->v.nextthink = -1;
 	ed->v.solid = 0;
 
-	ed->e->freetime = sv.time;
+	EDICT_SV(ed)->freetime = sv.time;
+	PR_FindTouch (ed);
 }
 
 //===========================================================================
@@ -498,7 +500,7 @@ void ED_Print (edict_t *ed)
 	char	*name;
 	int		type;
 
-	if (ed->e->free)
+	if (EDICT_SV(ed)->free)
 	{
 		Con_Printf ("FREE\n");
 		return;
@@ -548,7 +550,7 @@ void ED_Write (FILE *f, edict_t *ed)
 
 	fprintf (f, "{\n");
 
-	if (ed->e->free)
+	if (EDICT_SV(ed)->free)
 	{
 		fprintf (f, "}\n");
 		return;
@@ -647,7 +649,7 @@ void ED_Count (void)
 	for (i=0 ; i<sv.num_edicts ; i++)
 	{
 		ent = EDICT_NUM(i);
-		if (ent->e->free)
+		if (EDICT_SV(ent)->free)
 			continue;
 		active++;
 		if (ent->v.solid)
@@ -666,6 +668,114 @@ void ED_Count (void)
 
 }
 
+/*
+=============
+PR_ABICheck_f
+
+checks that what is shared with progs and QVMs has the 32 bit layout they
+were compiled for, whatever the host: sizes of the types, and offsets of
+fields and globals against the ones the loaded progs or QVM use
+=============
+*/
+typedef struct
+{
+	char	*name;
+	int		ofs;
+} abioffset_t;
+
+#define ABI_FIELD(x)	{#x, (int) offsetof(entvars_t, x)}
+#define ABI_GLOBAL(x)	{#x, (int) offsetof(globalvars_t, x)}
+
+// first and last of the structs and each type in between
+static abioffset_t abi_fields[] =
+{
+	ABI_FIELD(modelindex), ABI_FIELD(origin), ABI_FIELD(classname), ABI_FIELD(model),
+	ABI_FIELD(touch), ABI_FIELD(think), ABI_FIELD(nextthink), ABI_FIELD(groundentity),
+	ABI_FIELD(weaponmodel), ABI_FIELD(chain), ABI_FIELD(v_angle), ABI_FIELD(netname),
+	ABI_FIELD(enemy), ABI_FIELD(owner), ABI_FIELD(movedir), ABI_FIELD(message),
+	ABI_FIELD(noise3)
+};
+
+static abioffset_t abi_globals[] =
+{
+	ABI_GLOBAL(self), ABI_GLOBAL(time), ABI_GLOBAL(newmis), ABI_GLOBAL(mapname),
+	ABI_GLOBAL(parm1), ABI_GLOBAL(parm16), ABI_GLOBAL(v_forward), ABI_GLOBAL(trace_ent),
+	ABI_GLOBAL(msg_entity), ABI_GLOBAL(main), ABI_GLOBAL(StartFrame), ABI_GLOBAL(SetChangeParms)
+};
+
+static int abi_checks, abi_fails;
+
+static void PR_ABICheck (qbool ok, char *what, char *name)
+{
+	abi_checks++;
+	if (ok)
+		return;
+
+	abi_fails++;
+	Con_Printf ("pr_abicheck: %s %s is wrong\n", what, name);
+}
+
+void PR_ABICheck_f (void)
+{
+	ddef_t *def;
+	int i;
+#ifdef USE_PR2
+	extern field_t *fields;
+	field_t *f;
+	char *s;
+#endif
+
+	abi_checks = abi_fails = 0;
+
+	PR_ABICheck (sizeof(string_t) == 4, "size of", "string_t");
+	PR_ABICheck (sizeof(func_t) == 4, "size of", "func_t");
+	PR_ABICheck (offsetof(edict_t, v) == 4, "offset of", "edict_t v");
+	PR_ABICheck (sizeof(entvars_t) == offsetof(entvars_t, noise3) + 4, "size of", "entvars_t");
+	PR_ABICheck (sizeof(globalvars_t) == offsetof(globalvars_t, SetChangeParms) + 4, "size of", "globalvars_t");
+#ifdef USE_PR2
+	PR_ABICheck (sizeof(pr2val_t) == 4, "size of", "pr2val_t");
+	PR_ABICheck (sizeof(field_t) == 12, "size of", "field_t");
+	PR_ABICheck (sizeof(gameData_t) == 20, "size of", "gameData_t");
+#endif
+
+	if (sv.state != ss_active)
+		Con_Printf ("pr_abicheck: no map running, progs not checked\n");
+#ifdef USE_PR2
+	else if (sv_vm && sv_vm->type != VM_BYTECODE)
+		Con_Printf ("pr_abicheck: native game library, not checked\n");
+	else if (sv_vm)
+	{
+		// QVM exports offsets from start of its edict_t
+		PR_ABICheck (pr_edict_size >= (int) sizeof(edict_t), "size of", "QVM edict");
+		for (i = 0; i < (int) (sizeof(abi_fields) / sizeof(abi_fields[0])); i++)
+		{
+			for (f = fields; (s = PR2_GetString(f->name)) && *s; f++)
+				if (!strcmp(s, abi_fields[i].name))
+					break;
+			if (s && *s)
+				PR_ABICheck (f->ofs == (int) offsetof(edict_t, v) + abi_fields[i].ofs, "QVM field", abi_fields[i].name);
+		}
+	}
+#endif
+	else if (pr_nqprogs)
+		Con_Printf ("pr_abicheck: NQ progs, not checked\n");
+	else
+	{
+		for (i = 0; i < (int) (sizeof(abi_fields) / sizeof(abi_fields[0])); i++)
+		{
+			def = ED_FindField (abi_fields[i].name);
+			PR_ABICheck (def && def->ofs * 4 == abi_fields[i].ofs, "progs field", abi_fields[i].name);
+		}
+		for (i = 0; i < (int) (sizeof(abi_globals) / sizeof(abi_globals[0])); i++)
+		{
+			def = ED_FindGlobal (abi_globals[i].name);
+			PR_ABICheck (def && def->ofs * 4 == abi_globals[i].ofs, "progs global", abi_globals[i].name);
+		}
+	}
+
+	Con_Printf ("pr_abicheck: %i checks, %i failed\n", abi_checks, abi_fails);
+}
+
 /*
 ==============================================================================
  
@@ -759,11 +869,10 @@ ED_NewString
 */
 char *ED_NewString (char *string)
 {
-	char	*nuw, *new_p;
+	char	nuw[MAX_PR_STRING_SIZE], *new_p;
 	int		i,l;
 
-	l = strlen(string) + 1;
-	nuw = (char *) Hunk_Alloc (l);
+	l = min(strlen(string) + 1, sizeof(nuw));
 	new_p = nuw;
 
 	for (i=0 ; i< l ; i++)
@@ -779,8 +888,9 @@ char *ED_NewString (char *string)
 		else
 			*new_p++ = string[i];
 	}
+	nuw[sizeof(nuw) - 1] = 0;
 
-	return nuw;
+	return PR_LevelString(nuw);
 }
 
 
@@ -935,7 +1045,9 @@ char *ED_ParseEdict (char *data, edict_t *ent)
 	}
 
 	if (!init)
-		ent->e->free = true;
+		EDICT_SV(ent)->free = true;
+
+	PR_FindTouch (ent);
 
 	return data;
 }
@@ -1080,7 +1192,6 @@ qbool PR1_ClientCmd(void)
 PR1_LoadProgs
 ===============
 */
-void PF_clear_strtbl(void);
 
 #ifdef WITH_NQPROGS
 void PR_InitPatchTables (void)
@@ -1121,7 +1232,7 @@ void PR1_LoadProgs (void)
 		gefvCache[i].field[0] = 0;
 
 	// clear pr_newstrtbl
-	PF_clear_strtbl();
+	PR_ClearZoneStrings();
 
 	progs = NULL;
 #ifdef WITH_NQPROGS
@@ -1176,8 +1287,6 @@ void PR1_LoadProgs (void)
 	pr_fielddefs = (ddef_t *)((byte *)progs + progs->ofs_fielddefs);
 	pr_statements = (dstatement_t *)((byte *)progs + progs->ofs_statements);
 
-	num_prstr = 0;
-
 	pr_global_struct = (globalvars_t *)((byte *)progs + progs->ofs_globals);
 	pr_globals = (float *)pr_global_struct;
 
@@ -1245,8 +1354,10 @@ void PR1_Init (void)
 	Cmd_AddCommand ("edicts", ED_PrintEdicts);
 	Cmd_AddCommand ("edictcount", ED_Count);
 	Cmd_AddCommand ("profile", PR_Profile_f);
+	Cmd_AddCommand ("pr_abicheck", PR_ABICheck_f);
 
-	memset(pr_newstrtbl, 0, sizeof(pr_newstrtbl));
+	PR_InitStrings();
+	PR_InitFind();
 }
 
 edict_t *EDICT_NUM(int n)
@@ -249,6 +249,8 @@ void PR_Profile_f (void)
 		}
 	}
 	while (best);
+
+	PR_FindPrintStats ();
 }
 
 
@@ -276,6 +278,7 @@ void PR_RunError (char *error, ...)
 	Con_Printf ("%s\n", string);
 
 	pr_depth = 0; // dump the stack so SV_Error can shutdown functions
+	SV_ProfileQCAbort ();
 
 	SV_Error ("Program error");
 }
@@ -376,6 +379,8 @@ void PR_ExecuteProgram (func_t fnum)
 
 	f = &pr_functions[fnum];
 
+	SV_ProfileQCEnter ();
+
 	runaway = 100000;
 	pr_trace = false;
 
@@ -540,10 +545,12 @@ void PR_ExecuteProgram (func_t fnum)
 			b->vector[2] = a->vector[2];
 			break;
 
+		case OP_STOREP_S:
+			PR_FindTouchOfs (b->_int);	// may be an indexed field
+			// fall through
 		case OP_STOREP_F:
 		case OP_STOREP_ENT:
 		case OP_STOREP_FLD:		// integers
-		case OP_STOREP_S:
 		case OP_STOREP_FNC:		// pointers
 			ptr = (eval_t *)((byte *)sv.edicts + b->_int);
 			ptr->_int = a->_int;
@@ -647,7 +654,10 @@ void PR_ExecuteProgram (func_t fnum)
 
 			s = PR_LeaveFunction ();
 			if (pr_depth == exitdepth)
+			{
+				SV_ProfileQCLeave ();
 				return;		// all done
+			}
 			break;
 
 		case OP_STATE:
@@ -669,71 +679,6 @@ void PR_ExecuteProgram (func_t fnum)
 
 //=============================================================================
 
-char *pr_newstrtbl[MAX_PRSTR];
-char *pr_strtbl[MAX_PRSTR];
-int num_prstr;
-
-char *PR1_GetString(int num)
-{
-	if (num < 0)
-	{
-		//Con_DPrintf("GET:%d == %s\n", num, pr_strtbl[-num]);
-		num = -num;
-		if (num >= 2 * MAX_PRSTR)
-		{
-			Con_Printf("PR1_GetString: num = %d\n", num);// May be will be better to generate PR_RunError?
-			return NULL;
-		}
-		if (num >= MAX_PRSTR)
-			return pr_newstrtbl[num - MAX_PRSTR];
-
-		return pr_strtbl[num];
-	}
-	return pr_strings + num;
-}
-
-int PR1_SetString(char *s)
-{
-	int i;
-
-	if (s - pr_strings < 0)
-	{
-		for (i = 0; i < num_prstr; i++)
-			if (pr_strtbl[i] == s)
-				return -i;
-
-		if (num_prstr + 1 >= MAX_PRSTR)
-			Sys_Error("MAX_PRSTR");
-
-		pr_strtbl[++num_prstr] = s;
-		//Con_DPrintf("SET:%d == %s\n", -num_prstr, s);
-		return -num_prstr;
-	}
-	return (int)(s - pr_strings);
-}
-
-/*
-==============
-PR_SetTmpString
-
-temp strings are used for qc function parameters
-many calls to function could cause strtbl overflow
-==============
-*/
-
-int PR_SetTmpString(const char *s)
-{
-	static int index1;
-	static char tmp[8][2048];
-
-	index1 = (index1 + 1) & 7;
-
-	strlcpy(tmp[index1], s, sizeof(tmp[index1]));
-	return PR1_SetString(tmp[index1]);
-}
-
-//=============================================================================
-
 void PR1_GameClientDisconnect(int spec)
 {
 	if (spec)
@@ -0,0 +1,540 @@
+/*
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+//	pr_find.c - indexed entity searches for the find/findradius builtins
+//
+//	every indexed string field keeps a hash of edicts by field contents, each
+//	bucket is a list sorted by edict number so find() loops walk it in the
+//	same order as a linear scan would.
+//	QC stores to string fields (OP_STOREP_S) and engine writes mark edicts
+//	dirty, dirty edicts are reindexed before the next query. QVM writes its
+//	edicts directly, so there all edicts are reindexed once a frame, before
+//	its first query. edicts the engine spawned, freed or wrote this frame are
+//	reindexed before every query, so spawn-and-name works within a frame.
+//	a hit is checked against the field as it is now, but an older edict the
+//	QVM gave a new value this frame is only found by it from the next frame.
+//	that only works for strings whose text stays with their value (see
+//	PR_StringIsConst). edicts with other strings (client names, strzone,
+//	temp strings, qvm buffers) go to an extra list which every query scans.
+
+#include "qwsvdef.h"
+
+#define MAX_FIND_FIELDS		8
+#define FIND_HASH_SIZE		128		// must be power of 2
+#define FIND_VOLATILE		FIND_HASH_SIZE	// bucket of strings which can change under the same value
+
+typedef struct findindex_s
+{
+	int			fofs;						// byte offset of string field from &ed->v
+	short		hash[FIND_HASH_SIZE + 1];	// first edict in bucket, -1 if empty
+	short		next[MAX_EDICTS];
+	short		prev[MAX_EDICTS];
+	short		bucket[MAX_EDICTS];			// -1 if edict is not indexed
+	string_t	value[MAX_EDICTS];			// field value edict was indexed with
+} findindex_t;
+
+static findindex_t	find_fields[MAX_FIND_FIELDS];
+static int			find_numfields;
+
+static byte			find_dirty[MAX_EDICTS];
+static short		find_dirtylist[MAX_EDICTS];
+static int			find_numdirty;
+static qbool		find_fullsync;
+
+// QVM: edicts touched by the engine this frame, reindexed before each query
+static byte			find_recent[MAX_EDICTS];
+static short		find_recentlist[MAX_EDICTS];
+static int			find_numrecent;
+
+static edict_t		*find_touchlist[MAX_EDICTS];
+
+// candidates of the last PF2_FindRadius query, sorted by edict number
+static struct
+{
+	vec3_t	org;
+	float	rad;
+	int		linkcount;
+	int		num;
+	short	list[MAX_EDICTS];
+} find_radius;
+
+static struct
+{
+	int		find, find_indexed, radius;
+	double	find_time, radius_time;
+} findstats;
+
+#define FIND_FIELD(ed, fofs) (*(string_t *)((byte *)&(ed)->v + (fofs)))
+
+static unsigned PR_FindHash (const char *s)
+{
+	unsigned h = 5381;
+
+	while (*s)
+		h = h * 33 + (byte) *s++;
+
+	return h & (FIND_HASH_SIZE - 1);
+}
+
+static findindex_t *PR_FindIndexForField (int fofs)
+{
+	int i;
+
+	for (i = 0; i < find_numfields; i++)
+		if (find_fields[i].fofs == fofs)
+			return &find_fields[i];
+
+	return NULL;
+}
+
+static void PR_FindUnlink (findindex_t *fi, int e)
+{
+	if (fi->bucket[e] < 0)
+		return;
+
+	if (fi->prev[e] >= 0)
+		fi->next[fi->prev[e]] = fi->next[e];
+	else
+		fi->hash[fi->bucket[e]] = fi->next[e];
+	if (fi->next[e] >= 0)
+		fi->prev[fi->next[e]] = fi->prev[e];
+
+	fi->bucket[e] = -1;
+	fi->value[e] = 0;
+}
+
+static void PR_FindLink (findindex_t *fi, int e, string_t value)
+{
+	int h, p, n;
+
+	h = PR_StringIsConst (value) ? PR_FindHash (PR_GetString (value)) : FIND_VOLATILE;
+
+	// keep bucket sorted by edict number
+	for (p = -1, n = fi->hash[h]; n >= 0 && n < e; p = n, n = fi->next[n])
+		;
+
+	fi->prev[e] = p;
+	fi->next[e] = n;
+	if (p >= 0)
+		fi->next[p] = e;
+	else
+		fi->hash[h] = e;
+	if (n >= 0)
+		fi->prev[n] = e;
+
+	fi->bucket[e] = h;
+	fi->value[e] = value;
+}
+
+static void PR_FindSyncEdict (int e)
+{
+	findindex_t *fi;
+	edict_t *ed;
+	string_t value;
+	int i;
+
+	ed = (e < sv.num_edicts) ? EDICT_NUM(e) : NULL;
+	for (i = 0, fi = find_fields; i < find_numfields; i++, fi++)
+	{
+		value = (!ed || EDICT_SV(ed)->free) ? 0 : FIND_FIELD(ed, fi->fofs);
+		if (value == fi->value[e] && (value != 0) == (fi->bucket[e] >= 0))
+			continue;
+
+		PR_FindUnlink (fi, e);
+		if (value)
+			PR_FindLink (fi, e, value);
+	}
+}
+
+static void PR_FindSync (void)
+{
+	int i, e;
+
+	if (find_fullsync)
+	{
+		for (i = 0; i < MAX_EDICTS; i++)
+			PR_FindSyncEdict (i);
+
+		memset (find_dirty, 0, sizeof(find_dirty));
+		find_numdirty = 0;
+		find_fullsync = false;
+		return;
+	}
+
+	for (i = 0; i < find_numdirty; i++)
+	{
+		e = find_dirtylist[i];
+		find_dirty[e] = 0;
+		PR_FindSyncEdict (e);
+
+#ifdef USE_PR2
+		// QVM may name it after the engine is done with it
+		if (sv_vm && !find_recent[e])
+		{
+			find_recent[e] = 1;
+			find_recentlist[find_numrecent++] = e;
+		}
+#endif
+	}
+	find_numdirty = 0;
+
+	for (i = 0; i < find_numrecent; i++)
+		PR_FindSyncEdict (find_recentlist[i]);
+}
+
+/*
+=================
+PR_FindFrame
+
+called once per server frame, QVM edicts are reindexed before next query
+=================
+*/
+void PR_FindFrame (void)
+{
+	int i;
+
+	for (i = 0; i < find_numrecent; i++)
+		find_recent[find_recentlist[i]] = 0;
+	find_numrecent = 0;
+
+#ifdef USE_PR2
+	if (sv_vm)
+		find_fullsync = true;
+#endif
+}
+
+/*
+=================
+PR_FindAddField
+
+index string field at fofs (bytes from &ed->v) for find queries
+=================
+*/
+qbool PR_FindAddField (int fofs)
+{
+	findindex_t *fi;
+
+	if (fofs < 0 || (fofs & 3))
+		return false;
+	if (PR_FindIndexForField (fofs))
+		return true;
+	if (find_numfields == MAX_FIND_FIELDS)
+		return false;
+
+	fi = &find_fields[find_numfields++];
+	fi->fofs = fofs;
+	memset (fi->hash, -1, sizeof(fi->hash));
+	memset (fi->bucket, -1, sizeof(fi->bucket));
+	memset (fi->value, 0, sizeof(fi->value));
+	find_fullsync = true;
+
+	return true;
+}
+
+/*
+=================
+PR_FindNewMap
+
+forget all indexes, only classname is indexed until the mod registers more fields
+=================
+*/
+void PR_FindNewMap (void)
+{
+	find_numfields = 0;
+	find_radius.num = 0;
+	find_radius.linkcount = -1;
+	PR_FindAddField ((int) offsetof(entvars_t, classname));
+}
+
+/*
+=================
+PR_FindResync
+
+edicts were overwritten behind our back, reindex all of them before next query
+=================
+*/
+void PR_FindResync (void)
+{
+	find_fullsync = true;
+	find_radius.linkcount = -1;
+}
+
+/*
+=================
+PR_FindTouch
+
+engine wrote a string field of ed
+=================
+*/
+void PR_FindTouch (edict_t *ed)
+{
+	int e = NUM_FOR_EDICT(ed);
+
+	if (!find_dirty[e])
+	{
+		find_dirty[e] = 1;
+		find_dirtylist[find_numdirty++] = e;
+	}
+}
+
+/*
+=================
+PR_FindTouchOfs
+
+QC stored a string through a pointer, ofs is in bytes from sv.edicts
+=================
+*/
+void PR_FindTouchOfs (int ofs)
+{
+	int e = ofs / pr_edict_size;
+
+	if ((unsigned) e < MAX_EDICTS && !find_dirty[e])
+	{
+		find_dirty[e] = 1;
+		find_dirtylist[find_numdirty++] = e;
+	}
+}
+
+// first edict after start in bucket h whose string is s, -1 if none
+static int PR_FindInBucket (findindex_t *fi, int h, int start, char *s)
+{
+	string_t value;
+	edict_t *ed;
+	int e;
+
+	// find loops pass previous result back in, so usually we can just step to next in bucket
+	if (start > 0 && start < MAX_EDICTS && fi->bucket[start] == h)
+		e = fi->next[start];
+	else
+		for (e = fi->hash[h]; e >= 0 && e <= start; e = fi->next[e])
+			;
+
+	for ( ; e >= 0; e = fi->next[e])
+	{
+		ed = EDICT_NUM(e);
+		value = FIND_FIELD(ed, fi->fofs);
+
+		// QVM may have changed the field since it was indexed
+		if (value && !EDICT_SV(ed)->free && !strcmp (PR_GetString (value), s))
+			break;
+	}
+
+	return e;
+}
+
+/*
+=================
+PR_FindString
+
+returns first edict after start whose string field at fofs equals s, 0 if
+there is none, or -1 if that field is not indexed and caller has to scan
+=================
+*/
+int PR_FindString (int start, int fofs, char *s)
+{
+	findindex_t *fi;
+	double t;
+	int e, v;
+
+	findstats.find++;
+
+	if (!*s || !(fi = PR_FindIndexForField (fofs)))
+		return -1;
+
+	t = Sys_DoubleTime ();
+	findstats.find_indexed++;
+
+	PR_FindSync ();
+
+	e = PR_FindInBucket (fi, PR_FindHash (s), start, s);
+	v = PR_FindInBucket (fi, FIND_VOLATILE, start, s);
+	if (v >= 0 && (e < 0 || v < e))
+		e = v;
+
+	findstats.find_time += Sys_DoubleTime () - t;
+
+	return max(e, 0);
+}
+
+/*
+=================
+PR_FindRadiusChain
+
+Returns a chain of entities that have origins within a spherical area, as
+the findradius builtin always did
+=================
+*/
+edict_t *PR_FindRadiusChain (vec3_t org, float rad)
+{
+	edict_t *ent, *chain;
+	int i, numtouch;
+	double t = Sys_DoubleTime ();
+
+	findstats.radius++;
+
+	numtouch = SV_AreaEdictsRadius (org, rad, find_touchlist, MAX_EDICTS, AREA_SOLID);
+	numtouch += SV_AreaEdictsRadius (org, rad, &find_touchlist[numtouch], MAX_EDICTS - numtouch, AREA_TRIGGERS);
+
+	chain = (edict_t *)sv.edicts;
+	for (i = 0; i < numtouch; i++)
+	{
+		ent = find_touchlist[i];
+		ent->v.chain = EDICT_TO_PROG(chain);
+		chain = ent;
+	}
+
+	findstats.radius_time += Sys_DoubleTime () - t;
+
+	return chain;
+}
+
+static int PR_FindRadiusCompare (const void *a, const void *b)
+{
+	return *(const short *) a - *(const short *) b;
+}
+
+/*
+=================
+PR_FindRadiusNext
+
+returns number of first edict after start within rad of org, 0 if none.
+candidates are cached while org, rad and area links stay the same
+=================
+*/
+int PR_FindRadiusNext (int start, vec3_t org, float rad)
+{
+	edict_t *ent;
+	vec3_t eorg;
+	int i, j, lo, hi, numtouch;
+	double t = Sys_DoubleTime ();
+
+	findstats.radius++;
+
+	if (find_radius.linkcount != sv_linkcount || find_radius.rad != rad
+		|| find_radius.org[0] != org[0] || find_radius.org[1] != org[1] || find_radius.org[2] != org[2])
+	{
+		numtouch = SV_AreaEdictsRadius (org, rad, find_touchlist, MAX_EDICTS, AREA_SOLID);
+		numtouch += SV_AreaEdictsRadius (org, rad, &find_touchlist[numtouch], MAX_EDICTS - numtouch, AREA_TRIGGERS);
+
+		for (i = 0; i < numtouch; i++)
+			find_radius.list[i] = NUM_FOR_EDICT(find_touchlist[i]);
+		qsort (find_radius.list, numtouch, sizeof(find_radius.list[0]), PR_FindRadiusCompare);
+
+		find_radius.num = numtouch;
+		find_radius.linkcount = sv_linkcount;
+		find_radius.rad = rad;
+		VectorCopy (org, find_radius.org);
+	}
+
+	// first candidate after start
+	for (lo = 0, hi = find_radius.num; lo < hi; )
+	{
+		i = (lo + hi) / 2;
+		if (find_radius.list[i] <= start)
+			lo = i + 1;
+		else
+			hi = i;
+	}
+
+	// fields may have changed since the candidates were collected
+	for (i = lo; i < find_radius.num; i++)
+	{
+		ent = EDICT_NUM(find_radius.list[i]);
+		if (EDICT_SV(ent)->free || ent->v.solid == SOLID_NOT)
+			continue;
+		for (j = 0; j < 3; j++)
+			eorg[j] = org[j] - (ent->v.origin[j] + (ent->v.mins[j] + ent->v.maxs[j]) * 0.5);
+		if (DotProduct (eorg, eorg) > rad * rad)
+			continue;
+		break;
+	}
+
+	findstats.radius_time += Sys_DoubleTime () - t;
+
+	return i < find_radius.num ? find_radius.list[i] : 0;
+}
+
+/*
+=================
+PR_FindPrintStats
+
+appended to profile output, counters are reset
+=================
+*/
+void PR_FindPrintStats (void)
+{
+	Con_Printf ("find      : %i queries, %i indexed, %.3f ms\n", findstats.find, findstats.find_indexed, findstats.find_time * 1000);
+	Con_Printf ("findradius: %i queries, %.3f ms\n", findstats.radius, findstats.radius_time * 1000);
+	memset (&findstats, 0, sizeof(findstats));
+}
+
+/*
+=================
+PR_FindIndex_f
+
+findindex <field> : also index that string field for find queries of the current map
+=================
+*/
+static void PR_FindIndex_f (void)
+{
+	char *name;
+	int i, fofs;
+
+	if (Cmd_Argc () != 2)
+	{
+		Con_Printf ("usage: findindex <field>\nindexed fields:");
+		for (i = 0; i < find_numfields; i++)
+			Con_Printf (" %i", find_fields[i].fofs);
+		Con_Printf ("\n");
+		return;
+	}
+
+	if (sv.state == ss_dead)
+	{
+		Con_Printf ("No map loaded\n");
+		return;
+	}
+
+	name = Cmd_Argv (1);
+#ifdef USE_PR2
+	if (sv_vm)
+		fofs = ED2_FindFieldOffset (name);
+	else
+#endif
+	{
+		ddef_t *d = ED_FindField (name);
+
+		if (d && (d->type & ~DEF_SAVEGLOBAL) != ev_string)
+			d = NULL;
+		fofs = d ? PR_FIELDOFS(d->ofs) * 4 : 0;
+	}
+
+	if (!fofs)
+	{
+		Con_Printf ("findindex: no string field \"%s\"\n", name);
+		return;
+	}
+
+	if (!PR_FindAddField (fofs))
+		Con_Printf ("findindex: can't index \"%s\"\n", name);
+}
+
+void PR_InitFind (void)
+{
+	Cmd_AddCommand ("findindex", PR_FindIndex_f);
+}
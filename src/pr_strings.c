@@ -0,0 +1,641 @@
+/*
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+//	pr_strings.c - string storage for progs
+//
+//	string_t values handed to progs are encoded as follows:
+//	  >= 0                                 offset into pr_strings
+//	  -1 .. -(MAX_PRSTR-1)                 engine string registered in pr_strtbl
+//	  -MAX_PRSTR .. -(2*MAX_PRSTR-1)       strzone()'d string in pr_newstrtbl
+//	  -PR_TMPSTR_BASE - offset             temp string in the scratch ring
+
+#include "qwsvdef.h"
+
+char *pr_strtbl[MAX_PRSTR];
+char *pr_newstrtbl[MAX_PRSTR];
+static int pr_newstrsize[MAX_PRSTR];
+int num_prstr;
+
+prstrstats_t pr_strstats;
+
+// pointer -> pr_strtbl index, so PR1_SetString does not have to scan the table
+#define PR_STRTBL_HASH_SIZE		(MAX_PRSTR * 2)	// must be power of two
+static short pr_strtbl_hash[PR_STRTBL_HASH_SIZE];
+
+// level strings: bump allocated from hunk blocks, gone with the hunk on map change
+#define PR_LEVELSTR_BLOCK		(16 * 1024)
+static char *pr_levelstr_block;
+static int pr_levelstr_used;
+
+// interned level strings, so repeated classnames/models/etc share storage
+#define PR_INTERN_SIZE			8192	// must be power of two
+static char *pr_interned[PR_INTERN_SIZE];
+static int pr_num_interned;
+
+// scratch ring for temp strings (ftos, vtos, substr, parameters...)
+#define PR_TMPSTR_SIZE			(128 * 1024)
+#define PR_TMPSTR_BASE			(2 * MAX_PRSTR)
+static char pr_tmpstr[PR_TMPSTR_SIZE];
+static int pr_tmpstr_used;
+
+static int PR_StrTblHash(const char *s)
+{
+	uintptr_t p = (uintptr_t) s;
+
+	p ^= p >> 13;
+	return (int) ((p * 2654435761u) >> 4) & (PR_STRTBL_HASH_SIZE - 1);
+}
+
+static unsigned int PR_StrHash(const char *s)
+{
+	unsigned int key;
+
+	for (key = 5381; *s; s++)
+		key = ((key << 5) + key) + (unsigned char) *s;
+
+	return key;
+}
+
+/*
+=================
+PR_StringsNewMap
+
+hunk was flushed, so all level strings and engine string registrations are invalid
+=================
+*/
+void PR_StringsNewMap (void)
+{
+	num_prstr = 0;
+	memset(pr_strtbl_hash, 0, sizeof(pr_strtbl_hash));
+
+	pr_levelstr_block = NULL;
+	pr_levelstr_used = 0;
+
+	memset(pr_interned, 0, sizeof(pr_interned));
+	pr_num_interned = 0;
+
+	pr_strstats.level_strings = pr_strstats.level_bytes = pr_strstats.intern_hits = 0;
+}
+
+/*
+=================
+PR_StringsFrame
+
+called once per server frame, latches per frame counters
+=================
+*/
+void PR_StringsFrame (void)
+{
+	pr_strstats.last_frame_allocs = pr_strstats.frame_allocs;
+	if (pr_strstats.frame_allocs > pr_strstats.peak_frame_allocs)
+		pr_strstats.peak_frame_allocs = pr_strstats.frame_allocs;
+	pr_strstats.frame_allocs = 0;
+
+	pr_strstats.last_frame_tmpbytes = pr_strstats.frame_tmpbytes;
+	pr_strstats.frame_tmpbytes = 0;
+}
+
+//=============================================================================
+
+char *PR1_GetString(int num)
+{
+	if (num < 0)
+	{
+		//Con_DPrintf("GET:%d == %s\n", num, pr_strtbl[-num]);
+		num = -num;
+		if (num >= PR_TMPSTR_BASE)
+		{
+			if (num - PR_TMPSTR_BASE < PR_TMPSTR_SIZE)
+				return pr_tmpstr + num - PR_TMPSTR_BASE;
+
+			Con_Printf("PR1_GetString: num = %d\n", num);// May be will be better to generate PR_RunError?
+			return NULL;
+		}
+		if (num >= MAX_PRSTR)
+			return pr_newstrtbl[num - MAX_PRSTR];
+
+		return pr_strtbl[num];
+	}
+	return pr_strings + num;
+}
+
+int PR1_SetString(char *s)
+{
+	int i;
+
+	if (s >= pr_tmpstr && s < pr_tmpstr + PR_TMPSTR_SIZE)
+		return -(PR_TMPSTR_BASE + (int)(s - pr_tmpstr));
+
+	if (s - pr_strings < 0)
+	{
+		for (i = PR_StrTblHash(s); pr_strtbl_hash[i]; i = (i + 1) & (PR_STRTBL_HASH_SIZE - 1))
+			if (pr_strtbl[pr_strtbl_hash[i]] == s)
+				return -pr_strtbl_hash[i];
+
+		if (num_prstr + 1 >= MAX_PRSTR)
+			Sys_Error("MAX_PRSTR");
+
+		pr_strtbl[++num_prstr] = s;
+		pr_strtbl_hash[i] = num_prstr;
+		//Con_DPrintf("SET:%d == %s\n", -num_prstr, s);
+		return -num_prstr;
+	}
+	return (int)(s - pr_strings);
+}
+
+//=============================================================================
+
+/*
+=================
+PR_TmpAlloc
+
+returns size bytes from the scratch ring, old temp strings are overwritten when it wraps
+=================
+*/
+char *PR_TmpAlloc (int size)
+{
+	char *s;
+
+	if (size > MAX_PR_STRING_SIZE)
+		size = MAX_PR_STRING_SIZE;
+
+	if (pr_tmpstr_used + size > PR_TMPSTR_SIZE)
+	{
+		pr_tmpstr_used = 0;
+		pr_strstats.tmp_wraps++;
+	}
+
+	s = pr_tmpstr + pr_tmpstr_used;
+	pr_tmpstr_used += size;
+
+	pr_strstats.frame_allocs++;
+	pr_strstats.frame_tmpbytes += size;
+
+	return s;
+}
+
+/*
+==============
+PR_SetTmpString
+
+temp strings are used for qc function parameters and builtin results,
+they live in the scratch ring and do not take pr_strtbl slots
+==============
+*/
+int PR_SetTmpString(const char *s)
+{
+	char *tmp;
+	int size;
+
+	size = strlen(s) + 1;
+	tmp = PR_TmpAlloc(size);
+	strlcpy(tmp, s, min(size, MAX_PR_STRING_SIZE));
+
+	return PR1_SetString(tmp);
+}
+
+//=============================================================================
+
+static char *PR_LevelAlloc (int size)
+{
+	char *s;
+
+	pr_strstats.frame_allocs++;
+	pr_strstats.level_bytes += size;
+
+	if (size > PR_LEVELSTR_BLOCK / 4)
+		return (char *) Hunk_AllocName (size, "levelstr");
+
+	if (!pr_levelstr_block || pr_levelstr_used + size > PR_LEVELSTR_BLOCK)
+	{
+		pr_levelstr_block = (char *) Hunk_AllocName (PR_LEVELSTR_BLOCK, "levelstr");
+		pr_levelstr_used = 0;
+	}
+
+	s = pr_levelstr_block + pr_levelstr_used;
+	pr_levelstr_used += size;
+
+	return s;
+}
+
+/*
+=================
+PR_LevelString
+
+returns a copy of the string which lives until the next map, equal strings share storage
+=================
+*/
+char *PR_LevelString (const char *string)
+{
+	unsigned int i;
+	char *s;
+	int size;
+
+	size = strlen(string) + 1;
+
+	// keep the table at most 3/4 full, after that just allocate
+	if (pr_num_interned >= PR_INTERN_SIZE / 4 * 3)
+	{
+		s = PR_LevelAlloc(size);
+		memcpy(s, string, size);
+		pr_strstats.level_strings++;
+		return s;
+	}
+
+	for (i = PR_StrHash(string) & (PR_INTERN_SIZE - 1); pr_interned[i]; i = (i + 1) & (PR_INTERN_SIZE - 1))
+	{
+		if (!strcmp(pr_interned[i], string))
+		{
+			pr_strstats.intern_hits++;
+			return pr_interned[i];
+		}
+	}
+
+	s = PR_LevelAlloc(size);
+	memcpy(s, string, size);
+	pr_interned[i] = s;
+	pr_num_interned++;
+	pr_strstats.level_strings++;
+
+	return s;
+}
+
+/*
+=================
+PR1_StringIsConst
+
+true if text of the string can't change while num stays the same: strings of
+progs and interned level strings. strzone slots are reused, temp strings are
+overwritten and engine strings may be buffers like client names
+=================
+*/
+qbool PR1_StringIsConst (int num)
+{
+	unsigned int i;
+	char *s;
+
+	if (num >= 0)
+		return true;
+
+	num = -num;
+	if (num >= MAX_PRSTR || !(s = pr_strtbl[num]))
+		return false;
+
+	for (i = PR_StrHash(s) & (PR_INTERN_SIZE - 1); pr_interned[i]; i = (i + 1) & (PR_INTERN_SIZE - 1))
+	{
+		if (pr_interned[i] == s)
+			return true;
+	}
+
+	return false;
+}
+
+//=============================================================================
+
+/*
+=================
+PR_StrZone
+
+ZQ_QC_STRINGS storage, strings stay until strunzone'd or progs are reloaded
+=================
+*/
+int PR_StrZone (const char *s, int size)
+{
+	int i;
+
+	for (i = 0; i < MAX_PRSTR; i++)
+	{
+		if (!pr_newstrtbl[i] || pr_newstrtbl[i] == pr_strings)
+			break;
+	}
+
+	if (i == MAX_PRSTR)
+		PR_RunError("strzone: out of string memory");
+
+	pr_newstrtbl[i] = (char *) Q_malloc(size);
+	pr_newstrsize[i] = size;
+	strlcpy(pr_newstrtbl[i], s, size);
+
+	pr_strstats.frame_allocs++;
+	pr_strstats.zone_strings++;
+	pr_strstats.zone_bytes += size;
+
+	return -(i+MAX_PRSTR);
+}
+
+void PR_StrUnzone (int num)
+{
+	if (num > - MAX_PRSTR)
+		PR_RunError("strunzone: not a dynamic string");
+
+	if (num <= -(MAX_PRSTR * 2))
+		PR_RunError ("strunzone: bad string");
+
+	num = - (num + MAX_PRSTR);
+
+	if (pr_newstrtbl[num] == pr_strings)
+		return;	// allow multiple strunzone on the same string (like free in C)
+
+	pr_strstats.zone_strings--;
+	pr_strstats.zone_bytes -= pr_newstrsize[num];
+
+	Q_free(pr_newstrtbl[num]);
+	pr_newstrtbl[num] = pr_strings;
+}
+
+void PR_ClearZoneStrings (void)
+{
+	int i;
+
+	for (i = 0; i < MAX_PRSTR; i++)
+	{
+		if (pr_newstrtbl[i] && pr_newstrtbl[i] != pr_strings)
+		{
+			Q_free(pr_newstrtbl[i]);
+			pr_newstrtbl[i] = NULL;
+		}
+	}
+
+	memset(pr_newstrsize, 0, sizeof(pr_newstrsize));
+	pr_strstats.zone_strings = pr_strstats.zone_bytes = 0;
+}
+
+//=============================================================================
+
+typedef struct prstrstate_s
+{
+	int				num_prstr;
+	char			*strtbl[MAX_PRSTR];
+	short			strtbl_hash[PR_STRTBL_HASH_SIZE];
+	char			*levelstr_block;
+	int				levelstr_used;
+	char			*interned[PR_INTERN_SIZE];
+	int				num_interned;
+	prstrstats_t	stats;
+	int				zonesize[MAX_PRSTR];	// zone string contents follow the struct
+} prstrstate_t;
+
+/*
+=================
+PR_SaveStrings
+
+returns a copy of the whole string state, used by the map restart snapshot.
+level strings are not copied, the caller keeps the hunk below the current mark
+=================
+*/
+byte *PR_SaveStrings (void)
+{
+	prstrstate_t *st;
+	byte *data;
+	int i, size;
+
+	size = sizeof(*st);
+	for (i = 0; i < MAX_PRSTR; i++)
+		if (pr_newstrtbl[i] && pr_newstrtbl[i] != pr_strings)
+			size += pr_newstrsize[i];
+
+	st = (prstrstate_t *) Q_malloc(size);
+	st->num_prstr = num_prstr;
+	memcpy(st->strtbl, pr_strtbl, sizeof(st->strtbl));
+	memcpy(st->strtbl_hash, pr_strtbl_hash, sizeof(st->strtbl_hash));
+	st->levelstr_block = pr_levelstr_block;
+	st->levelstr_used = pr_levelstr_used;
+	memcpy(st->interned, pr_interned, sizeof(st->interned));
+	st->num_interned = pr_num_interned;
+	st->stats = pr_strstats;
+
+	data = (byte *)(st + 1);
+	for (i = 0; i < MAX_PRSTR; i++)
+	{
+		if (pr_newstrtbl[i] && pr_newstrtbl[i] != pr_strings)
+		{
+			st->zonesize[i] = pr_newstrsize[i];
+			memcpy(data, pr_newstrtbl[i], pr_newstrsize[i]);
+			data += pr_newstrsize[i];
+		}
+		else
+			st->zonesize[i] = 0;
+	}
+
+	return (byte *) st;
+}
+
+void PR_RestoreStrings (byte *state)
+{
+	prstrstate_t *st = (prstrstate_t *) state;
+	byte *data;
+	int i;
+
+	num_prstr = st->num_prstr;
+	memcpy(pr_strtbl, st->strtbl, sizeof(pr_strtbl));
+	memcpy(pr_strtbl_hash, st->strtbl_hash, sizeof(pr_strtbl_hash));
+	pr_levelstr_block = st->levelstr_block;
+	pr_levelstr_used = st->levelstr_used;
+	memcpy(pr_interned, st->interned, sizeof(pr_interned));
+	pr_num_interned = st->num_interned;
+
+	PR_ClearZoneStrings();
+
+	data = (byte *)(st + 1);
+	for (i = 0; i < MAX_PRSTR; i++)
+	{
+		if (!st->zonesize[i])
+			continue;
+
+		pr_newstrtbl[i] = (char *) Q_malloc(st->zonesize[i]);
+		pr_newstrsize[i] = st->zonesize[i];
+		memcpy(pr_newstrtbl[i], data, st->zonesize[i]);
+		data += st->zonesize[i];
+	}
+
+	pr_strstats.level_strings = st->stats.level_strings;
+	pr_strstats.level_bytes = st->stats.level_bytes;
+	pr_strstats.intern_hits = st->stats.intern_hits;
+	pr_strstats.zone_strings = st->stats.zone_strings;
+	pr_strstats.zone_bytes = st->stats.zone_bytes;
+}
+
+//=============================================================================
+
+static void PR_Strings_f (void)
+{
+	Con_Printf ("engine strings : %i/%i\n", num_prstr, MAX_PRSTR);
+	Con_Printf ("level strings  : %i (%i bytes, %i shared)\n",
+	            pr_strstats.level_strings, pr_strstats.level_bytes, pr_strstats.intern_hits);
+	Con_Printf ("zone strings   : %i (%i bytes)\n", pr_strstats.zone_strings, pr_strstats.zone_bytes);
+	Con_Printf ("temp strings   : %i bytes last frame, %i wraps\n", pr_strstats.last_frame_tmpbytes, pr_strstats.tmp_wraps);
+	Con_Printf ("allocs/frame   : %i last, %i peak\n", pr_strstats.last_frame_allocs, pr_strstats.peak_frame_allocs);
+}
+
+//=============================================================================
+
+static int pr_checks, pr_checkfails;
+
+static void PR_StrCheck (qbool ok, const char *what)
+{
+	pr_checks++;
+	if (ok)
+		return;
+
+	pr_checkfails++;
+	Con_Printf ("pr_strings_check: %s failed\n", what);
+}
+
+static qbool PR_StrIs (int num, const char *text)
+{
+	char *s = PR1_GetString(num);
+
+	return s && !strcmp(s, text);
+}
+
+// zone strings are never passed to PR1_SetString, the rest must come back the same
+static qbool PR_StrRoundTrip (int num, const char *text)
+{
+	return PR_StrIs(num, text) && PR1_SetString(PR1_GetString(num)) == num;
+}
+
+/*
+=================
+PR_StringsCheck_f
+
+self-test of level, engine, zone and temp strings against the running
+progs. whatever it allocates is dropped again, temp ring included
+=================
+*/
+static void PR_StringsCheck_f (void)
+{
+	static char buffer[32] = "pr_strings_check buffer";
+	char text[MAX_PR_STRING_SIZE + 16], *ring, *a, *b;
+	prstrstats_t stats;
+	byte *state, *saved;
+	int mark, ringused, num, num2, i, wraps;
+
+#ifdef USE_PR2
+	if (sv_vm)
+	{
+		Con_Printf ("pr_strings_check: needs QC progs, not a game library\n");
+		return;
+	}
+#endif
+	if (sv.state != ss_active || !pr_strings)
+	{
+		Con_Printf ("pr_strings_check: no map running\n");
+		return;
+	}
+	if (num_prstr + 3 >= MAX_PRSTR)
+	{
+		Con_Printf ("pr_strings_check: engine string table is full\n");
+		return;
+	}
+
+	pr_checks = pr_checkfails = 0;
+
+	state = PR_SaveStrings();
+	stats = pr_strstats;
+	mark = Hunk_LowMark();
+	ring = (char *) Q_malloc(PR_TMPSTR_SIZE);
+	memcpy(ring, pr_tmpstr, PR_TMPSTR_SIZE);
+	ringused = pr_tmpstr_used;
+
+	// progs strings
+	PR_StrCheck(PR1_GetString(0) == pr_strings, "progs string 0");
+	PR_StrCheck(PR1_StringIsConst(0), "progs string is const");
+
+	// level strings are interned
+	a = PR_LevelString("pr_strings_check level");
+	strlcpy(text, "pr_strings_check level", sizeof(text));
+	b = PR_LevelString(text);
+	PR_StrCheck((a == b || pr_num_interned >= PR_INTERN_SIZE / 4 * 3) && b != text, "level string interning");
+	num = PR1_SetString(a);
+	PR_StrCheck(PR_StrRoundTrip(num, "pr_strings_check level"), "level string round trip");
+	PR_StrCheck(PR1_StringIsConst(num) || pr_num_interned >= PR_INTERN_SIZE / 4 * 3, "level string is const");
+
+	// engine buffers can change under the same string_t
+	num = PR1_SetString(buffer);
+	PR_StrCheck(PR_StrRoundTrip(num, buffer), "engine string round trip");
+	PR_StrCheck(!PR1_StringIsConst(num), "engine string is not const");
+
+	// zone strings, slot is reused after strunzone
+	for (i = 0; i < MAX_PRSTR; i++)
+		if (!pr_newstrtbl[i] || pr_newstrtbl[i] == pr_strings)
+			break;
+	if (i < MAX_PRSTR)
+	{
+		num = PR_StrZone("pr_strings_check zone", 64);
+		PR_StrCheck(num == -(i + MAX_PRSTR), "zone string encoding");
+		PR_StrCheck(PR_StrIs(num, "pr_strings_check zone"), "zone string text");
+		PR_StrCheck(!PR1_StringIsConst(num), "zone string is not const");
+		PR_StrCheck(pr_strstats.zone_strings == stats.zone_strings + 1, "zone string count");
+		PR_StrUnzone(num);
+		PR_StrUnzone(num);
+		PR_StrCheck(pr_strstats.zone_strings == stats.zone_strings, "zone string unzone");
+		num2 = PR_StrZone("pr_strings_check zone 2", 64);
+		PR_StrCheck(num2 == num && PR_StrIs(num2, "pr_strings_check zone 2"), "zone slot reuse");
+		PR_StrUnzone(num2);
+	}
+	else
+		Con_Printf ("pr_strings_check: no free zone slot, zone strings not checked\n");
+
+	// temp strings, long ones are cut
+	num = PR_SetTmpString("pr_strings_check temp");
+	PR_StrCheck(num <= -PR_TMPSTR_BASE, "temp string encoding");
+	PR_StrCheck(PR_StrRoundTrip(num, "pr_strings_check temp"), "temp string round trip");
+	PR_StrCheck(!PR1_StringIsConst(num), "temp string is not const");
+
+	memset(text, 'x', sizeof(text) - 1);
+	text[sizeof(text) - 1] = 0;
+	num = PR_SetTmpString(text);
+	PR_StrCheck(strlen(PR1_GetString(num)) == MAX_PR_STRING_SIZE - 1, "long temp string");
+
+	// ring wraps back to its start
+	wraps = pr_strstats.tmp_wraps;
+	for (i = 0; i <= PR_TMPSTR_SIZE / MAX_PR_STRING_SIZE && pr_strstats.tmp_wraps == wraps; i++)
+		num = PR_SetTmpString(text);
+	PR_StrCheck(pr_strstats.tmp_wraps == wraps + 1 && PR1_GetString(num) == pr_tmpstr, "temp ring wrap");
+	num = PR_SetTmpString("pr_strings_check wrapped");
+	PR_StrCheck(PR_StrRoundTrip(num, "pr_strings_check wrapped"), "temp string after wrap");
+
+	// restore drops strings made after the save
+	saved = PR_SaveStrings();
+	num = num_prstr;
+	PR1_SetString(buffer + 1);
+	PR_StrCheck(num_prstr == num + 1, "engine string registration");
+	PR_RestoreStrings(saved);
+	Q_free(saved);
+	PR_StrCheck(num_prstr == num && PR_StrRoundTrip(PR1_SetString(a), "pr_strings_check level"), "strings restore");
+
+	// put everything back
+	PR_RestoreStrings(state);
+	Q_free(state);
+	Hunk_FreeToLowMark(mark);
+	memcpy(pr_tmpstr, ring, PR_TMPSTR_SIZE);
+	pr_tmpstr_used = ringused;
+	Q_free(ring);
+	pr_strstats = stats;
+	PR_FindResync();
+
+	Con_Printf ("pr_strings_check: %i checks, %i failed\n", pr_checks, pr_checkfails);
+}
+
+void PR_InitStrings (void)
+{
+	memset(pr_newstrtbl, 0, sizeof(pr_newstrtbl));
+
+	Cmd_AddCommand ("pr_strings", PR_Strings_f);
+	Cmd_AddCommand ("pr_strings_check", PR_StringsCheck_f);
+}
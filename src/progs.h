@@ -65,9 +65,8 @@ typedef struct sv_edict_s
 
 typedef struct edict_s
 {
-	sv_edict_t	*e;			// server side part of the edict_t,
-							// basically we can get rid of this pointer at all, since we can access it via sv.sv_edicts[num]
-							// but this way it more friendly, I think.
+	int			e;			// index of server side part of the edict_t in sv.sv_edicts, use EDICT_SV().
+							// QVMs reserve exactly 4 bytes in front of v, so this must not be a pointer.
 
 	entvars_t	v;			// C exported fields from progs
 	// other fields from progs come immediately after
@@ -128,7 +127,7 @@ edict_t *ED_Alloc (void);
 void ED_Free (edict_t *ed);
 
 char *ED_NewString (char *string);
-// returns a copy of the string allocated from the server's string heap
+// returns an unescaped copy of the string from the level string arena, equal strings share storage
 
 void ED_Print (edict_t *ed);
 void ED_Write (FILE *f, edict_t *ed);
@@ -143,6 +142,7 @@ edict_t *EDICT_NUM(int n);
 int NUM_FOR_EDICT(edict_t *e);
 
 #define	NEXT_EDICT(e) ((edict_t *)( (byte *)e + pr_edict_size))
+#define	EDICT_SV(ent) (&sv.sv_edicts[(ent)->e])
 
 #define	EDICT_TO_PROG(e) ((byte *)e - (byte *)sv.edicts)
 #define PROG_TO_EDICT(e) ((edict_t *)((byte *)sv.edicts + e))
@@ -198,19 +198,62 @@ void ED_PrintNum (int ent);
 eval_t *PR1_GetEdictFieldValue(edict_t *ed, char *field);
 
 int ED1_FindFieldOffset (char *field);
+ddef_t *ED_FindField (char *name);
 
 //
 // PR Strings stuff
 //
 #define MAX_PRSTR 1024
+#define MAX_PR_STRING_SIZE 2048
+
+typedef struct prstrstats_s
+{
+	int		frame_allocs;		// string allocations made this frame
+	int		last_frame_allocs;
+	int		peak_frame_allocs;
+	int		frame_tmpbytes;		// scratch ring bytes used this frame
+	int		last_frame_tmpbytes;
+	int		tmp_wraps;			// times scratch ring wrapped around
+	int		level_strings;		// unique strings in level arena
+	int		level_bytes;
+	int		intern_hits;		// level strings which reused existing storage
+	int		zone_strings;		// strzone()'d strings alive
+	int		zone_bytes;
+} prstrstats_t;
 
 extern char *pr_strtbl[MAX_PRSTR];
 extern char *pr_newstrtbl[MAX_PRSTR];
 extern int num_prstr;
+extern prstrstats_t pr_strstats;
 
+// pr_strings.c
+void PR_InitStrings (void);
+void PR_StringsNewMap (void);
+void PR_StringsFrame (void);
 char *PR1_GetString(int num);
 int PR1_SetString(char *s);
+char *PR_TmpAlloc (int size);
 int PR_SetTmpString(const char *s);
+char *PR_LevelString (const char *string);
+qbool PR1_StringIsConst (int num);
+int PR_StrZone (const char *s, int size);
+void PR_StrUnzone (int num);
+void PR_ClearZoneStrings (void);
+byte *PR_SaveStrings (void);
+void PR_RestoreStrings (byte *state);
+
+// pr_find.c
+void PR_InitFind (void);
+void PR_FindNewMap (void);
+void PR_FindResync (void);
+void PR_FindFrame (void);
+qbool PR_FindAddField (int fofs);
+void PR_FindTouch (edict_t *ed);
+void PR_FindTouchOfs (int ofs);
+int PR_FindString (int start, int fofs, char *s);
+edict_t *PR_FindRadiusChain (vec3_t org, float rad);
+int PR_FindRadiusNext (int start, vec3_t org, float rad);
+void PR_FindPrintStats (void);
 
 void PR1_LoadProgs (void);
 void PR1_InitProg();
@@ -247,6 +290,7 @@ qbool PR1_ClientCmd(void);
 	#define PR_Init PR1_Init
 	#define PR_GetString PR1_GetString
 	#define PR_SetString PR1_SetString
+	#define PR_StringIsConst PR1_StringIsConst
 	#define ED_FindFieldOffset ED1_FindFieldOffset
 	#define PR_GetEdictFieldValue PR1_GetEdictFieldValue
 
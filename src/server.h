@@ -357,11 +357,8 @@ typedef struct
 	double			time;
 
 // { reset each time frame wroten with SV_MVDWritePackets()
+	// data with mvd headers, block of demo frame arena which MVDWrite_Begin grows as needed
 	sizebuf_t		_buf_;
-	// !!! OUCH OUCH OUCH, 64 frames, so it about 2mb !!!
-	// here data with mvd headers, so it up to 4 mvd msg with maximum size, however basically here alot of small msgs,
-	// so this size pathetic
-	byte			_buf__data[(MAX_MVD_SIZE + 10) * 4];
 
 	int				lastto;
 	int				lasttype;
@@ -371,6 +368,15 @@ typedef struct
 
 } demo_frame_t;
 
+// where SV_MVDWritePacketsEx stopped looking for interpolation partner of a client,
+// frames between demo.lastwritten and these are known not to be it
+typedef struct
+{
+	int				blocked;	// first frame client is missing in or has fixangle
+	int				alive;		// first frame client is not dead in
+	int				reached;	// first frame client's time reaches time of frame being written
+} demo_interp_t;
+
 //qtv proxies are meant to send a small header now, bit like http
 //this header gives supported version numbers and stuff
 typedef struct mvdpendingdest_s
@@ -417,6 +423,12 @@ typedef struct mvddest_s
 
 	unsigned int totalsize;
 
+	struct demoio_s *io; // writer thread state, file is owned by writer thread if set
+
+	FILE *indexfile; // keyframe index, see sv_demo_index.c
+	struct demoio_s *indexio; // writer thread state of index, indexfile is owned by it if set
+	double indexstart, indexkey, indexsnap;
+
 // { used by QTV
 	double			io_time; // when last IO occur on socket, so we can timeout this dest
 	int				id; // dest id, used by QTV only
@@ -428,6 +440,14 @@ typedef struct mvddest_s
 	char			qtvname[64];
 
 	qtvuser_t		*qtvuserlist;
+
+	struct qtvchunk_s *chunk; // cursor into shared stream data, see sv_demo_qtv.c
+	int				chunkofs;
+
+	int				lag; // bytes not sent yet
+	int				maxlag;
+	qbool			resync; // cut off, waits for fresh gamestate
+	int				resyncs;
 // }
 
 	struct mvddest_s *nextdest;
@@ -456,6 +476,7 @@ typedef struct
 
 	demo_frame_t	frames[UPDATE_BACKUP]; // here we store all previous frames
 	demo_client_t	clients[MAX_CLIENTS]; // we store here what we wrote last time so we can delta
+	demo_interp_t	interp[MAX_CLIENTS];
 
 	// =====================================
 	char			mem_set_point; // fields below, like ->dest and ->pendingdest must not be memset to 0
@@ -771,6 +792,28 @@ int SV_GenerateUserID (void);
 int SV_ModelIndex (char *name);
 void SV_FlushSignon (void);
 void SV_SpawnServer (char *server, qbool devmap, char* entityfile);
+void SV_SpawnStats_f (void);
+
+// copy of everything a map and its progs change while running
+typedef struct gamestate_s
+{
+	int			hunkmark;				// everything allocated later is dropped on restore
+
+	server_t	*sv;
+	byte		*edicts;				// PR1 only, QVM keeps edicts in its data segment
+	int			edicts_size;
+	byte		*vmdata;				// PR1 globals or QVM data segment
+	int			vmdata_size;
+	int			vm_sp, vm_lp;
+	byte		*strings;
+	byte		linked[MAX_EDICTS / 8];	// which edicts were linked into the world
+} gamestate_t;
+
+qbool SV_SaveGameState (gamestate_t *gs);
+void SV_RestoreGameState (gamestate_t *gs);
+void SV_FreeGameState (gamestate_t *gs);
+
+extern	cvar_t	sv_fastmaprestart;
 
 
 //
@@ -787,6 +830,77 @@ void SV_RunNQNewmis (void);
 void SV_Impact (edict_t *e1, edict_t *e2);
 void SV_SetMoveVars(void);
 
+//
+// sv_nav.c
+//
+void SV_NavInit (void);
+void SV_NavNewMap (void);
+int SV_NavFindPath (vec3_t start, vec3_t end, float *path, int maxpoints);
+
+//
+// sv_gamestate.c
+//
+void SV_GamestateInit (void);
+void SV_GamestateInvalidate (void);
+int SV_WriteList (sizebuf_t *msg, int svc, unsigned n);
+qbool SV_GamestateList (sizebuf_t *msg, int svc, unsigned n);
+qbool SV_GamestateLightstyles (client_t *cl);
+byte *SV_GamestateDemo (int *len);
+void SV_GamestateServerinfo (sizebuf_t *msg);
+
+//
+// sv_preload.c
+//
+void SV_PreloadInit (void);
+qbool SV_PreloadMap (char *mapname);
+void SV_PreloadFinish (char *name);
+qbool SV_PreloadModelChecksum (char *name, unsigned *crc);
+
+//
+// sv_profile.c
+//
+typedef enum
+{
+	PROF_CBUF,			// console input and command buffer
+	PROF_MVDSTREAM,		// SV_MVDStream_Poll
+	PROF_QTVDEMO,		// SV_QTVDemo_Frame
+	PROF_READPACKETS,
+	PROF_PHYSICS_QC,	// QC/QVM called from SV_Physics
+	PROF_PHYSICS,		// rest of SV_Physics
+	PROF_SEND,			// SV_SendClientMessages
+	PROF_DEMO,			// SV_SendDemoMessage
+	PROF_OTHER,			// everything in SV_Frame not above
+	PROF_FRAME,			// whole SV_Frame
+	PROF_NUM
+} profstage_t;
+
+void SV_ProfileInit (void);
+void SV_ProfileFrameBegin (void);
+void SV_ProfileFrameEnd (void);
+void SV_ProfileEnter (profstage_t stage);
+void SV_ProfileLeave (profstage_t stage);
+void SV_ProfileQCEnter (void);
+void SV_ProfileQCLeave (void);
+void SV_ProfileQCAbort (void);
+
+//
+// sv_capture.c
+//
+void SV_CaptureInit (void);
+qbool SV_CaptureSpawn (char *mapname);
+int SV_CaptureSeed (int seed);
+void SV_CaptureFrame (double *frametime);
+void SV_CaptureFrameEnd (void);
+void SV_CapturePacket (netadr_t *from, sizebuf_t *message);
+qbool SV_CaptureSend (int length, void *data, netadr_t to);
+qbool SV_ReplayRunning (void);
+qbool SV_ReplayGetPacket (netadr_t *from, sizebuf_t *message);
+
+//
+// sv_bench.c
+//
+void SV_BenchInit (void);
+
 //
 // sv_send.c
 //
@@ -824,6 +938,15 @@ void SV_UserInit (void);
 void SV_TogglePause (const char *msg, int bit);
 void ProcessUserInfoChange (client_t* sv_client, const char* key, const char* old_value);
 
+//
+// sv_dlcache.c
+//
+void		SV_DownloadCacheInit (void);
+vfsfile_t	*SV_DownloadOpen (const char *name);
+const byte	*SV_DownloadMapping (vfsfile_t *vfs);
+void		SV_DownloadSent (int bytes);
+void		SV_DownloadFrame (void);
+
 #ifdef FTE_PEXT2_VOICECHAT
 void SV_VoiceInitClient(client_t *client);
 void SV_VoiceSendPacket(client_t *client, sizebuf_t *buf);
@@ -840,6 +963,7 @@ void SV_SendServerInfoChange (char *key, char *value);
 // sv_ents.c
 //
 void SV_WriteEntitiesToClient (client_t *client, sizebuf_t *msg, qbool recorder);
+void SV_EmitPacketEntities (client_t *client, packet_entities_t *to, sizebuf_t *msg);
 
 //
 // sv_nchan.c
@@ -913,6 +1037,69 @@ extern cvar_t	sv_silentrecord;
 
 void SV_MVDInit (void);
 char *SV_MVDNum(int num);
+void SV_MVDStripExtension (char *name);
+
+//
+// sv_demo_io.c
+//
+
+typedef struct demoio_s demoio_t;
+
+typedef struct demoiostats_s
+{
+	double			gametime;	// game thread time in demo file io, including waits below
+	double			waittime;	// game thread waiting for writer thread
+	double			writertime;	// writer thread busy
+	unsigned int	handoffs;
+	unsigned int	bytes;
+	unsigned int	gzraw;		// KB given to compressed dests
+	unsigned int	gzfile;		// KB they took on disk
+	double			gztime;		// writer time of compressed dests
+} demoiostats_t;
+
+#define MVD_COMPRESSED_EXT ".gz"
+
+extern demoiostats_t demoio_stats;
+extern cvar_t	sv_demoAsync;
+extern cvar_t	sv_demoCompress;
+
+void SV_DemoIO_Init (void);
+int SV_DemoIO_CompressLevel (void);
+qbool SV_DemoIO_Attach (mvddest_t *d, int compresslevel);
+qbool SV_DemoIO_Handoff (mvddest_t *d);
+void SV_DemoIO_Close (mvddest_t *d);
+demoio_t *SV_DemoIO_AttachFile (FILE *f, int bufsize);
+char *SV_DemoIO_Reserve (demoio_t *io, int len);
+void SV_DemoIO_FlushFile (demoio_t *io);
+qbool SV_DemoIO_CloseFile (demoio_t *io);
+
+//
+// sv_demo_index.c
+//
+
+#define MVD_INDEX_EXT		".idx"
+#define MVD_INDEX_MAGIC		"MVDI"
+#define MVD_INDEX_VERSION	1
+#define MVD_INDEX_KEYFRAME	'K'
+#define MVD_INDEX_SNAPSHOT	'S'
+
+extern cvar_t	sv_demoIndex;
+extern cvar_t	sv_demoIndexSnapshot;
+
+void SV_MVDIndexInit (void);
+void SV_MVDIndexOpen (mvddest_t *d, char *name);
+void SV_MVDIndexClose (mvddest_t *d);
+void SV_MVDIndexFrame (double time);
+
+//
+// sv_demo_cat.c
+//
+
+void	SV_DemoCatInit (void);
+void	SV_DemoCatUpdate (const char *dir, const char *name);
+void	SV_DemoCatUpdateDemo (const char *dir, const char *name);
+void	SV_DemoCatFinish (const char *dir, const char *name);
+dir_t	SV_DemoDir (const char *regexp, int sort_type);
 
 //
 // sv_demo_misc.c
@@ -948,6 +1135,8 @@ extern cvar_t	qtv_maxstreams;
 extern cvar_t	qtv_password;
 extern cvar_t	qtv_pendingtimeout;
 extern cvar_t	qtv_streamtimeout;
+extern cvar_t	qtv_backpressure;
+extern cvar_t	qtv_streambuffer;
 
 
 void SV_MVDStream_Poll(void);
@@ -957,6 +1146,25 @@ void SV_QTV_Init(void);
 void DemoWriteQTV (sizebuf_t *msg);
 void QTVsv_FreeUserList(mvddest_t *d);
 
+void QTV_ChainWrite (void *data, int len);
+void QTV_ChainMark (void);
+void QTV_StreamCheckLag (mvddest_t *d, qbool canresync);
+qbool QTV_ChainToCache (mvddest_t *d);
+void QTV_ChainRelease (mvddest_t *d);
+int QTV_StreamSend (mvddest_t *d);
+
+//
+// sv_demo_play.c
+//
+
+extern cvar_t	qtv_demospeed;
+
+qbool SV_QTVDemo_Playing (void);
+qbool SV_QTVDemo_AddViewer (int socket1, netadr_t na, char *userinfo);
+void SV_QTVDemo_Frame (void);
+void SV_QTVDemo_Status (void);
+void SV_QTVDemo_Init (void);
+
 //
 // sv_login.c
 //
@@ -0,0 +1,631 @@
+/*
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+//	sv_bench.c - microbenchmarks of functions a frame spends its time in
+//
+//	"bench" runs them in the server itself, on the map it has loaded and
+//	its entities, so numbers are for real data. inputs come from a fixed
+//	seed: the same map gives the same inputs on any build. each benchmark
+//	is calibrated to BENCH_REP_TIME a repetition, gets one repetition of
+//	warmup and then the repetitions which are counted.
+//
+//	output is one JSON object a line, keys don't change:
+//	  {"bench":<name>,"map":<map>,"reps":n,"iters":n,
+//	   "ns_min":f,"ns_median":f,"ns_mean":f,"ns_stddev":f}
+//	times are per call. first line tells version and build date, benchmark
+//	which can't run gets {"bench":<name>,"skipped":<why>}.
+//
+//	progs benchmarks run QC/QVM against a copy of the game taken before the
+//	first repetition and put back after each one, so the map is left as it
+//	was. cvars and files the progs change are not covered. clients and demos
+//	would get whatever the progs send, so these only run on an empty server.
+
+#include "qwsvdef.h"
+
+#define BENCH_REP_TIME		0.02		// seconds a repetition runs
+#define BENCH_MAX_REPS		100
+#define BENCH_POINTS		1024		// inputs, power of two
+#define BENCH_SEED			0x2545f491
+
+#define BENCH_MAP			1			// needs a map running
+#define BENCH_GAME			2			// runs progs, game state is put back after each repetition
+
+typedef struct
+{
+	char	*name;
+	int		needs;
+	void	(*setup) (void);
+	void	(*run) (int iters);
+	void	(*cleanup) (void);
+} bench_t;
+
+static unsigned int	bench_random;
+static volatile int	bench_sink;		// results go here, so calls are not optimized out
+
+static vec3_t		bench_start[BENCH_POINTS], bench_end[BENCH_POINTS];
+static int			bench_index;
+
+static float Bench_Random (float from, float to)
+{
+	// xorshift, same numbers everywhere
+	bench_random ^= bench_random << 13;
+	bench_random ^= bench_random >> 17;
+	bench_random ^= bench_random << 5;
+
+	return from + (to - from) * (bench_random & 0xffff) / 65535.0;
+}
+
+/*
+====================
+Bench_Points
+
+start and end points near entities of the map, where players are,
+rather than anywhere in the bounds of the world which is mostly solid
+====================
+*/
+static void Bench_Points (float range)
+{
+	vec3_t anchors[64];
+	int i, j, numanchors = 0;
+	edict_t *ent;
+
+	for (i = 1; i < sv.num_edicts && numanchors < 64; i++)
+	{
+		ent = EDICT_NUM(i);
+		if (EDICT_SV(ent)->free || !VectorLength (ent->v.origin))
+			continue;
+		VectorCopy (ent->v.origin, anchors[numanchors]);
+		numanchors++;
+	}
+
+	if (!numanchors)
+	{
+		VectorAdd (sv.worldmodel->mins, sv.worldmodel->maxs, anchors[0]);
+		VectorScale (anchors[0], 0.5, anchors[0]);
+		numanchors = 1;
+	}
+
+	for (i = 0; i < BENCH_POINTS; i++)
+	{
+		for (j = 0; j < 3; j++)
+		{
+			bench_start[i][j] = anchors[i % numanchors][j] + Bench_Random (-range / 4, range / 4);
+			bench_end[i][j] = bench_start[i][j] + Bench_Random (-range, range);
+		}
+	}
+}
+
+//============================================================
+
+static void Bench_PointsSetup (void)
+{
+	Bench_Points (256);
+}
+
+static void Bench_HullTrace (int iters)
+{
+	hull_t *hull = &sv.worldmodel->hulls[1];
+	trace_t trace;
+	int i;
+
+	for (i = 0; i < iters; i++, bench_index++)
+	{
+		trace = CM_HullTrace (hull, bench_start[bench_index & (BENCH_POINTS - 1)], bench_end[bench_index & (BENCH_POINTS - 1)]);
+		bench_sink += trace.fraction < 1;
+	}
+}
+
+static void Bench_Trace (int iters)
+{
+	vec3_t mins = {-16, -16, -24}, maxs = {16, 16, 32};
+	trace_t trace;
+	int i;
+
+	for (i = 0; i < iters; i++, bench_index++)
+	{
+		trace = SV_Trace (bench_start[bench_index & (BENCH_POINTS - 1)], mins, maxs,
+		                  bench_end[bench_index & (BENCH_POINTS - 1)], MOVE_NORMAL, sv.edicts);
+		bench_sink += trace.fraction < 1;
+	}
+}
+
+static void Bench_AreaEdicts (int iters)
+{
+	static edict_t *list[MAX_EDICTS];
+	vec3_t mins, maxs, size = {256, 256, 256};
+	int i;
+
+	for (i = 0; i < iters; i++, bench_index++)
+	{
+		VectorSubtract (bench_start[bench_index & (BENCH_POINTS - 1)], size, mins);
+		VectorAdd (bench_start[bench_index & (BENCH_POINTS - 1)], size, maxs);
+		bench_sink += SV_AreaEdicts (mins, maxs, list, MAX_EDICTS, (i & 1) ? AREA_TRIGGERS : AREA_SOLID);
+	}
+}
+
+static void Bench_FatPVS (int iters)
+{
+	int i;
+
+	for (i = 0; i < iters; i++, bench_index++)
+		bench_sink += CM_FatPVS (bench_start[bench_index & (BENCH_POINTS - 1)])[0];
+}
+
+static void Bench_PlayerMove (int iters)
+{
+	vec3_t forward;
+	int i, p;
+
+	pmove.numphysent = 1;
+	memset (&pmove.physents[0], 0, sizeof(pmove.physents[0]));
+	pmove.physents[0].model = sv.worldmodel;
+
+	for (i = 0; i < iters; i++, bench_index++)
+	{
+		// a player running somewhere near an entity
+		p = bench_index & (BENCH_POINTS - 1);
+		VectorCopy (bench_start[p], pmove.origin);
+		VectorSubtract (bench_end[p], bench_start[p], forward);
+		forward[2] = 0;
+		VectorNormalize (forward);
+		VectorScale (forward, 320, pmove.velocity);
+		pmove.angles[PITCH] = 0;
+		pmove.angles[YAW] = atan2 (forward[1], forward[0]) * 180 / M_PI;
+		pmove.angles[ROLL] = 0;
+		pmove.jump_held = false;
+		pmove.jump_msec = 0;
+		pmove.waterjumptime = 0;
+		pmove.pm_type = PM_NORMAL;
+		pmove.onground = false;
+
+		memset (&pmove.cmd, 0, sizeof(pmove.cmd));
+		pmove.cmd.msec = 13;
+		pmove.cmd.forwardmove = 400;
+		pmove.cmd.sidemove = (p & 1) ? 400 : -400;
+		VectorCopy (pmove.angles, pmove.cmd.angles);
+		if (p & 2)
+			pmove.cmd.buttons = BUTTON_JUMP;
+
+		PM_PlayerMove ();
+		bench_sink += pmove.onground;
+	}
+}
+
+//============================================================
+
+static client_t				*bench_client;
+static packet_entities_t	bench_pack;
+
+// entities as a client near them would get them, and the frame before
+static void Bench_PacketEntitiesSetup (void)
+{
+	packet_entities_t *old;
+	entity_state_t *state;
+	edict_t *ent;
+	int i;
+
+	bench_client = (client_t *) Q_malloc (sizeof(client_t));
+	old = &bench_client->frames[0].entities;
+	bench_pack.num_entities = 0;
+
+	for (i = MAX_CLIENTS + 1; i < sv.num_edicts && bench_pack.num_entities < MAX_PACKET_ENTITIES; i++)
+	{
+		ent = EDICT_NUM(i);
+		if (EDICT_SV(ent)->free || !ent->v.modelindex)
+			continue;
+
+		state = &bench_pack.entities[bench_pack.num_entities++];
+		state->number = i;
+		state->flags = 0;
+		VectorCopy (ent->v.origin, state->origin);
+		VectorCopy (ent->v.angles, state->angles);
+		state->modelindex = (int) ent->v.modelindex;
+		state->frame = (int) ent->v.frame;
+		state->colormap = (int) ent->v.colormap;
+		state->skinnum = (int) ent->v.skin;
+		state->effects = (int) ent->v.effects;
+
+		// about half of them moved or animated since last frame
+		old->entities[old->num_entities] = *state;
+		if (i & 1)
+		{
+			old->entities[old->num_entities].origin[0] -= 8;
+			old->entities[old->num_entities].frame--;
+		}
+		old->num_entities++;
+	}
+}
+
+static void Bench_PacketEntitiesCleanup (void)
+{
+	Q_free (bench_client);
+}
+
+static void Bench_PacketEntities (int iters)
+{
+	byte data[MAX_MSGLEN];
+	sizebuf_t msg;
+	int i;
+
+	for (i = 0; i < iters; i++)
+	{
+		// full update from baselines and delta from the frame before
+		bench_client->delta_sequence = (i & 1) ? 0 : -1;
+		SZ_Init (&msg, data, sizeof(data));
+		SV_EmitPacketEntities (bench_client, &bench_pack, &msg);
+		bench_sink += msg.cursize;
+	}
+}
+
+//============================================================
+
+static byte		bench_msg[MAX_MSGLEN];
+static int		bench_msglen;
+
+// what an entity update in a packet might look like
+static void Bench_WriteRecord (sizebuf_t *msg, int i)
+{
+	MSG_WriteByte (msg, i & 0xff);
+	MSG_WriteShort (msg, i);
+	MSG_WriteLong (msg, i * 31);
+	MSG_WriteFloat (msg, i * 0.25);
+	MSG_WriteCoord (msg, i);
+	MSG_WriteCoord (msg, -i);
+	MSG_WriteCoord (msg, i * 0.5);
+	MSG_WriteAngle (msg, i);
+	MSG_WriteAngle16 (msg, -i);
+	MSG_WriteString (msg, "player");
+}
+
+static void Bench_MSGWrite (int iters)
+{
+	sizebuf_t msg;
+	int i;
+
+	SZ_Init (&msg, bench_msg, sizeof(bench_msg));
+
+	for (i = 0; i < iters; i++)
+	{
+		if (msg.cursize > msg.maxsize - 64)
+			SZ_Clear (&msg);
+		Bench_WriteRecord (&msg, i);
+	}
+
+	bench_sink += msg.cursize;
+}
+
+static void Bench_MSGReadSetup (void)
+{
+	sizebuf_t msg;
+	int i;
+
+	SZ_Init (&msg, bench_msg, sizeof(bench_msg));
+	for (i = 0; msg.cursize <= msg.maxsize - 64; i++)
+		Bench_WriteRecord (&msg, i);
+	bench_msglen = msg.cursize;
+}
+
+static void Bench_MSGRead (int iters)
+{
+	sizebuf_t saved = net_message;
+	int savedcount = msg_readcount, savedbad = msg_badread, i;
+
+	// bench may have come in a packet (rcon), put it back afterwards
+	net_message.data = bench_msg;
+	net_message.cursize = bench_msglen;
+	MSG_BeginReading ();
+
+	for (i = 0; i < iters; i++)
+	{
+		if (msg_readcount >= bench_msglen)
+			MSG_BeginReading ();
+
+		bench_sink += MSG_ReadByte ();
+		bench_sink += MSG_ReadShort ();
+		bench_sink += MSG_ReadLong ();
+		bench_sink += (int) MSG_ReadFloat ();
+		bench_sink += (int) MSG_ReadCoord ();
+		bench_sink += (int) MSG_ReadCoord ();
+		bench_sink += (int) MSG_ReadCoord ();
+		bench_sink += (int) MSG_ReadAngle ();
+		bench_sink += (int) MSG_ReadAngle16 ();
+		bench_sink += MSG_ReadString ()[0];
+	}
+
+	net_message = saved;
+	msg_readcount = savedcount;
+	msg_badread = savedbad;
+}
+
+//============================================================
+
+static ctxinfo_t	bench_info;
+static char			*bench_infokeys[] = {"name", "team", "topcolor", "bottomcolor", "rate", "spectator", "skin", "msg"};
+
+static void Bench_InfoSetup (void)
+{
+	memset (&bench_info, 0, sizeof(bench_info));
+	bench_info.max = MAX_CLIENT_INFOS;
+	Info_Convert (&bench_info, "\\name\\player\\team\\red\\topcolor\\4\\bottomcolor\\4\\rate\\25000"
+	              "\\skin\\base\\msg\\1\\noaim\\1\\pmodel\\33168\\emodel\\6967\\*client\\ezQuake 1.9");
+}
+
+static void Bench_InfoCleanup (void)
+{
+	Info_RemoveAll (&bench_info);
+}
+
+static void Bench_InfoGet (int iters)
+{
+	int i;
+
+	// spectator is not set, misses are looked up as well
+	for (i = 0; i < iters; i++)
+		bench_sink += Info_Get (&bench_info, bench_infokeys[i & 7])[0];
+}
+
+static hashtable_t	*bench_hash;
+static char			bench_hashkeys[512][32];
+
+static void Bench_HashSetup (void)
+{
+	int i;
+
+	// about as many as there are cvars and commands
+	bench_hash = Hash_InitTable (512);
+	for (i = 0; i < 512; i++)
+	{
+		snprintf (bench_hashkeys[i], sizeof(bench_hashkeys[i]), "sv_bench_%d", i);
+		if (i & 1)
+			Hash_Add (bench_hash, bench_hashkeys[i], bench_hashkeys[i]);
+	}
+}
+
+static void Bench_HashCleanup (void)
+{
+	Hash_Flush (bench_hash);
+	Q_free (bench_hash->bucket);
+	Q_free (bench_hash);
+}
+
+static void Bench_HashGet (int iters)
+{
+	int i;
+
+	for (i = 0; i < iters; i++)
+		bench_sink += Hash_Get (bench_hash, bench_hashkeys[(i * 7) & 511]) != NULL;
+}
+
+//============================================================
+
+static gamestate_t	bench_game;
+static cbuf_t		*bench_cbuf;
+
+static void Bench_GameSetup (void)
+{
+	SV_SaveGameState (&bench_game);
+
+	// localcmd from progs goes to the command buffer
+	bench_cbuf = (cbuf_t *) Q_malloc (sizeof(cbuf_t));
+	memcpy (bench_cbuf, &cbuf_main, sizeof(cbuf_t));
+}
+
+static void Bench_GameReset (void)
+{
+	SV_RestoreGameState (&bench_game);
+	memcpy (&cbuf_main, bench_cbuf, sizeof(cbuf_t));
+}
+
+static void Bench_GameCleanup (void)
+{
+	SV_FreeGameState (&bench_game);
+	Q_free (bench_cbuf);
+}
+
+static void Bench_StartFrame (int iters)
+{
+	int i;
+
+	for (i = 0; i < iters; i++)
+		SV_ProgStartFrame ();
+
+	bench_sink += sv.num_edicts;
+}
+
+static void Bench_Physics (int iters)
+{
+	double tic = max(0.013, (double) sv_mintic.value);
+	int i;
+
+	// frames of an empty server: StartFrame, thinks and movement of entities
+	for (i = 0; i < iters; i++)
+	{
+		sv.time += tic;
+		SV_Physics ();
+	}
+
+	bench_sink += sv.num_edicts;
+}
+
+//============================================================
+
+static bench_t benches[] =
+{
+	{"cm_hulltrace", BENCH_MAP, Bench_PointsSetup, Bench_HullTrace, NULL},
+	{"sv_trace", BENCH_MAP, Bench_PointsSetup, Bench_Trace, NULL},
+	{"sv_areaedicts", BENCH_MAP, Bench_PointsSetup, Bench_AreaEdicts, NULL},
+	{"pm_playermove", BENCH_MAP, Bench_PointsSetup, Bench_PlayerMove, NULL},
+	{"cm_fatpvs", BENCH_MAP, Bench_PointsSetup, Bench_FatPVS, NULL},
+	{"sv_emitpacketentities", BENCH_MAP, Bench_PacketEntitiesSetup, Bench_PacketEntities, Bench_PacketEntitiesCleanup},
+	{"pr_startframe", BENCH_MAP | BENCH_GAME, NULL, Bench_StartFrame, NULL},
+	{"sv_physics", BENCH_MAP | BENCH_GAME, NULL, Bench_Physics, NULL},
+	{"msg_write", 0, NULL, Bench_MSGWrite, NULL},
+	{"msg_read", 0, Bench_MSGReadSetup, Bench_MSGRead, NULL},
+	{"info_get", 0, Bench_InfoSetup, Bench_InfoGet, Bench_InfoCleanup},
+	{"hash_get", 0, Bench_HashSetup, Bench_HashGet, Bench_HashCleanup},
+};
+
+#define NUM_BENCHES (sizeof(benches) / sizeof(benches[0]))
+
+static double Bench_Time (bench_t *b, int iters)
+{
+	double start = Sys_DoubleTime (), time;
+
+	b->run (iters);
+	time = Sys_DoubleTime () - start;
+
+	if (b->needs & BENCH_GAME)
+		Bench_GameReset ();
+
+	return time;
+}
+
+// why benchmark can't run now, NULL if it can
+static char *Bench_Skip (bench_t *b)
+{
+	int i;
+
+	if ((b->needs & BENCH_MAP) && sv.state != ss_active)
+		return "no map running";
+
+	if (!(b->needs & BENCH_GAME))
+		return NULL;
+
+#ifdef USE_PR2
+	if (sv_vm && sv_vm->type != VM_BYTECODE)
+		return "game state of native library can't be copied";
+#endif
+	if (pr_nqprogs)
+		return "game state of NQ progs can't be copied";
+	if (sv.mvdrecording)
+		return "demo recording";
+	for (i = 0; i < MAX_CLIENTS; i++)
+	{
+		if (svs.clients[i].state != cs_free)
+			return "clients connected";
+	}
+
+	return NULL;
+}
+
+static int Bench_Compare (const void *a, const void *b)
+{
+	double d = *(const double *) a - *(const double *) b;
+
+	return d < 0 ? -1 : d > 0;
+}
+
+static void Bench_Run (bench_t *b, int reps)
+{
+	double ns[BENCH_MAX_REPS], time, mean = 0, var = 0;
+	int i, iters;
+
+	bench_random = BENCH_SEED;
+	bench_index = 0;
+	if (b->needs & BENCH_GAME)
+		Bench_GameSetup ();
+	if (b->setup)
+		b->setup ();
+
+	// iterations for a repetition to take BENCH_REP_TIME
+	for (iters = 1; (time = Bench_Time (b, iters)) < BENCH_REP_TIME / 10 && iters < (1 << 28); iters *= 2)
+		;
+	iters = max(1, (int) (iters * BENCH_REP_TIME / max(time, 1e-6)));
+
+	// warmup
+	Bench_Time (b, iters);
+
+	for (i = 0; i < reps; i++)
+	{
+		bench_index = 0;
+		ns[i] = Bench_Time (b, iters) * 1e9 / iters;
+		mean += ns[i];
+	}
+	mean /= reps;
+
+	for (i = 0; i < reps; i++)
+		var += (ns[i] - mean) * (ns[i] - mean);
+	var = reps > 1 ? var / (reps - 1) : 0;
+
+	qsort (ns, reps, sizeof(ns[0]), Bench_Compare);
+
+	if (b->cleanup)
+		b->cleanup ();
+	if (b->needs & BENCH_GAME)
+		Bench_GameCleanup ();
+
+	Con_Printf ("{\"bench\":\"%s\",\"map\":\"%s\",\"reps\":%d,\"iters\":%d,"
+	            "\"ns_min\":%.2f,\"ns_median\":%.2f,\"ns_mean\":%.2f,\"ns_stddev\":%.2f}\n",
+	            b->name, (b->needs & BENCH_MAP) ? sv.mapname : "", reps, iters,
+	            ns[0], reps & 1 ? ns[reps / 2] : (ns[reps / 2 - 1] + ns[reps / 2]) / 2, mean, sqrt (var));
+}
+
+/*
+====================
+SV_Bench_f
+
+bench [all|list|<prefix>] [reps]
+====================
+*/
+static void SV_Bench_f (void)
+{
+	char *which = Cmd_Argv (1), *skip;
+	int i, reps, ran = 0;
+
+	if (!which[0])
+	{
+		Con_Printf ("usage: %s <all|list|name prefix> [repetitions]\n"
+		            "runs microbenchmarks, prints a JSON object for each, server stops while they run\n", Cmd_Argv (0));
+		return;
+	}
+
+	if (!strcmp (which, "list"))
+	{
+		for (i = 0; i < (int) NUM_BENCHES; i++)
+			Con_Printf ("%s%s\n", benches[i].name, (benches[i].needs & BENCH_GAME) ? " (needs map, no clients)"
+			            : (benches[i].needs & BENCH_MAP) ? " (needs map)" : "");
+		return;
+	}
+
+	reps = Cmd_Argc () > 2 ? bound(1, Q_atoi (Cmd_Argv (2)), BENCH_MAX_REPS) : 10;
+
+	Con_Printf ("{\"version\":\"%s\",\"built\":\"%s\",\"rep_ms\":%g}\n", VERSION_NUMBER, __DATE__, BENCH_REP_TIME * 1000);
+
+	for (i = 0; i < (int) NUM_BENCHES; i++)
+	{
+		if (strcmp (which, "all") && strncmp (benches[i].name, which, strlen (which)))
+			continue;
+
+		if ((skip = Bench_Skip (&benches[i])))
+		{
+			Con_Printf ("{\"bench\":\"%s\",\"skipped\":\"%s\"}\n", benches[i].name, skip);
+			continue;
+		}
+
+		Bench_Run (&benches[i], reps);
+		ran++;
+	}
+
+	if (!ran)
+		Con_Printf ("no benchmark %s, see %s list\n", which, Cmd_Argv (0));
+}
+
+void SV_BenchInit (void)
+{
+	Cmd_AddCommand ("bench", SV_Bench_f);
+}
@@ -0,0 +1,651 @@
+/*
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+//	sv_capture.c - capture of server input and its replay
+//
+//	sv_capture records everything a game depends on from outside: random
+//	seed, times each frame ran with and datagrams read, from a map load on an
+//	empty server on. sv_replay loads the same map and runs frames with the
+//	recorded times and packets instead of clock and sockets, as fast as it
+//	can, nothing is sent. output of each frame is hashed in both, so replay
+//	tells frame time of a real game and where output starts to differ.
+//
+//	file, numbers in native byte order, it is for the machine it was made on:
+//	  header: CAPTURE_MAGIC, version, seed, map[MAX_QPATH], realtime, curtime
+//	  'F' curtime realtime frametime         - SV_Frame begins
+//	  'P' time type ip[4] port len data...   - datagram read
+//	  'O' packets bytes hash                 - SV_Frame ended, what it sent
+
+#include "qwsvdef.h"
+
+#define CAPTURE_MAGIC		"QWCP"
+#define CAPTURE_VERSION		1
+#define CAPTURE_EXT			".qwcap"
+
+#define CAPTURE_IDLE		0
+#define CAPTURE_ARMED		1		// waits for map load on an empty server
+#define CAPTURE_RUNNING		2
+
+typedef struct
+{
+	int				packets, bytes;
+	unsigned int	hash;
+} captureout_t;
+
+static struct
+{
+	int				state;
+	FILE			*file;
+	char			name[MAX_OSPATH];
+	int				seed;
+	int				spawns;
+	double			start;			// Sys_DoubleTime when it began
+	captureout_t	out;			// of this frame
+
+	unsigned int	frames, packets;
+	double			bytes;
+} capture;
+
+static struct
+{
+	int				state;
+	FILE			*file;
+	char			name[MAX_OSPATH];
+	char			map[MAX_QPATH];
+	int				seed;
+	int				spawns;
+	double			realtime, curtime;
+
+	int				next;			// type of record not read yet, 0 if none
+	captureout_t	out;
+
+	unsigned int	frames, packets, mismatches, firstmismatch;
+	double			framestart, active, maxframe, wallstart;
+	double			vstart;
+	double			outbytes;
+} replay;
+
+// FNV-1a
+static unsigned int SV_CaptureHash (unsigned int hash, const void *data, int len)
+{
+	const byte *p = (const byte *) data;
+
+	while (len--)
+		hash = (hash ^ *p++) * 16777619u;
+
+	return hash;
+}
+
+static void SV_CaptureOut (captureout_t *out, int length, void *data, netadr_t to)
+{
+	out->hash = SV_CaptureHash (out->hash, to.ip, sizeof(to.ip));
+	out->hash = SV_CaptureHash (out->hash, &to.port, sizeof(to.port));
+	out->hash = SV_CaptureHash (out->hash, data, length);
+	out->packets++;
+	out->bytes += length;
+}
+
+static void SV_CaptureResetOut (captureout_t *out)
+{
+	out->packets = out->bytes = 0;
+	out->hash = 2166136261u;
+}
+
+static void SV_CaptureClose (void)
+{
+	if (capture.file)
+	{
+		fputc ('E', capture.file);
+		fclose (capture.file);
+		capture.file = NULL;
+	}
+
+	if (capture.state == CAPTURE_RUNNING)
+		Con_Printf ("capture %s: %u frames, %u packets, %.0f KB in, %.0f s\n", capture.name,
+		            capture.frames, capture.packets, capture.bytes / 1024, Sys_DoubleTime () - capture.start);
+
+	capture.state = CAPTURE_IDLE;
+}
+
+static void SV_CaptureWriteError (void)
+{
+	Con_Printf ("capture %s: write error, stopped\n", capture.name);
+	SV_CaptureClose ();
+}
+
+//============================================================
+
+static void SV_ReplayStop (void)
+{
+	double wall;
+
+	if (replay.file)
+	{
+		fclose (replay.file);
+		replay.file = NULL;
+	}
+
+	if (replay.state == CAPTURE_RUNNING)
+	{
+		wall = Sys_DoubleTime () - replay.wallstart;
+
+		Con_Printf ("replay %s: %u frames, %u packets in, %.0f KB out\n", replay.name,
+		            replay.frames, replay.packets, replay.outbytes / 1024);
+		Con_Printf ("%.1f s of game in %.1f s, frames %.3f ms avg, %.3f ms max\n",
+		            realtime - replay.vstart, wall, replay.frames ? replay.active * 1000 / replay.frames : 0,
+		            replay.maxframe * 1000);
+		if (replay.mismatches)
+			Con_Printf ("output differs from capture in %u frames, first in frame %u\n",
+			            replay.mismatches, replay.firstmismatch);
+		else
+			Con_Printf ("output is the same as in capture\n");
+	}
+
+	replay.state = CAPTURE_IDLE;
+}
+
+// type of next record, 0 at end of file
+static int SV_ReplayNext (void)
+{
+	int c;
+
+	if (!replay.next)
+	{
+		if ((c = fgetc (replay.file)) == EOF || c == 'E')
+			return 0;
+		replay.next = c;
+	}
+
+	return replay.next;
+}
+
+static qbool SV_ReplayRead (void *data, int len)
+{
+	if (fread (data, 1, len, replay.file) == (size_t) len)
+		return true;
+
+	Con_Printf ("replay %s: unexpected end of file\n", replay.name);
+	SV_ReplayStop ();
+	return false;
+}
+
+qbool SV_ReplayRunning (void)
+{
+	return replay.state == CAPTURE_RUNNING;
+}
+
+/*
+====================
+SV_ReplayGetPacket
+
+NET_GetPacket while replay runs, next datagram of this frame
+====================
+*/
+qbool SV_ReplayGetPacket (netadr_t *from, sizebuf_t *message)
+{
+	double time;
+	byte type, ip[4];
+	unsigned short port, len;
+
+	if (SV_ReplayNext () != 'P')
+		return false;
+	replay.next = 0;
+
+	if (!SV_ReplayRead (&time, sizeof(time)) || !SV_ReplayRead (&type, 1) || !SV_ReplayRead (ip, 4)
+		|| !SV_ReplayRead (&port, 2) || !SV_ReplayRead (&len, 2))
+		return false;
+
+	if (len > message->maxsize)
+	{
+		Con_Printf ("replay %s: bad packet\n", replay.name);
+		SV_ReplayStop ();
+		return false;
+	}
+
+	if (!SV_ReplayRead (message->data, len))
+		return false;
+
+	memset (from, 0, sizeof(*from));
+	from->type = (netadrtype_t) type;
+	memcpy (from->ip, ip, 4);
+	from->port = port;
+	message->cursize = len;
+
+	replay.packets++;
+	return true;
+}
+
+//============================================================
+
+/*
+====================
+SV_CaptureSpawn
+
+called by SV_SpawnServer before anything random is done, starts armed
+capture or replay, true if it did
+====================
+*/
+qbool SV_CaptureSpawn (char *mapname)
+{
+	char map[MAX_QPATH];
+	int i;
+
+	if (capture.state == CAPTURE_ARMED)
+	{
+		for (i = 0; i < MAX_CLIENTS; i++)
+		{
+			if (svs.clients[i].state != cs_free)
+			{
+				Con_Printf ("capture %s: waits for map load without clients\n", capture.name);
+				return false;
+			}
+		}
+
+		if (!(capture.file = fopen (capture.name, "wb")))
+		{
+			Con_Printf ("capture %s: can't open\n", capture.name);
+			capture.state = CAPTURE_IDLE;
+			return false;
+		}
+
+		capture.seed = (int) time (NULL) ^ (int) (Sys_DoubleTime () * 1000000);
+		capture.spawns = 0;
+		capture.start = Sys_DoubleTime ();
+		capture.frames = capture.packets = 0;
+		capture.bytes = 0;
+		SV_CaptureResetOut (&capture.out);
+
+		i = CAPTURE_VERSION;
+		fwrite (CAPTURE_MAGIC, 1, 4, capture.file);
+		fwrite (&i, 4, 1, capture.file);
+		fwrite (&capture.seed, 4, 1, capture.file);
+		memset (map, 0, sizeof(map));
+		strlcpy (map, mapname, sizeof(map));
+		fwrite (map, 1, MAX_QPATH, capture.file);
+		fwrite (&realtime, sizeof(realtime), 1, capture.file);
+		fwrite (&curtime, sizeof(curtime), 1, capture.file);
+
+		if (ferror (capture.file))
+		{
+			SV_CaptureWriteError ();
+			return false;
+		}
+
+		srand (capture.seed);
+		capture.state = CAPTURE_RUNNING;
+		Con_Printf ("capture %s: started on %s\n", capture.name, mapname);
+		return true;
+	}
+
+	if (capture.state == CAPTURE_RUNNING)
+		capture.spawns++;
+
+	if (replay.state == CAPTURE_ARMED)
+	{
+		if (strcmp (mapname, replay.map))
+		{
+			Con_Printf ("replay %s: is of %s, not %s\n", replay.name, replay.map, mapname);
+			SV_ReplayStop ();
+			return false;
+		}
+
+		// server looks as it did when capture started
+		realtime = replay.realtime;
+		curtime = replay.curtime;
+		srand (replay.seed);
+
+		replay.spawns = 0;
+		replay.frames = replay.packets = replay.mismatches = replay.firstmismatch = 0;
+		replay.active = replay.maxframe = replay.outbytes = 0;
+		replay.next = 0;
+		replay.wallstart = Sys_DoubleTime ();
+		replay.vstart = realtime;
+		replay.framestart = 0;
+		SV_CaptureResetOut (&replay.out);
+		replay.state = CAPTURE_RUNNING;
+		return true;
+	}
+
+	if (replay.state == CAPTURE_RUNNING)
+		replay.spawns++;
+
+	return false;
+}
+
+/*
+====================
+SV_CaptureSeed
+
+seed game progs get at init, it has to be the same in capture and replay
+====================
+*/
+int SV_CaptureSeed (int seed)
+{
+	if (capture.state == CAPTURE_RUNNING)
+		return capture.seed + capture.spawns;
+
+	if (replay.state == CAPTURE_RUNNING)
+		return replay.seed + replay.spawns;
+
+	return seed;
+}
+
+/*
+====================
+SV_CaptureFrame
+
+called at start of SV_Frame, replay changes frame time to the captured one
+====================
+*/
+void SV_CaptureFrame (double *frametime)
+{
+	if (capture.state == CAPTURE_RUNNING)
+	{
+		fputc ('F', capture.file);
+		fwrite (&curtime, sizeof(curtime), 1, capture.file);
+		fwrite (&realtime, sizeof(realtime), 1, capture.file);
+		fwrite (frametime, sizeof(*frametime), 1, capture.file);
+		capture.frames++;
+	}
+
+	if (replay.state != CAPTURE_RUNNING)
+		return;
+
+	// packets not read in the frame they were in the capture
+	while (SV_ReplayNext () == 'P')
+	{
+		if (!SV_ReplayGetPacket (&net_from, &net_message))
+			return;
+	}
+
+	if (SV_ReplayNext () != 'F')
+	{
+		SV_ReplayStop ();
+		return;
+	}
+	replay.next = 0;
+
+	if (!SV_ReplayRead (&curtime, sizeof(curtime)) || !SV_ReplayRead (&realtime, sizeof(realtime))
+		|| !SV_ReplayRead (frametime, sizeof(*frametime)))
+		return;
+
+	replay.frames++;
+	replay.framestart = Sys_DoubleTime ();
+}
+
+/*
+====================
+SV_CapturePacket
+
+datagram NET_GetPacket read for server
+====================
+*/
+void SV_CapturePacket (netadr_t *from, sizebuf_t *message)
+{
+	double time;
+	byte type = from->type;
+	unsigned short len = message->cursize;
+
+	if (capture.state != CAPTURE_RUNNING)
+		return;
+
+	time = Sys_DoubleTime () - capture.start;
+
+	fputc ('P', capture.file);
+	fwrite (&time, sizeof(time), 1, capture.file);
+	fwrite (&type, 1, 1, capture.file);
+	fwrite (from->ip, 1, 4, capture.file);
+	fwrite (&from->port, 2, 1, capture.file);
+	fwrite (&len, 2, 1, capture.file);
+	fwrite (message->data, 1, len, capture.file);
+
+	capture.packets++;
+	capture.bytes += len;
+}
+
+/*
+====================
+SV_CaptureSend
+
+datagram NET_SendPacket sends for server, true if it must not be sent
+====================
+*/
+qbool SV_CaptureSend (int length, void *data, netadr_t to)
+{
+	if (capture.state == CAPTURE_RUNNING)
+		SV_CaptureOut (&capture.out, length, data, to);
+
+	if (replay.state != CAPTURE_RUNNING)
+		return false;
+
+	SV_CaptureOut (&replay.out, length, data, to);
+	replay.outbytes += length;
+	return true;
+}
+
+/*
+====================
+SV_CaptureFrameEnd
+
+called at end of SV_Frame, output of the frame is recorded or compared
+====================
+*/
+void SV_CaptureFrameEnd (void)
+{
+	captureout_t out;
+	double time;
+
+	if (capture.state == CAPTURE_RUNNING)
+	{
+		fputc ('O', capture.file);
+		fwrite (&capture.out, sizeof(capture.out), 1, capture.file);
+		SV_CaptureResetOut (&capture.out);
+
+		if (ferror (capture.file))
+			SV_CaptureWriteError ();
+	}
+
+	if (replay.state != CAPTURE_RUNNING)
+		return;
+
+	if (replay.framestart)
+	{
+		time = Sys_DoubleTime () - replay.framestart;
+		replay.active += time;
+		replay.maxframe = max(replay.maxframe, time);
+	}
+
+	// packets capture had but replay did not read, they are lost
+	while (SV_ReplayNext () == 'P')
+	{
+		if (!SV_ReplayGetPacket (&net_from, &net_message))
+			return;
+	}
+
+	if (SV_ReplayNext () != 'O')
+	{
+		SV_ReplayStop ();
+		return;
+	}
+	replay.next = 0;
+
+	if (!SV_ReplayRead (&out, sizeof(out)))
+		return;
+
+	if (out.packets != replay.out.packets || out.bytes != replay.out.bytes || out.hash != replay.out.hash)
+	{
+		if (!replay.mismatches++)
+			replay.firstmismatch = replay.frames;
+	}
+	SV_CaptureResetOut (&replay.out);
+
+	if (!SV_ReplayNext ())
+		SV_ReplayStop ();
+}
+
+//============================================================
+
+static qbool SV_CaptureName (char *name, char *arg, int size)
+{
+	char file[MAX_OSPATH];
+
+	if (strlcpy (file, arg, sizeof(file)) >= sizeof(file) - strlen(CAPTURE_EXT))
+		return false;
+	COM_DefaultExtension (file, CAPTURE_EXT);
+
+	return snprintf (name, size, "%s/%s", fs_gamedir, file) < size;
+}
+
+/*
+====================
+SV_Capture_f
+
+sv_capture <name>|stop
+====================
+*/
+static void SV_Capture_f (void)
+{
+	if (Cmd_Argc () < 2)
+	{
+		Con_Printf ("usage: %s <name>|stop\n"
+		            "records server input from next map load on an empty server,\n"
+		            "sv_replay runs it again\n", Cmd_Argv (0));
+		if (capture.state != CAPTURE_IDLE)
+			Con_Printf ("capture %s: %s, %u frames, %u packets\n", capture.name,
+			            capture.state == CAPTURE_ARMED ? "waits for map load" : "running", capture.frames, capture.packets);
+		return;
+	}
+
+	if (!strcmp (Cmd_Argv (1), "stop"))
+	{
+		if (capture.state == CAPTURE_IDLE)
+			Con_Printf ("not capturing\n");
+		SV_CaptureClose ();
+		return;
+	}
+
+	if (strstr (Cmd_Argv (1), ".."))
+	{
+		Con_Printf ("bad name\n");
+		return;
+	}
+
+	if (replay.state != CAPTURE_IDLE)
+	{
+		Con_Printf ("can't capture replay\n");
+		return;
+	}
+
+	SV_CaptureClose ();
+	if (!SV_CaptureName (capture.name, Cmd_Argv (1), sizeof(capture.name)))
+	{
+		Con_Printf ("name too long\n");
+		return;
+	}
+	capture.state = CAPTURE_ARMED;
+	Con_Printf ("capture %s: starts with next map load without clients\n", capture.name);
+}
+
+/*
+====================
+SV_Replay_f
+
+sv_replay <name>|stop
+====================
+*/
+static void SV_Replay_f (void)
+{
+	client_t *cl;
+	char magic[4];
+	int i, version;
+
+	if (Cmd_Argc () < 2)
+	{
+		Con_Printf ("usage: %s <name>|stop\n"
+		            "loads map of capture and runs its frames as fast as possible\n", Cmd_Argv (0));
+		return;
+	}
+
+	if (!strcmp (Cmd_Argv (1), "stop"))
+	{
+		SV_ReplayStop ();
+		return;
+	}
+
+	if (strstr (Cmd_Argv (1), ".."))
+	{
+		Con_Printf ("bad name\n");
+		return;
+	}
+
+	if (capture.state != CAPTURE_IDLE)
+	{
+		Con_Printf ("can't replay while capturing\n");
+		return;
+	}
+
+	SV_ReplayStop ();
+	if (!SV_CaptureName (replay.name, Cmd_Argv (1), sizeof(replay.name)))
+	{
+		Con_Printf ("name too long\n");
+		return;
+	}
+
+	if (!(replay.file = fopen (replay.name, "rb")))
+	{
+		Con_Printf ("replay %s: can't open\n", replay.name);
+		return;
+	}
+
+	if (fread (magic, 1, 4, replay.file) != 4 || memcmp (magic, CAPTURE_MAGIC, 4)
+		|| fread (&version, 4, 1, replay.file) != 1 || version != CAPTURE_VERSION
+		|| fread (&replay.seed, 4, 1, replay.file) != 1 || fread (replay.map, 1, MAX_QPATH, replay.file) != MAX_QPATH
+		|| fread (&replay.realtime, sizeof(replay.realtime), 1, replay.file) != 1
+		|| fread (&replay.curtime, sizeof(replay.curtime), 1, replay.file) != 1)
+	{
+		Con_Printf ("replay %s: not a capture\n", replay.name);
+		SV_ReplayStop ();
+		return;
+	}
+	replay.map[MAX_QPATH - 1] = 0;
+
+	// drop everyone, capture began with nobody connected
+	for (i = 0, cl = svs.clients; i < MAX_CLIENTS; i++, cl++)
+	{
+#ifdef USE_PR2
+		// map load removes bots
+		if (cl->isBot)
+			continue;
+#endif
+		if (cl->state >= cs_preconnected)
+		{
+			SV_ClientPrintf (cl, PRINT_HIGH, "server replays a capture\n");
+			SV_DropClient (cl);
+		}
+		cl->state = cs_free;
+	}
+
+	replay.state = CAPTURE_ARMED;
+	Cbuf_AddText (va ("map %s\n", replay.map));
+}
+
+void SV_CaptureInit (void)
+{
+	Cmd_AddCommand ("sv_capture", SV_Capture_f);
+	Cmd_AddCommand ("sv_replay", SV_Replay_f);
+}
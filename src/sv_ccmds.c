@@ -92,8 +92,7 @@ void SV_Logfile (int sv_log, qbool newlog)
 	{
 		// turn off logging
 
-		fclose (logs[sv_log].sv_logfile);
-		logs[sv_log].sv_logfile = NULL;
+		SV_LogFileClose (sv_log);
 
 		// in case of NON "newlog" we do some additional work and exit function
 		if (!newlog)
@@ -130,6 +129,8 @@ void SV_Logfile (int sv_log, qbool newlog)
 		return;
 	}
 
+	SV_LogFileOpened (sv_log);
+
 	switch (sv_log)
 	{
 	case TELNET_LOG:
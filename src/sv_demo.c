@@ -50,6 +50,7 @@ cvar_t	sv_ondemoremove		= {"sv_onDemoRemove",	""};
 cvar_t	sv_demoRegexp		= {"sv_demoRegexp",		"\\.mvd(\\.(gz|bz2|rar|zip))?$"};
 
 cvar_t	sv_silentrecord		= {"sv_silentrecord",   "0"};
+cvar_t	sv_demoInterpCheck	= {"sv_demoInterpCheck", "0"}; // compare interpolation partners with full scan
 
 cvar_t	extralogname		= {"extralogname",		"unset"}; // no sv_ prefix? WTF!
 
@@ -104,6 +105,164 @@ void MVD_SZ_Write (const void *data, int length)
 
 // }
 
+// { demo frame arena
+//
+// frame buffers are variable sized blocks carved from big pages, all released
+// at once when recording stops. block sizes are powers of 2 from DEMO_BLOCK_MIN,
+// blocks given back are kept in per size free lists for the next frame to grow.
+// frame grows in MVDWrite_BeginEx before anything is written to it, so it only
+// holds as much as it ever needed instead of four max sized messages.
+
+#define DEMO_PAGE_SIZE		0x40000
+#define DEMO_BLOCK_MIN		0x400		// most frames fit, 64 of them are 64KB
+#define DEMO_BLOCK_KEEP		0x4000		// bigger blocks are given back once frame is written
+#define DEMO_BLOCK_CLASSES	16
+
+typedef struct demoblock_s
+{
+	struct demoblock_s	*next;
+} demoblock_t;
+
+typedef struct demopage_s
+{
+	struct demopage_s	*next;
+	int					size;
+	int					used;
+	double				align;			// data follows
+} demopage_t;
+
+static struct
+{
+	demopage_t		*pages;
+	demoblock_t		*freeblocks[DEMO_BLOCK_CLASSES];
+	unsigned int	pagebytes;
+	unsigned int	framebytes;			// blocks held by frames
+	unsigned int	peakbytes;
+	int				grows;
+} demoarena;
+
+static int MVD_BlockClass (int size)
+{
+	int c;
+
+	for (c = 0; c < DEMO_BLOCK_CLASSES - 1 && (DEMO_BLOCK_MIN << c) < size; c++)
+		;
+
+	if ((DEMO_BLOCK_MIN << c) < size)
+		Sys_Error ("MVD_BlockClass: %d bytes frame", size);
+
+	return c;
+}
+
+static byte *MVD_BlockAlloc (int c)
+{
+	demoblock_t *b;
+	demopage_t *page = demoarena.pages;
+	int size = DEMO_BLOCK_MIN << c;
+
+	if ((b = demoarena.freeblocks[c]))
+	{
+		demoarena.freeblocks[c] = b->next;
+		return (byte *) b;
+	}
+
+	if (!page || page->used + size > page->size)
+	{
+		page = (demopage_t *) Q_malloc (sizeof(demopage_t) + max(DEMO_PAGE_SIZE, size));
+		page->size = max(DEMO_PAGE_SIZE, size);
+		page->next = demoarena.pages;
+		demoarena.pages = page;
+		demoarena.pagebytes += page->size;
+	}
+
+	page->used += size;
+	return (byte *) (page + 1) + page->used - size;
+}
+
+static void MVD_BlockFree (byte *data, int size)
+{
+	demoblock_t *b = (demoblock_t *) data;
+	int c = MVD_BlockClass (size);
+
+	b->next = demoarena.freeblocks[c];
+	demoarena.freeblocks[c] = b;
+}
+
+// give frame buffer at least size bytes, keeping what is in it
+static void MVD_FrameGrow (sizebuf_t *buf, int size)
+{
+	byte *data;
+	int c = MVD_BlockClass (max(size, buf->maxsize * 2));
+
+	data = MVD_BlockAlloc (c);
+	if (buf->data)
+	{
+		memcpy (data, buf->data, buf->cursize);
+		MVD_BlockFree (buf->data, buf->maxsize);
+	}
+
+	demoarena.framebytes += (DEMO_BLOCK_MIN << c) - buf->maxsize;
+	demoarena.peakbytes = max(demoarena.peakbytes, demoarena.framebytes);
+	if (buf->data)
+		demoarena.grows++;
+
+	buf->data = data;
+	buf->maxsize = DEMO_BLOCK_MIN << c;
+}
+
+// frame was written, do not let one big frame hold a big block forever
+static void MVD_FrameShrink (sizebuf_t *buf)
+{
+	if (buf->maxsize <= DEMO_BLOCK_KEEP)
+		return;
+
+	MVD_BlockFree (buf->data, buf->maxsize);
+	demoarena.framebytes -= buf->maxsize;
+	buf->data = NULL;
+	buf->maxsize = 0;
+	MVD_FrameGrow (buf, DEMO_BLOCK_MIN);
+}
+
+// every frame gets its smallest block, so frame buffers are always valid while recording
+static void MVD_ArenaInit (void)
+{
+	int i;
+
+	for (i = 0; i < UPDATE_BACKUP; i++)
+	{
+		SZ_InitEx (&demo.frames[i]._buf_, NULL, 0, true);
+		MVD_FrameGrow (&demo.frames[i]._buf_, DEMO_BLOCK_MIN);
+	}
+}
+
+static void MVD_ArenaFree (void)
+{
+	demopage_t *page;
+	int i;
+
+	while ((page = demoarena.pages))
+	{
+		demoarena.pages = page->next;
+		Q_free (page);
+	}
+
+	for (i = 0; i < UPDATE_BACKUP; i++)
+		SZ_InitEx (&demo.frames[i]._buf_, NULL, 0, true);
+
+	memset (demoarena.freeblocks, 0, sizeof(demoarena.freeblocks));
+	demoarena.pagebytes = demoarena.framebytes = 0;
+}
+
+static void SV_MVDMem_f (void)
+{
+	Con_Printf ("demo state : %u KB%s\n", (unsigned int) sizeof(demo) / 1024, sv.mvdrecording ? ", recording" : ", idle");
+	Con_Printf ("frame arena: %u KB in pages, %u KB in frames, %u KB peak, %d grows\n",
+	            demoarena.pagebytes / 1024, demoarena.framebytes / 1024, demoarena.peakbytes / 1024, demoarena.grows);
+	Con_Printf ("resident   : %u KB\n", (unsigned int) (sizeof(demo) + demoarena.pagebytes) / 1024);
+}
+
+// }
+
 mvddest_t *DestByName (char *name)
 {
 	mvddest_t *d;
@@ -118,25 +277,35 @@ mvddest_t *DestByName (char *name)
 void DestClose (mvddest_t *d, qbool destroyfiles)
 {
 	char path[MAX_OSPATH];
+	double start = Sys_DoubleTime();
 
+	if (d->io)
+		SV_DemoIO_Close(d);
+	SV_MVDIndexClose(d);
 	if (d->cache)
 		Q_free(d->cache);
 	if (d->file)
 		fclose(d->file);
+	if (d->desttype != DEST_STREAM)
+		demoio_stats.gametime += Sys_DoubleTime() - start;
 	if (d->socket)
 		closesocket(d->socket);
 	if (d->qtvuserlist)
 		QTVsv_FreeUserList(d);
+	QTV_ChainRelease(d);
 
 	if (destroyfiles)
 	{
 		snprintf(path, MAX_OSPATH, "%s/%s/%s", fs_gamedir, d->path, d->name);
 		Sys_remove(path);
-		strlcpy(path + strlen(path) - 3, "txt", MAX_OSPATH - strlen(path) + 3);
+		SV_MVDStripExtension(path);
+		strlcat(path, ".txt", MAX_OSPATH);
+		Sys_remove(path);
+		path[strlen(path) - 4] = 0;
+		strlcat(path, MVD_INDEX_EXT, MAX_OSPATH);
 		Sys_remove(path);
 
-		// force cache rebuild.
-		FS_FlushFSHash();
+		SV_DemoCatUpdateDemo(d->path, d->name);
 	}
 
 	Q_free(d);
@@ -149,6 +318,7 @@ void DestFlush (qbool compleate)
 {
 	int len;
 	mvddest_t *d, *t;
+	double start;
 
 	if (!demo.dest)
 		return;
@@ -167,27 +337,56 @@ void DestFlush (qbool compleate)
 		}
 	}
 
+	// we are between demo frames, lagging proxies may be cut here
+	QTV_ChainMark();
+
 	for (d = demo.dest; d; d = d->nextdest)
 	{
+		start = Sys_DoubleTime();
+
 		switch(d->desttype)
 		{
 		case DEST_FILE:
-			fflush (d->file);
+			if (d->io)
+			{
+				if (!SV_DemoIO_Handoff(d))
+				{
+					Sys_Printf("DestFlush: writer thread error\n");
+					d->error = true;
+				}
+			}
+			else
+				fflush (d->file);
+
+			demoio_stats.gametime += Sys_DoubleTime() - start;
 			break;
 
 		case DEST_BUFFEREDFILE:
 			if (d->cacheused + DEMO_FLUSH_CACHE_IF_LESS_THAN_THIS > d->maxcachesize || compleate)
 			{
-				len = fwrite(d->cache, 1, d->cacheused, d->file);
-				if (len != d->cacheused)
+				if (d->io)
 				{
-					Sys_Printf("DestFlush: fwrite() error\n");
-					d->error = true;
+					if (!SV_DemoIO_Handoff(d))
+					{
+						Sys_Printf("DestFlush: writer thread error\n");
+						d->error = true;
+					}
 				}
-				fflush(d->file);
+				else
+				{
+					len = fwrite(d->cache, 1, d->cacheused, d->file);
+					if (len != d->cacheused)
+					{
+						Sys_Printf("DestFlush: fwrite() error\n");
+						d->error = true;
+					}
+					fflush(d->file);
 
-				d->cacheused = 0;
+					d->cacheused = 0;
+				}
 			}
+
+			demoio_stats.gametime += Sys_DoubleTime() - start;
 			break;
 
 		case DEST_STREAM:
@@ -199,9 +398,9 @@ void DestFlush (qbool compleate)
 				d->error = true;
 			}
 
-			if (d->cacheused && !d->error)
+			if (!d->error)
 			{
-				len = send(d->socket, d->cache, d->cacheused, 0);
+				len = QTV_StreamSend(d);
 
 				if (len == 0) //client died
 				{
@@ -210,10 +409,7 @@ void DestFlush (qbool compleate)
 					// so 0 is legal or what?
 				}
 				else if (len > 0) //we put some data through
-				{ //move up the buffer
-					d->cacheused -= len;
-					memmove(d->cache, d->cache+len, d->cacheused);
-
+				{ //QTV_StreamSend() moved up the buffers
 					d->io_time = Sys_DoubleTime(); // update IO activity
 				}
 				else
@@ -225,6 +421,8 @@ void DestFlush (qbool compleate)
 					}
 				}
 			}
+
+			QTV_StreamCheckLag(d, !compleate && sv.mvdrecording);
 			break;
 
 		case DEST_NONE:
@@ -302,17 +500,33 @@ int DemoWriteDest (void *data, int len, mvddest_t *d)
 	switch(d->desttype)
 	{
 		case DEST_FILE:
-			ret = fwrite(data, 1, len, d->file);
-			if (ret != len)
+			if (!d->io)
 			{
-				Sys_Printf("DemoWriteDest: fwrite() error\n");
-				d->error = true;
-				return 0;
-			}
+				double start = Sys_DoubleTime();
 
-			break;
+				ret = fwrite(data, 1, len, d->file);
+				demoio_stats.gametime += Sys_DoubleTime() - start;
+				if (ret != len)
+				{
+					Sys_Printf("DemoWriteDest: fwrite() error\n");
+					d->error = true;
+					return 0;
+				}
+
+				break;
+			}
+			// writer thread owns the file, go through cache as buffered file does
 		case DEST_BUFFEREDFILE:	//these write to a cache, which is flushed later
 		case DEST_STREAM:
+			// keep order with shared data this stream has not sent yet
+			if (d->desttype == DEST_STREAM && !QTV_ChainToCache(d))
+				return 0;
+			if (d->io && d->cacheused + len > d->maxcachesize && !SV_DemoIO_Handoff(d))
+			{
+				Sys_Printf("DemoWriteDest: writer thread error\n");
+				d->error = true;
+				return 0;
+			}
 			if (d->cacheused + len > d->maxcachesize)
 			{
 				Sys_Printf("DemoWriteDest: cache overflow %d > %d\n", d->cacheused + len, d->maxcachesize);
@@ -333,9 +547,20 @@ int DemoWriteDest (void *data, int len, mvddest_t *d)
 static void DemoWrite (void *data, int len) //broadcast to all proxies/mvds
 {
 	mvddest_t *d;
+
+	// singledest may be not in the list, see SV_MVDIndexFrame
+	if (singledest)
+	{
+		DemoWriteDest(data, len, singledest);
+		return;
+	}
+
+	// proxies share one copy of broadcast data
+	QTV_ChainWrite(data, len);
+
 	for (d = demo.dest; d; d = d->nextdest)
 	{
-		if (singledest && singledest != d)
+		if (d->desttype == DEST_STREAM)
 			continue;
 
 		DemoWriteDest(data, len, d);
@@ -375,6 +600,10 @@ static qbool MVDWrite_BeginEx (byte type, int to, int size)
 		return false; // ERROR
 	}
 
+	// room for message and its header, previous message may just be extended, never mind
+	if (demo.frames[demo.parsecount&UPDATE_MASK]._buf_.cursize + 10 + size > demo.frames[demo.parsecount&UPDATE_MASK]._buf_.maxsize)
+		MVD_FrameGrow(&demo.frames[demo.parsecount&UPDATE_MASK]._buf_, demo.frames[demo.parsecount&UPDATE_MASK]._buf_.cursize + 10 + size);
+
 	new_mvd_msg =    demo.frames[demo.parsecount&UPDATE_MASK].lasttype != type
 				  || demo.frames[demo.parsecount&UPDATE_MASK].lastto   != to
 				  || demo.frames[demo.parsecount&UPDATE_MASK].lastsize + size > MAX_MVD_SIZE;
@@ -531,11 +760,101 @@ and writes packets to the disk/memory
 ====================
 */
 
+/*
+====================
+SV_MVDInterpPartner
+
+first frame after demo.lastwritten client 'num' can be interpolated towards,
+-1 if there is none yet. frames are scanned once per client: cursors only move
+forward, since both demo.lastwritten and time of written frame do
+====================
+*/
+static int SV_MVDInterpPartner (int num, double time1, qbool dead)
+{
+	demo_interp_t	*ip = &demo.interp[num];
+	demo_client_t	*nextcl;
+	int				first = demo.lastwritten + 1, limit;
+
+	// disconnected? respawned, or walked into teleport, do not interpolate!
+	ip->blocked = max(ip->blocked, first);
+	for ( ; ip->blocked < demo.parsecount; ip->blocked++)
+	{
+		nextcl = &demo.frames[ip->blocked&UPDATE_MASK].clients[num];
+		if (nextcl->parsecount != ip->blocked || nextcl->fixangle)
+			break;
+	}
+	limit = ip->blocked;
+
+	// respawned, do not interpolate
+	if (dead)
+	{
+		ip->alive = max(ip->alive, first);
+		for ( ; ip->alive < limit; ip->alive++)
+			if (!(demo.frames[ip->alive&UPDATE_MASK].clients[num].flags & DF_DEAD))
+				break;
+		limit = ip->alive;
+	}
+
+	ip->reached = max(ip->reached, first);
+	for ( ; ip->reached < limit; ip->reached++)
+	{
+		if (demo.frames[ip->reached&UPDATE_MASK].time - demo.frames[ip->reached&UPDATE_MASK].clients[num].sec >= time1)
+			return ip->reached;
+	}
+
+	return -1;
+}
+
+/*
+====================
+SV_MVDInterpPartnerScan
+
+same as SV_MVDInterpPartner, but looks at every frame each time, as it was
+done before the cursors. used by sv_demoInterpCheck
+====================
+*/
+static int SV_MVDInterpPartnerScan (int num, double time1, qbool dead)
+{
+	demo_client_t	*nextcl;
+	int				j;
+
+	for (j = demo.lastwritten + 1; j < demo.parsecount; j++)
+	{
+		nextcl = &demo.frames[j&UPDATE_MASK].clients[num];
+
+		if (nextcl->parsecount != j)
+			break; // disconnected?
+		if (nextcl->fixangle)
+			break; // respawned, or walked into teleport, do not interpolate!
+		if (!(nextcl->flags & DF_DEAD) && dead)
+			break; // respawned, do not interpolate
+
+		if (demo.frames[j&UPDATE_MASK].time - nextcl->sec >= time1)
+			return j;
+	}
+
+	return -1;
+}
+
+static void SV_MVDInterpCheck (int num, double time1, qbool dead, int partner)
+{
+	static unsigned int checked, mismatches;
+	int scan = SV_MVDInterpPartnerScan (num, time1, dead);
+
+	checked++;
+	if (scan == partner)
+		return;
+
+	mismatches++;
+	Con_Printf ("sv_demoInterpCheck: client %d frame %d: partner %d, full scan %d (%u of %u wrong)\n",
+	            num, demo.lastwritten, partner, scan, mismatches, checked);
+}
+
 static qbool SV_MVDWritePacketsEx (int num)
 {
 	demo_frame_t	*frame, *nextframe;
 	demo_client_t	*cl, *nextcl = NULL, *last_cl;
-	int				i, j, flags;
+	int				i, j, flags, partner;
 	qbool			valid;
 	double			time1, playertime, nexttime;
 	vec3_t			origin, angles;
@@ -559,7 +878,9 @@ static qbool SV_MVDWritePacketsEx (int num)
 
 		frame = &demo.frames[demo.lastwritten&UPDATE_MASK];
 		time1 = frame->time;
-		nextframe = frame;
+
+		// we are on frame boundary, let index know
+		SV_MVDIndexFrame(time1);
 
 		// find two frames
 		// one before the exact time (time - msec) and one after,
@@ -576,26 +897,21 @@ static qbool SV_MVDWritePacketsEx (int num)
 
 			valid = false;
 
-			for (j = demo.lastwritten+1; nexttime < time1 && j < demo.parsecount; j++)
+			partner = -1;
+			if (nexttime < time1)
 			{
-				nextframe = &demo.frames[j&UPDATE_MASK];
-				nextcl = &nextframe->clients[i];
-
-				if (nextcl->parsecount != j)
-					break; // disconnected?
-				if (nextcl->fixangle)
-					break; // respawned, or walked into teleport, do not interpolate!
-				if (!(nextcl->flags & DF_DEAD) && (cl->flags & DF_DEAD))
-					break; // respawned, do not interpolate
+				partner = SV_MVDInterpPartner(i, time1, cl->flags & DF_DEAD);
+				if ((int)sv_demoInterpCheck.value)
+					SV_MVDInterpCheck(i, time1, cl->flags & DF_DEAD, partner);
+			}
 
+			if (partner >= 0)
+			{
+				// good, found what we were looking for
+				nextframe = &demo.frames[partner&UPDATE_MASK];
+				nextcl = &nextframe->clients[i];
 				nexttime = nextframe->time - nextcl->sec;
-
-				if (nexttime >= time1)
-				{
-					// good, found what we were looking for
-					valid = true;
-					break;
-				}
+				valid = true;
 			}
 
 			if (valid)
@@ -704,6 +1020,7 @@ static qbool SV_MVDWritePacketsEx (int num)
 
 		// { reset frame for future usage
 		SZ_Clear(&demo.frames[demo.lastwritten&UPDATE_MASK]._buf_);
+		MVD_FrameShrink(&demo.frames[demo.lastwritten&UPDATE_MASK]._buf_);
 
 		demo.frames[demo.lastwritten&UPDATE_MASK].lastto = 0;
 		demo.frames[demo.lastwritten&UPDATE_MASK].lasttype = 0;
@@ -755,10 +1072,21 @@ static mvddest_t *SV_InitRecordFile (char *name)
 	char *s;
 	mvddest_t *dst;
 	FILE *file;
+	int compresslevel;
 
 	char path[MAX_OSPATH];
+	char gzname[MAX_OSPATH];
+
+	// compressed demos are written by writer thread, so the name has to be decided up front
+	if ((compresslevel = SV_DemoIO_CompressLevel()))
+	{
+		snprintf(gzname, sizeof(gzname), "%s%s", name, MVD_COMPRESSED_EXT);
+		name = gzname;
+	}
 
 	Con_DPrintf("SV_InitRecordFile: Demo name: \"%s\"\n", name);
+	// never truncate old file in place, someone may be downloading it from its mapping
+	Sys_remove (name);
 	file = fopen (name, "wb");
 	if (!file)
 	{
@@ -782,6 +1110,16 @@ static mvddest_t *SV_InitRecordFile (char *name)
 		dst->cache = (char *) Q_malloc (dst->maxcachesize);
 	}
 
+	if (!SV_DemoIO_Attach (dst, compresslevel) && compresslevel)
+	{
+		Con_Printf ("ERROR: couldn't start compressed recording of \"%s\"\n", name);
+		fclose (dst->file);
+		Q_free (dst->cache);
+		Q_free (dst);
+		Sys_remove (name);
+		return NULL;
+	}
+
 	s = name + strlen(name);
 	while (*s != '/') s--;
 	strlcpy(dst->name, s+1, sizeof(dst->name));
@@ -792,8 +1130,11 @@ static mvddest_t *SV_InitRecordFile (char *name)
 						(dst->desttype == DEST_BUFFEREDFILE) ? "memory" : "disk", s+1);
 	Cvar_SetROM(&serverdemo, dst->name);
 
+	SV_MVDIndexOpen(dst, name);
+
 	strlcpy(path, name, MAX_OSPATH);
-	strlcpy(path + strlen(path) - 3, "txt", MAX_OSPATH - strlen(path) + 3);
+	SV_MVDStripExtension(path);
+	strlcat(path, ".txt", MAX_OSPATH);
 
 	if ((int)sv_demotxt.value)
 	{
@@ -816,8 +1157,7 @@ static mvddest_t *SV_InitRecordFile (char *name)
 	else
 		Sys_remove(path);
 
-	// force cache rebuild.
-	FS_FlushFSHash();
+	SV_DemoCatUpdateDemo(dst->path, dst->name);
 
 	return dst;
 }
@@ -884,7 +1224,10 @@ void SV_MVDStop (int reason, qbool mvdonly)
 		DestCloseAllFlush(true, mvdonly);
 
 		if (!demo.dest)
+		{
 			sv.mvdrecording = false;
+			MVD_ArenaFree();
+		}
 
 		if (reason == 4)
 			SV_BroadcastPrintf (PRINT_CHAT, "Error in MVD/QTV recording, recording stopped\n");
@@ -921,7 +1264,10 @@ void SV_MVDStop (int reason, qbool mvdonly)
 	numclosed = DestCloseAllFlush(false, mvdonly);
 
 	if (!demo.dest)
+	{
 		sv.mvdrecording = false;
+		MVD_ArenaFree();
+	}
 
 	if (numclosed)
 	{
@@ -1021,6 +1367,109 @@ static void SV_WriteRecordMVDStatsMessage (sizebuf_t *msg, int client)
 }
 
 
+/*
+====================
+SV_MVD_SendSignon
+
+sound and model lists, signon buffers and spawn command, when they are not
+in SV_GamestateDemo
+====================
+*/
+static void SV_MVD_SendSignon (sizebuf_t *buf)
+{
+	unsigned int n;
+	char *s;
+
+	// soundlist
+	MSG_WriteByte (buf, svc_soundlist);
+	MSG_WriteByte (buf, 0);
+
+	n = 0;
+	s = sv.sound_precache[n+1];
+	while (s)
+	{
+		MSG_WriteString (buf, s);
+		if (buf->cursize > MAX_MSGLEN/2)
+		{
+			MSG_WriteByte (buf, 0);
+			MSG_WriteByte (buf, n);
+			SV_WriteRecordMVDMessage (buf);
+			SZ_Clear (buf);
+			MSG_WriteByte (buf, svc_soundlist);
+			MSG_WriteByte (buf, n + 1);
+		}
+		n++;
+		s = sv.sound_precache[n+1];
+	}
+
+	if (buf->cursize)
+	{
+		MSG_WriteByte (buf, 0);
+		MSG_WriteByte (buf, 0);
+		SV_WriteRecordMVDMessage (buf);
+		SZ_Clear (buf);
+	}
+
+	// modellist
+	MSG_WriteByte (buf, svc_modellist);
+	MSG_WriteByte (buf, 0);
+
+	n = 0;
+	s = sv.model_precache[n+1];
+	while (s)
+	{
+		MSG_WriteString (buf, s);
+		if (buf->cursize > MAX_MSGLEN/2)
+		{
+			MSG_WriteByte (buf, 0);
+			MSG_WriteByte (buf, n);
+			SV_WriteRecordMVDMessage (buf);
+			SZ_Clear (buf);
+			MSG_WriteByte (buf, svc_modellist);
+			MSG_WriteByte (buf, n + 1);
+		}
+		n++;
+		s = sv.model_precache[n+1];
+	}
+
+	if (buf->cursize)
+	{
+		MSG_WriteByte (buf, 0);
+		MSG_WriteByte (buf, 0);
+		SV_WriteRecordMVDMessage (buf);
+		SZ_Clear (buf);
+	}
+
+	// prespawn
+
+	for (n = 0; n < sv.num_signon_buffers; n++)
+	{
+		if (buf->cursize+sv.signon_buffer_size[n] > MAX_MSGLEN/2)
+		{
+			SV_WriteRecordMVDMessage (buf);
+			SZ_Clear (buf);
+		}
+		SZ_Write (buf,
+		          sv.signon_buffers[n],
+		          sv.signon_buffer_size[n]);
+	}
+
+	if (buf->cursize > MAX_MSGLEN/2)
+	{
+		SV_WriteRecordMVDMessage (buf);
+		SZ_Clear (buf);
+	}
+
+	MSG_WriteByte (buf, svc_stufftext);
+	MSG_WriteString (buf, va("cmd spawn %i 0\n",svs.spawncount) );
+
+	if (buf->cursize)
+	{
+		SV_WriteRecordMVDMessage (buf);
+		SZ_Clear (buf);
+	}
+}
+
 /*
 static void SV_WriteSetMVDMessage (void)
 {
@@ -1062,8 +1511,6 @@ void MVD_PlayerReset(int player)
 
 qbool SV_MVD_Record (mvddest_t *dest, qbool mapchange)
 {
-	int i;
-
 	if (mapchange)
 	{
 		if (dest) // during mapchange dest must be NULL
@@ -1083,13 +1530,13 @@ qbool SV_MVD_Record (mvddest_t *dest, qbool mapchange)
 
     	// and here we memset() not whole demo_t struct, but part,
     	// so demo.dest and demo.pendingdest is not overwriten
-		memset(&demo, 0, ((int)&(((demo_t *)0)->mem_set_point)));
+		MVD_ArenaFree();
+		memset(&demo, 0, offsetof(demo_t, mem_set_point));
 
-		for (i = 0; i < UPDATE_BACKUP; i++)
-		{
-			// set up buffer for record in each frame
-			SZ_InitEx(&demo.frames[i]._buf_, demo.frames[i]._buf__data, sizeof(demo.frames[0]._buf__data), true);
-		}
+		// set up buffer for record in each frame, only if something is recorded:
+		// every map spawn comes here, with no demo or qtv stream as well
+		if (dest || demo.dest)
+			MVD_ArenaInit();
 
 		// set up buffer for non releable data
 		SZ_InitEx(&demo.datagram, demo.datagram_data, sizeof(demo.datagram_data), true);
@@ -1121,13 +1568,13 @@ void SV_MVD_SendInitialGamestate(mvddest_t *dest)
 {
 	sizebuf_t	buf;
 	unsigned char buf_data[MAX_MSGLEN];
-	unsigned int n;
-	char *s, info[MAX_EXT_INFO_STRING];
+	byte *gamestate;
+	char info[MAX_EXT_INFO_STRING];
 
 	client_t *player;
 	edict_t *ent;
 	char *gamedir;
-	int i;
+	int i, len;
 
 	if (!demo.dest)
 		return;
@@ -1207,101 +1654,17 @@ void SV_MVD_SendInitialGamestate(mvddest_t *dest)
 	MSG_WriteByte (&buf, 0); // none in demos
 
 	// send server info string
-	MSG_WriteByte (&buf, svc_stufftext);
-	MSG_WriteString (&buf, va("fullserverinfo \"%s\"\n", svs.info) );
+	SV_GamestateServerinfo (&buf);
 
 	// flush packet
 	SV_WriteRecordMVDMessage (&buf);
 	SZ_Clear (&buf);
 
-	// soundlist
-	MSG_WriteByte (&buf, svc_soundlist);
-	MSG_WriteByte (&buf, 0);
-
-	n = 0;
-	s = sv.sound_precache[n+1];
-	while (s)
-	{
-		MSG_WriteString (&buf, s);
-		if (buf.cursize > MAX_MSGLEN/2)
-		{
-			MSG_WriteByte (&buf, 0);
-			MSG_WriteByte (&buf, n);
-			SV_WriteRecordMVDMessage (&buf);
-			SZ_Clear (&buf);
-			MSG_WriteByte (&buf, svc_soundlist);
-			MSG_WriteByte (&buf, n + 1);
-		}
-		n++;
-		s = sv.sound_precache[n+1];
-	}
-
-	if (buf.cursize)
-	{
-		MSG_WriteByte (&buf, 0);
-		MSG_WriteByte (&buf, 0);
-		SV_WriteRecordMVDMessage (&buf);
-		SZ_Clear (&buf);
-	}
-
-	// modellist
-	MSG_WriteByte (&buf, svc_modellist);
-	MSG_WriteByte (&buf, 0);
-
-	n = 0;
-	s = sv.model_precache[n+1];
-	while (s)
-	{
-		MSG_WriteString (&buf, s);
-		if (buf.cursize > MAX_MSGLEN/2)
-		{
-			MSG_WriteByte (&buf, 0);
-			MSG_WriteByte (&buf, n);
-			SV_WriteRecordMVDMessage (&buf);
-			SZ_Clear (&buf);
-			MSG_WriteByte (&buf, svc_modellist);
-			MSG_WriteByte (&buf, n + 1);
-		}
-		n++;
-		s = sv.model_precache[n+1];
-	}
-
-	if (buf.cursize)
-	{
-		MSG_WriteByte (&buf, 0);
-		MSG_WriteByte (&buf, 0);
-		SV_WriteRecordMVDMessage (&buf);
-		SZ_Clear (&buf);
-	}
-
-	// prespawn
-
-	for (n = 0; n < sv.num_signon_buffers; n++)
-	{
-		if (buf.cursize+sv.signon_buffer_size[n] > MAX_MSGLEN/2)
-		{
-			SV_WriteRecordMVDMessage (&buf);
-			SZ_Clear (&buf);
-		}
-		SZ_Write (&buf,
-		          sv.signon_buffers[n],
-		          sv.signon_buffer_size[n]);
-	}
-
-	if (buf.cursize > MAX_MSGLEN/2)
-	{
-		SV_WriteRecordMVDMessage (&buf);
-		SZ_Clear (&buf);
-	}
-
-	MSG_WriteByte (&buf, svc_stufftext);
-	MSG_WriteString (&buf, va("cmd spawn %i 0\n",svs.spawncount) );
-
-	if (buf.cursize)
-	{
-		SV_WriteRecordMVDMessage (&buf);
-		SZ_Clear (&buf);
-	}
+	// soundlist, modellist, prespawn
+	if ((gamestate = SV_GamestateDemo (&len)))
+		DemoWrite (gamestate, len);
+	else
+		SV_MVD_SendSignon (&buf);
 
 	// send current status of all other players
 
@@ -1629,19 +1992,16 @@ void SV_MVDEasyRecord_f (void)
 	strlcpy(name2, name, sizeof(name2));
 	Sys_mkdir(va("%s/%s", fs_gamedir, sv_demoDir.string));
 
-	// FIXME: very SLOW
 	if (!(name3 = quote(name2)))
 		return;
-	dir = Sys_listdir(va("%s/%s", fs_gamedir, sv_demoDir.string),
-					  va("^%s%s", name3, sv_demoRegexp.string), SORT_NO);
+	dir = SV_DemoDir(va("^%s%s", name3, sv_demoRegexp.string), SORT_NO);
 	Q_free(name3);
 	for (i = 1; dir.numfiles; )
 	{
 		snprintf(name2, sizeof(name2), "%s_%02i", name, i++);
 		if (!(name3 = quote(name2)))
 			return;
-		dir = Sys_listdir(va("%s/%s", fs_gamedir, sv_demoDir.string),
-						  va("^%s%s", name3, sv_demoRegexp.string), SORT_NO);
+		dir = SV_DemoDir(va("^%s%s", name3, sv_demoRegexp.string), SORT_NO);
 		Q_free(name3);
 	}
 
@@ -1678,9 +2038,14 @@ static void MVD_Init (void)
 	Cvar_Register (&sv_demoExtraNames);
 	Cvar_Register (&sv_demoRegexp);
 	Cvar_Register (&sv_silentrecord);
+	Cvar_Register (&sv_demoInterpCheck);
 
 	Cvar_Register (&extralogname);
 
+	SV_DemoIO_Init ();
+	SV_MVDIndexInit ();
+	SV_DemoCatInit ();
+
 	p = COM_CheckParm ("-democache");
 	if (p)
 	{
@@ -1730,6 +2095,7 @@ void SV_MVDInit (void)
 	Cmd_AddCommand ("sv_demoinfoadd",	SV_MVDInfoAdd_f);
 	Cmd_AddCommand ("sv_demoinforemove",SV_MVDInfoRemove_f);
 	Cmd_AddCommand ("sv_demoinfo",		SV_MVDInfo_f);
+	Cmd_AddCommand ("sv_demomem",		SV_MVDMem_f);
 	// not prefixed.
 	Cmd_AddCommand ("script",			SV_Script_f);
 
@@ -0,0 +1,508 @@
+/*
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the included (GNU.txt) GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+//	sv_demo_cat.c - in-memory catalogue of demo directory
+//
+//	directory is read once, after that catalogue is kept up to date by code
+//	creating or removing files there (SV_DemoCatUpdate). on linux inotify
+//	reports changes made by others (onrecordfinish scripts, cron jobs and so on),
+//	elsewhere changed mtime of the directory itself causes a rescan.
+//	listings, demo numbers, cleanup and easyrecord name lookup are answered
+//	from here instead of reading and sorting the directory every time.
+
+#include "qwsvdef.h"
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <fcntl.h>
+#endif
+
+#define DEMOCAT_HASH	1024
+
+typedef struct democatentry_s
+{
+	file_t		f;
+	char		map[MAX_QPATH];		// known for demos finished while we run
+	int			players;
+	struct democatentry_s *hashnext;
+} democatentry_t;
+
+static struct
+{
+	char			path[MAX_OSPATH];	// directory catalogue was built for
+	qbool			valid;
+
+	democatentry_t	**entries;
+	int				numentries;
+	int				maxentries;
+	qbool			sorted;				// entries are in date order
+	democatentry_t	*hash[DEMOCAT_HASH];
+
+	int				dirtime;			// mtime of directory when we last looked
+#ifdef __linux__
+	int				inotify;
+	int				watch;
+#endif
+
+	int				scans;
+	double			scantime;
+	int				updates;
+	int				events;
+	int				queries;
+} democat;
+
+static file_t	*democat_list;			// what SV_DemoDir returns
+static int		democat_listsize;
+
+static democatentry_t *DemoCat_Find (const char *name)
+{
+	democatentry_t *e;
+
+	for (e = democat.hash[Hash_Key ((char *) name, DEMOCAT_HASH)]; e; e = e->hashnext)
+		if (!strcmp (e->f.name, name))
+			return e;
+
+	return NULL;
+}
+
+static int DemoCat_Index (democatentry_t *e)
+{
+	int i;
+
+	for (i = democat.numentries - 1; i >= 0; i--)
+		if (democat.entries[i] == e)
+			return i;
+
+	return -1;
+}
+
+static void DemoCat_Remove (democatentry_t *e)
+{
+	democatentry_t **link;
+	int i;
+
+	for (link = &democat.hash[Hash_Key (e->f.name, DEMOCAT_HASH)]; *link; link = &(*link)->hashnext)
+	{
+		if (*link == e)
+		{
+			*link = e->hashnext;
+			break;
+		}
+	}
+
+	// keep the order, so date sorted list stays sorted
+	if ((i = DemoCat_Index (e)) >= 0)
+	{
+		memmove (democat.entries + i, democat.entries + i + 1, (democat.numentries - i - 1) * sizeof(*democat.entries));
+		democat.numentries--;
+	}
+
+	Q_free (e);
+}
+
+static void DemoCat_Clear (void)
+{
+	int i;
+
+	for (i = 0; i < democat.numentries; i++)
+		Q_free (democat.entries[i]);
+
+	democat.numentries = 0;
+	democat.sorted = true;
+	memset (democat.hash, 0, sizeof(democat.hash));
+	democat.valid = false;
+}
+
+// (re)reads file of given name, adds, updates or drops its entry
+static democatentry_t *DemoCat_Stat (const char *name, qbool isdir)
+{
+	democatentry_t *e = DemoCat_Find (name);
+	char path[MAX_OSPATH];
+	int size, time, i, key;
+
+	// such a name can't be in the catalogue either
+	if (snprintf (path, sizeof(path), "%s/%s", democat.path, name) >= (int) sizeof(path))
+		return NULL;
+	size = Sys_FileSizeTime (path, &time);
+
+	if (time == -1)
+	{
+		if (e)
+			DemoCat_Remove (e);
+		return NULL;
+	}
+
+	if (isdir)
+		size = time = 0;
+
+	if (!e)
+	{
+		if (strlen (name) >= sizeof(e->f.name))
+			return NULL;
+
+		if (democat.numentries == democat.maxentries)
+		{
+			democat.maxentries = max(256, democat.maxentries * 2);
+			democat.entries = (democatentry_t **) realloc (democat.entries, democat.maxentries * sizeof(*democat.entries));
+			if (!democat.entries)
+				Sys_Error ("DemoCat_Stat: out of memory");
+		}
+
+		e = (democatentry_t *) Q_malloc (sizeof(democatentry_t));
+		strlcpy (e->f.name, name, sizeof(e->f.name));
+		key = Hash_Key (e->f.name, DEMOCAT_HASH);
+		e->hashnext = democat.hash[key];
+		democat.hash[key] = e;
+		democat.entries[democat.numentries++] = e;
+	}
+
+	e->f.size = size;
+	e->f.time = time;
+	e->f.isdir = isdir;
+
+	if (democat.sorted && (i = DemoCat_Index (e)) >= 0)
+	{
+		if ((i > 0 && democat.entries[i - 1]->f.time > time)
+			|| (i < democat.numentries - 1 && democat.entries[i + 1]->f.time < time))
+			democat.sorted = false;
+	}
+
+	return e;
+}
+
+static int DemoCat_ScanFile (char *name, int size, void *parm)
+{
+	int len = strlen (name);
+	qbool isdir = len && name[len - 1] == '/';
+
+	if (isdir)
+		name[len - 1] = 0;
+
+	DemoCat_Stat (name, isdir);
+	return true;
+}
+
+#ifdef __linux__
+static void DemoCat_Watch (void)
+{
+	if (democat.watch >= 0)
+		inotify_rm_watch (democat.inotify, democat.watch);
+	democat.watch = -1;
+
+	if (democat.inotify < 0)
+		return;
+
+	democat.watch = inotify_add_watch (democat.inotify, democat.path,
+	                                   IN_CREATE | IN_CLOSE_WRITE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO
+	                                   | IN_ATTRIB | IN_DELETE_SELF | IN_MOVE_SELF);
+}
+
+// returns false if events were lost and directory has to be read again
+static qbool DemoCat_ReadEvents (void)
+{
+	union
+	{
+		struct inotify_event	ev;
+		char					buf[8192];
+	} u;
+	struct inotify_event *ev;
+	char *p;
+	int n;
+	qbool ok = true;
+
+	while ((n = read (democat.inotify, u.buf, sizeof(u.buf))) > 0)
+	{
+		for (p = u.buf; p < u.buf + n; p += sizeof(struct inotify_event) + ev->len)
+		{
+			ev = (struct inotify_event *) p;
+			if (ev->wd != democat.watch)
+				continue;	// left from previous directory
+			democat.events++;
+
+			if (ev->mask & (IN_Q_OVERFLOW | IN_IGNORED | IN_DELETE_SELF | IN_MOVE_SELF))
+				ok = false;
+			else if (ev->len && ok)
+				DemoCat_Stat (ev->name, ev->mask & IN_ISDIR);
+		}
+	}
+
+	return ok;
+}
+#endif
+
+static void DemoCat_Scan (void)
+{
+	double start = Sys_DoubleTime ();
+
+	DemoCat_Clear ();
+
+#ifdef __linux__
+	// directory may not have existed when we tried before
+	if (democat.watch < 0)
+		DemoCat_Watch ();
+#endif
+
+	democat.dirtime = Sys_FileTime (democat.path);
+	Sys_EnumerateFiles (democat.path, "*", DemoCat_ScanFile, NULL);
+
+	democat.valid = true;
+	democat.scans++;
+	democat.scantime += Sys_DoubleTime () - start;
+}
+
+// brings catalogue up to date before it is used
+static void DemoCat_Refresh (void)
+{
+	char path[MAX_OSPATH];
+
+	democat.queries++;
+
+	if (snprintf (path, sizeof(path), "%s/%s", fs_gamedir, sv_demoDir.string) >= (int) sizeof(path))
+	{
+		Con_Printf ("DemoCat_Refresh: path of %s is too long\n", sv_demoDir.string);
+		DemoCat_Clear ();
+		democat.path[0] = 0;
+		return;
+	}
+
+	if (strcmp (path, democat.path))
+	{
+		strlcpy (democat.path, path, sizeof(democat.path));
+		democat.valid = false;
+#ifdef __linux__
+		DemoCat_Watch ();
+#endif
+	}
+
+#ifdef __linux__
+	if (democat.watch >= 0)
+	{
+		if (!DemoCat_ReadEvents ())
+		{
+			democat.valid = false;
+			DemoCat_Watch ();
+		}
+	}
+	else
+#endif
+	if (democat.valid && Sys_FileTime (democat.path) != democat.dirtime)
+		democat.valid = false;
+
+	if (!democat.valid)
+		DemoCat_Scan ();
+}
+
+/*
+====================
+SV_DemoCatUpdate
+
+file 'name' in 'dir' (relative to gamedir) was created, changed or removed
+====================
+*/
+void SV_DemoCatUpdate (const char *dir, const char *name)
+{
+	char path[MAX_OSPATH];
+
+	snprintf (path, sizeof(path), "%s/%s", dir, name);
+	if (Sys_FileTime (va("%s/%s", fs_gamedir, path)) != -1)
+		FS_AddFileToHash (path);
+
+	if (!democat.valid || strcmp (dir, sv_demoDir.string))
+		return;
+
+	democat.updates++;
+	DemoCat_Stat (name, false);
+
+	// our own change, no need to read directory again because of it
+	democat.dirtime = Sys_FileTime (democat.path);
+}
+
+/*
+====================
+SV_DemoCatUpdateDemo
+
+same for a demo and the .txt and .idx files going with it
+====================
+*/
+void SV_DemoCatUpdateDemo (const char *dir, const char *name)
+{
+	char base[MAX_OSPATH];
+
+	SV_DemoCatUpdate (dir, name);
+
+	strlcpy (base, name, sizeof(base));
+	SV_MVDStripExtension (base);
+	SV_DemoCatUpdate (dir, va("%s.txt", base));
+	SV_DemoCatUpdate (dir, va("%s%s", base, MVD_INDEX_EXT));
+}
+
+/*
+====================
+SV_DemoCatFinish
+
+demo recording finished, remember what we know about it
+====================
+*/
+void SV_DemoCatFinish (const char *dir, const char *name)
+{
+	democatentry_t *e;
+
+	SV_DemoCatUpdateDemo (dir, name);
+
+	if (democat.valid && !strcmp (dir, sv_demoDir.string) && (e = DemoCat_Find (name)))
+	{
+		strlcpy (e->map, sv.mapname, sizeof(e->map));
+		e->players = Dem_CountPlayers ();
+	}
+}
+
+static int DemoCat_CompareByDate (const void *a, const void *b)
+{
+	const democatentry_t *e1 = *(const democatentry_t **) a, *e2 = *(const democatentry_t **) b;
+
+	if (e1->f.time != e2->f.time)
+		return e1->f.time < e2->f.time ? -1 : 1;
+
+	return strcmp (e1->f.name, e2->f.name);
+}
+
+/*
+====================
+SV_DemoDir
+
+Sys_listdir of demo dir served from catalogue. there is no MAX_DIRFILES
+limit, list is terminated by entry with empty name and stays valid until
+next call.
+====================
+*/
+dir_t SV_DemoDir (const char *regexp, int sort_type)
+{
+	dir_t dir;
+	democatentry_t *e;
+	int i, r;
+	pcre *preg = NULL;
+	const char *errbuf;
+	qbool all = !strncmp (regexp, ".*", 3);
+
+	memset (&dir, 0, sizeof(dir));
+
+	DemoCat_Refresh ();
+
+	if (democat_listsize < democat.numentries + 1)
+	{
+		democat_listsize = democat.numentries + 256;
+		Q_free (democat_list);
+		democat_list = (file_t *) Q_malloc (democat_listsize * sizeof(file_t));
+	}
+	dir.files = democat_list;
+	dir.files[0].name[0] = 0;
+
+	if (!all && !(preg = pcre_compile (regexp, PCRE_CASELESS, &errbuf, &r, NULL)))
+	{
+		Con_Printf ("SV_DemoDir: pcre_compile(%s) error: %s at offset %d\n", regexp, errbuf, r);
+		return dir;
+	}
+
+	if (sort_type == SORT_BY_DATE && !democat.sorted)
+	{
+		qsort (democat.entries, democat.numentries, sizeof(*democat.entries), DemoCat_CompareByDate);
+		democat.sorted = true;
+	}
+
+	for (i = 0; i < democat.numentries; i++)
+	{
+		e = democat.entries[i];
+
+		if (!all)
+		{
+			switch (r = pcre_exec (preg, NULL, e->f.name, strlen (e->f.name), 0, 0, NULL, 0))
+			{
+			case 0: break;
+			case PCRE_ERROR_NOMATCH: continue;
+			default:
+				Con_Printf ("SV_DemoDir: pcre_exec(%s, %s) error code: %d\n", regexp, e->f.name, r);
+				continue;
+			}
+		}
+
+		dir.files[dir.numfiles++] = e->f;
+		if (e->f.isdir)
+			dir.numdirs++;
+		else
+			dir.size += e->f.size;
+	}
+	dir.files[dir.numfiles].name[0] = 0;
+
+	if (preg)
+		Q_free (preg);
+
+	if (sort_type == SORT_BY_NAME)
+		qsort (dir.files, dir.numfiles, sizeof(file_t), Sys_compare_by_name);
+
+	return dir;
+}
+
+static void SV_DemoCat_f (void)
+{
+	democatentry_t *e;
+	dir_t dir;
+	time_t t;
+
+	if (Cmd_Argc () > 1 && !strcmp (Cmd_Argv (1), "rescan"))
+		democat.valid = false;
+
+	dir = SV_DemoDir (sv_demoRegexp.string, SORT_NO);
+
+	if (Cmd_Argc () > 2 && !strcmp (Cmd_Argv (1), "info"))
+	{
+		if (!(e = DemoCat_Find (Cmd_Argv (2))))
+		{
+			Con_Printf ("%s is not in %s\n", Cmd_Argv (2), democat.path);
+			return;
+		}
+
+		t = e->f.time;
+		Con_Printf ("%s: %d KB, modified %s", e->f.name, e->f.size / 1024, ctime (&t));
+		if (e->map[0])
+			Con_Printf ("map %s, %d players\n", e->map, e->players);
+		return;
+	}
+
+	Con_Printf ("directory : %s\n", democat.path);
+	Con_Printf ("entries   : %d, %d demos, %.1f MB of demos\n", democat.numentries, dir.numfiles, (float) dir.size / (1024 * 1024));
+	Con_Printf ("scans     : %d, %.1f ms total\n", democat.scans, democat.scantime * 1000);
+	Con_Printf ("updates   : %d\n", democat.updates);
+	Con_Printf ("queries   : %d\n", democat.queries);
+#ifdef __linux__
+	if (democat.watch >= 0)
+		Con_Printf ("watching  : inotify, %d events\n", democat.events);
+	else
+#endif
+	Con_Printf ("watching  : directory mtime\n");
+}
+
+void SV_DemoCatInit (void)
+{
+#ifdef __linux__
+	democat.inotify = inotify_init ();
+	if (democat.inotify >= 0)
+		fcntl (democat.inotify, F_SETFL, fcntl (democat.inotify, F_GETFL) | O_NONBLOCK);
+	democat.watch = -1;
+#endif
+
+	Cmd_AddCommand ("sv_democat", SV_DemoCat_f);
+}
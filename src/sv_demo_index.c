@@ -0,0 +1,401 @@
+/*
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the included (GNU.txt) GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+//	sv_demo_index.c - keyframe index written next to recorded demos
+//
+//	<demo>.idx starts with MVD_INDEX_MAGIC and a version, followed by records:
+//	  'K' offset time                   - frame boundary in the mvd stream
+//	  'S' offset time length data...    - gamestate as SV_MVD_SendInitialGamestate
+//	                                      writes it, valid from offset on
+//	offsets are in the uncompressed mvd stream, time is seconds since demo start.
+//	gamestate followed by mvd data from its offset is a playable demo, so any
+//	time range can be cut without parsing what comes before it.
+//	with sv_demoAsync the index is written by the demo writer thread too,
+//	snapshots are large enough to hold up a frame on a slow disk.
+
+#include "qwsvdef.h"
+
+#define MVD_INDEX_INTERVAL		0.5			// seconds between keyframes
+#define MVD_INDEX_SNAPSHOT_SIZE	0x40000
+
+cvar_t	sv_demoIndex			= {"sv_demoIndex", "1"};			// write .idx next to new demos
+cvar_t	sv_demoIndexSnapshot	= {"sv_demoIndexSnapshot", "30"};	// seconds between gamestate snapshots
+
+static mvddest_t	index_capture;	// never linked to demo.dest
+
+static void SV_MVDIndexWriteRecord (mvddest_t *d, int type, double time, char *data, int len)
+{
+	byte header[13];
+	int i, headerlen;
+	float f;
+	char *p;
+
+	header[0] = type;
+	i = LittleLong (d->totalsize);
+	memcpy (header + 1, &i, 4);
+	f = LittleFloat (time - d->indexstart);
+	memcpy (header + 5, &f, 4);
+	headerlen = 9;
+
+	if (type == MVD_INDEX_SNAPSHOT)
+	{
+		i = LittleLong (len);
+		memcpy (header + 9, &i, 4);
+		headerlen = 13;
+	}
+	else
+	{
+		len = 0;
+	}
+
+	if (d->indexio)
+	{
+		if ((p = SV_DemoIO_Reserve (d->indexio, headerlen + len)))
+		{
+			memcpy (p, header, headerlen);
+			if (len)
+				memcpy (p + headerlen, data, len);
+			SV_DemoIO_FlushFile (d->indexio);
+			return;
+		}
+	}
+	else
+	{
+		fwrite (header, 1, headerlen, d->indexfile);
+		if (len)
+			fwrite (data, 1, len, d->indexfile);
+		if (!ferror (d->indexfile))
+			return;
+	}
+
+	Con_Printf ("SV_MVDIndex: write error on index of %s\n", d->name);
+	SV_MVDIndexClose (d);
+}
+
+/*
+====================
+SV_MVDIndexOpen
+
+start index for freshly opened file dest, name is full path of the demo
+====================
+*/
+void SV_MVDIndexOpen (mvddest_t *d, char *name)
+{
+	char path[MAX_OSPATH];
+	int version = LittleLong (MVD_INDEX_VERSION);
+
+	strlcpy (path, name, sizeof(path));
+	SV_MVDStripExtension (path);
+	strlcat (path, MVD_INDEX_EXT, sizeof(path));
+
+	if (!(int)sv_demoIndex.value)
+	{
+		Sys_remove (path);
+		return;
+	}
+
+	if (!(d->indexfile = fopen (path, "wb")))
+	{
+		Con_Printf ("SV_MVDIndexOpen: couldn't open %s\n", path);
+		return;
+	}
+
+	fwrite (MVD_INDEX_MAGIC, 1, 4, d->indexfile);
+	fwrite (&version, 4, 1, d->indexfile);
+	d->indexstart = -1;
+
+	// snapshot and the record before it have to fit in a buffer
+	d->indexio = SV_DemoIO_AttachFile (d->indexfile, MVD_INDEX_SNAPSHOT_SIZE + 32);
+}
+
+void SV_MVDIndexClose (mvddest_t *d)
+{
+	if (!d->indexfile)
+		return;
+
+	if (d->indexio)
+	{
+		if (!SV_DemoIO_CloseFile (d->indexio))
+			Con_Printf ("SV_MVDIndex: write error on index of %s\n", d->name);
+		d->indexio = NULL;
+	}
+	else
+	{
+		fclose (d->indexfile);
+	}
+	d->indexfile = NULL;
+}
+
+// gamestate of this very moment, written to capture dest
+static int SV_MVDIndexCapture (void)
+{
+	double time = demo.time, pingtime = demo.pingtime;
+
+	if (!index_capture.cache)
+	{
+		index_capture.desttype = DEST_BUFFEREDFILE;
+		index_capture.maxcachesize = MVD_INDEX_SNAPSHOT_SIZE;
+		index_capture.cache = (char *) Q_malloc (index_capture.maxcachesize);
+	}
+
+	index_capture.error = false;
+	index_capture.cacheused = 0;
+
+	SV_MVD_SendInitialGamestate (&index_capture);
+
+	// do not disturb timing of the real stream
+	demo.time = time;
+	demo.pingtime = pingtime;
+
+	return index_capture.error ? 0 : index_capture.cacheused;
+}
+
+/*
+====================
+SV_MVDIndexFrame
+
+called by SV_MVDWritePacketsEx before demo frame of given time is written
+====================
+*/
+void SV_MVDIndexFrame (double time)
+{
+	mvddest_t *d;
+	int snaplen = -1;
+	double snapinterval = max(5, sv_demoIndexSnapshot.value);
+
+	for (d = demo.dest; d; d = d->nextdest)
+	{
+		if (!d->indexfile || d->error)
+			continue;
+
+		// demo starts with its own gamestate, that is the first snapshot
+		if (d->indexstart < 0)
+		{
+			d->indexstart = d->indexkey = d->indexsnap = time;
+			SV_MVDIndexWriteRecord (d, MVD_INDEX_KEYFRAME, time, NULL, 0);
+			continue;
+		}
+
+		if ((int)sv_demoIndexSnapshot.value && time - d->indexsnap >= snapinterval)
+		{
+			if (snaplen < 0)
+				snaplen = SV_MVDIndexCapture ();
+
+			if (snaplen)
+			{
+				d->indexsnap = d->indexkey = time;
+				SV_MVDIndexWriteRecord (d, MVD_INDEX_SNAPSHOT, time, index_capture.cache, snaplen);
+				continue;
+			}
+		}
+
+		if (time - d->indexkey >= MVD_INDEX_INTERVAL)
+		{
+			d->indexkey = time;
+			SV_MVDIndexWriteRecord (d, MVD_INDEX_KEYFRAME, time, NULL, 0);
+		}
+	}
+}
+
+//============================================================
+
+/*
+====================
+SV_MVDCut_f
+
+sv_democut <demo> <from> <to> [output]
+cuts time range of a demo using its index, reads only the range itself
+====================
+*/
+static void SV_MVDCut_f (void)
+{
+	char	name[MAX_DEMO_NAME], outname[MAX_DEMO_NAME];
+	char	path[MAX_OSPATH], idxpath[MAX_OSPATH];
+	char	buf[0x10000], magic[4];
+	FILE	*demof, *idxf, *outf;
+	float	from, to, t;
+	int		version, offset, len, n;
+	int		snapoffset = 0, snaplen = 0, endoffset = -1;
+	long	snappos = 0;
+	byte	type;
+	double	start = Sys_DoubleTime ();
+
+	if (Cmd_Argc () < 4)
+	{
+		Con_Printf ("usage: %s <demoname> <from> <to> [output]\n"
+					"cuts demo between given seconds using its index,\n"
+					"output starts at the last gamestate snapshot before <from>\n", Cmd_Argv (0));
+		return;
+	}
+
+	strlcpy (name, Cmd_Argv (1), sizeof(name));
+	COM_DefaultExtension (name, ".mvd");
+	from = atof (Cmd_Argv (2));
+	to = atof (Cmd_Argv (3));
+
+	if (to <= from || from < 0)
+	{
+		Con_Printf ("bad time range\n");
+		return;
+	}
+
+	// offsets in index are of uncompressed stream, we can't seek in gzip
+	if (strstr (name, MVD_COMPRESSED_EXT))
+	{
+		Con_Printf ("compressed demos can't be cut, gunzip %s first\n", name);
+		return;
+	}
+
+	if (DestByName (name))
+	{
+		Con_Printf ("%s is being recorded\n", name);
+		return;
+	}
+
+	if (snprintf (path, sizeof(path), "%s/%s/%s", fs_gamedir, sv_demoDir.string, name) >= (int) sizeof(path))
+	{
+		Con_Printf ("path of %s is too long\n", name);
+		return;
+	}
+	strlcpy (idxpath, path, sizeof(idxpath));
+	SV_MVDStripExtension (idxpath);
+	strlcat (idxpath, MVD_INDEX_EXT, sizeof(idxpath));
+
+	if (!(idxf = fopen (idxpath, "rb")))
+	{
+		Con_Printf ("%s has no index\n", name);
+		return;
+	}
+
+	if (fread (magic, 1, 4, idxf) != 4 || memcmp (magic, MVD_INDEX_MAGIC, 4)
+		|| fread (&version, 4, 1, idxf) != 1 || LittleLong (version) != MVD_INDEX_VERSION)
+	{
+		Con_Printf ("%s: bad index\n", idxpath);
+		fclose (idxf);
+		return;
+	}
+
+	// latest snapshot at or before 'from', first keyframe at or after 'to'
+	while (fread (&type, 1, 1, idxf) == 1 && fread (&offset, 4, 1, idxf) == 1 && fread (&t, 4, 1, idxf) == 1)
+	{
+		offset = LittleLong (offset);
+		t = LittleFloat (t);
+
+		if (type == MVD_INDEX_SNAPSHOT)
+		{
+			if (fread (&len, 4, 1, idxf) != 1)
+				break;
+			len = LittleLong (len);
+
+			if (t <= from)
+			{
+				snapoffset = offset;
+				snaplen = len;
+				snappos = ftell (idxf);
+			}
+
+			if (fseek (idxf, len, SEEK_CUR))
+				break;
+		}
+
+		if (t >= to)
+		{
+			endoffset = offset;
+			break;
+		}
+	}
+
+	if (!(demof = fopen (path, "rb")))
+	{
+		Con_Printf ("couldn't open %s\n", path);
+		fclose (idxf);
+		return;
+	}
+
+	if (Cmd_Argc () > 4)
+		strlcpy (outname, Cmd_Argv (4), sizeof(outname));
+	else
+	{
+		strlcpy (outname, name, sizeof(outname));
+		SV_MVDStripExtension (outname);
+		strlcat (outname, va("_%d-%d", (int)from, (int)to), sizeof(outname));
+	}
+	COM_DefaultExtension (outname, ".mvd");
+
+	if (strstr (outname, "..") || strchr (outname, '/') || strchr (outname, '\\') || !strcmp (outname, name))
+	{
+		Con_Printf ("bad output name %s\n", outname);
+		fclose (idxf);
+		fclose (demof);
+		return;
+	}
+
+	// same as recording, do not truncate a demo someone may be downloading
+	Sys_remove (va("%s/%s/%s", fs_gamedir, sv_demoDir.string, outname));
+	if (!(outf = fopen (va("%s/%s/%s", fs_gamedir, sv_demoDir.string, outname), "wb")))
+	{
+		Con_Printf ("couldn't open %s for writing\n", outname);
+		fclose (idxf);
+		fclose (demof);
+		return;
+	}
+
+	// gamestate, then demo data it is valid for
+	len = 0;
+	if (snaplen)
+	{
+		fseek (idxf, snappos, SEEK_SET);
+		for (len = snaplen; len > 0; len -= n)
+		{
+			if ((n = fread (buf, 1, min(len, (int) sizeof(buf)), idxf)) <= 0)
+				break;
+			fwrite (buf, 1, n, outf);
+		}
+	}
+
+	fseek (demof, snapoffset, SEEK_SET);
+	for (offset = snapoffset; len <= 0 && (endoffset < 0 || offset < endoffset); offset += n)
+	{
+		n = sizeof(buf);
+		if (endoffset >= 0)
+			n = min(n, endoffset - offset);
+		if ((n = fread (buf, 1, n, demof)) <= 0)
+			break;
+		fwrite (buf, 1, n, outf);
+	}
+
+	if (len > 0 || ferror (outf))
+		Con_Printf ("error while cutting %s\n", name);
+	else
+		Con_Printf ("%s: %d KB cut to %s in %.1f ms\n", name, (snaplen + offset - snapoffset) / 1024,
+					outname, (Sys_DoubleTime () - start) * 1000);
+
+	fclose (outf);
+	fclose (idxf);
+	fclose (demof);
+
+	SV_DemoCatUpdate (sv_demoDir.string, outname);
+}
+
+void SV_MVDIndexInit (void)
+{
+	Cvar_Register (&sv_demoIndex);
+	Cvar_Register (&sv_demoIndexSnapshot);
+
+	Cmd_AddCommand ("sv_democut", SV_MVDCut_f);
+}
@@ -0,0 +1,500 @@
+/*
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+//	sv_demo_io.c - demo writer thread
+//
+//	file dests attached here are written by a separate thread which owns
+//	their FILE. each dest has two cache buffers: game thread fills one while
+//	the writer drains the other, filled buffers are passed through a single
+//	producer/single consumer queue.
+//	with sv_demoCompress the writer also gzips the stream, so compression
+//	never costs the game thread anything.
+//	other files written along with a demo (its index) are attached with
+//	SV_DemoIO_AttachFile and filled through SV_DemoIO_Reserve instead.
+
+#include "qwsvdef.h"
+#ifdef WITH_ZLIB
+#include <zlib.h>
+#endif
+
+#define DEMOIO_QUEUE		64			// power of 2
+#define DEMOIO_FILEBUF		0x40000		// cache for DEST_FILE dests, they are handed off every frame
+
+#ifdef _WIN32
+#define DEMOIO_BARRIER()	MemoryBarrier()
+#else
+#define DEMOIO_BARRIER()	__sync_synchronize()
+#endif
+
+cvar_t	sv_demoAsync = {"sv_demoAsync", "1"};	// write demo files from a separate thread
+cvar_t	sv_demoCompress = {"sv_demoCompress", "0"};	// gzip level of new demos, 0 is off
+
+struct demoio_s
+{
+	FILE			*file;
+
+	char			*buf[2];
+	volatile int	busy[2];		// buffer is queued or being written
+	int				cur;			// buffer game thread is filling
+	int				bufsize;
+	int				used;			// of cur, for files not of a dest
+
+	volatile int	error;
+	volatile int	closed;
+
+	int				level;			// gzip level, 0 if written plain
+#ifdef WITH_ZLIB
+	z_stream		*zs;
+#endif
+	unsigned int	rawbytes;		// given to writer
+	unsigned int	filebytes;		// written to file
+	double			cputime;		// writer time spent on this dest
+};
+
+typedef struct demoiojob_s
+{
+	demoio_t	*io;
+	int			buf;
+	int			len;				// -1 means close the file
+} demoiojob_t;
+
+static demoiojob_t			demoio_queue[DEMOIO_QUEUE];
+static volatile unsigned	demoio_head;	// written by game thread only
+static volatile unsigned	demoio_tail;	// written by writer thread only
+static qbool				demoio_running;
+
+demoiostats_t demoio_stats;
+
+static void SV_DemoIO_Write (demoio_t *io, char *data, int len, qbool finish)
+{
+#ifdef WITH_ZLIB
+	char out[0x10000];
+	int n;
+
+	if (io->zs)
+	{
+		io->zs->next_in = (Bytef *) data;
+		io->zs->avail_in = len;
+
+		do
+		{
+			io->zs->next_out = (Bytef *) out;
+			io->zs->avail_out = sizeof(out);
+			if (deflate (io->zs, finish ? Z_FINISH : Z_NO_FLUSH) == Z_STREAM_ERROR)
+			{
+				io->error = true;
+				return;
+			}
+
+			n = sizeof(out) - io->zs->avail_out;
+			if (n && (int) fwrite (out, 1, n, io->file) != n)
+			{
+				io->error = true;
+				return;
+			}
+			io->filebytes += n;
+		}
+		while (!io->zs->avail_out);
+
+		io->rawbytes += len;
+		return;
+	}
+#endif
+
+	if (len && (int) fwrite (data, 1, len, io->file) != len)
+	{
+		io->error = true;
+		return;
+	}
+	if (fflush (io->file))
+		io->error = true;
+
+	io->rawbytes += len;
+	io->filebytes += len;
+}
+
+static DWORD WINAPI SV_DemoIO_Thread (void *unused)
+{
+	demoiojob_t *job;
+	demoio_t *io;
+	double start;
+
+	while (1)
+	{
+		if (demoio_tail == demoio_head)
+		{
+			Sys_Sleep (1);
+			continue;
+		}
+
+		DEMOIO_BARRIER ();
+		job = &demoio_queue[demoio_tail & (DEMOIO_QUEUE - 1)];
+		io = job->io;
+		start = Sys_DoubleTime ();
+
+		if (job->len < 0)
+		{
+#ifdef WITH_ZLIB
+			if (io->zs)
+			{
+				if (!io->error)
+					SV_DemoIO_Write (io, NULL, 0, true);
+				deflateEnd (io->zs);
+				Q_free (io->zs);
+			}
+#endif
+			if (fclose (io->file))
+				io->error = true;
+			io->file = NULL;
+			io->cputime += Sys_DoubleTime () - start;
+			DEMOIO_BARRIER ();
+			io->closed = true;
+		}
+		else
+		{
+			if (!io->error)
+				SV_DemoIO_Write (io, io->buf[job->buf], job->len, false);
+			io->cputime += Sys_DoubleTime () - start;
+			DEMOIO_BARRIER ();
+			io->busy[job->buf] = false;
+		}
+
+		demoio_stats.writertime += Sys_DoubleTime () - start;
+
+		DEMOIO_BARRIER ();
+		demoio_tail++;
+	}
+
+	return 0;
+}
+
+static void SV_DemoIO_Push (demoio_t *io, int buf, int len)
+{
+	demoiojob_t *job;
+	double start = Sys_DoubleTime ();
+
+	while (demoio_head - demoio_tail >= DEMOIO_QUEUE)
+		Sys_Sleep (1);
+
+	job = &demoio_queue[demoio_head & (DEMOIO_QUEUE - 1)];
+	job->io = io;
+	job->buf = buf;
+	job->len = len;
+
+	DEMOIO_BARRIER ();
+	demoio_head++;
+
+	demoio_stats.waittime += Sys_DoubleTime () - start;
+}
+
+static qbool SV_DemoIO_Start (void)
+{
+	if (!(int)sv_demoAsync.value)
+		return false;
+
+	if (!demoio_running)
+	{
+		if (!Sys_CreateThread (SV_DemoIO_Thread, NULL))
+		{
+			Con_Printf ("SV_DemoIO_Start: can't create writer thread\n");
+			return false;
+		}
+		demoio_running = true;
+	}
+
+	return true;
+}
+
+/*
+====================
+SV_DemoIO_CompressLevel
+
+gzip level a demo started now would be written with, 0 if it is written plain
+====================
+*/
+int SV_DemoIO_CompressLevel (void)
+{
+#ifdef WITH_ZLIB
+	if ((int)sv_demoCompress.value && SV_DemoIO_Start ())
+		return bound(1, (int)sv_demoCompress.value, 9);
+#endif
+	return 0;
+}
+
+/*
+====================
+SV_DemoIO_Attach
+
+hand file of a freshly opened file dest over to the writer thread,
+returns false if dest stays written from game thread
+====================
+*/
+qbool SV_DemoIO_Attach (mvddest_t *d, int compresslevel)
+{
+	demoio_t *io;
+
+	if (d->desttype != DEST_FILE && d->desttype != DEST_BUFFEREDFILE)
+		return false;
+	if (!SV_DemoIO_Start ())
+		return false;
+
+	io = (demoio_t *) Q_malloc (sizeof(demoio_t));
+
+#ifdef WITH_ZLIB
+	if (compresslevel)
+	{
+		io->zs = (z_stream *) Q_malloc (sizeof(z_stream));
+		// 16 + MAX_WBITS: gzip header and trailer instead of zlib ones
+		if (deflateInit2 (io->zs, compresslevel, Z_DEFLATED, 16 + MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+		{
+			Con_Printf ("SV_DemoIO_Attach: deflateInit2 failed\n");
+			Q_free (io->zs);
+			Q_free (io);
+			return false;
+		}
+		io->level = compresslevel;
+	}
+#endif
+
+	io->file = d->file;
+	d->file = NULL;
+
+	if (!d->cache)
+	{
+		d->maxcachesize = DEMOIO_FILEBUF;
+		d->cache = (char *) Q_malloc (d->maxcachesize);
+	}
+	io->bufsize = d->maxcachesize;
+	io->buf[0] = d->cache;
+
+	d->io = io;
+	return true;
+}
+
+// queue len bytes of the buffer being filled, returns the other one to fill next
+static char *SV_DemoIO_Swap (demoio_t *io, int len)
+{
+	double start = Sys_DoubleTime ();
+	int other;
+
+	other = !io->cur;
+	if (!io->buf[other])
+		io->buf[other] = (char *) Q_malloc (io->bufsize);
+
+	// writer is slower than we fill buffers, nothing to do but wait
+	while (io->busy[other])
+		Sys_Sleep (1);
+	DEMOIO_BARRIER ();
+
+	demoio_stats.waittime += Sys_DoubleTime () - start;
+
+	io->busy[io->cur] = true;
+	SV_DemoIO_Push (io, io->cur, len);
+
+	demoio_stats.handoffs++;
+	demoio_stats.bytes += len;
+
+	io->cur = other;
+	return io->buf[other];
+}
+
+/*
+====================
+SV_DemoIO_Handoff
+
+queue filled cache for writing and continue in the other buffer.
+returns false if the writer thread failed on this dest
+====================
+*/
+qbool SV_DemoIO_Handoff (mvddest_t *d)
+{
+	demoio_t *io = d->io;
+
+	if (io->error)
+		return false;
+	if (!d->cacheused)
+		return true;
+
+	d->cache = SV_DemoIO_Swap (d->io, d->cacheused);
+	d->cacheused = 0;
+
+	return true;
+}
+
+// queue close of the file and wait until writer has closed it
+static void SV_DemoIO_Finish (demoio_t *io)
+{
+	double start;
+
+	SV_DemoIO_Push (io, 0, -1);
+
+	start = Sys_DoubleTime ();
+	while (!io->closed)
+		Sys_Sleep (1);
+	DEMOIO_BARRIER ();
+	demoio_stats.waittime += Sys_DoubleTime () - start;
+}
+
+static void SV_DemoIO_Free (demoio_t *io)
+{
+	Q_free (io->buf[0]);
+	Q_free (io->buf[1]);
+	Q_free (io);
+}
+
+/*
+====================
+SV_DemoIO_Close
+
+write out what is left, wait until writer thread has closed the file and
+free buffers, so whoever runs after us sees a complete file
+====================
+*/
+void SV_DemoIO_Close (mvddest_t *d)
+{
+	demoio_t *io = d->io;
+
+	if (!d->error)
+		SV_DemoIO_Handoff (d);
+
+	SV_DemoIO_Finish (io);
+
+	if (io->error)
+		Sys_Printf ("SV_DemoIO_Close: write error on %s\n", d->name);
+
+	if (io->level)
+	{
+		Con_Printf ("%s: %u KB compressed to %u KB (%.1f%%), %.0f ms writer time\n", d->name,
+		            io->rawbytes / 1024, io->filebytes / 1024,
+		            io->rawbytes ? 100.0 * io->filebytes / io->rawbytes : 0.0, io->cputime * 1000);
+		demoio_stats.gzraw += io->rawbytes / 1024;
+		demoio_stats.gzfile += io->filebytes / 1024;
+		demoio_stats.gztime += io->cputime;
+	}
+
+	SV_DemoIO_Free (io);
+
+	d->io = NULL;
+	d->cache = NULL;
+	d->cacheused = 0;
+}
+
+/*
+====================
+SV_DemoIO_AttachFile
+
+hand a file written along with a demo over to the writer thread, it is
+filled through SV_DemoIO_Reserve. returns NULL if it stays with the caller
+====================
+*/
+demoio_t *SV_DemoIO_AttachFile (FILE *f, int bufsize)
+{
+	demoio_t *io;
+
+	if (!SV_DemoIO_Start ())
+		return NULL;
+
+	io = (demoio_t *) Q_malloc (sizeof(demoio_t));
+	io->file = f;
+	io->bufsize = bufsize;
+	io->buf[0] = (char *) Q_malloc (bufsize);
+
+	return io;
+}
+
+/*
+====================
+SV_DemoIO_Reserve
+
+room for len bytes in the buffer being filled, a full buffer is queued
+first. NULL if len is more than a buffer or the writer failed on the file
+====================
+*/
+char *SV_DemoIO_Reserve (demoio_t *io, int len)
+{
+	char *p;
+
+	if (io->error || len > io->bufsize)
+		return NULL;
+
+	if (io->used + len > io->bufsize)
+	{
+		SV_DemoIO_Swap (io, io->used);
+		io->used = 0;
+	}
+
+	p = io->buf[io->cur] + io->used;
+	io->used += len;
+
+	return p;
+}
+
+// queue what was reserved so far
+void SV_DemoIO_FlushFile (demoio_t *io)
+{
+	if (!io->used || io->error)
+		return;
+
+	SV_DemoIO_Swap (io, io->used);
+	io->used = 0;
+}
+
+/*
+====================
+SV_DemoIO_CloseFile
+
+write out the rest and wait until the file is closed, false on write error
+====================
+*/
+qbool SV_DemoIO_CloseFile (demoio_t *io)
+{
+	qbool ok;
+
+	SV_DemoIO_FlushFile (io);
+	SV_DemoIO_Finish (io);
+
+	ok = !io->error;
+	SV_DemoIO_Free (io);
+
+	return ok;
+}
+
+static void SV_DemoIO_Stats_f (void)
+{
+	Con_Printf ("writer thread : %s\n", demoio_running ? "running" : "not started");
+	Con_Printf ("game thread io: %.1f ms (%.1f ms waiting for writer)\n", demoio_stats.gametime * 1000, demoio_stats.waittime * 1000);
+	Con_Printf ("writer thread : %.1f ms\n", demoio_stats.writertime * 1000);
+	Con_Printf ("handed off    : %u buffers, %u KB\n", demoio_stats.handoffs, demoio_stats.bytes / 1024);
+	if (demoio_stats.gzraw)
+		Con_Printf ("compressed    : %u KB to %u KB (%.1f%%), %.0f ms\n", demoio_stats.gzraw, demoio_stats.gzfile,
+		            100.0 * demoio_stats.gzfile / demoio_stats.gzraw, demoio_stats.gztime * 1000);
+#ifndef WITH_ZLIB
+	Con_Printf ("compression   : not compiled in\n");
+#endif
+
+	if (Cmd_Argc () > 1 && !strcmp (Cmd_Argv (1), "reset"))
+		memset (&demoio_stats, 0, sizeof(demoio_stats));
+}
+
+void SV_DemoIO_Init (void)
+{
+	Cvar_Register (&sv_demoAsync);
+	Cvar_Register (&sv_demoCompress);
+
+	Cmd_AddCommand ("sv_demoiostats", SV_DemoIO_Stats_f);
+}
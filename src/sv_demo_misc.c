@@ -153,7 +153,7 @@ void sv_demoDir_OnChange (cvar_t *cvar, char *value, qbool *cancel)
 ====================
 SV_DirSizeCheck
 
-Deletes sv_demoClearOld files from demo dir if out of space
+Deletes sv_demoClearOld demos, with their .txt and .idx, from demo dir if out of space
 ====================
 */
 qbool SV_DirSizeCheck (void)
@@ -161,10 +161,11 @@ qbool SV_DirSizeCheck (void)
 	dir_t	dir;
 	file_t	*list;
 	int	n;
+	char	path[MAX_OSPATH];
 
 	if ((int)sv_demoMaxDirSize.value)
 	{
-		dir = Sys_listdir(va("%s/%s", fs_gamedir, sv_demoDir.string), ".*", SORT_NO/*BY_DATE*/);
+		dir = SV_DemoDir(".*", SORT_NO);
 		if ((float)dir.size > sv_demoMaxDirSize.value * 1024)
 		{
 			if ((int)sv_demoClearOld.value <= 0)
@@ -172,25 +173,24 @@ qbool SV_DirSizeCheck (void)
 				Con_Printf("Insufficient directory space, increase sv_demoMaxDirSize\n");
 				return false;
 			}
-			list = dir.files;
 			n = (int) sv_demoClearOld.value;
 			Con_Printf("Clearing %d old demos\n", n);
-			// HACK!!! HACK!!! HACK!!!
-			if ((int)sv_demotxt.value) // if our server record demos and txts, then to remove
-				n <<= 1;  // 50 demos, we have to remove 50 demos and 50 txts = 50*2 = 100 files
 
-			qsort((void *)list, dir.numfiles, sizeof(file_t), Sys_compare_by_date);
-			for (; list->name[0] && n > 0; list++)
+			dir = SV_DemoDir(sv_demoRegexp.string, SORT_BY_DATE);
+			for (list = dir.files; list->name[0] && n > 0; list++)
 			{
 				if (list->isdir)
 					continue;
-				Sys_remove(va("%s/%s/%s", fs_gamedir, sv_demoDir.string, list->name));
-				//Con_Printf("Remove %d - %s/%s/%s\n", n, fs_gamedir, sv_demoDir.string, list->name);
+				// a cut path could name some other file
+				if (snprintf(path, MAX_OSPATH, "%s/%s/%s", fs_gamedir, sv_demoDir.string, list->name) >= MAX_OSPATH)
+					continue;
+				Sys_remove(path);
+				SV_MVDStripExtension(path);
+				Sys_remove(va("%s.txt", path));
+				Sys_remove(va("%s%s", path, MVD_INDEX_EXT));
+				SV_DemoCatUpdateDemo(sv_demoDir.string, list->name);
 				n--;
 			}
-
-			// force cache rebuild.
-			FS_FlushFSHash();
 		}
 	}
 	return true;
@@ -201,7 +201,8 @@ void Run_sv_demotxt_and_sv_onrecordfinish (const char *dest_name, const char *de
 	char path[MAX_OSPATH];
 
 	snprintf(path, MAX_OSPATH, "%s/%s/%s", fs_gamedir, dest_path, dest_name);
-	strlcpy(path + strlen(path) - 3, "txt", MAX_OSPATH - strlen(path) + 3);
+	SV_MVDStripExtension(path);
+	strlcat(path, ".txt", MAX_OSPATH);
 
 	if ((int)sv_demotxt.value && !destroyfiles) // dont keep txt's for deleted demos
 	{
@@ -222,6 +223,9 @@ void Run_sv_demotxt_and_sv_onrecordfinish (const char *dest_name, const char *de
 		}
 	}
 
+	if (!destroyfiles)
+		SV_DemoCatFinish(dest_path, dest_name);
+
 	if (sv_onrecordfinish.string[0] && !destroyfiles) // dont gzip deleted demos
 	{
 		extern redirect_t sv_redirected;
@@ -232,7 +236,7 @@ void Run_sv_demotxt_and_sv_onrecordfinish (const char *dest_name, const char *de
 			*p = 0; // strip parameters
 	
 		strlcpy(path, dest_name, sizeof(path));
-		COM_StripExtension(path);
+		SV_MVDStripExtension(path);
 	
 		sv_redirected = RD_NONE; // onrecord script is called always from the console
 		Cmd_TokenizeString(va("script %s \"%s\" \"%s\" %s", sv_onrecordfinish.string, dest_path, path, p != NULL ? p+1 : ""));
@@ -244,9 +248,6 @@ void Run_sv_demotxt_and_sv_onrecordfinish (const char *dest_name, const char *de
 	
 		sv_redirected = old;
 	}
-
-	// force cache rebuild.
-	FS_FlushFSHash();
 }
 
 char *SV_PrintTeams (void)
@@ -349,17 +350,16 @@ void SV_DemoList (qbool use_regex)
 	file_t	*list;
 	float	free_space;
 	int		i, j, n;
-	int		files[MAX_DIRFILES + 1];
+	int		*files;
 
 	int	r;
 	pcre	*preg;
 	const char	*errbuf;
 
-	memset(files, 0, sizeof(files));
-
 	Con_Printf("Listing content of %s/%s/%s\n", fs_gamedir, sv_demoDir.string, sv_demoRegexp.string);
-	dir = Sys_listdir(va("%s/%s", fs_gamedir, sv_demoDir.string), sv_demoRegexp.string, SORT_BY_DATE);
+	dir = SV_DemoDir(sv_demoRegexp.string, SORT_BY_DATE);
 	list = dir.files;
+	files = (int *) Q_malloc((dir.numfiles + 1) * sizeof(int));
 	if (!list->name[0])
 	{
 		Con_Printf("no demos\n");
@@ -414,6 +414,7 @@ void SV_DemoList (qbool use_regex)
 		else
 			Con_Printf("%4d: %s (%dk)\n", i, list[i - 1].name, list[i - 1].size / 1024);
 	}
+	Q_free(files);
 
 	for (d = demo.dest; d; d = d->nextdest)
 	{
@@ -454,16 +455,17 @@ char *SV_MVDNum (int num)
 	if (num & 0xFF000000)
 	{
 		char *name = demo.lastdemosname[(demo.lastdemospos - (num >> 24) + 1) & 0xF];
-		char *name2;
-		int c;
+		char *name2, base[MAX_OSPATH];
 
-		if (!(name2 = quote(name)))
+		if (!name)
+			return NULL;
+
+		strlcpy(base, name, sizeof(base));
+		SV_MVDStripExtension(base); // crop '.mvd' or '.mvd.gz'
+		if (!(name2 = quote(base)))
 			return NULL;
-		if ((c = strlen(name2)) > 5)
-			name2[c - 5] = '\0'; // crop quoted extension '\.mvd'
 
-		dir = Sys_listdir(va("%s/%s", fs_gamedir, sv_demoDir.string),
-						  va("^%s%s", name2, sv_demoRegexp.string), SORT_NO);
+		dir = SV_DemoDir(va("^%s%s", name2, sv_demoRegexp.string), SORT_NO);
 		list = dir.files;
 		if (dir.numfiles > 1)
 		{
@@ -481,7 +483,7 @@ char *SV_MVDNum (int num)
 		return dir.files[0].name;
 	}
 
-	dir = Sys_listdir(va("%s/%s", fs_gamedir, sv_demoDir.string), sv_demoRegexp.string, SORT_BY_DATE);
+	dir = SV_DemoDir(sv_demoRegexp.string, SORT_BY_DATE);
 	list = dir.files;
 
 	if (num & 0x00800000)
@@ -506,6 +508,23 @@ char *SV_MVDNum (int num)
 	return list->name[0] ? list->name : NULL;
 }
 
+/*
+====================
+SV_MVDStripExtension
+
+cut '.mvd' or compressed '.mvd.gz' off demo name
+====================
+*/
+void SV_MVDStripExtension (char *name)
+{
+	int len = strlen(name), extlen = strlen(MVD_COMPRESSED_EXT);
+
+	if (len > extlen && !strcasecmp(name + len - extlen, MVD_COMPRESSED_EXT))
+		name[len -= extlen] = 0;
+	if (len > 4 && !strcasecmp(name + len - 4, ".mvd"))
+		name[len - 4] = 0;
+}
+
 #define OVECCOUNT 3
 static char *SV_MVDName2Txt (char *name)
 {
@@ -590,7 +609,7 @@ void SV_MVDRemove_f (void)
 		// remove all demos with specified token
 		ptr++;
 
-		dir = Sys_listdir(va("%s/%s", fs_gamedir, sv_demoDir.string), sv_demoRegexp.string, SORT_BY_DATE);
+		dir = SV_DemoDir(sv_demoRegexp.string, SORT_BY_DATE);
 		list = dir.files;
 		for (i = 0;list->name[0]; list++)
 		{
@@ -608,6 +627,9 @@ void SV_MVDRemove_f (void)
 				}
 
 				Sys_remove(SV_MVDName2Txt(path));
+				SV_MVDStripExtension(path);
+				Sys_remove(va("%s%s", path, MVD_INDEX_EXT));
+				SV_DemoCatUpdateDemo(sv_demoDir.string, list->name);
 			}
 		}
 
@@ -620,9 +642,6 @@ void SV_MVDRemove_f (void)
 			Con_Printf("no match found\n");
 		}
 
-		// force cache rebuild.
-		FS_FlushFSHash();
-
 		return;
 	}
 
@@ -631,6 +650,13 @@ void SV_MVDRemove_f (void)
 
 	snprintf(path, MAX_OSPATH, "%s/%s/%s", fs_gamedir, sv_demoDir.string, name);
 
+	// demo may have been recorded compressed
+	if (Sys_FileTime(path) == -1 && Sys_FileTime(va("%s%s", path, MVD_COMPRESSED_EXT)) != -1)
+	{
+		strlcat(name, MVD_COMPRESSED_EXT, MAX_DEMO_NAME);
+		strlcat(path, MVD_COMPRESSED_EXT, MAX_OSPATH);
+	}
+
 	if (sv.mvdrecording && DestByName(name) /*!strcmp(name, demo.name)*/)
 		SV_MVDStop_f(); // FIXME: probably we must stop not all demos, but only partial dest
 
@@ -654,9 +680,10 @@ void SV_MVDRemove_f (void)
 		Con_Printf("unable to remove demo %s\n", name);
 
 	Sys_remove(SV_MVDName2Txt(path));
+	SV_MVDStripExtension(path);
+	Sys_remove(va("%s%s", path, MVD_INDEX_EXT));
 
-	// force cache rebuild.
-	FS_FlushFSHash();
+	SV_DemoCatUpdateDemo(sv_demoDir.string, name);
 }
 
 void SV_MVDRemoveNum_f (void)
@@ -705,9 +732,10 @@ void SV_MVDRemoveNum_f (void)
 			Con_Printf("unable to remove demo %s\n", name);
 
 		Sys_remove(SV_MVDName2Txt(path));
+		SV_MVDStripExtension(path);
+		Sys_remove(va("%s%s", path, MVD_INDEX_EXT));
 
-		// force cache rebuild.
-		FS_FlushFSHash();
+		SV_DemoCatUpdateDemo(sv_demoDir.string, name);
 	}
 	else
 		Con_Printf("invalid demo num\n");
@@ -715,7 +743,7 @@ void SV_MVDRemoveNum_f (void)
 
 void SV_MVDInfoAdd_f (void)
 {
-	char *name, *args, path[MAX_OSPATH];
+	char *name, *args, path[MAX_OSPATH], txtname[MAX_OSPATH];
 	FILE *f;
 
 	if (Cmd_Argc() < 3)
@@ -748,6 +776,7 @@ void SV_MVDInfoAdd_f (void)
 
 		snprintf(path, MAX_OSPATH, "%s/%s/%s", fs_gamedir, sv_demoDir.string, name);
 	}
+	strlcpy(txtname, strrchr(path, '/') + 1, sizeof(txtname));
 
 	if ((f = fopen(path, !strcmp(Cmd_Argv(1), "**") ? "a+b" : "a+t")) == NULL)
 	{
@@ -793,8 +822,7 @@ void SV_MVDInfoAdd_f (void)
 	fflush(f);
 	fclose(f);
 
-	// force cache rebuild.
-	FS_FlushFSHash();
+	SV_DemoCatUpdate(sv_demoDir.string, txtname);
 }
 
 void SV_MVDInfoRemove_f (void)
@@ -837,8 +865,7 @@ void SV_MVDInfoRemove_f (void)
 	else
 		Con_Printf("file %s removed\n", path);
 
-	// force cache rebuild.
-	FS_FlushFSHash();
+	SV_DemoCatUpdate(sv_demoDir.string, strrchr(path, '/') + 1);
 }
 
 void SV_MVDInfo_f (void)
@@ -914,8 +941,7 @@ void SV_LastScores_f (void)
 		if ((demos = Q_atoi(Cmd_Argv(1))) <= 0)
 			demos = MAXDEMOS;
 
-	dir = Sys_listdir(va("%s/%s", fs_gamedir, sv_demoDir.string),
-	                  sv_demoRegexp.string, SORT_BY_DATE);
+	dir = SV_DemoDir(sv_demoRegexp.string, SORT_BY_DATE);
 	if (!dir.numfiles)
 	{
 		Con_Printf("No demos.\n");
@@ -0,0 +1,558 @@
+/*
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the included (GNU.txt) GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+//	sv_demo_play.c - streaming recorded demos to QTV proxies
+//
+//	while qtv_playdemo runs, proxies passing the usual QTV handshake get the
+//	demo instead of the live game. there is one reader for all of them: demo
+//	is mapped through the download cache and released at the pace of its own
+//	timestamps, viewers are just cursors into it and send straight from the
+//	mapping. only send() touches the mapping, which fails with EFAULT rather
+//	than raising SIGBUS if the file is truncated; message headers are parsed
+//	from guarded VFS_READs. a demo which can't be mapped is read in pieces
+//	as playback gets to them.
+//	a viewer connecting after the start gets the last gamestate snapshot from
+//	the demo index and continues from its offset, without index it gets the
+//	demo from the beginning. either way it catches up as fast as it can take.
+
+#include "qwsvdef.h"
+
+#define QTVDEMO_MAX_SNAPSHOTS	1024
+#define QTVDEMO_READ_CHUNK		65536
+
+cvar_t	qtv_demospeed = {"qtv_demospeed", "1"};	// playback speed of qtv_playdemo
+
+typedef struct qtvviewer_s
+{
+	int					socket;
+	netadr_t			na;
+	int					id;
+	char				name[32];
+
+	byte				*head;		// gamestate snapshot sent before demo data
+	int					headlen;
+	unsigned int		pos;		// offset of demo data to be sent next
+
+	double				io_time;	// last time something was sent or read
+	unsigned int		sent;
+
+	struct qtvviewer_s	*next;
+} qtvviewer_t;
+
+typedef struct
+{
+	unsigned int		offset;
+	byte				*data;
+	int					len;
+} qtvsnapshot_t;
+
+static struct
+{
+	char				name[MAX_DEMO_NAME];
+	qbool				active;
+	qbool				finished;	// all data released
+
+	vfsfile_t			*file;
+	const byte			*map;		// mapping in the download cache, NULL if read into data
+	byte				*data;
+	unsigned int		loaded;		// bytes of data read so far
+	unsigned int		size;		// of data
+	unsigned int		len;
+
+	byte				*index;
+	qtvsnapshot_t		snapshots[QTVDEMO_MAX_SNAPSHOTS];
+	int					numsnapshots;
+
+	double				start;		// realtime of demo time 0
+	double				time;		// demo time of what was released
+	unsigned int		parsepos;	// next message to be released
+	unsigned int		released;	// data viewers may send, always a frame boundary
+
+	qtvviewer_t			*viewers;
+	int					numviewers;
+	int					lastid;
+
+	// cost of fan-out, latched every STATFRAMES frames
+	int					frames;
+	double				cputime;
+	double				frametime;
+	unsigned int		bytes;
+	int					viewerframes;
+	double				latched_cputime;
+	double				latched_time;
+	unsigned int		latched_bytes;
+	double				latched_viewers;
+} qtvdemo;
+
+// demo data viewers send from
+#define QTVDEMO_DATA (qtvdemo.map ? qtvdemo.map : qtvdemo.data)
+
+// make demo up to end readable from data, a piece at a time. a mapped demo is all there
+static qbool SV_QTVDemo_Load (unsigned int end)
+{
+	int len;
+
+	if (qtvdemo.map)
+		return true;
+
+	while (qtvdemo.loaded < end)
+	{
+		if (qtvdemo.loaded + QTVDEMO_READ_CHUNK > qtvdemo.size)
+		{
+			qtvdemo.size = min(max(qtvdemo.size * 2, qtvdemo.loaded + QTVDEMO_READ_CHUNK), qtvdemo.len);
+			if (!(qtvdemo.data = (byte *) realloc (qtvdemo.data, qtvdemo.size)))
+				Sys_Error ("SV_QTVDemo_Load: not enough memory for %u bytes", qtvdemo.size);
+		}
+
+		len = VFS_READ (qtvdemo.file, qtvdemo.data + qtvdemo.loaded, min(QTVDEMO_READ_CHUNK, qtvdemo.size - qtvdemo.loaded), NULL);
+		if (len <= 0)
+			return false;
+		qtvdemo.loaded += len;
+	}
+
+	return true;
+}
+
+// copy len bytes at offset, false if the file does not have them (any more)
+static qbool SV_QTVDemo_Read (unsigned int offset, byte *buf, int len)
+{
+	if (!qtvdemo.map)
+	{
+		if (!SV_QTVDemo_Load (offset + len))
+			return false;
+		memcpy (buf, qtvdemo.data + offset, len);
+		return true;
+	}
+
+	// not straight from the mapping, the file may have been truncated under it
+	return !VFS_SEEK (qtvdemo.file, offset, SEEK_SET) && VFS_READ (qtvdemo.file, buf, len, NULL) == len;
+}
+
+// length of mvd message at offset and its time, 0 if it is truncated or broken
+static unsigned int SV_QTVDemo_MessageLen (unsigned int offset, byte *msec)
+{
+	byte p[10];
+	unsigned int left = qtvdemo.len - offset, hdr;
+	int len;
+
+	// longest header in one read
+	if (left < 2 || !SV_QTVDemo_Read (offset, p, min(left, sizeof(p))))
+		return 0;
+	*msec = p[0];
+
+	switch (p[1] & 7)
+	{
+	case dem_set:
+		hdr = 10;
+		len = 0;
+		break;
+	case dem_multiple:
+		hdr = 10;
+		break;
+	case dem_read: case dem_single: case dem_stats: case dem_all:
+		hdr = 6;
+		break;
+	default:
+		return 0;
+	}
+
+	if (left < hdr)
+		return 0;
+
+	if ((p[1] & 7) != dem_set)
+	{
+		len = LittleLong (*(int *) (p + hdr - 4));
+		if (len < 0 || len > MAX_MVD_SIZE)
+			return 0;
+	}
+
+	if (hdr + len > left || !SV_QTVDemo_Load (offset + hdr + len))
+		return 0;
+
+	return hdr + len;
+}
+
+// keep snapshots of demo index, viewers joining late start from them
+static void SV_QTVDemo_LoadIndex (char *name)
+{
+	char path[MAX_OSPATH];
+	FILE *f;
+	byte *p, *end;
+	int len;
+
+	if (snprintf (path, sizeof(path), "%s/%s/%s", fs_gamedir, sv_demoDir.string, name) >= (int) sizeof(path))
+		return;
+	SV_MVDStripExtension (path);
+	if (strlcat (path, MVD_INDEX_EXT, sizeof(path)) >= sizeof(path))
+		return;
+
+	if (!(f = fopen (path, "rb")))
+		return;
+
+	fseek (f, 0, SEEK_END);
+	len = ftell (f);
+	fseek (f, 0, SEEK_SET);
+
+	qtvdemo.index = (byte *) Q_malloc (len + 1);
+	if (len < 8 || (int) fread (qtvdemo.index, 1, len, f) != len
+		|| memcmp (qtvdemo.index, MVD_INDEX_MAGIC, 4) || LittleLong (*(int *) (qtvdemo.index + 4)) != MVD_INDEX_VERSION)
+	{
+		Con_Printf ("%s: bad index\n", path);
+		Q_free (qtvdemo.index);
+		fclose (f);
+		return;
+	}
+	fclose (f);
+
+	for (p = qtvdemo.index + 8, end = qtvdemo.index + len; end - p >= 9; )
+	{
+		if (*p != MVD_INDEX_SNAPSHOT)
+		{
+			p += 9;
+			continue;
+		}
+
+		if (end - p < 13 || end - p - 13 < LittleLong (*(int *) (p + 9)))
+			break;
+
+		if (qtvdemo.numsnapshots < QTVDEMO_MAX_SNAPSHOTS)
+		{
+			qtvdemo.snapshots[qtvdemo.numsnapshots].offset = LittleLong (*(int *) (p + 1));
+			qtvdemo.snapshots[qtvdemo.numsnapshots].len = LittleLong (*(int *) (p + 9));
+			qtvdemo.snapshots[qtvdemo.numsnapshots].data = p + 13;
+			qtvdemo.numsnapshots++;
+		}
+
+		p += 13 + LittleLong (*(int *) (p + 9));
+	}
+}
+
+static void SV_QTVDemo_FreeViewer (qtvviewer_t *v)
+{
+	Con_Printf ("QTV demo viewer id:%d %s disconnected, %u KB sent\n", v->id, v->name, v->sent / 1024);
+
+	closesocket (v->socket);
+	Q_free (v);
+	qtvdemo.numviewers--;
+}
+
+static void SV_QTVDemo_Stop (void)
+{
+	qtvviewer_t *v;
+
+	if (!qtvdemo.active)
+		return;
+
+	while ((v = qtvdemo.viewers))
+	{
+		qtvdemo.viewers = v->next;
+		SV_QTVDemo_FreeViewer (v);
+	}
+
+	VFS_CLOSE (qtvdemo.file);
+	Q_free (qtvdemo.data);
+	Q_free (qtvdemo.index);
+
+	Con_Printf ("QTV demo playback of %s stopped\n", qtvdemo.name);
+
+	memset (&qtvdemo, 0, sizeof(qtvdemo));
+}
+
+static qbool SV_QTVDemo_Start (char *name)
+{
+	char path[MAX_OSPATH];
+
+	if (!strcmp (COM_FileExtension (name), "gz"))
+	{
+		Con_Printf ("compressed demos can't be streamed, gunzip %s first\n", name);
+		return false;
+	}
+
+	if (DestByName (name))
+	{
+		Con_Printf ("%s is being recorded\n", name);
+		return false;
+	}
+
+	strlcpy (path, va("%s/%s", sv_demoDir.string, name), sizeof(path));
+	// mapped through the download cache, a demo being downloaded is mapped already
+	if (!(qtvdemo.file = SV_DownloadOpen (path)))
+	{
+		Con_Printf ("couldn't open %s\n", name);
+		return false;
+	}
+
+	qtvdemo.map = SV_DownloadMapping (qtvdemo.file);
+	qtvdemo.len = VFS_GETLEN (qtvdemo.file);
+
+	strlcpy (qtvdemo.name, name, sizeof(qtvdemo.name));
+	qtvdemo.active = true;
+	qtvdemo.start = realtime;
+
+	SV_QTVDemo_LoadIndex (name);
+
+	Con_Printf ("QTV demo playback of %s started, %u KB%s, %d snapshots\n", name, qtvdemo.len / 1024,
+	            qtvdemo.map ? " mapped" : "", qtvdemo.numsnapshots);
+	return true;
+}
+
+qbool SV_QTVDemo_Playing (void)
+{
+	return qtvdemo.active && !qtvdemo.finished;
+}
+
+/*
+====================
+SV_QTVDemo_AddViewer
+
+proxy passed the handshake while a demo is played, it is served the demo
+from now on. returns false if it can't be
+====================
+*/
+qbool SV_QTVDemo_AddViewer (int socket1, netadr_t na, char *userinfo)
+{
+	qtvviewer_t *v;
+	int i;
+
+	if (!SV_QTVDemo_Playing ())
+		return false;
+	if ((int)qtv_maxstreams.value > 0 && qtvdemo.numviewers >= (int)qtv_maxstreams.value)
+		return false;
+
+	v = (qtvviewer_t *) Q_malloc (sizeof(qtvviewer_t));
+	v->socket = socket1;
+	v->na = na;
+	v->id = ++qtvdemo.lastid;
+	v->io_time = Sys_DoubleTime ();
+	strlcpy (v->name, Info_ValueForKey (userinfo, "name"), sizeof(v->name));
+
+	// latest gamestate we have for what was released so far
+	for (i = qtvdemo.numsnapshots - 1; i >= 0; i--)
+	{
+		if (qtvdemo.snapshots[i].offset <= qtvdemo.released)
+		{
+			v->head = qtvdemo.snapshots[i].data;
+			v->headlen = qtvdemo.snapshots[i].len;
+			v->pos = qtvdemo.snapshots[i].offset;
+			break;
+		}
+	}
+
+	v->next = qtvdemo.viewers;
+	qtvdemo.viewers = v;
+	qtvdemo.numviewers++;
+
+	Con_Printf ("QTV demo viewer id:%d %s connected from %s, starts at %u KB\n", v->id, v->name,
+	            NET_AdrToString (na), v->pos / 1024);
+	return true;
+}
+
+// release demo data up to current demo time
+static void SV_QTVDemo_Release (void)
+{
+	double elapsed = (realtime - qtvdemo.start) * max(0.1, qtv_demospeed.value);
+	unsigned int len;
+	byte msec;
+
+	while (qtvdemo.parsepos < qtvdemo.len)
+	{
+		if (!(len = SV_QTVDemo_MessageLen (qtvdemo.parsepos, &msec)))
+		{
+			// playback ends here, viewers are done when they have what was released
+			Con_Printf ("QTV demo %s is broken at %u\n", qtvdemo.name, qtvdemo.parsepos);
+			qtvdemo.parsepos = qtvdemo.len;
+			break;
+		}
+
+		// message with time starts a new frame, frames are released whole
+		if (msec && qtvdemo.time + msec * 0.001 > elapsed)
+			break;
+
+		qtvdemo.time += msec * 0.001;
+		qtvdemo.parsepos += len;
+		qtvdemo.released = qtvdemo.parsepos;
+	}
+
+	if (qtvdemo.parsepos >= qtvdemo.len && !qtvdemo.finished)
+	{
+		qtvdemo.finished = true;
+		Con_Printf ("QTV demo %s finished after %.0f seconds\n", qtvdemo.name, qtvdemo.time);
+	}
+}
+
+// send what viewer has not got yet, false if it has to be dropped
+static qbool SV_QTVDemo_Send (qtvviewer_t *v)
+{
+	char buf[256];
+	int len;
+
+	// proxies send commands and such, nobody is listening to them
+	while ((len = recv (v->socket, buf, sizeof(buf), 0)) > 0)
+		v->io_time = Sys_DoubleTime ();
+	if (!len || (len < 0 && qerrno != EWOULDBLOCK && qerrno != EAGAIN))
+		return false;
+
+	while (v->headlen || v->pos < qtvdemo.released)
+	{
+		if (v->headlen)
+			len = send (v->socket, (char *) v->head, v->headlen, 0);
+		else
+			len = send (v->socket, (char *) QTVDEMO_DATA + v->pos, qtvdemo.released - v->pos, 0);
+
+		if (len <= 0)
+			return len < 0 && (qerrno == EWOULDBLOCK || qerrno == EAGAIN);
+
+		if (v->headlen)
+		{
+			v->head += len;
+			v->headlen -= len;
+		}
+		else
+		{
+			v->pos += len;
+		}
+
+		v->sent += len;
+		v->io_time = Sys_DoubleTime ();
+		qtvdemo.bytes += len;
+	}
+
+	return true;
+}
+
+/*
+====================
+SV_QTVDemo_Frame
+
+called every server frame, releases demo data and sends it to viewers
+====================
+*/
+void SV_QTVDemo_Frame (void)
+{
+	qtvviewer_t *v, **link;
+	double start;
+
+	if (!qtvdemo.active)
+		return;
+
+	start = Sys_DoubleTime ();
+
+	SV_QTVDemo_Release ();
+
+	for (link = &qtvdemo.viewers; (v = *link); )
+	{
+		if (!SV_QTVDemo_Send (v) || v->io_time + qtv_streamtimeout.value <= start
+			|| (qtvdemo.finished && v->pos >= qtvdemo.released && !v->headlen))
+		{
+			*link = v->next;
+			SV_QTVDemo_FreeViewer (v);
+			continue;
+		}
+		link = &v->next;
+	}
+
+	qtvdemo.cputime += Sys_DoubleTime () - start;
+	qtvdemo.viewerframes += qtvdemo.numviewers;
+
+	if (++qtvdemo.frames == STATFRAMES)
+	{
+		qtvdemo.latched_cputime = qtvdemo.cputime;
+		qtvdemo.latched_time = start - qtvdemo.frametime;
+		qtvdemo.latched_bytes = qtvdemo.bytes;
+		qtvdemo.latched_viewers = (double) qtvdemo.viewerframes / STATFRAMES;
+
+		qtvdemo.frames = qtvdemo.viewerframes = 0;
+		qtvdemo.cputime = 0;
+		qtvdemo.bytes = 0;
+		qtvdemo.frametime = start;
+	}
+
+	if (qtvdemo.finished && !qtvdemo.viewers)
+		SV_QTVDemo_Stop ();
+}
+
+void SV_QTVDemo_Status (void)
+{
+	qtvviewer_t *v;
+	double load;
+
+	if (!qtvdemo.active)
+	{
+		Con_Printf ("Demo playback  : off\n");
+		return;
+	}
+
+	Con_Printf ("Demo playback  : %s, at %.0f seconds, %u of %u KB%s\n", qtvdemo.name, qtvdemo.time,
+	            qtvdemo.released / 1024, qtvdemo.len / 1024, qtvdemo.finished ? ", finished" : "");
+	Con_Printf ("Demo viewers   : %d\n", qtvdemo.numviewers);
+
+	for (v = qtvdemo.viewers; v; v = v->next)
+		Con_Printf ("%4d %-16s %s, %u KB sent, %u KB behind\n", v->id, v->name, NET_AdrToString (v->na),
+		            v->sent / 1024, (qtvdemo.released - v->pos + v->headlen) / 1024);
+
+	if (qtvdemo.latched_time <= 0)
+		return;
+
+	// what the fan-out costs, and how many viewers one core could feed at that rate
+	load = qtvdemo.latched_cputime / qtvdemo.latched_time;
+	Con_Printf ("Fan-out        : %.1f viewers, %.1f KB/s, %.2f%% of a core\n", qtvdemo.latched_viewers,
+	            qtvdemo.latched_bytes / 1024.0 / qtvdemo.latched_time, load * 100);
+	if (load > 0 && qtvdemo.latched_viewers > 0)
+		Con_Printf ("Viewers/core   : %.0f\n", qtvdemo.latched_viewers / load);
+}
+
+static void SV_QTVDemo_Play_f (void)
+{
+	char name[MAX_DEMO_NAME];
+
+	if (Cmd_Argc () != 2)
+	{
+		Con_Printf ("usage: %s <demoname>\n"
+		            "streams demo to QTV proxies connecting from now on, instead of the game\n", Cmd_Argv (0));
+		SV_QTVDemo_Status ();
+		return;
+	}
+
+	strlcpy (name, Cmd_Argv (1), sizeof(name));
+	COM_DefaultExtension (name, ".mvd");
+
+	if (strstr (name, "..") || strchr (name, '/') || strchr (name, '\\'))
+	{
+		Con_Printf ("bad demo name %s\n", name);
+		return;
+	}
+
+	SV_QTVDemo_Stop ();
+	SV_QTVDemo_Start (name);
+}
+
+static void SV_QTVDemo_Stop_f (void)
+{
+	if (!qtvdemo.active)
+		Con_Printf ("no demo is played\n");
+
+	SV_QTVDemo_Stop ();
+}
+
+void SV_QTVDemo_Init (void)
+{
+	Cvar_Register (&qtv_demospeed);
+
+	Cmd_AddCommand ("qtv_playdemo", SV_QTVDemo_Play_f);
+	Cmd_AddCommand ("qtv_stopdemo", SV_QTVDemo_Stop_f);
+}
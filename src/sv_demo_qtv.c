@@ -26,6 +26,420 @@ cvar_t	qtv_maxstreams		= {"qtv_maxstreams",		"1"};
 cvar_t	qtv_password		= {"qtv_password",			""};
 cvar_t	qtv_pendingtimeout	= {"qtv_pendingtimeout",	"5"};  // 5  seconds must be enough
 cvar_t	qtv_streamtimeout	= {"qtv_streamtimeout",		"45"}; // 45 seconds
+cvar_t	qtv_backpressure	= {"qtv_backpressure",		"1"};  // resync lagging proxies instead of dropping them
+cvar_t	qtv_streambuffer	= {"qtv_streambuffer",		"256"}; // KB of unsent data allowed per proxy, at least its cache size (64)
+
+//============================================================
+//
+// shared stream data
+//
+// everything broadcast to proxies is stored once in a chain of refcounted
+// chunks, each stream dest only keeps a cursor into it. chunk refs count
+// cursors sitting in the chunk, chunks are freed from the head as soon as
+// every dest has sent past them. data written to one dest only (initial
+// gamestate, handshake) still goes to its private cache which is always
+// sent before the shared data.
+//
+// DestFlush() marks chain position on every call, these are frame boundaries
+// where a proxy lagging more than qtv_streambuffer may be cut off and resynced
+// with a fresh gamestate.
+//
+
+#define QTV_CHUNK_SIZE		0x4000
+#define QTV_MAX_IOV			16
+#define QTV_MAX_MARKS		256			// power of 2
+
+typedef struct
+{
+	unsigned int	pos;
+	double			time;
+} qtvmark_t;
+
+typedef struct qtvchunk_s
+{
+	struct qtvchunk_s	*next;
+	int					refs;
+	int					used;
+	unsigned int		pos;		// stream position of data[0]
+	char				data[QTV_CHUNK_SIZE];
+} qtvchunk_t;
+
+static struct
+{
+	qtvchunk_t		*head;
+	qtvchunk_t		*tail;
+	unsigned int	pos;			// stream position of end of tail
+	int				numdests;		// cursors attached
+	int				numchunks;
+
+	qtvmark_t		marks[QTV_MAX_MARKS];
+	unsigned int	nummarks;
+} qtvchain;
+
+static int QTV_ChainPending (mvddest_t *d)
+{
+	return d->chunk ? (int)(qtvchain.pos - (d->chunk->pos + d->chunkofs)) : 0;
+}
+
+// free chunks nobody is going to send any more
+static void QTV_ChainTrim (void)
+{
+	qtvchunk_t *c;
+
+	while ((c = qtvchain.head) && !c->refs && c != qtvchain.tail)
+	{
+		qtvchain.head = c->next;
+		Q_free (c);
+		qtvchain.numchunks--;
+	}
+
+	// nobody attached, tail data is not needed either
+	if (c && !c->refs)
+		c->used = 0, c->pos = qtvchain.pos;
+}
+
+static void QTV_ChainAttach (mvddest_t *d)
+{
+	if (!qtvchain.tail)
+	{
+		qtvchain.head = qtvchain.tail = (qtvchunk_t *) Q_malloc (sizeof(qtvchunk_t));
+		qtvchain.tail->pos = qtvchain.pos;
+		qtvchain.numchunks++;
+	}
+
+	d->chunk = qtvchain.tail;
+	d->chunkofs = qtvchain.tail->used;
+	d->chunk->refs++;
+	qtvchain.numdests++;
+}
+
+void QTV_ChainRelease (mvddest_t *d)
+{
+	if (!d->chunk)
+		return;
+
+	d->chunk->refs--;
+	d->chunk = NULL;
+	qtvchain.numdests--;
+
+	QTV_ChainTrim ();
+}
+
+// move cursor forward by len bytes, len must not exceed pending data
+static void QTV_ChainAdvance (mvddest_t *d, int len)
+{
+	int avail;
+
+	while (len > 0)
+	{
+		avail = d->chunk->used - d->chunkofs;
+		if (len < avail || !d->chunk->next)
+		{
+			d->chunkofs += min(len, avail);
+			break;
+		}
+
+		len -= avail;
+		d->chunk->refs--;
+		d->chunk = d->chunk->next;
+		d->chunk->refs++;
+		d->chunkofs = 0;
+	}
+
+	// cursor at the end of a full chunk may step over right away
+	if (d->chunkofs == d->chunk->used && d->chunk->next)
+	{
+		d->chunk->refs--;
+		d->chunk = d->chunk->next;
+		d->chunk->refs++;
+		d->chunkofs = 0;
+	}
+
+	QTV_ChainTrim ();
+}
+
+/*
+====================
+QTV_ChainWrite
+
+append data for all proxies, it is stored once no matter how many are connected
+====================
+*/
+void QTV_ChainWrite (void *data, int len)
+{
+	mvddest_t *d;
+	qtvchunk_t *c;
+	char *p = (char *) data;
+	int n;
+
+	if (!qtvchain.numdests || len <= 0)
+		return;
+
+	while (len > 0)
+	{
+		c = qtvchain.tail;
+		if (c->used == QTV_CHUNK_SIZE)
+		{
+			c = (qtvchunk_t *) Q_malloc (sizeof(qtvchunk_t));
+			c->pos = qtvchain.pos;
+			qtvchain.tail->next = c;
+			qtvchain.tail = c;
+			qtvchain.numchunks++;
+		}
+
+		n = min(len, QTV_CHUNK_SIZE - c->used);
+		memcpy (c->data + c->used, p, n);
+		c->used += n;
+		qtvchain.pos += n;
+		p += n;
+		len -= n;
+	}
+
+	len = p - (char *) data;
+
+	for (d = demo.dest; d; d = d->nextdest)
+	{
+		if (d->desttype != DEST_STREAM || d->error || !d->chunk)
+			continue;
+
+		d->totalsize += len;
+	}
+}
+
+/*
+====================
+QTV_ChainMark
+
+remember current end of shared data as a point where stream may be cut,
+must be called between demo frames
+====================
+*/
+void QTV_ChainMark (void)
+{
+	qtvmark_t *m;
+
+	if (!qtvchain.numdests)
+		return;
+	if (qtvchain.nummarks && qtvchain.marks[(qtvchain.nummarks - 1) & (QTV_MAX_MARKS - 1)].pos == qtvchain.pos)
+		return;
+
+	m = &qtvchain.marks[qtvchain.nummarks++ & (QTV_MAX_MARKS - 1)];
+	m->pos = qtvchain.pos;
+	m->time = demo.time;
+}
+
+// first remembered frame boundary at or after pos, chain end is always one
+static qtvmark_t *QTV_ChainFindMark (unsigned int pos)
+{
+	unsigned int i = qtvchain.nummarks > QTV_MAX_MARKS ? qtvchain.nummarks - QTV_MAX_MARKS : 0;
+	qtvmark_t *m;
+
+	for ( ; i < qtvchain.nummarks; i++)
+	{
+		m = &qtvchain.marks[i & (QTV_MAX_MARKS - 1)];
+		if ((int)(m->pos - pos) >= 0)
+			return m;
+	}
+
+	return NULL;
+}
+
+// copy len bytes of shared data dest has not sent yet into its private cache
+static qbool QTV_ChainCopy (mvddest_t *d, int len)
+{
+	qtvchunk_t *c;
+	int n, ofs, left;
+
+	if (d->cacheused + len > d->maxcachesize)
+	{
+		Sys_Printf ("QTV_ChainCopy: cache overflow %d > %d\n", d->cacheused + len, d->maxcachesize);
+		d->error = true;
+		return false;
+	}
+
+	for (c = d->chunk, ofs = d->chunkofs, left = len; c && left > 0; c = c->next, ofs = 0)
+	{
+		n = min(left, c->used - ofs);
+		memcpy (d->cache + d->cacheused, c->data + ofs, n);
+		d->cacheused += n;
+		left -= n;
+	}
+
+	QTV_ChainAdvance (d, len);
+	return true;
+}
+
+/*
+====================
+QTV_ChainToCache
+
+copy shared data dest has not sent yet into its private cache,
+so data written to this dest alone keeps its place in the stream
+====================
+*/
+qbool QTV_ChainToCache (mvddest_t *d)
+{
+	int pending = QTV_ChainPending(d);
+
+	return pending ? QTV_ChainCopy (d, pending) : true;
+}
+
+/*
+====================
+QTV_StreamSend
+
+send private cache followed by pending shared data with one call,
+returns what send() would
+====================
+*/
+int QTV_StreamSend (mvddest_t *d)
+{
+	qtvchunk_t *c;
+	int ofs, cnt = 0, len;
+#ifdef _WIN32
+	WSABUF iov[QTV_MAX_IOV];
+	DWORD sent;
+#else
+	struct iovec iov[QTV_MAX_IOV];
+#endif
+
+	if (d->cacheused)
+	{
+#ifdef _WIN32
+		iov[cnt].buf = d->cache;
+		iov[cnt].len = d->cacheused;
+#else
+		iov[cnt].iov_base = d->cache;
+		iov[cnt].iov_len = d->cacheused;
+#endif
+		cnt++;
+	}
+
+	for (c = d->chunk, ofs = d->chunkofs; c && cnt < QTV_MAX_IOV; c = c->next, ofs = 0)
+	{
+		if (c->used == ofs)
+			continue;
+#ifdef _WIN32
+		iov[cnt].buf = c->data + ofs;
+		iov[cnt].len = c->used - ofs;
+#else
+		iov[cnt].iov_base = c->data + ofs;
+		iov[cnt].iov_len = c->used - ofs;
+#endif
+		cnt++;
+	}
+
+	if (!cnt)
+		return 0;
+
+#ifdef _WIN32
+	if (WSASend (d->socket, iov, cnt, &sent, 0, NULL, NULL) == SOCKET_ERROR)
+		return -1;
+	len = sent;
+#else
+	len = writev (d->socket, iov, cnt);
+	if (len < 0)
+		return -1;
+#endif
+
+	ofs = min(len, d->cacheused);
+	if (ofs)
+	{
+		d->cacheused -= ofs;
+		memmove (d->cache, d->cache + ofs, d->cacheused);
+	}
+	if (len > ofs)
+		QTV_ChainAdvance (d, len - ofs);
+
+	return len;
+}
+
+/*
+====================
+QTV_StreamCheckLag
+
+called by DestFlush() after sending, at a frame boundary.
+a proxy with more than qtv_streambuffer KB unsent is cut at the first frame
+boundary after what it already got and detached from shared data. once it has
+sent what was left it gets a fresh gamestate, as a newly connected one does.
+the limit is never below the size of the proxy's private cache, which may be
+full of data not sent yet without the proxy being behind at all.
+a proxy whose place in shared data can't be found is dropped
+====================
+*/
+void QTV_StreamCheckLag (mvddest_t *d, qbool canresync)
+{
+	qtvmark_t *m;
+	int limit;
+
+	if (d->error)
+		return;
+
+	d->lag = d->cacheused + QTV_ChainPending(d);
+	d->maxlag = max(d->maxlag, d->lag);
+
+	if (d->resync)
+	{
+		if (d->cacheused || !canresync)
+			return;
+
+		QTV_ChainAttach (d);
+		d->resync = false;
+		d->resyncs++;
+		SV_MVD_SendInitialGamestate (d);
+		return;
+	}
+
+	limit = max(d->maxcachesize, (int)qtv_streambuffer.value * 1024);
+	if (d->lag <= limit)
+		return;
+
+	if (!(int)qtv_backpressure.value)
+	{
+		Sys_Printf ("QTV_StreamCheckLag: stream overflow %d > %d\n", d->lag, limit);
+		d->error = true;
+		return;
+	}
+
+	// private cache always ends on a message boundary, shared data
+	// is only needed to finish the message being sent
+	if (!d->cacheused && d->chunk)
+	{
+		if (!(m = QTV_ChainFindMark (d->chunk->pos + d->chunkofs)))
+		{
+			Sys_Printf ("QTV_StreamCheckLag: id:%d has no frame boundary ahead, dropping it\n", d->id);
+			d->error = true;
+			return;
+		}
+		if (!QTV_ChainCopy (d, m->pos - (d->chunk->pos + d->chunkofs)))
+			return;
+	}
+
+	Sys_Printf ("QTV id:%d is %d KB behind, resyncing\n", d->id, d->lag / 1024);
+
+	QTV_ChainRelease (d);
+	d->resync = true;
+}
+
+// seconds of game time proxy is behind, -1 while it waits for resync
+static double QTV_StreamLagTime (mvddest_t *d)
+{
+	qtvmark_t *m;
+
+	if (d->resync)
+		return -1;
+	if (!d->chunk || !(m = QTV_ChainFindMark (d->chunk->pos + d->chunkofs)))
+		return 0;
+
+	return max(0, demo.time - m->time);
+}
+
+static void QTV_ChainStatus (void)
+{
+	Con_Printf ("Shared data    : %d KB in %d chunks\n", qtvchain.numchunks * (int)sizeof(qtvchunk_t) / 1024, qtvchain.numchunks);
+}
+
+//============================================================
 
 static mvddest_t *SV_InitStream (int socket1, netadr_t na, char *userinfo)
 {
@@ -62,6 +476,8 @@ static mvddest_t *SV_InitStream (int socket1, netadr_t na, char *userinfo)
 	dst->id = ++lastdest;
 	dst->na = na;
 
+	QTV_ChainAttach(dst);
+
 	strlcpy(dst->qtvname, name, sizeof(dst->qtvname));
 
 	if (dst->qtvname[0])
@@ -596,6 +1012,11 @@ void SV_MVD_RunPendingConnections (void)
 						{
 							e =	"";
 						}
+						else if (SV_QTVDemo_Playing())
+						{
+							if (SV_QTVDemo_AddViewer(p->socket, p->na, userinfo))
+								p->socket = -1;	//so it's not cleared wrongly.
+						}
 						else
 						{
 							mvddest_t *tmpdest;
@@ -618,7 +1039,25 @@ void SV_MVD_RunPendingConnections (void)
 					}
 					else
 					{
-						if (p->hasauthed == true)
+						if (p->hasauthed == true && SV_QTVDemo_Playing())
+						{
+							// viewer gets nothing before next frame, BEGIN goes first
+							if (SV_QTVDemo_AddViewer(p->socket, p->na, userinfo))
+							{
+								e = ("QTVSV 1\n"
+								 	"BEGIN\n\n");
+								send(p->socket, e, strlen(e), 0);
+								e = NULL;
+
+								p->socket = -1;	//so it's not cleared wrongly.
+							}
+							else
+							{
+								e = ("QTVSV 1\n"
+									"ERROR: Can't init stream, probably server reach a limit on the number of proxies connected at any one time.\n\n");
+							}
+						}
+						else if (p->hasauthed == true)
 						{
 							mvddest_t *tmpdest;
 
@@ -1270,7 +1709,6 @@ void DemoWriteQTVTimePad (int msecs)	//broadcast to all proxies
 //broadcast to all proxies
 void DemoWriteQTV (sizebuf_t *msg)
 {
-	mvddest_t		*d;
 	sizebuf_t		mvdheader;
 	byte			mvdheader_buf[6];
 
@@ -1283,20 +1721,15 @@ void DemoWriteQTV (sizebuf_t *msg)
 	//length
 	MSG_WriteLong (&mvdheader, msg->cursize);
 
-	for (d = demo.dest; d; d = d->nextdest)
-	{
-		if (d->desttype == DEST_STREAM)
-		{
-			DemoWriteDest(mvdheader.data, mvdheader.cursize, d);
-			DemoWriteDest(msg->data, msg->cursize, d);
-		}
-	}
+	QTV_ChainWrite(mvdheader.data, mvdheader.cursize);
+	QTV_ChainWrite(msg->data, msg->cursize);
 }
 
 void Qtv_List_f(void)
 {
 	mvddest_t *d;
 	int cnt;
+	double lagtime;
 
 	for (cnt = 0, d = demo.dest; d; d = d->nextdest)
 	{
@@ -1305,11 +1738,13 @@ void Qtv_List_f(void)
 
 		if (!cnt) // print banner
 			Con_Printf ("QTV list:\n"
-						"%4.4s %s\n", "#Id", "Addr");
+						"%4.4s %-21.21s %6.6s %6.6s %5.5s %4.4s\n", "#Id", "Addr", "LagKB", "MaxKB", "Sec", "Sync");
 
 		cnt++;
 
-		Con_Printf ("%4d %s\n", d->id, NET_AdrToString(d->na));
+		lagtime = QTV_StreamLagTime(d);
+		Con_Printf ("%4d %-21.21s %6d %6d %5s %4d\n", d->id, NET_AdrToString(d->na), d->lag / 1024, d->maxlag / 1024,
+					lagtime < 0 ? "sync" : va("%.1f", lagtime), d->resyncs);
 	}
 
 	if (!cnt)
@@ -1377,6 +1812,9 @@ void Qtv_Status_f(void)
 		cnt++;
 
 	Con_Printf ("Pending streams: %d\n", cnt);
+
+	QTV_ChainStatus();
+	SV_QTVDemo_Status();
 }
 
 //====================================
@@ -1388,8 +1826,12 @@ void SV_QTV_Init(void)
 	Cvar_Register (&qtv_password);
 	Cvar_Register (&qtv_pendingtimeout);
 	Cvar_Register (&qtv_streamtimeout);
+	Cvar_Register (&qtv_backpressure);
+	Cvar_Register (&qtv_streambuffer);
 
 	Cmd_AddCommand ("qtv_list", Qtv_List_f);
 	Cmd_AddCommand ("qtv_close", Qtv_Close_f);
 	Cmd_AddCommand ("qtv_status", Qtv_Status_f);
+
+	SV_QTVDemo_Init();
 }
@@ -0,0 +1,456 @@
+/*
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the included (GNU.txt) GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+//	sv_dlcache.c - shared download cache
+//
+//	file being downloaded is mapped into memory once and shared by all
+//	clients downloading it, pak entries are mapped as a range of the pak.
+//	each download gets its own vfsfile_t reading from the mapping, so the
+//	download code does not change.
+//	a mapped file which someone truncates raises SIGBUS when the pages past
+//	its new end are touched, so reads copy from the mapping with a SIGBUS
+//	handler armed for just that copy. when it fires the read comes up short,
+//	as it would from the file, and the mapping is not given to new downloads.
+//	any other SIGBUS is left to whatever handled it before. windows does not
+//	let a mapped file be truncated.
+//	chunked downloads read straight into the outgoing message, so that copy
+//	is the only one.
+
+#include "qwsvdef.h"
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <setjmp.h>
+#include <signal.h>
+#endif
+
+cvar_t	sv_downloadcache = {"sv_downloadcache", "1"};	// map downloaded files and share them between clients
+
+typedef struct dlcache_s
+{
+	char			path[MAX_OSPATH];	// file on disk, pak for pak entries
+	unsigned long	offset;				// of data in that file
+	unsigned long	len;
+	int				mtime;
+
+	byte			*map;				// what was mapped, aligned to page
+	unsigned long	maplen;
+	byte			*data;				// map + offset within the page
+#ifdef _WIN32
+	HANDLE			file;
+	HANDLE			mapping;
+#endif
+
+	int				refs;
+	unsigned int	served;				// bytes sent from this file
+	qbool			truncated;			// file got shorter under the mapping
+	struct dlcache_s *next;
+} dlcache_t;
+
+typedef struct
+{
+	vfsfile_t		funcs;				// <= must be at top/begining of struct
+	dlcache_t		*cache;
+	unsigned long	pos;
+} vfsdlcache_t;
+
+static dlcache_t	*dlcache;
+
+#ifndef _WIN32
+static sigjmp_buf				dlcache_fault;
+static struct sigaction			dlcache_oldbus;	// restored after the copy
+#endif
+
+static struct
+{
+	unsigned int	hits;				// opened file already mapped for someone else
+	unsigned int	misses;
+	unsigned int	fallbacks;			// could not map, read with VFS
+	unsigned int	truncations;		// mapped files which got shorter
+	double			totalkb;
+
+	int				frames;
+	unsigned int	framebytes;			// sent in current frame
+	unsigned int	bytes;				// sent in current STATFRAMES frames
+	unsigned int	peak;				// most sent in one of those frames
+	double			start;
+
+	unsigned int	latched_bytes;
+	unsigned int	latched_peak;
+	double			latched_time;
+} dlstats;
+
+static qbool DLCache_Map (dlcache_t *c)
+{
+	unsigned long start;
+#ifdef _WIN32
+	SYSTEM_INFO si;
+
+	GetSystemInfo (&si);
+	start = c->offset - c->offset % si.dwAllocationGranularity;
+	c->maplen = c->len + (c->offset - start);
+
+	c->file = CreateFile (c->path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (c->file == INVALID_HANDLE_VALUE)
+		return false;
+
+	if (!(c->mapping = CreateFileMapping (c->file, NULL, PAGE_READONLY, 0, 0, NULL)))
+	{
+		CloseHandle (c->file);
+		return false;
+	}
+
+	if (!(c->map = (byte *) MapViewOfFile (c->mapping, FILE_MAP_READ, 0, start, c->maplen)))
+	{
+		CloseHandle (c->mapping);
+		CloseHandle (c->file);
+		return false;
+	}
+#else
+	int fd;
+	void *map;
+
+	start = c->offset - c->offset % sysconf (_SC_PAGESIZE);
+	c->maplen = c->len + (c->offset - start);
+
+	if ((fd = open (c->path, O_RDONLY)) < 0)
+		return false;
+
+	map = mmap (NULL, c->maplen, PROT_READ, MAP_SHARED, fd, start);
+	close (fd);
+
+	if (map == MAP_FAILED)
+		return false;
+	c->map = (byte *) map;
+#endif
+
+	c->data = c->map + (c->offset - start);
+	return true;
+}
+
+static void DLCache_Unmap (dlcache_t *c)
+{
+	if (!c->map)
+		return;
+
+#ifdef _WIN32
+	UnmapViewOfFile (c->map);
+	CloseHandle (c->mapping);
+	CloseHandle (c->file);
+#else
+	munmap (c->map, c->maplen);
+#endif
+	c->map = c->data = NULL;
+}
+
+static void DLCache_Unlink (dlcache_t *c)
+{
+	dlcache_t **link;
+
+	for (link = &dlcache; *link; link = &(*link)->next)
+	{
+		if (*link == c)
+		{
+			*link = c->next;
+			break;
+		}
+	}
+}
+
+static void DLCache_Release (dlcache_t *c)
+{
+	if (--c->refs > 0)
+		return;
+
+	DLCache_Unlink (c);
+	DLCache_Unmap (c);
+	Q_free (c);
+}
+
+#ifndef _WIN32
+// only installed while DLCache_Copy copies
+static void DLCache_SigBus (int sig)
+{
+	siglongjmp (dlcache_fault, 1);
+}
+#endif
+
+/*
+====================
+DLCache_Copy
+
+copy from the mapping, false if the file was truncated under it
+====================
+*/
+static qbool DLCache_Copy (dlcache_t *c, void *buffer, unsigned long pos, int len)
+{
+#ifndef _WIN32
+	struct sigaction sa;
+#endif
+
+	if (c->truncated)
+		return false;
+
+#ifndef _WIN32
+	memset (&sa, 0, sizeof(sa));
+	sa.sa_handler = DLCache_SigBus;
+	sigemptyset (&sa.sa_mask);
+
+	if (sigsetjmp (dlcache_fault, 1))
+	{
+		sigaction (SIGBUS, &dlcache_oldbus, NULL);
+		c->truncated = true;
+		DLCache_Unlink (c);
+		dlstats.truncations++;
+		Con_Printf ("%s was truncated while being downloaded\n", c->path);
+		return false;
+	}
+	sigaction (SIGBUS, &sa, &dlcache_oldbus);
+	// copy must not be moved out of where the handler is armed
+	__sync_synchronize ();
+#endif
+
+	memcpy (buffer, c->data + pos, len);
+
+#ifndef _WIN32
+	__sync_synchronize ();
+	sigaction (SIGBUS, &dlcache_oldbus, NULL);
+#endif
+	return true;
+}
+
+// files in demo dir other than demos (.txt, .idx and such) are rewritten in place,
+// truncating a mapped file would kill us. demos are always created as new files
+static qbool DLCache_Mappable (const char *name)
+{
+	int len = strlen (sv_demoDir.string), n = strlen (name);
+
+	if (strncmp (name, sv_demoDir.string, len) || name[len] != '/')
+		return true;
+
+	return (n > 4 && !strcasecmp (name + n - 4, ".mvd"))
+		|| (n > 7 && !strcasecmp (name + n - 7, ".mvd" MVD_COMPRESSED_EXT));
+}
+
+//=====================================
+// VFS functions
+//=====================================
+
+static int VFSDL_ReadBytes (struct vfsfile_s *vfs, void *buffer, int bytestoread, vfserrno_t *err)
+{
+	vfsdlcache_t *vf = (vfsdlcache_t *) vfs;
+
+	if (bytestoread > (int) (vf->cache->len - vf->pos))
+		bytestoread = vf->cache->len - vf->pos;
+	if (bytestoread <= 0)
+		return -1;
+
+	if (!DLCache_Copy (vf->cache, buffer, vf->pos, bytestoread))
+		return 0;
+	vf->pos += bytestoread;
+	vf->cache->served += bytestoread;
+
+	return bytestoread;
+}
+
+static int VFSDL_Seek (struct vfsfile_s *vfs, unsigned long offset, int whence)
+{
+	vfsdlcache_t *vf = (vfsdlcache_t *) vfs;
+
+	switch (whence)
+	{
+	case SEEK_SET:
+		vf->pos = offset;
+		break;
+	case SEEK_CUR:
+		vf->pos += offset;
+		break;
+	case SEEK_END:
+		vf->pos = vf->cache->len + offset;
+		break;
+	default:
+		return -1;
+	}
+
+	return vf->pos > vf->cache->len ? -1 : 0;
+}
+
+static unsigned long VFSDL_Tell (struct vfsfile_s *vfs)
+{
+	return ((vfsdlcache_t *) vfs)->pos;
+}
+
+static unsigned long VFSDL_GetLen (struct vfsfile_s *vfs)
+{
+	return ((vfsdlcache_t *) vfs)->cache->len;
+}
+
+static void VFSDL_Close (struct vfsfile_s *vfs)
+{
+	DLCache_Release (((vfsdlcache_t *) vfs)->cache);
+	Q_free (vfs);
+}
+
+/*
+====================
+SV_DownloadOpen
+
+open file for download, shared mapping if possible, plain VFS file otherwise
+====================
+*/
+vfsfile_t *SV_DownloadOpen (const char *name)
+{
+	char path[MAX_OSPATH];
+	unsigned long offset, len;
+	qbool copyprotected;
+	vfsdlcache_t *vf;
+	dlcache_t *c;
+	int mtime, size;
+
+	if (!(int)sv_downloadcache.value || !DLCache_Mappable (name)
+		|| !FS_DiskRange (name, path, sizeof(path), &offset, &len, &copyprotected) || !len)
+	{
+		dlstats.fallbacks++;
+		return FS_OpenVFS (name, "rb", FS_GAME);
+	}
+
+	// whoever modifies the file gets a new mapping, old one stays with its clients
+	size = Sys_FileSizeTime (path, &mtime);
+
+	for (c = dlcache; c; c = c->next)
+		if (c->offset == offset && c->len == len && c->mtime == mtime && !strcmp (c->path, path))
+			break;
+
+	if (c)
+	{
+		dlstats.hits++;
+	}
+	else
+	{
+		c = (dlcache_t *) Q_malloc (sizeof(dlcache_t));
+		strlcpy (c->path, path, sizeof(c->path));
+		c->offset = offset;
+		c->len = len;
+		c->mtime = mtime;
+
+		if ((unsigned long) size < offset + len || !DLCache_Map (c))
+		{
+			Q_free (c);
+			dlstats.fallbacks++;
+			return FS_OpenVFS (name, "rb", FS_GAME);
+		}
+
+		c->next = dlcache;
+		dlcache = c;
+		dlstats.misses++;
+	}
+
+	c->refs++;
+
+	vf = (vfsdlcache_t *) Q_malloc (sizeof(vfsdlcache_t));
+	vf->cache = c;
+	vf->funcs.ReadBytes = VFSDL_ReadBytes;
+	vf->funcs.Seek = VFSDL_Seek;
+	vf->funcs.Tell = VFSDL_Tell;
+	vf->funcs.GetLen = VFSDL_GetLen;
+	vf->funcs.Close = VFSDL_Close;
+	vf->funcs.copyprotected = copyprotected;
+
+	return &vf->funcs;
+}
+
+/*
+====================
+SV_DownloadMapping
+
+mapping behind a file from SV_DownloadOpen, NULL if it is not mapped.
+it is only to be handed to the kernel, send() fails with EFAULT where the
+file was truncated. touching it here could raise SIGBUS, read it with
+VFS_READ
+====================
+*/
+const byte *SV_DownloadMapping (vfsfile_t *vfs)
+{
+	if (vfs->ReadBytes != VFSDL_ReadBytes || ((vfsdlcache_t *) vfs)->cache->truncated)
+		return NULL;
+
+	return ((vfsdlcache_t *) vfs)->cache->data;
+}
+
+// download data of 'bytes' was sent to a client
+void SV_DownloadSent (int bytes)
+{
+	if (bytes > 0)
+		dlstats.framebytes += bytes;
+}
+
+// called once a frame by SV_Frame
+void SV_DownloadFrame (void)
+{
+	dlstats.bytes += dlstats.framebytes;
+	dlstats.peak = max(dlstats.peak, dlstats.framebytes);
+	dlstats.totalkb += dlstats.framebytes / 1024.0;
+	dlstats.framebytes = 0;
+
+	if (++dlstats.frames == STATFRAMES)
+	{
+		dlstats.latched_bytes = dlstats.bytes;
+		dlstats.latched_peak = dlstats.peak;
+		dlstats.latched_time = realtime - dlstats.start;
+
+		dlstats.frames = 0;
+		dlstats.bytes = dlstats.peak = 0;
+		dlstats.start = realtime;
+	}
+}
+
+static void SV_DownloadCache_f (void)
+{
+	dlcache_t *c;
+	int files = 0, refs = 0;
+	double mapped = 0;
+
+	for (c = dlcache; c; c = c->next)
+	{
+		Con_Printf ("%4d %6.0fK %6uK %s", c->refs, c->len / 1024.0, c->served / 1024, c->path);
+		if (c->offset)
+			Con_Printf (" @%lu", c->offset);
+		Con_Printf ("\n");
+
+		files++;
+		refs += c->refs;
+		mapped += c->len;
+	}
+
+	Con_Printf ("mapped    : %d files, %.1f MB, %d downloads\n", files, mapped / (1024 * 1024), refs);
+	Con_Printf ("opened    : %u shared, %u mapped, %u not cached, %u truncated\n", dlstats.hits, dlstats.misses,
+	            dlstats.fallbacks, dlstats.truncations);
+	Con_Printf ("sent      : %.1f MB total\n", dlstats.totalkb / 1024);
+	Con_Printf ("per frame : %.1f KB average, %.1f KB peak over last %d frames",
+	            dlstats.latched_bytes / 1024.0 / STATFRAMES, dlstats.latched_peak / 1024.0, STATFRAMES);
+	if (dlstats.latched_time > 0)
+		Con_Printf (", %.1f KB/s", dlstats.latched_bytes / 1024.0 / dlstats.latched_time);
+	Con_Printf ("\n");
+}
+
+void SV_DownloadCacheInit (void)
+{
+	Cvar_Register (&sv_downloadcache);
+
+	Cmd_AddCommand ("sv_dlcache", SV_DownloadCache_f);
+}
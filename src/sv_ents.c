@@ -210,7 +210,7 @@ Writes a delta update of a packet_entities_t to the message.
 
 =============
 */
-static void SV_EmitPacketEntities (client_t *client, packet_entities_t *to, sizebuf_t *msg)
+void SV_EmitPacketEntities (client_t *client, packet_entities_t *to, sizebuf_t *msg)
 {
 	int oldindex, newindex, oldnum, newnum, oldmax;
 	client_frame_t	*fromframe;
@@ -267,7 +267,7 @@ static void SV_EmitPacketEntities (client_t *client, packet_entities_t *to, size
 			}
 			ent = EDICT_NUM(newnum);
 			//Con_Printf ("baseline %i\n", newnum);
-			SV_WriteDelta (&ent->e->baseline, &to->entities[newindex], msg, true);
+			SV_WriteDelta (&EDICT_SV(ent)->baseline, &to->entities[newindex], msg, true);
 			newindex++;
 			continue;
 		}
@@ -429,11 +429,11 @@ static void SV_WritePlayersToClient (client_t *client, client_frame_t *frame, by
 			// ignore if not touching a PV leaf
 			if ( pvs )
 			{
-				for (i=0 ; i < ent->e->num_leafs ; i++)
-					if (pvs[ent->e->leafnums[i] >> 3] & (1 << (ent->e->leafnums[i]&7) ))
+				for (i=0 ; i < EDICT_SV(ent)->num_leafs ; i++)
+					if (pvs[EDICT_SV(ent)->leafnums[i] >> 3] & (1 << (EDICT_SV(ent)->leafnums[i]&7) ))
 						break;
 
-				if (i == ent->e->num_leafs)
+				if (i == EDICT_SV(ent)->num_leafs)
 					continue; // not visable
 			}
 		}
@@ -710,11 +710,11 @@ void SV_WriteEntitiesToClient (client_t *client, sizebuf_t *msg, qbool recorder)
 			if ( pvs )
 			{
 				// ignore if not touching a PV leaf
-				for (i=0 ; i < ent->e->num_leafs ; i++)
-					if (pvs[ent->e->leafnums[i] >> 3] & (1 << (ent->e->leafnums[i]&7) ))
+				for (i=0 ; i < EDICT_SV(ent)->num_leafs ; i++)
+					if (pvs[EDICT_SV(ent)->leafnums[i] >> 3] & (1 << (EDICT_SV(ent)->leafnums[i]&7) ))
 						break;
 
-				if (i == ent->e->num_leafs)
+				if (i == EDICT_SV(ent)->num_leafs)
 					continue;		// not visible
 			}
 
@@ -758,8 +758,8 @@ void SV_WriteEntitiesToClient (client_t *client, sizebuf_t *msg, qbool recorder)
 				continue;
 
 			// ignore if not touching a PV leaf
-			for (i=0 ; i < ent->e->num_leafs ; i++)
-				if (pvs[ent->e->leafnums[i] >> 3] & (1 << (ent->e->leafnums[i]&7) ))
+			for (i=0 ; i < EDICT_SV(ent)->num_leafs ; i++)
+				if (pvs[EDICT_SV(ent)->leafnums[i] >> 3] & (1 << (EDICT_SV(ent)->leafnums[i]&7) ))
 					break;
 
 			if ((int)ent->v.effects & EF_MUZZLEFLASH) {
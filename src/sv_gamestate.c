@@ -0,0 +1,447 @@
+/*
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+//	sv_gamestate.c - gamestate serialized once per map
+//
+//	what a connecting client or a new demo/QTV dest gets before it spawns is
+//	the same for everyone: sound and model lists, signon buffers, lightstyles
+//	and serverinfo. those are written into blocks once per map here, and each
+//	connection copies the blocks instead of serializing it all again, which
+//	matters on map change when all clients and dests ask at once.
+//	blocks are rebuilt on next use after a precache or lightstyle change, map
+//	change or signon change. serverinfo block is checked against svs.info.
+
+#include "qwsvdef.h"
+
+#define GS_MAXBLOCKS		(MAX_SOUNDS + MAX_MODELS + MAX_LIGHTSTYLES)
+
+cvar_t	sv_gamestatecache = {"sv_gamestatecache", "1"};	// share serialized gamestate between connections
+
+typedef struct
+{
+	int			svc;				// svc_soundlist, svc_modellist or svc_lightstyle
+	int			start;				// lists: index block starts at
+	int			ofs, len;			// in gamestate.data
+} gsblock_t;
+
+static struct
+{
+	qbool		valid;
+	int			spawncount;			// what blocks were built for
+	int			numsignon;
+	int			signonsize;
+
+	byte		*data;
+	int			size, maxsize;
+	gsblock_t	blocks[GS_MAXBLOCKS];
+	int			numblocks;
+	int			demoofs, demolen;	// lists, signon and spawn as framed mvd messages
+
+	char		info[MAX_SERVERINFO_STRING];
+	byte		serverinfo[MAX_SERVERINFO_STRING + 32];
+	int			serverinfolen;
+
+	unsigned	builds, hits, misses;
+	double		buildtime;
+} gamestate;
+
+/*
+====================
+SV_WriteList
+
+writes sound or model list from index n on, as much of it as fits into half
+of a message, returns index of first name not written, 0 if none is left
+====================
+*/
+int SV_WriteList (sizebuf_t *msg, int svc, unsigned n)
+{
+	char **s = (svc == svc_soundlist ? sv.sound_precache : sv.model_precache) + 1 + n;
+
+	MSG_WriteByte (msg, svc);
+	MSG_WriteByte (msg, n);
+	for ( ; *s && msg->cursize < (MAX_MSGLEN/2); s++, n++)
+		MSG_WriteString (msg, *s);
+	MSG_WriteByte (msg, 0);
+
+	// next msg
+	MSG_WriteByte (msg, *s ? n : 0);
+	return *s ? n : 0;
+}
+
+void SV_GamestateInvalidate (void)
+{
+	gamestate.valid = false;
+}
+
+static qbool SV_GamestateCurrent (void)
+{
+	return gamestate.valid && gamestate.spawncount == svs.spawncount && gamestate.numsignon == sv.num_signon_buffers
+		&& gamestate.signonsize == sv.signon_buffer_size[sv.num_signon_buffers - 1];
+}
+
+static byte *SV_GamestateAlloc (int len)
+{
+	if (gamestate.size + len > gamestate.maxsize)
+	{
+		gamestate.maxsize = max (gamestate.maxsize * 2, gamestate.size + len);
+		if (!(gamestate.data = (byte *) realloc (gamestate.data, gamestate.maxsize)))
+			Sys_Error ("SV_GamestateBuild: out of memory");
+	}
+
+	gamestate.size += len;
+	return gamestate.data + gamestate.size - len;
+}
+
+static void SV_GamestateAddBlock (int svc, int start, sizebuf_t *msg)
+{
+	gsblock_t *b = &gamestate.blocks[gamestate.numblocks++];
+
+	b->svc = svc;
+	b->start = start;
+	b->len = msg->cursize;
+	b->ofs = SV_GamestateAlloc (msg->cursize) - gamestate.data;
+	memcpy (gamestate.data + b->ofs, msg->data, msg->cursize);
+	SZ_Clear (msg);
+}
+
+// same as SV_WriteRecordMVDMessage would write it
+static void SV_GamestateAddDemoMessage (sizebuf_t *msg)
+{
+	byte *p;
+	int len;
+
+	if (!msg->cursize)
+		return;
+
+	p = SV_GamestateAlloc (6 + msg->cursize);
+	p[0] = 0;
+	p[1] = dem_all;
+	len = LittleLong (msg->cursize);
+	memcpy (p + 2, &len, 4);
+	memcpy (p + 6, msg->data, msg->cursize);
+
+	gamestate.demolen += 6 + msg->cursize;
+	SZ_Clear (msg);
+}
+
+static void SV_GamestateBuild (void)
+{
+	byte buf_data[MAX_MSGLEN];
+	double start = Sys_DoubleTime ();
+	sizebuf_t buf;
+	int i, n, svc, first;
+
+	memset (&buf, 0, sizeof(buf));
+	buf.data = buf_data;
+	buf.maxsize = sizeof(buf_data);
+
+	gamestate.size = gamestate.numblocks = 0;
+
+	// lists, the way clients ask for them
+	for (svc = svc_soundlist; svc; svc = (svc == svc_soundlist ? svc_modellist : 0))
+	{
+		n = 0;
+		do
+		{
+			i = n;
+			n = SV_WriteList (&buf, svc, n);
+			SV_GamestateAddBlock (svc, i, &buf);
+		} while (n);
+	}
+
+	// lightstyles, in pieces not bigger than a list
+	for (i = 0; i < MAX_LIGHTSTYLES; i++)
+	{
+		MSG_WriteByte (&buf, svc_lightstyle);
+		MSG_WriteByte (&buf, (char)i);
+		MSG_WriteString (&buf, sv.lightstyles[i]);
+
+		if (buf.cursize >= MAX_MSGLEN/2 || i == MAX_LIGHTSTYLES - 1)
+			SV_GamestateAddBlock (svc_lightstyle, 0, &buf);
+	}
+
+	// demos get lists as one message each, then signon buffers and spawn
+	gamestate.demoofs = gamestate.size;
+	gamestate.demolen = 0;
+
+	first = gamestate.numblocks;
+	for (i = 0; i < first; i++)
+	{
+		if (gamestate.blocks[i].svc == svc_lightstyle)
+			continue;
+		SZ_Write (&buf, gamestate.data + gamestate.blocks[i].ofs, gamestate.blocks[i].len);
+		SV_GamestateAddDemoMessage (&buf);
+	}
+
+	for (i = 0; i < sv.num_signon_buffers; i++)
+	{
+		if (buf.cursize + sv.signon_buffer_size[i] > MAX_MSGLEN/2)
+			SV_GamestateAddDemoMessage (&buf);
+		SZ_Write (&buf, sv.signon_buffers[i], sv.signon_buffer_size[i]);
+	}
+
+	if (buf.cursize > MAX_MSGLEN/2)
+		SV_GamestateAddDemoMessage (&buf);
+
+	MSG_WriteByte (&buf, svc_stufftext);
+	MSG_WriteString (&buf, va("cmd spawn %i 0\n", svs.spawncount));
+	SV_GamestateAddDemoMessage (&buf);
+
+	gamestate.spawncount = svs.spawncount;
+	gamestate.numsignon = sv.num_signon_buffers;
+	gamestate.signonsize = sv.signon_buffer_size[sv.num_signon_buffers - 1];
+	gamestate.valid = true;
+
+	gamestate.builds++;
+	gamestate.buildtime = Sys_DoubleTime () - start;
+}
+
+static qbool SV_GamestateReady (void)
+{
+	if (!(int)sv_gamestatecache.value || sv.state != ss_active)
+		return false;
+
+	if (!SV_GamestateCurrent ())
+		SV_GamestateBuild ();
+
+	return true;
+}
+
+/*
+====================
+SV_GamestateList
+
+copies list block starting at n to msg, false if there is no such block or
+it doesn't fit, caller has to SV_WriteList then
+====================
+*/
+qbool SV_GamestateList (sizebuf_t *msg, int svc, unsigned n)
+{
+	gsblock_t *b;
+	int i;
+
+	if (!SV_GamestateReady ())
+		return false;
+
+	for (i = 0, b = gamestate.blocks; i < gamestate.numblocks; i++, b++)
+	{
+		if (b->svc == svc && b->start == (int) n)
+			break;
+	}
+
+	if (i == gamestate.numblocks || msg->cursize + b->len > msg->maxsize)
+	{
+		gamestate.misses++;
+		return false;
+	}
+
+	SZ_Write (msg, gamestate.data + b->ofs, b->len);
+	gamestate.hits++;
+	return true;
+}
+
+/*
+====================
+SV_GamestateLightstyles
+
+sends all lightstyles to client, false if caller has to do it itself
+====================
+*/
+qbool SV_GamestateLightstyles (client_t *cl)
+{
+	gsblock_t *b;
+	int i;
+
+	if (!SV_GamestateReady ())
+		return false;
+
+	for (i = 0, b = gamestate.blocks; i < gamestate.numblocks; i++, b++)
+	{
+		if (b->svc != svc_lightstyle)
+			continue;
+
+		ClientReliableCheckBlock (cl, b->len);
+		ClientReliableWrite_SZ (cl, gamestate.data + b->ofs, b->len);
+	}
+
+	gamestate.hits++;
+	return true;
+}
+
+/*
+====================
+SV_GamestateDemo
+
+lists, signon buffers and spawn command as framed mvd messages, NULL if
+SV_MVD_SendInitialGamestate has to write them itself
+====================
+*/
+byte *SV_GamestateDemo (int *len)
+{
+	if (!SV_GamestateReady ())
+		return NULL;
+
+	gamestate.hits++;
+	*len = gamestate.demolen;
+	return gamestate.data + gamestate.demoofs;
+}
+
+/*
+====================
+SV_GamestateServerinfo
+
+writes fullserverinfo stufftext of current svs.info
+====================
+*/
+void SV_GamestateServerinfo (sizebuf_t *msg)
+{
+	sizebuf_t buf;
+
+	if (!(int)sv_gamestatecache.value)
+	{
+		MSG_WriteByte (msg, svc_stufftext);
+		MSG_WriteString (msg, va("fullserverinfo \"%s\"\n", svs.info));
+		return;
+	}
+
+	if (!gamestate.serverinfolen || strcmp (gamestate.info, svs.info))
+	{
+		memset (&buf, 0, sizeof(buf));
+		buf.data = gamestate.serverinfo;
+		buf.maxsize = sizeof(gamestate.serverinfo);
+
+		MSG_WriteByte (&buf, svc_stufftext);
+		MSG_WriteString (&buf, va("fullserverinfo \"%s\"\n", svs.info));
+
+		strlcpy (gamestate.info, svs.info, sizeof(gamestate.info));
+		gamestate.serverinfolen = buf.cursize;
+	}
+	else
+	{
+		gamestate.hits++;
+	}
+
+	SZ_Write (msg, gamestate.serverinfo, gamestate.serverinfolen);
+}
+
+/*
+====================
+SV_GamestateBench
+
+what MAX_CLIENTS clients and a demo joining at once cost serialized for
+each of them and copied from blocks, seconds
+====================
+*/
+static void SV_GamestateBench (double *serialized, double *shared)
+{
+	byte buf_data[MAX_MSGLEN * 2];
+	sizebuf_t buf;
+	double start;
+	int c, i, n, len;
+
+	memset (&buf, 0, sizeof(buf));
+	buf.data = buf_data;
+	buf.maxsize = sizeof(buf_data);
+	buf.allowoverflow = true;
+
+	start = Sys_DoubleTime ();
+	for (c = 0; c < MAX_CLIENTS; c++)
+	{
+		for (n = 0; (n = SV_WriteList (&buf, svc_soundlist, n)); SZ_Clear (&buf))
+			;
+		for (n = 0; (n = SV_WriteList (&buf, svc_modellist, n)); SZ_Clear (&buf))
+			;
+		SZ_Clear (&buf);
+
+		for (i = 0; i < MAX_LIGHTSTYLES; i++)
+		{
+			MSG_WriteByte (&buf, svc_lightstyle);
+			MSG_WriteByte (&buf, (char)i);
+			MSG_WriteString (&buf, sv.lightstyles[i]);
+		}
+		SZ_Clear (&buf);
+
+		MSG_WriteByte (&buf, svc_stufftext);
+		MSG_WriteString (&buf, va("fullserverinfo \"%s\"\n", svs.info));
+		SZ_Clear (&buf);
+	}
+	// demo gets all of it once more
+	SV_GamestateBuild ();
+	*serialized = Sys_DoubleTime () - start;
+
+	start = Sys_DoubleTime ();
+	for (c = 0; c < MAX_CLIENTS; c++)
+	{
+		for (i = 0; i < gamestate.numblocks; i++)
+		{
+			SZ_Write (&buf, gamestate.data + gamestate.blocks[i].ofs, gamestate.blocks[i].len);
+			SZ_Clear (&buf);
+		}
+
+		SV_GamestateServerinfo (&buf);
+		SZ_Clear (&buf);
+	}
+	SV_GamestateDemo (&len);
+	*shared = Sys_DoubleTime () - start;
+}
+
+static void SV_Gamestate_f (void)
+{
+	double serialized, shared;
+	int i, lists = 0, styles = 0;
+
+	if (sv.state != ss_active)
+	{
+		Con_Printf ("no map running\n");
+		return;
+	}
+
+	if (!SV_GamestateReady ())
+	{
+		Con_Printf ("gamestate cache is off\n");
+		return;
+	}
+
+	for (i = 0; i < gamestate.numblocks; i++)
+	{
+		if (gamestate.blocks[i].svc == svc_lightstyle)
+			styles++;
+		else
+			lists++;
+	}
+
+	Con_Printf ("blocks    : %d list, %d lightstyle, %d bytes, %d bytes for demos\n", lists, styles, gamestate.size - gamestate.demolen, gamestate.demolen);
+	Con_Printf ("built     : %u times, last in %.3f ms\n", gamestate.builds, gamestate.buildtime * 1000);
+	Con_Printf ("used      : %u times, %u not usable\n", gamestate.hits, gamestate.misses);
+
+	if (Cmd_Argc () > 1 && !strcmp (Cmd_Argv (1), "bench"))
+	{
+		SV_GamestateBench (&serialized, &shared);
+		Con_Printf ("%d clients and a demo joining: %.3f ms serialized, %.3f ms shared", MAX_CLIENTS, serialized * 1000, shared * 1000);
+		if (shared > 0)
+			Con_Printf (", %.1fx", serialized / shared);
+		Con_Printf ("\n");
+	}
+}
+
+void SV_GamestateInit (void)
+{
+	Cvar_Register (&sv_gamestatecache);
+
+	Cmd_AddCommand ("sv_gamestate", SV_Gamestate_f);
+}
@@ -97,7 +97,7 @@ static void SV_CreateBaseline (void)
 	for (entnum = 0; entnum < sv.num_edicts ; entnum++)
 	{
 		svent = EDICT_NUM(entnum);
-		if (svent->e->free)
+		if (EDICT_SV(svent)->free)
 			continue;
 		// create baselines for all player slots,
 		// and any other edict that has a visible model
@@ -107,19 +107,19 @@ static void SV_CreateBaseline (void)
 		//
 		// create entity baseline
 		//
-		VectorCopy (svent->v.origin, svent->e->baseline.origin);
-		VectorCopy (svent->v.angles, svent->e->baseline.angles);
-		svent->e->baseline.frame = svent->v.frame;
-		svent->e->baseline.skinnum = svent->v.skin;
+		VectorCopy (svent->v.origin, EDICT_SV(svent)->baseline.origin);
+		VectorCopy (svent->v.angles, EDICT_SV(svent)->baseline.angles);
+		EDICT_SV(svent)->baseline.frame = svent->v.frame;
+		EDICT_SV(svent)->baseline.skinnum = svent->v.skin;
 		if (entnum > 0 && entnum <= MAX_CLIENTS)
 		{
-			svent->e->baseline.colormap = entnum;
-			svent->e->baseline.modelindex = SV_ModelIndex("progs/player.mdl");
+			EDICT_SV(svent)->baseline.colormap = entnum;
+			EDICT_SV(svent)->baseline.modelindex = SV_ModelIndex("progs/player.mdl");
 		}
 		else
 		{
-			svent->e->baseline.colormap = 0;
-			svent->e->baseline.modelindex = SV_ModelIndex(PR_GetString(svent->v.model));
+			EDICT_SV(svent)->baseline.colormap = 0;
+			EDICT_SV(svent)->baseline.modelindex = SV_ModelIndex(PR_GetString(svent->v.model));
 		}
 
 		//
@@ -134,14 +134,14 @@ static void SV_CreateBaseline (void)
 		MSG_WriteByte (&sv.signon,svc_spawnbaseline);
 		MSG_WriteShort (&sv.signon,entnum);
 
-		MSG_WriteByte (&sv.signon, svent->e->baseline.modelindex);
-		MSG_WriteByte (&sv.signon, svent->e->baseline.frame);
-		MSG_WriteByte (&sv.signon, svent->e->baseline.colormap);
-		MSG_WriteByte (&sv.signon, svent->e->baseline.skinnum);
+		MSG_WriteByte (&sv.signon, EDICT_SV(svent)->baseline.modelindex);
+		MSG_WriteByte (&sv.signon, EDICT_SV(svent)->baseline.frame);
+		MSG_WriteByte (&sv.signon, EDICT_SV(svent)->baseline.colormap);
+		MSG_WriteByte (&sv.signon, EDICT_SV(svent)->baseline.skinnum);
 		for (i=0 ; i<3 ; i++)
 		{
-			MSG_WriteCoord(&sv.signon, svent->e->baseline.origin[i]);
-			MSG_WriteAngle(&sv.signon, svent->e->baseline.angles[i]);
+			MSG_WriteCoord(&sv.signon, EDICT_SV(svent)->baseline.origin[i]);
+			MSG_WriteAngle(&sv.signon, EDICT_SV(svent)->baseline.angles[i]);
 		}
 	}
 }
@@ -188,6 +188,10 @@ static unsigned SV_CheckModel(char *mdl)
 	unsigned short crc;
 	int filesize;
 	int mark;
+	unsigned preloaded;
+
+	if (SV_PreloadModelChecksum (mdl, &preloaded))
+		return preloaded;
 
 	mark = Hunk_LowMark ();
 	buf = (byte *) FS_LoadHunkFile (mdl, &filesize);
@@ -209,6 +213,255 @@ static unsigned SV_CheckModel(char *mdl)
 	return crc;
 }
 
+/*
+==============================================================================
+
+MAP RESTART SNAPSHOT
+
+Right after a map is spawned we copy edicts, progs/QVM data, string tables and
+the whole server_t (signon buffers, baselines, precaches, lightstyles).
+Spawning the same map again just puts that copy back, without reloading the
+bsp, progs or running spawn functions.
+
+Spawn functions may read any setting, so the snapshot is dropped when
+serverinfo or localinfo differ from what they were right after the spawn, or
+when the map, entity file, progs, deathmatch, teamplay, coop or skill change.
+Other cvars which are in neither info string are not checked, set
+sv_fastmaprestart 0 if the mod reads such ones on spawn.
+
+==============================================================================
+*/
+
+cvar_t	sv_fastmaprestart = {"sv_fastmaprestart", "0"};
+
+typedef struct spawnsnapshot_s
+{
+	qbool		valid;
+
+	// snapshot is only used if all of these match
+	char		mapname[MAP_NAME_LEN];
+	char		entityfile[MAX_QPATH];
+	qbool		devmap;
+	int			progtype;
+	char		progsname[MAX_QPATH];
+	float		deathmatch, teamplay, coop, skill;
+	char		serverinfo[MAX_SERVERINFO_STRING];
+	char		*localinfo;
+
+	gamestate_t	state;
+} spawnsnapshot_t;
+
+static spawnsnapshot_t spawnsnap;
+
+static double	spawn_coldtime, spawn_fasttime;
+static int		spawn_coldcount, spawn_fastcount;
+
+static void SV_FreeSpawnSnapshot (void)
+{
+	SV_FreeGameState (&spawnsnap.state);
+	Q_free (spawnsnap.localinfo);
+	memset (&spawnsnap, 0, sizeof(spawnsnap));
+}
+
+static byte *SV_GameStateVMData (int *size)
+{
+#ifdef USE_PR2
+	if (sv_vm)
+	{
+		qvm_t *qvm;
+
+		if (sv_vm->type != VM_BYTECODE)
+			return NULL; // can't copy state of native library
+
+		qvm = (qvm_t *) sv_vm->hInst;
+		*size = qvm->len_ds;
+		return qvm->ds;
+	}
+#endif
+
+	if (pr_nqprogs)
+		return NULL; // NQP_Reset() state is not covered
+
+	*size = progs->numglobals * 4;
+	return (byte *) pr_globals;
+}
+
+static qbool SV_SpawnSnapshotMatches (char *mapname, qbool devmap, char *entityfile)
+{
+	char localinfo[MAX_LOCALINFO_STRING];
+
+	if (!spawnsnap.valid)
+		return false;
+
+	Info_ReverseConvert (&_localinfo_, localinfo, sizeof(localinfo));
+
+	return sv.state == ss_active
+		&& !strcmp (spawnsnap.mapname, mapname)
+		&& !strcmp (spawnsnap.entityfile, entityfile)
+		&& spawnsnap.devmap == devmap
+#ifdef USE_PR2
+		&& spawnsnap.progtype == (int) sv_progtype.value
+#endif
+		&& !strcmp (spawnsnap.progsname, sv_progsname.string)
+		&& spawnsnap.deathmatch == deathmatch.value
+		&& spawnsnap.teamplay == teamplay.value
+		&& spawnsnap.coop == coop.value
+		&& spawnsnap.skill == skill.value
+		&& !strcmp (spawnsnap.serverinfo, svs.info)
+		&& !strcmp (spawnsnap.localinfo, localinfo);
+}
+
+/*
+================
+SV_SaveGameState
+
+copy edicts, progs/QVM data, string tables and server_t, false if the game
+can't be copied (native game library, NQ progs)
+================
+*/
+qbool SV_SaveGameState (gamestate_t *gs)
+{
+	byte *vmdata;
+	edict_t *ent;
+	int i, size;
+
+	memset (gs, 0, sizeof(*gs));
+
+	if (!(vmdata = SV_GameStateVMData (&size)))
+		return false;
+
+	gs->vmdata_size = size;
+	gs->vmdata = (byte *) Q_malloc (size);
+	memcpy (gs->vmdata, vmdata, size);
+
+#ifdef USE_PR2
+	if (sv_vm)
+	{
+		gs->vm_sp = ((qvm_t *) sv_vm->hInst)->SP;
+		gs->vm_lp = ((qvm_t *) sv_vm->hInst)->LP;
+	}
+	else
+#endif
+	{
+		gs->edicts_size = MAX_EDICTS * pr_edict_size;
+		gs->edicts = (byte *) Q_malloc (gs->edicts_size);
+		memcpy (gs->edicts, sv.edicts, gs->edicts_size);
+	}
+
+	gs->sv = (server_t *) Q_malloc (sizeof(sv));
+	memcpy (gs->sv, &sv, sizeof(sv));
+	gs->strings = PR_SaveStrings ();
+
+	for (i = 0; i < sv.num_edicts; i++)
+	{
+		ent = EDICT_NUM(i);
+		if (EDICT_SV(ent)->area.prev)
+			gs->linked[i >> 3] |= 1 << (i & 7);
+	}
+
+	gs->hunkmark = Hunk_LowMark ();
+	return true;
+}
+
+/*
+================
+SV_RestoreGameState
+
+put back what SV_SaveGameState copied, it can be restored again
+================
+*/
+void SV_RestoreGameState (gamestate_t *gs)
+{
+	edict_t *ent;
+	byte *vmdata;
+	int i, size;
+
+	// drop whatever was allocated since the copy
+	Hunk_FreeToLowMark (gs->hunkmark);
+
+	memcpy (&sv, gs->sv, sizeof(sv));
+
+	vmdata = SV_GameStateVMData (&size);
+	memcpy (vmdata, gs->vmdata, gs->vmdata_size);
+#ifdef USE_PR2
+	if (sv_vm)
+	{
+		((qvm_t *) sv_vm->hInst)->SP = gs->vm_sp;
+		((qvm_t *) sv_vm->hInst)->LP = gs->vm_lp;
+	}
+	else
+#endif
+		memcpy (sv.edicts, gs->edicts, gs->edicts_size);
+
+	PR_RestoreStrings (gs->strings);
+	PR_FindResync ();
+
+	// area links point into the old areanode tree, relink everything
+	SV_ClearWorld ();
+	for (i = 0; i < MAX_EDICTS; i++)
+	{
+		ent = EDICT_NUM(i);
+		EDICT_SV(ent)->area.prev = EDICT_SV(ent)->area.next = NULL;
+	}
+	for (i = 1; i < sv.num_edicts; i++)
+	{
+		if (gs->linked[i >> 3] & (1 << (i & 7)))
+			SV_LinkEdict (EDICT_NUM(i), false);
+	}
+}
+
+void SV_FreeGameState (gamestate_t *gs)
+{
+	Q_free (gs->sv);
+	Q_free (gs->edicts);
+	Q_free (gs->vmdata);
+	Q_free (gs->strings);
+}
+
+static void SV_TakeSpawnSnapshot (qbool devmap, char *entityfile)
+{
+	char localinfo[MAX_LOCALINFO_STRING];
+
+	SV_FreeSpawnSnapshot ();
+
+	if (!SV_SaveGameState (&spawnsnap.state))
+		return;
+
+	strlcpy (spawnsnap.mapname, sv.mapname, sizeof(spawnsnap.mapname));
+	strlcpy (spawnsnap.entityfile, entityfile, sizeof(spawnsnap.entityfile));
+	spawnsnap.devmap = devmap;
+#ifdef USE_PR2
+	spawnsnap.progtype = (int) sv_progtype.value;
+#endif
+	strlcpy (spawnsnap.progsname, sv_progsname.string, sizeof(spawnsnap.progsname));
+	spawnsnap.deathmatch = deathmatch.value;
+	spawnsnap.teamplay = teamplay.value;
+	spawnsnap.coop = coop.value;
+	spawnsnap.skill = skill.value;
+	strlcpy (spawnsnap.serverinfo, svs.info, sizeof(spawnsnap.serverinfo));
+	Info_ReverseConvert (&_localinfo_, localinfo, sizeof(localinfo));
+	spawnsnap.localinfo = Q_strdup (localinfo);
+	spawnsnap.valid = true;
+}
+
+/*
+================
+SV_SpawnStats_f
+
+compare full map spawn with snapshot restore
+================
+*/
+void SV_SpawnStats_f (void)
+{
+	Con_Printf ("full spawn      : %i times, last %.1f ms\n", spawn_coldcount, spawn_coldtime * 1000);
+	Con_Printf ("snapshot restore: %i times, last %.1f ms\n", spawn_fastcount, spawn_fasttime * 1000);
+	if (spawnsnap.valid)
+		Con_Printf ("snapshot        : %s, %i KB\n", spawnsnap.mapname,
+		            (int)(sizeof(sv) + spawnsnap.state.edicts_size + spawnsnap.state.vmdata_size) / 1024);
+	else
+		Con_Printf ("snapshot        : none%s\n", (int)sv_fastmaprestart.value ? "" : " (sv_fastmaprestart is 0)");
+}
+
 /*
 ================
 SV_SpawnServer
@@ -229,14 +482,20 @@ void SV_SpawnServer (char *mapname, qbool devmap, char* entityfile)
 	extern cvar_t sv_loadentfiles, sv_loadentfiles_dir;
 	char *entitystring;
 	char oldmap[MAP_NAME_LEN];
+	char snapentityfile[MAX_QPATH];
+	double start;
+	qbool fresh;
 	extern qbool	sv_allow_cheats;
 	extern cvar_t	sv_cheats, sv_paused, sv_bigcoords;
 #ifndef SERVERONLY
 	extern void CL_ClearState (void);
 #endif
 
+	start = Sys_DoubleTime ();
+
 	// store old map name
 	snprintf (oldmap, MAP_NAME_LEN, "%s", sv.mapname);
+	strlcpy (snapentityfile, entityfile ? entityfile : "", sizeof(snapentityfile));
 
 	Con_DPrintf ("SpawnServer: %s\n",mapname);
 
@@ -268,6 +527,35 @@ void SV_SpawnServer (char *mapname, qbool devmap, char* entityfile)
 
 #endif
 
+	// capture and replay need a full load, random numbers from their seed
+	fresh = SV_CaptureSpawn (mapname);
+
+	if (!fresh && (int)sv_fastmaprestart.value && SV_SpawnSnapshotMatches (mapname, devmap, snapentityfile))
+	{
+		svs.spawncount++; // any partially connected client will be restarted
+
+		// drops whatever was allocated while the map was running
+		SV_RestoreGameState (&spawnsnap.state);
+
+		// same as below, server_t was wiped before the snapshot was taken
+		sv.mvdrecording = false;
+		sv.paused = false;
+		Cvar_SetROM(&sv_paused, "0");
+
+		Info_SetValueForKey (svs.info, "map", sv.mapname, MAX_SERVERINFO_STRING);
+
+		Con_DPrintf ("Server spawned from snapshot.\n");
+
+		spawn_fasttime = Sys_DoubleTime () - start;
+		spawn_fastcount++;
+
+		SV_MVD_Record(NULL, true);
+		return;
+	}
+
+	// snapshot refers to the hunk which is about to be flushed
+	SV_FreeSpawnSnapshot ();
+
 	// Shutdown game.
 	PR_GameShutDown();
 	PR_UnLoadProgs();
@@ -282,6 +570,8 @@ void SV_SpawnServer (char *mapname, qbool devmap, char* entityfile)
 	Cvar_SetROM(&sv_paused, "0");
 
 	Host_ClearMemory();
+	PR_StringsNewMap();
+	PR_FindNewMap();
 
 #ifdef FTE_PEXT_FLOATCOORDS
 	if (sv_bigcoords.value)
@@ -349,9 +639,9 @@ void SV_SpawnServer (char *mapname, qbool devmap, char* entityfile)
 	for (i = 0; i < MAX_EDICTS; i++)
 	{
 		ent = EDICT_NUM(i);
-		ent->e = &sv.sv_edicts[i]; // assigning ->e field in each edict_t
-		ent->e->entnum = i;
-		ent->e->area.ed = ent; // yeah, pretty funny, but this help to find which edict_t own this area (link_t)
+		ent->e = i; // assigning ->e field in each edict_t
+		EDICT_SV(ent)->entnum = i;
+		EDICT_SV(ent)->area.ed = ent; // yeah, pretty funny, but this help to find which edict_t own this area (link_t)
 	}
 
 	fofs_items2 = ED_FindFieldOffset ("items2"); // ZQ_ITEMS2 extension
@@ -397,6 +687,9 @@ void SV_SpawnServer (char *mapname, qbool devmap, char* entityfile)
 	Cvar_ForceSet (&host_mapname, mapname);
 #endif
 
+	// preloaded map is in the map cache by now
+	SV_PreloadFinish (sv.modelname);
+
 	if (!(sv.worldmodel = CM_LoadMap (sv.modelname, false, &sv.map_checksum, &sv.map_checksum2))) // true if bad map
 	{
 		Con_Printf ("Cant load map %s, falling back to %s\n", mapname, oldmap);
@@ -416,6 +709,8 @@ void SV_SpawnServer (char *mapname, qbool devmap, char* entityfile)
 	
 	sv.map_checksum2 = Com_TranslateMapChecksum (sv.mapname, sv.map_checksum2);
 
+	SV_NavNewMap ();
+
 	SV_ClearWorld (); // clear physics interaction links
 
 #ifdef USE_PR2
@@ -456,7 +751,7 @@ void SV_SpawnServer (char *mapname, qbool devmap, char* entityfile)
 #endif
 
 	ent = EDICT_NUM(0);
-	ent->e->free = false;
+	EDICT_SV(ent)->free = false;
 	ent->v.model = PR_SetString(sv.modelname);
 	ent->v.modelindex = 1;		// world model
 	ent->v.solid = SOLID_BSP;
@@ -562,6 +857,12 @@ void SV_SpawnServer (char *mapname, qbool devmap, char* entityfile)
 
 	Con_DPrintf ("Server spawned.\n");
 
+	if ((int)sv_fastmaprestart.value)
+		SV_TakeSpawnSnapshot (devmap, snapentityfile);
+
+	spawn_coldtime = Sys_DoubleTime () - start;
+	spawn_coldcount++;
+
 	// we change map - clear whole demo struct and sent initial state to all dest if any (for QTV only I thought)
 	SV_MVD_Record(NULL, true);
 
@@ -0,0 +1,445 @@
+/*
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+//	sv_log.c - log file writer thread
+//
+//	SV_Write_Log puts lines into a ring and a thread writes them to log files,
+//	so a slow disk never holds up a frame. only the game thread puts records
+//	in, only the writer thread takes them out, so the ring needs no lock.
+//	log files are opened by the game thread (SV_Logfile) and from then on
+//	belong to the writer: lines and close requests for a file go through the
+//	ring in order, the game thread only keeps the pointer to tell logs apart.
+//	file size for sv_maxlogsize is counted here instead of asked from the file.
+//	when the ring is full lines are dropped and counted, the frame never waits.
+//	a close request can't be dropped, it is kept aside and put in the ring
+//	with the next line which fits.
+
+#include "qwsvdef.h"
+
+#ifdef _WIN32
+#define LOG_BARRIER()	MemoryBarrier()
+#else
+#define LOG_BARRIER()	__sync_synchronize()
+#endif
+
+#define LOG_RING_SIZE		0x40000		// power of two
+#define LOG_ALIGN(x)		(((x) + 7) & ~7)
+#define LOG_HEADER			LOG_ALIGN((int) sizeof(logrecord_t))
+#define LOG_IDLE_SLEEP		10			// ms writer sleeps when there is nothing to write
+#define LOG_FLUSH_TIMEOUT	2.0			// seconds SV_LogFlush waits for a stuck disk
+#define LOG_MAX_CLOSING		64			// close requests kept aside while the ring is full
+
+#define LOGREC_SKIP			0			// rest of the ring up to its end is unused
+#define LOGREC_DATA			1
+#define LOGREC_CLOSE		2
+
+typedef struct
+{
+	FILE			*file;
+	int				type;
+	int				log;
+	int				gen;				// which opening of the log file this is for
+	int				len;				// of text following the header
+} logrecord_t;
+
+static struct
+{
+	volatile unsigned int	head;		// moved by game thread only
+	volatile unsigned int	tail;		// moved by writer only
+	volatile unsigned int	done;		// head at last flush of files
+
+	qbool			started;
+	unsigned int	highwater;
+	volatile unsigned int	batches;
+
+	byte			data[LOG_RING_SIZE];
+} logring;
+
+static int				log_gen[MAX_LOG];			// bumped each time log file is opened
+static volatile int		log_failed[MAX_LOG];		// gen of log file writer couldn't write
+static unsigned int		log_pending_drops[MAX_LOG];	// dropped since last line which got in
+
+static struct
+{
+	FILE			*file;
+	int				log;
+	int				gen;
+} log_closing[LOG_MAX_CLOSING];								// not in the ring yet, oldest first
+static int				log_numclosing;
+
+cvar_t	sv_logthread = {"sv_logthread", "1"};	// write log files from a thread
+
+static logrecord_t *SV_LogReserve (int len, unsigned int *size)
+{
+	unsigned int ofs = logring.head & (LOG_RING_SIZE - 1);
+	unsigned int room = LOG_RING_SIZE - ofs;
+	unsigned int need = LOG_HEADER + LOG_ALIGN(len);
+	logrecord_t *rec;
+
+	// record doesn't fit before end of the ring, skip there
+	if (room < need)
+	{
+		if (room + need > LOG_RING_SIZE - (logring.head - logring.tail))
+			return NULL;
+
+		if (room >= (unsigned int) LOG_HEADER)
+			((logrecord_t *) (logring.data + ofs))->type = LOGREC_SKIP;
+
+		*size = room + need;
+		rec = (logrecord_t *) logring.data;
+	}
+	else
+	{
+		if (need > LOG_RING_SIZE - (logring.head - logring.tail))
+			return NULL;
+
+		*size = need;
+		rec = (logrecord_t *) (logring.data + ofs);
+	}
+
+	rec->len = len;
+	return rec;
+}
+
+static void SV_LogCommit (unsigned int size)
+{
+	// record has to be there before the writer sees it
+	LOG_BARRIER ();
+	logring.head += size;
+
+	logring.highwater = max(logring.highwater, logring.head - logring.tail);
+}
+
+static DWORD WINAPI SV_LogWriter_Thread (void *unused)
+{
+	FILE *dirty[MAX_LOG];
+	int dirtygen[MAX_LOG];
+	logrecord_t *rec;
+	unsigned int head, ofs, room;
+	int i;
+
+	memset (dirty, 0, sizeof(dirty));
+
+	for ( ; ; )
+	{
+		head = logring.head;
+		if (logring.tail == head)
+		{
+			Sys_Sleep (LOG_IDLE_SLEEP);
+			continue;
+		}
+
+		LOG_BARRIER ();
+
+		while (logring.tail != head)
+		{
+			ofs = logring.tail & (LOG_RING_SIZE - 1);
+			room = LOG_RING_SIZE - ofs;
+			rec = (logrecord_t *) (logring.data + ofs);
+
+			if (room < (unsigned int) LOG_HEADER || rec->type == LOGREC_SKIP)
+			{
+				logring.tail += room;
+				continue;
+			}
+
+			if (rec->type == LOGREC_DATA)
+			{
+				if (fwrite ((byte *) rec + LOG_HEADER, 1, rec->len, rec->file) != (size_t) rec->len)
+					log_failed[rec->log] = rec->gen;
+				dirty[rec->log] = rec->file;
+				dirtygen[rec->log] = rec->gen;
+			}
+			else if (rec->type == LOGREC_CLOSE)
+			{
+				fclose (rec->file);
+				if (dirty[rec->log] == rec->file)
+					dirty[rec->log] = NULL;
+			}
+
+			// done with it, space can be used again
+			LOG_BARRIER ();
+			logring.tail += LOG_HEADER + LOG_ALIGN(rec->len);
+		}
+
+		// one flush for all lines of a batch
+		for (i = 0; i < MAX_LOG; i++)
+		{
+			if (dirty[i] && fflush (dirty[i]))
+				log_failed[i] = dirtygen[i];
+			dirty[i] = NULL;
+		}
+
+		logring.batches++;
+		LOG_BARRIER ();
+		logring.done = head;
+	}
+
+	return 0;
+}
+
+static qbool SV_LogPushClose (FILE *f, int sv_log, int gen)
+{
+	unsigned int size;
+	logrecord_t *rec;
+
+	if (!(rec = SV_LogReserve (0, &size)))
+		return false;
+
+	rec->type = LOGREC_CLOSE;
+	rec->file = f;
+	rec->log = sv_log;
+	rec->gen = gen;
+
+	SV_LogCommit (size);
+	return true;
+}
+
+// put close requests kept aside into the ring, as many as fit
+static void SV_LogPushClosing (void)
+{
+	int i;
+
+	for (i = 0; i < log_numclosing; i++)
+	{
+		if (!SV_LogPushClose (log_closing[i].file, log_closing[i].log, log_closing[i].gen))
+			break;
+	}
+
+	if (i)
+	{
+		log_numclosing -= i;
+		memmove (log_closing, log_closing + i, log_numclosing * sizeof(log_closing[0]));
+	}
+}
+
+static qbool SV_LogStart (void)
+{
+	if (logring.started)
+		return true;
+
+	if (!Sys_CreateThread (SV_LogWriter_Thread, NULL))
+	{
+		Con_Printf ("SV_LogStart: can't create thread, writing logs directly\n");
+		Cvar_SetValue (&sv_logthread, 0);
+		return false;
+	}
+
+	logring.started = true;
+	return true;
+}
+
+/*
+====================
+SV_LogFlush
+
+wait for the writer to write and flush everything put in the ring so far
+====================
+*/
+void SV_LogFlush (void)
+{
+	double start;
+
+	if (!logring.started || (logring.done == logring.head && !log_numclosing))
+		return;
+
+	start = Sys_DoubleTime ();
+	for (SV_LogPushClosing (); logring.done != logring.head || log_numclosing; SV_LogPushClosing ())
+	{
+		if (Sys_DoubleTime () - start > LOG_FLUSH_TIMEOUT)
+		{
+			Sys_Printf ("SV_LogFlush: log writer is stuck, %u bytes and %d files not written\n",
+			            logring.head - logring.tail, log_numclosing);
+			return;
+		}
+
+		Sys_Sleep (1);
+	}
+
+	LOG_BARRIER ();
+}
+
+static qbool SV_LogPush (int sv_log, char *prefix, char *msg)
+{
+	int prefixlen = strlen (prefix), msglen = strlen (msg);
+	unsigned int size;
+	logrecord_t *rec;
+
+	// files kept aside are closed as soon as there is room
+	if (log_numclosing)
+		SV_LogPushClosing ();
+
+	if (!(rec = SV_LogReserve (prefixlen + msglen, &size)))
+		return false;
+
+	rec->type = LOGREC_DATA;
+	rec->file = logs[sv_log].sv_logfile;
+	rec->log = sv_log;
+	rec->gen = log_gen[sv_log];
+	memcpy ((byte *) rec + LOG_HEADER, prefix, prefixlen);
+	memcpy ((byte *) rec + LOG_HEADER + prefixlen, msg, msglen);
+
+	SV_LogCommit (size);
+
+	logs[sv_log].file_size += prefixlen + msglen;
+	return true;
+}
+
+/*
+====================
+SV_LogAppend
+
+write prefix and msg to log file, false on write error. line which doesn't
+fit in the ring is dropped, that is not an error
+====================
+*/
+qbool SV_LogAppend (int sv_log, char *prefix, char *msg)
+{
+	FILE *f = logs[sv_log].sv_logfile;
+	char note[64];
+
+	if (!(int)sv_logthread.value || !SV_LogStart ())
+	{
+		// lines still in the ring go first
+		SV_LogFlush ();
+
+		if (log_failed[sv_log] == log_gen[sv_log])
+			return false;
+
+		if (fprintf (f, "%s%s", prefix, msg) < 0 || fflush (f))
+			return false;
+
+		logs[sv_log].file_size += strlen (prefix) + strlen (msg);
+		return true;
+	}
+
+	if (log_failed[sv_log] == log_gen[sv_log])
+		return false;
+
+	// frag logs are read by programs, they get no note
+	if (log_pending_drops[sv_log] && prefix[0])
+	{
+		snprintf (note, sizeof(note), "%u lines dropped, log writer was behind\n", log_pending_drops[sv_log]);
+		if (!SV_LogPush (sv_log, prefix, note))
+		{
+			log_pending_drops[sv_log]++;
+			logs[sv_log].dropped++;
+			return true;
+		}
+		log_pending_drops[sv_log] = 0;
+	}
+
+	if (!SV_LogPush (sv_log, prefix, msg))
+	{
+		log_pending_drops[sv_log]++;
+		logs[sv_log].dropped++;
+	}
+
+	return true;
+}
+
+/*
+====================
+SV_LogFileOpened
+
+called by SV_Logfile after log file was opened
+====================
+*/
+void SV_LogFileOpened (int sv_log)
+{
+	log_gen[sv_log]++;
+	log_pending_drops[sv_log] = 0;
+	logs[sv_log].file_size = FS_FileLength (logs[sv_log].sv_logfile);
+}
+
+/*
+====================
+SV_LogFileClose
+
+close log file after lines written to it so far
+====================
+*/
+void SV_LogFileClose (int sv_log)
+{
+	FILE *f = logs[sv_log].sv_logfile;
+
+	if (!f)
+		return;
+
+	logs[sv_log].sv_logfile = NULL;
+
+	if (!logring.started)
+	{
+		fclose (f);
+		return;
+	}
+
+	// earlier requests keep their order
+	if (log_numclosing)
+		SV_LogPushClosing ();
+
+	if (!log_numclosing && SV_LogPushClose (f, sv_log, log_gen[sv_log]))
+		return;
+
+	// ring is full, keep it aside until a line gets in. this many closes
+	// behind a writer which doesn't move only happen with a dead disk
+	if (log_numclosing == LOG_MAX_CLOSING)
+		SV_LogFlush ();
+
+	if (log_numclosing == LOG_MAX_CLOSING)
+	{
+		Sys_Printf ("SV_LogFileClose: log writer is stuck, %s log file left open\n", logs[sv_log].message_on);
+		return;
+	}
+
+	log_closing[log_numclosing].file = f;
+	log_closing[log_numclosing].log = sv_log;
+	log_closing[log_numclosing].gen = log_gen[sv_log];
+	log_numclosing++;
+}
+
+static void SV_LogStatus_f (void)
+{
+	int i;
+
+	Con_Printf ("writer    : %s", logring.started ? "thread" : "none");
+	if (logring.started && !(int)sv_logthread.value)
+		Con_Printf (", not used");
+	Con_Printf ("\n");
+
+	Con_Printf ("ring      : %u of %d KB used, %u KB at most, %u batches\n",
+	            (logring.head - logring.tail) / 1024, LOG_RING_SIZE / 1024, logring.highwater / 1024, logring.batches);
+	if (log_numclosing)
+		Con_Printf ("closing   : %d files waiting for room in the ring\n", log_numclosing);
+
+	for (i = MIN_LOG; i < MAX_LOG; i++)
+	{
+		if (!logs[i].sv_logfile && !logs[i].dropped)
+			continue;
+
+		Con_Printf ("%-10s: %s, %ld KB, %u lines dropped\n", logs[i].message_on,
+		            logs[i].sv_logfile ? "on" : "off", logs[i].file_size / 1024, logs[i].dropped);
+	}
+}
+
+void SV_LogInit (void)
+{
+	Cvar_Register (&sv_logthread);
+
+	Cmd_AddCommand ("logstatus", SV_LogStatus_f);
+}
@@ -140,6 +140,7 @@ cvar_t  sv_loadentfiles_dir = {"sv_loadentfiles_dir", ""}; // check for .ent fil
 cvar_t	sv_default_name = {"sv_default_name", "unnamed"};
 
 void sv_mod_msg_file_OnChange(cvar_t *cvar, char *value, qbool *cancel);
+void sv_mod_msg_bench_f(void);
 cvar_t	sv_mod_msg_file = {"sv_mod_msg_file", "", CVAR_NONE, sv_mod_msg_file_OnChange};
 
 cvar_t	sv_reliable_sound = {"sv_reliable_sound", "0"};
@@ -205,20 +206,18 @@ void SV_Shutdown (char *finalmsg)
 	int i;
 
 	if (!sv.state)
+	{
+		SV_LogFlush ();
 		return; // already shutdown. FIXME: what about error during SV_SpawnServer() ?
+	}
 
 	SV_FinalMessage(finalmsg);
 
 	Master_Shutdown ();
 
 	for (i = MIN_LOG; i < MAX_LOG; ++i)
-	{
-		if (logs[i].sv_logfile)
-		{
-			fclose (logs[i].sv_logfile);
-			logs[i].sv_logfile = NULL;
-		}
-	}
+		SV_LogFileClose (i);
+	SV_LogFlush ();
 	if (sv.mvdrecording)
 		SV_MVDStop_f();
 
@@ -1291,10 +1290,11 @@ static void SVC_DirectConnect (void)
 
 	edictnum = (newcl-svs.clients)+1;
 	ent = EDICT_NUM(edictnum);
-	ent->e->free = false;
+	EDICT_SV(ent)->free = false;
 	newcl->edict = ent;
 	// restore client name.
 	ent->v.netname = PR_SetString(newcl->name);
+	PR_FindTouch (ent);
 
 	s = ( vip ? va("%d", vip) : "" );
 
@@ -3115,9 +3115,17 @@ void SV_Frame (double time1)
 	start = Sys_DoubleTime ();
 	svs.stats.idle += start - end;
 
+	SV_ProfileFrameBegin ();
+
+	// capture records frame time, replay sets it
+	SV_CaptureFrame (&time1);
+
 	// keep the random time dependent
 	rand ();
 
+	PR_StringsFrame ();
+	PR_FindFrame ();
+
 	// decide the simulation time
 	if (!sv.paused)
 	{
@@ -3139,14 +3147,24 @@ void SV_Frame (double time1)
 	// toggle the log buffer if full
 	SV_CheckLog ();
 
+	SV_ProfileEnter (PROF_MVDSTREAM);
 	SV_MVDStream_Poll();
+	SV_ProfileLeave (PROF_MVDSTREAM);
+
+	SV_ProfileEnter (PROF_QTVDEMO);
+	SV_QTVDemo_Frame ();
+	SV_ProfileLeave (PROF_QTVDEMO);
 
 #ifdef SERVERONLY
+	SV_ProfileEnter (PROF_CBUF);
+
 	// check for commands typed to the host
 	SV_GetConsoleCommands ();
 
 	// process console commands
 	Cbuf_Execute ();
+
+	SV_ProfileLeave (PROF_CBUF);
 #endif
 
 	// check for map change;
@@ -3155,25 +3173,39 @@ void SV_Frame (double time1)
 	SV_CheckVars ();
 
 	// get packets
+	SV_ProfileEnter (PROF_READPACKETS);
 	SV_ReadPackets ();
+	SV_ProfileLeave (PROF_READPACKETS);
 
 	// move autonomous things around if enough time has passed
+	SV_ProfileEnter (PROF_PHYSICS);
 	if (!sv.paused)
 		SV_Physics ();
 	else
 		PausedTic ();
+	SV_ProfileLeave (PROF_PHYSICS);
 
 	// send messages back to the clients that had packets read this frame
+	SV_ProfileEnter (PROF_SEND);
 	SV_SendClientMessages ();
+	SV_ProfileLeave (PROF_SEND);
 
+	SV_ProfileEnter (PROF_DEMO);
 	demo_start = Sys_DoubleTime ();
 	SV_SendDemoMessage();
 	demo_end = Sys_DoubleTime ();
 	svs.stats.demo += demo_end - demo_start;
+	SV_ProfileLeave (PROF_DEMO);
 
 	// send a heartbeat to the master if needed
 	Master_Heartbeat ();
 
+	SV_DownloadFrame ();
+
+	SV_CaptureFrameEnd ();
+
+	SV_ProfileFrameEnd ();
+
 	// collect timing statistics
 	end = Sys_DoubleTime ();
 	svs.stats.active += end-start;
@@ -3224,11 +3256,21 @@ void SV_InitLocal (void)
 
 	SV_InitOperatorCommands	();
 	SV_UserInit ();
+	SV_DownloadCacheInit ();
+	SV_PreloadInit ();
+	SV_GamestateInit ();
+	SV_LogInit ();
+	SV_ProfileInit ();
+	SV_CaptureInit ();
+	SV_BenchInit ();
 
 	Cvar_Register (&sv_getrealip);
 	Cvar_Register (&sv_maxdownloadrate);
 	Cvar_Register (&sv_serverip);
 	Cvar_Register (&sv_forcespec_onfull);
+	Cvar_Register (&sv_fastmaprestart);
+
+	SV_NavInit ();
 
 #ifdef SERVERONLY
 	Cvar_Register (&rcon_password);
@@ -3361,6 +3403,8 @@ void SV_InitLocal (void)
 
 // QW262 -->
 	Cmd_AddCommand ("svadmin", SV_Admin_f);
+	Cmd_AddCommand ("spawnstats", SV_SpawnStats_f);
+	Cmd_AddCommand ("sv_mod_msg_bench", sv_mod_msg_bench_f);
 // <-- QW262
 
 	Cmd_AddCommand ("addip", SV_AddIP_f);
@@ -3858,7 +3902,9 @@ SV_Write_Log
 void SV_Write_Log(int sv_log, int level, char *msg)
 {
 	static date_t date;
-	char *log_msg, *error_msg;
+	static time_t datetime;
+	time_t now;
+	char prefix[sizeof(date.str) + 32];
 
 	if (!(logs[sv_log].sv_logfile && *msg))
 		return;
@@ -3866,40 +3912,40 @@ void SV_Write_Log(int sv_log, int level, char *msg)
 	if (logs[sv_log].log_level < level)
 		return;
 
-	SV_TimeOfDay(&date);
-
 	switch (sv_log)
 	{
 	case FRAG_LOG:
 	case MOD_FRAG_LOG:
-		log_msg = msg; // these logs aren't in fs_gamedir
-		error_msg = va("Can't write in %s log file: "/*%s/ */"%sN.log.\n",
-		               /*fs_gamedir,*/ logs[sv_log].message_on,
-		               logs[sv_log].file_name);
+		prefix[0] = 0;
 		break;
 	default:
-		log_msg = va("[%s].[%d] %s", date.str, level, msg);
-		error_msg = va("Can't write in %s log file: "/*%s/ */"%s%i.log.\n",
-		               /*fs_gamedir,*/ logs[sv_log].message_on,
-		               logs[sv_log].file_name, NET_UDPSVPort());
+		// date changes once a second, not every line
+		if ((now = time (NULL)) != datetime)
+		{
+			SV_TimeOfDay(&date);
+			datetime = now;
+		}
+		snprintf(prefix, sizeof(prefix), "[%s].[%d] ", date.str, level);
 	}
 
-	if (fprintf(logs[sv_log].sv_logfile, "%s", log_msg) < 0)
+	if (!SV_LogAppend(sv_log, prefix, msg))
 	{
 		//bliP: Sys_Error to Con_DPrintf ->
 		//VVD: Con_DPrintf to Sys_Printf ->
-		Sys_Printf("%s", error_msg);
+		if (sv_log == FRAG_LOG || sv_log == MOD_FRAG_LOG) // these logs aren't in fs_gamedir
+			Sys_Printf("Can't write in %s log file: "/*%s/ */"%sN.log.\n",
+			           /*fs_gamedir,*/ logs[sv_log].message_on,
+			           logs[sv_log].file_name);
+		else
+			Sys_Printf("Can't write in %s log file: "/*%s/ */"%s%i.log.\n",
+			           /*fs_gamedir,*/ logs[sv_log].message_on,
+			           logs[sv_log].file_name, NET_UDPSVPort());
 		//<-
 		SV_Logfile(sv_log, false);
 	}
-	else
+	else if ((int)sv_maxlogsize.value && logs[sv_log].file_size > (int)sv_maxlogsize.value)
 	{
-		fflush(logs[sv_log].sv_logfile);
-		if ((int)sv_maxlogsize.value &&
-		        (FS_FileLength(logs[sv_log].sv_logfile) > (int)sv_maxlogsize.value))
-		{
-			SV_Logfile(sv_log, true);
-		}
+		SV_Logfile(sv_log, true);
 	}
 }
 
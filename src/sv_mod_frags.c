@@ -33,17 +33,143 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 qwmsg_t *qwmsg[MOD_MSG_MAX + 1];
 static qbool qwm_static = true;
 
-void free_qwmsg_t(qwmsg_t **qwmsg1)
+// prefilter: messages by hash of first QWMSG_PREFIX chars of their literal.
+// one pass over the string finds messages whose literal is in it, only
+// those and messages without literal are given to pcre
+#define QWMSG_PREFIX		4
+#define QWMSG_HASH_SIZE		256
+#define QWMSG_OVECTOR		30
+
+static int qwmsg_hash[QWMSG_HASH_SIZE];		// first message + 1, 0 if none
+static int qwmsg_hash_next[MOD_MSG_MAX];	// next message + 1 with same hash
+
+static unsigned int qwmsg_prefix_hash(const char *s)
 {
-	int i;
+	unsigned int key;
 
-	if (qwm_static)
-		return;
+	memcpy(&key, s, QWMSG_PREFIX);
+	return (key * 2654435761u) >> 24;
+}
+
+/*
+ * longest text outside of groups that every match of regexp has to contain.
+ * conservative: anything not understood ends the text, alternatives and
+ * inline options give no text at all
+ */
+static char *qwmsg_literal(const char *re)
+{
+	char run[128], best[128];
+	int runlen = 0, bestlen = 0, depth = 0;
+	const char *p;
+	char c;
+
+	if (strchr(re, '|') || strstr(re, "(?"))
+		return NULL;
+
+	for (p = re; ; p++)
+	{
+		c = *p;
+
+		if (c == '\\' && p[1] && !isalnum((unsigned char)p[1]))
+			c = *++p; // escaped punctuation is itself
+		else if (c == '\\' || c == '(' || c == ')' || c == '[' || strchr(".^$*+?{", c))
+		{
+			// quantifier makes the char before it optional
+			if ((c == '*' || c == '?' || c == '{') && runlen)
+				runlen--;
+
+			if (runlen > bestlen)
+			{
+				memcpy(best, run, runlen);
+				bestlen = runlen;
+			}
+			runlen = 0;
+
+			if (!c)
+				break;
+
+			if (c == '(')
+				depth++;
+			else if (c == ')')
+				depth--;
+			else if (c == '\\')
+			{
+				// classes and \b are one letter, \x41, \0nn, \cX, \p{..}, back references... have
+				// more after it which is not text, there is no telling how much
+				if (!p[1] || !strchr("dDwWsSbB", p[1]))
+					return NULL;
+				p++;
+			}
+			else if (c == '{' && (p = strchr(p, '}')) == NULL)
+				return NULL;
+			else if (c == '[')
+			{
+				// class, "]" right at its start is part of it
+				p += (p[1] == '^') ? 2 : 1;
+				for (p++; *p && *p != ']'; p++)
+				{
+					if (*p == '\\' && p[1])
+						p++;
+				}
+				if (!*p)
+					return NULL;
+			}
+			continue;
+		}
+
+		if (depth || runlen >= (int) sizeof(run) - 1)
+			continue;
+
+		run[runlen++] = c;
+	}
+
+	if (bestlen < QWMSG_PREFIX)
+		return NULL;
+
+	best[bestlen] = 0;
+	return Q_strdup(best);
+}
+
+static void qwmsg_compile(void)
+{
+	const char *errbuf;
+	int i, erroffset, hash;
+
+	memset(qwmsg_hash, 0, sizeof(qwmsg_hash));
+
+	for (i = 0; qwmsg[i]; i++)
+	{
+		if (!(qwmsg[i]->regex = pcre_compile(qwmsg[i]->str, 0, &errbuf, &erroffset, 0)))
+		{
+			Con_Printf("WARNING: sv_mod_msg_file_OnChange: pcre_compile(%s) error %s\n", qwmsg[i]->str, errbuf);
+			continue;
+		}
+
+		if ((qwmsg[i]->literal = qwmsg_literal(qwmsg[i]->str)))
+		{
+			qwmsg[i]->literal_len = strlen(qwmsg[i]->literal);
+			// first message of a hash is matched first
+			hash = qwmsg_prefix_hash(qwmsg[i]->literal);
+			qwmsg_hash_next[i] = qwmsg_hash[hash];
+			qwmsg_hash[hash] = i + 1;
+		}
+	}
+}
+
+static void free_qwmsg_t(qwmsg_t **qwmsg1)
+{
+	int i;
 
 	for (i = 0; qwmsg1[i]; i++)
 	{
-		Q_free(qwmsg1[i]->str);
-		Q_free(qwmsg1[i]);
+		Q_free(qwmsg1[i]->regex);
+		Q_free(qwmsg1[i]->literal);
+
+		if (!qwm_static)
+		{
+			Q_free(qwmsg1[i]->str);
+			Q_free(qwmsg1[i]);
+		}
 	}
 }
 
@@ -108,71 +234,251 @@ void sv_mod_msg_file_OnChange(cvar_t *cvar, char *value, qbool *cancel)
 		fclose(fp);
 	}
 	qwmsg[i] = NULL;
+	qwmsg_compile();
 	*cancel = false;
 }
 
-const char **qwmsg_pcre_check(const char *str, const char *qwm_str, int str_len)
+// messages which may match str, in mask
+static void qwmsg_prefilter(const char *str, int str_len, unsigned int *mask)
+{
+	int i, pos;
+
+	memset(mask, 0, (MOD_MSG_MAX / 32) * sizeof(*mask));
+
+	for (i = 0; qwmsg[i]; i++)
+	{
+		if (qwmsg[i]->regex && !qwmsg[i]->literal)
+			mask[i >> 5] |= 1u << (i & 31);
+	}
+
+	for (pos = 0; pos + QWMSG_PREFIX <= str_len; pos++)
+	{
+		for (i = qwmsg_hash[qwmsg_prefix_hash(str + pos)] - 1; i >= 0; i = qwmsg_hash_next[i] - 1)
+		{
+			if (pos + qwmsg[i]->literal_len <= str_len && !memcmp(str + pos, qwmsg[i]->literal, qwmsg[i]->literal_len))
+				mask[i >> 5] |= 1u << (i & 31);
+		}
+	}
+}
+
+static const char **qwmsg_pcre_exec(const char *str, qwmsg_t *msg, int str_len)
+{
+	int ovector[QWMSG_OVECTOR];
+	const char **buf = NULL;
+	int stringcount;
+
+	stringcount = pcre_exec(msg->regex, NULL, str, str_len, 0, 0, ovector, QWMSG_OVECTOR);
+	if (stringcount <= 0)
+		return NULL;
+
+	pcre_get_substring_list(str, ovector, stringcount, &buf);
+	return buf;
+}
+
+// how it was done before patterns were compiled once, for sv_mod_msg_bench
+static const char **qwmsg_pcre_check(const char *str, const char *qwm_str, int str_len)
 {
 	pcre *reg;
-	int *ovector[32];
+	int ovector[QWMSG_OVECTOR];
 	const char *errbuf;
 	int erroffset = 0;
 	const char **buf = NULL;
 	int stringcount;
 
 	if (!(reg = pcre_compile(qwm_str, 0, &errbuf, &erroffset, 0)))
-	{
-		Sys_Printf("WARNING: qwmsg_pcre_check: pcre_compile(%s) error %s\n", qwm_str, errbuf);
 		return NULL;
-	}
 
-	stringcount = pcre_exec(reg, NULL, str, str_len, 0, 0, (int *)&ovector[0], 32);
+	stringcount = pcre_exec(reg, NULL, str, str_len, 0, 0, ovector, QWMSG_OVECTOR);
 	Q_free(reg);
 	if (stringcount <= 0)
 		return NULL;
 
-	pcre_get_substring_list(str, (int *)&ovector[0], stringcount, &buf);
+	pcre_get_substring_list(str, ovector, stringcount, &buf);
 	return buf;
 }
 
+static char *qwmsg_format(qwmsg_t *msg, const char **buf)
+{
+	int pl1, pl2, str_len;
+	char *ret = NULL;
+
+	switch (msg->msg_type)
+	{
+	case WEAPON:
+		pl1 = pl2 = 1;
+		switch (msg->pl_count)
+		{
+		case 2:
+			pl2 += msg->reverse;
+			pl1 = 3 - pl2;
+		case 1:
+			str_len = strlen(buf[pl1]) + strlen(buf[pl2]) + strlen(qw_weapon[msg->id]) + 5 + 10;
+			ret = (char *) Q_malloc (str_len);
+			snprintf(ret, str_len, "%s\\%s\\%s\\%d\n", buf[pl1], buf[pl2], qw_weapon[msg->id], (int)time(NULL));
+			break;
+		default: ret = NULL;
+		}
+		break;
+	case SYSTEM:
+		str_len = strlen(buf[1]) * 2 + strlen(qw_system[msg->id]) + 4 + 10;
+		ret = (char *) Q_malloc (str_len);
+		snprintf(ret, str_len, "%s\\%s\\%d\n", buf[1], qw_system[msg->id], (int)time(NULL));
+		break;
+	default: ret = NULL;
+	}
+
+	return ret;
+}
+
 // main function
 char *parse_mod_string(char *str)
+{
+	unsigned int mask[MOD_MSG_MAX / 32];
+	const char **buf;
+	int i, str_len = strlen(str);
+	char *ret = NULL;
+
+	qwmsg_prefilter(str, str_len, mask);
+
+	for (i = 0; qwmsg[i]; i++)
+	{
+		if (!(mask[i >> 5] & (1u << (i & 31))))
+			continue;
+
+		if ((buf = qwmsg_pcre_exec(str, qwmsg[i], str_len)))
+		{
+			ret = qwmsg_format(qwmsg[i], buf);
+			pcre_free_substring_list(buf);
+			break;
+		}
+	}
+	return ret;
+}
+
+// parse_mod_string as it was: compile every message for every string
+static char *parse_mod_string_compile(char *str)
 {
 	const char **buf;
 	int i, str_len = strlen(str);
 	char *ret = NULL;
+
 	for (i = 0; qwmsg[i]; i++)
 	{
 		if ((buf = qwmsg_pcre_check(str, qwmsg[i]->str, str_len)))
 		{
-			int pl1, pl2;
-			switch (qwmsg[i]->msg_type)
-			{
-			case WEAPON:
-				pl1 = pl2 = 1;
-				switch (qwmsg[i]->pl_count)
-				{
-				case 2:
-					pl2 += qwmsg[i]->reverse;
-					pl1 = 3 - pl2;
-				case 1:
-					str_len = strlen(buf[pl1]) + strlen(buf[pl2]) + strlen(qw_weapon[qwmsg[i]->id]) + 5 + 10;
-					ret = (char *) Q_malloc (str_len);
-					snprintf(ret, str_len, "%s\\%s\\%s\\%d\n", buf[pl1], buf[pl2], qw_weapon[qwmsg[i]->id], (int)time(NULL));
-					break;
-				default: ret = NULL;
-				}
-				break;
-			case SYSTEM:
-				str_len = strlen(buf[1]) * 2 + strlen(qw_system[qwmsg[i]->id]) + 4 + 10;
-				ret = (char *) Q_malloc (str_len);
-				snprintf(ret, str_len, "%s\\%s\\%d\n", buf[1], qw_system[qwmsg[i]->id], (int)time(NULL));
-				break;
-			default: ret = NULL;
-			}
+			ret = qwmsg_format(qwmsg[i], buf);
 			pcre_free_substring_list(buf);
 			break;
 		}
 	}
 	return ret;
 }
+
+/*
+ * sv_mod_msg_bench [file] [repeat]
+ * parses each line of file (console log with obituaries for example) with
+ * compiled messages and the way it was done before, checks both give the
+ * same and prints time per line. without file lines are made of messages
+ */
+void sv_mod_msg_bench_f(void)
+{
+	char **lines = NULL, buf[1024], *a, *b;
+	int numlines = 0, maxlines = 0, repeat, i, r, matched = 0, differ = 0;
+	double start, compiled, uncompiled;
+	FILE *fp;
+
+	repeat = Cmd_Argc() > 2 ? max(1, Q_atoi(Cmd_Argv(2))) : 10;
+
+	if (Cmd_Argc() > 1 && strcmp(Cmd_Argv(1), "-"))
+	{
+		if (!(fp = fopen(Cmd_Argv(1), "r")))
+		{
+			Con_Printf("can't open %s\n", Cmd_Argv(1));
+			return;
+		}
+
+		while (fgets(buf, sizeof(buf), fp))
+		{
+			// qconsole log lines start with "[date].[level] "
+			a = buf;
+			if (buf[0] == '[' && (b = strstr(buf, "] ")))
+				a = b + 2;
+
+			if (numlines == maxlines)
+			{
+				maxlines = max(1024, maxlines * 2);
+				if (!(lines = (char **) realloc(lines, maxlines * sizeof(char *))))
+					Sys_Error("sv_mod_msg_bench: out of memory");
+			}
+			lines[numlines++] = Q_strdup(a);
+		}
+		fclose(fp);
+	}
+	else
+	{
+		// every message, and a say line which matches none
+		maxlines = 2 * MOD_MSG_MAX;
+		lines = (char **) Q_malloc(maxlines * sizeof(char *));
+		for (i = 0; qwmsg[i]; i++)
+		{
+			strlcpy(buf, qwmsg[i]->str, sizeof(buf));
+			while ((a = strstr(buf, "(.*)")))
+			{
+				memmove(a + 6, a + 4, strlen(a + 4) + 1);
+				memcpy(a, "player", 6);
+			}
+			strlcat(buf, "\n", sizeof(buf));
+			lines[numlines++] = Q_strdup(buf);
+			lines[numlines++] = Q_strdup(va("player%d: gg\n", i));
+		}
+	}
+
+	for (i = 0; i < numlines; i++)
+	{
+		a = parse_mod_string(lines[i]);
+		b = parse_mod_string_compile(lines[i]);
+		if (a)
+			matched++;
+		// time in them may differ by a second
+		if (!a != !b || (a && strncmp(a, b, strrchr(a, '\\') - a)))
+		{
+			if (!differ++)
+				Con_Printf("differ: %s", lines[i]);
+		}
+		Q_free(a);
+		Q_free(b);
+	}
+
+	start = Sys_DoubleTime();
+	for (r = 0; r < repeat; r++)
+	{
+		for (i = 0; i < numlines; i++)
+		{
+			a = parse_mod_string(lines[i]);
+			Q_free(a);
+		}
+	}
+	compiled = Sys_DoubleTime() - start;
+
+	start = Sys_DoubleTime();
+	for (i = 0; i < numlines; i++)
+	{
+		a = parse_mod_string_compile(lines[i]);
+		Q_free(a);
+	}
+	uncompiled = (Sys_DoubleTime() - start) * repeat;
+
+	for (i = 0; i < numlines; i++)
+		Q_free(lines[i]);
+	free(lines);
+
+	if (!numlines)
+	{
+		Con_Printf("no lines\n");
+		return;
+	}
+
+	Con_Printf("%d lines, %d matched, %d differ\n", numlines, matched, differ);
+	Con_Printf("compiled   : %.2f us per line\n", compiled * 1000000 / (numlines * repeat));
+	Con_Printf("uncompiled : %.2f us per line\n", uncompiled * 1000000 / (numlines * repeat));
+}
@@ -66,6 +66,9 @@ typedef struct qw_message
     int pl_count; // count of players in each message
     char *str; // pointer to string
     qbool reverse; // reversing message? (a->b or b->a)
+    pcre *regex; // str compiled by sv_mod_msg_file_OnChange
+    char *literal; // text each match of str contains, NULL if none
+    int literal_len;
 } qwmsg_t;
 // messages types
 enum {	MIN_TYPE = 0, WEAPON = 0, SYSTEM, MAX_TYPE};
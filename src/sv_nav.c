@@ -0,0 +1,816 @@
+/*
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+//	sv_nav.c - waypoint graph of the world model and A* path queries for bots
+//
+//	nodes are player origins standing on walkable floor, sampled on a grid of
+//	columns through the player hull. edges connect nodes of neighbour columns
+//	which can be walked (step up to STEPSIZE) or dropped down to.
+//	only static world geometry is considered, doors and plats are ignored.
+
+#include "qwsvdef.h"
+
+#define NAV_VERSION		1
+#define NAV_GRID		48		// column spacing
+#define NAV_SCAN_STEP	16		// vertical sampling inside a column
+#define NAV_STEPSIZE	18
+#define NAV_MAXDROP		256
+#define NAV_MAX_NODES	65536
+#define NAV_SEARCH_IDLE	0.5		// seconds a search out of budget waits to be asked for again
+#define NAV_COST_TRACE	8		// budget a hull trace takes while building, a point test is 1
+#define NAV_COST_WRITE	2000	// budget a piece of the cache file takes
+#define NAV_WRITE_CHUNK	65536
+
+cvar_t	sv_nav			= {"sv_nav",		"0"};		// build/load graph on map load
+cvar_t	sv_nav_budget	= {"sv_nav_budget",	"20000"};	// A* node expansions per server frame, building takes from it too
+
+typedef struct navnode_s
+{
+	vec3_t	origin;
+	int		firstedge;
+	int		numedges;
+} navnode_t;
+
+typedef struct navedge_s
+{
+	int		node;
+	float	cost;
+} navedge_t;
+
+typedef struct navheader_s
+{
+	char		ident[4];
+	int			version;
+	unsigned	checksum;
+	int			numnodes;
+	int			numedges;
+} navheader_t;
+
+typedef enum
+{
+	NAVB_NONE,
+	NAVB_FLOORS,			// column by column
+	NAVB_EDGES,				// node by node
+	NAVB_WRITE				// cache file piece by piece, graph is valid already
+} navbuildstage_t;
+
+typedef struct navgraph_s
+{
+	qbool		valid;
+	unsigned	checksum;			// sv.map_checksum graph was built for
+
+	vec3_t		gridorigin;
+	int			gridx, gridy;
+	int			*colstart;			// [gridx*gridy+1], nodes are sorted by column
+
+	int			numnodes;
+	navnode_t	*nodes;
+	int			numedges;
+	navedge_t	*edges;
+
+	// A* work arrays, visited by generation so nothing is cleared per query
+	float		*g;
+	int			*parent;
+	int			*gen;
+	int			*heap;				// [numedges+1], a node goes in again each time its g improves
+	int			heapsize;
+	int			curgen;
+
+	// search which ran out of budget, the same query goes on with it next frame
+	qbool		searching;
+	int			from, goal;
+	double		searchtime;			// realtime it was last asked for
+
+	// graph being built a bit each frame queries are made
+	navbuildstage_t	stage;
+	int			buildnext;			// column or node to do next
+	int			maxedges;
+	FILE		*cachefile;
+	int			cacheofs;			// bytes of nodes and edges written
+} navgraph_t;
+
+static navgraph_t nav;
+
+static double	nav_budget_time;
+static int		nav_budget_left;
+
+static struct
+{
+	int		queries;
+	int		found;
+	int		deferred;			// ran out of per frame budget
+	int		expanded;
+	double	buildtime;
+} navstats;
+
+static void SV_NavFree (void)
+{
+	if (nav.cachefile)
+		fclose (nav.cachefile);
+	Q_free (nav.colstart);
+	Q_free (nav.nodes);
+	Q_free (nav.edges);
+	Q_free (nav.g);
+	Q_free (nav.parent);
+	Q_free (nav.gen);
+	Q_free (nav.heap);
+	memset (&nav, 0, sizeof(nav));
+}
+
+static void SV_NavSetupGrid (void)
+{
+	cmodel_t *world = sv.worldmodel;
+
+	VectorCopy (world->mins, nav.gridorigin);
+	nav.gridx = (int)((world->maxs[0] - world->mins[0]) / NAV_GRID) + 1;
+	nav.gridy = (int)((world->maxs[1] - world->mins[1]) / NAV_GRID) + 1;
+}
+
+static int SV_NavColumn (const vec3_t p)
+{
+	int x, y;
+
+	x = (int)((p[0] - nav.gridorigin[0]) / NAV_GRID + 0.5);
+	y = (int)((p[1] - nav.gridorigin[1]) / NAV_GRID + 0.5);
+	x = bound(0, x, nav.gridx - 1);
+	y = bound(0, y, nav.gridy - 1);
+
+	return y * nav.gridx + x;
+}
+
+static void SV_NavAllocWork (void)
+{
+	nav.g = (float *) Q_malloc (nav.numnodes * sizeof(float));
+	nav.parent = (int *) Q_malloc (nav.numnodes * sizeof(int));
+	nav.gen = (int *) Q_calloc (nav.numnodes, sizeof(int));
+	nav.heap = (int *) Q_malloc ((nav.numedges + 1) * sizeof(int));
+	nav.heapsize = 0;
+	nav.curgen = 0;
+	nav.searching = false;
+}
+
+/*
+==============================================================================
+
+BUILD
+
+==============================================================================
+*/
+
+// can player hull move from a to the column of b and end up standing on b
+static qbool SV_NavReachable (hull_t *hull, const vec3_t a, const vec3_t b)
+{
+	vec3_t start, mid, end;
+	trace_t trace;
+
+	VectorCopy (a, start);
+	start[2] += NAV_STEPSIZE;
+	VectorSet (mid, b[0], b[1], start[2]);
+
+	trace = CM_HullTrace (hull, start, mid);
+	if (trace.startsolid || trace.allsolid || trace.fraction < 1)
+		return false;
+
+	VectorSet (end, b[0], b[1], b[2] - 1);
+	trace = CM_HullTrace (hull, mid, end);
+	if (trace.startsolid || trace.allsolid)
+		return false;
+
+	return fabs (trace.endpos[2] - b[2]) < 1;
+}
+
+// floors of one column, returns the cost of it
+static int SV_NavBuildColumn (int c)
+{
+	cmodel_t *world = sv.worldmodel;
+	hull_t *hull = &world->hulls[1], *pointhull = &world->hulls[0];
+	trace_t trace;
+	vec3_t p, below, feet;
+	int i, cost = 0;
+
+	nav.colstart[c] = nav.numnodes;
+
+	p[0] = nav.gridorigin[0] + (c % nav.gridx) * NAV_GRID;
+	p[1] = nav.gridorigin[1] + (c / nav.gridx) * NAV_GRID;
+
+	for (p[2] = world->maxs[2]; p[2] > world->mins[2]; p[2] -= NAV_SCAN_STEP)
+	{
+		cost++;
+		if (CM_HullPointContents (hull, hull->firstclipnode, p) == CONTENTS_SOLID)
+			continue;
+
+		VectorSet (below, p[0], p[1], p[2] - NAV_SCAN_STEP);
+		if (CM_HullPointContents (hull, hull->firstclipnode, below) != CONTENTS_SOLID)
+			continue;
+
+		cost += NAV_COST_TRACE;
+		trace = CM_HullTrace (hull, p, below);
+		if (trace.startsolid || trace.fraction == 1 || trace.plane.normal[2] < 0.7)
+			continue;
+
+		VectorSet (feet, trace.endpos[0], trace.endpos[1], trace.endpos[2] - 23);
+		i = CM_HullPointContents (pointhull, pointhull->firstclipnode, feet);
+		if (i == CONTENTS_LAVA || i == CONTENTS_SLIME || i == CONTENTS_SKY)
+			continue;
+
+		if (nav.numnodes == NAV_MAX_NODES)
+			break;
+
+		VectorCopy (trace.endpos, nav.nodes[nav.numnodes].origin);
+		nav.numnodes++;
+	}
+
+	return cost;
+}
+
+// edges from node n to nodes of neighbour columns, returns the cost of it
+static int SV_NavBuildEdges (int n)
+{
+	hull_t *hull = &sv.worldmodel->hulls[1];
+	navnode_t *node = &nav.nodes[n];
+	int x, y, c, j, k, dx, dy, cost = 1;
+
+	node->firstedge = nav.numedges;
+	c = SV_NavColumn (node->origin);
+	x = c % nav.gridx;
+	y = c / nav.gridx;
+
+	for (dy = -1; dy <= 1; dy++)
+	{
+		for (dx = -1; dx <= 1; dx++)
+		{
+			if ((!dx && !dy) || x + dx < 0 || x + dx >= nav.gridx || y + dy < 0 || y + dy >= nav.gridy)
+				continue;
+
+			k = (y + dy) * nav.gridx + x + dx;
+			for (j = nav.colstart[k]; j < nav.colstart[k + 1]; j++)
+			{
+				float dz = nav.nodes[j].origin[2] - node->origin[2];
+				vec3_t d;
+
+				if (dz > NAV_STEPSIZE || dz < -NAV_MAXDROP)
+					continue;
+
+				cost += 2 * NAV_COST_TRACE;
+				if (!SV_NavReachable (hull, node->origin, nav.nodes[j].origin))
+					continue;
+
+				if (nav.numedges == nav.maxedges)
+				{
+					nav.maxedges *= 2;
+					if (!(nav.edges = (navedge_t *) realloc (nav.edges, nav.maxedges * sizeof(navedge_t))))
+						Sys_Error ("SV_NavBuildEdges: not enough memory for %i edges", nav.maxedges);
+				}
+
+				VectorSubtract (nav.nodes[j].origin, node->origin, d);
+				nav.edges[nav.numedges].node = j;
+				nav.edges[nav.numedges].cost = VectorLength (d);
+				nav.numedges++;
+			}
+		}
+	}
+
+	node->numedges = nav.numedges - node->firstedge;
+	return cost;
+}
+
+static void SV_NavBuildStart (void)
+{
+	SV_NavFree ();
+	SV_NavSetupGrid ();
+
+	nav.colstart = (int *) Q_malloc ((nav.gridx * nav.gridy + 1) * sizeof(int));
+	nav.nodes = (navnode_t *) Q_malloc (NAV_MAX_NODES * sizeof(navnode_t));
+	nav.checksum = sv.map_checksum;
+	nav.stage = NAVB_FLOORS;
+	nav.buildnext = 0;
+
+	navstats.buildtime = 0;
+}
+
+static qbool SV_NavOpenCache (void);
+static qbool SV_NavWriteCache (void);
+
+/*
+=================
+SV_NavBuildStep
+
+goes on with the graph being built or its cache file being written until
+budget is used up, a column of floors or the edges of a node at a time.
+returns true once the graph can be searched
+=================
+*/
+static qbool SV_NavBuildStep (int *budget)
+{
+	int ncol = nav.gridx * nav.gridy;
+	double start = Sys_DoubleTime ();
+
+	while (*budget > 0 && nav.stage != NAVB_NONE)
+	{
+		switch (nav.stage)
+		{
+		case NAVB_FLOORS:
+			if (nav.buildnext < ncol)
+			{
+				*budget -= SV_NavBuildColumn (nav.buildnext++);
+				break;
+			}
+
+			nav.colstart[ncol] = nav.numnodes;
+			nav.maxedges = max(nav.numnodes * 8, 1);
+			nav.edges = (navedge_t *) Q_malloc (nav.maxedges * sizeof(navedge_t));
+			nav.stage = NAVB_EDGES;
+			nav.buildnext = 0;
+			break;
+
+		case NAVB_EDGES:
+			if (nav.buildnext < nav.numnodes)
+			{
+				*budget -= SV_NavBuildEdges (nav.buildnext++);
+				break;
+			}
+
+			nav.valid = true;
+			SV_NavAllocWork ();
+			Con_DPrintf ("Nav: %i nodes, %i edges, built in %.0f ms\n", nav.numnodes, nav.numedges,
+				(navstats.buildtime + Sys_DoubleTime () - start) * 1000);
+
+			nav.stage = SV_NavOpenCache () ? NAVB_WRITE : NAVB_NONE;
+			break;
+
+		default: // NAVB_WRITE
+			*budget -= NAV_COST_WRITE;
+			if (!SV_NavWriteCache ())
+				nav.stage = NAVB_NONE;
+			break;
+		}
+	}
+
+	navstats.buildtime += Sys_DoubleTime () - start;
+	return nav.valid;
+}
+
+// whole graph and its cache at once, for map load and nav_build
+static void SV_NavBuild (void)
+{
+	int budget;
+
+	SV_NavBuildStart ();
+	do
+	{
+		budget = 0x7fffffff;
+		SV_NavBuildStep (&budget);
+	} while (nav.stage != NAVB_NONE);
+}
+
+/*
+==============================================================================
+
+DISK CACHE
+
+==============================================================================
+*/
+
+static void SV_NavCachePath (char *buf, int bufsize)
+{
+	snprintf (buf, bufsize, "navcache/%s.nav", sv.mapname);
+}
+
+// header goes out now, nodes and edges a piece per SV_NavWriteCache
+static qbool SV_NavOpenCache (void)
+{
+	navheader_t header;
+	char name[MAX_OSPATH + MAP_NAME_LEN + 16];
+
+	snprintf (name, sizeof(name), "%s/navcache/%s.nav", fs_gamedir, sv.mapname);
+	FS_CreatePath (name);
+
+	if (!(nav.cachefile = fopen (name, "wb")))
+	{
+		Con_Printf ("Nav: can't write %s\n", name);
+		return false;
+	}
+
+	memcpy (header.ident, "QNAV", 4);
+	header.version = LittleLong (NAV_VERSION);
+	header.checksum = LittleLong (nav.checksum);
+	header.numnodes = LittleLong (nav.numnodes);
+	header.numedges = LittleLong (nav.numedges);
+
+	// node/edge arrays are written in host order, the checksum in the header guards against foreign files
+	fwrite (&header, sizeof(header), 1, nav.cachefile);
+	nav.cacheofs = 0;
+	return true;
+}
+
+// next NAV_WRITE_CHUNK bytes of nodes and edges, returns false once the file is closed.
+// a file cut short by a map change fails the length check of SV_NavReadCache
+static qbool SV_NavWriteCache (void)
+{
+	int nodesize = nav.numnodes * sizeof(navnode_t);
+	int total = nodesize + nav.numedges * sizeof(navedge_t);
+	int len = min(total - nav.cacheofs, NAV_WRITE_CHUNK);
+	byte *data;
+
+	if (nav.cacheofs < nodesize)
+	{
+		data = (byte *) nav.nodes + nav.cacheofs;
+		len = min(len, nodesize - nav.cacheofs);
+	}
+	else
+	{
+		data = (byte *) nav.edges + nav.cacheofs - nodesize;
+	}
+
+	if (len > 0 && fwrite (data, 1, len, nav.cachefile) != (size_t) len)
+		len = total; // disk full, leave it short
+	nav.cacheofs += len;
+
+	if (nav.cacheofs < total)
+		return true;
+
+	fclose (nav.cachefile);
+	nav.cachefile = NULL;
+	return false;
+}
+
+static qbool SV_NavReadCache (void)
+{
+	navheader_t *header;
+	char name[MAX_OSPATH];
+	byte *buf;
+	int len, c, n, i;
+
+	SV_NavCachePath (name, sizeof(name));
+	if (!(buf = FS_LoadTempFile (name, &len)) || len < (int) sizeof(navheader_t))
+		return false;
+
+	header = (navheader_t *) buf;
+	if (memcmp (header->ident, "QNAV", 4) || LittleLong (header->version) != NAV_VERSION
+		|| (unsigned) LittleLong (header->checksum) != sv.map_checksum)
+		return false;
+
+	SV_NavFree ();
+	SV_NavSetupGrid ();
+
+	nav.numnodes = LittleLong (header->numnodes);
+	nav.numedges = LittleLong (header->numedges);
+	if (nav.numnodes < 0 || nav.numnodes > NAV_MAX_NODES || nav.numedges < 0 || nav.numedges > len / (int) sizeof(navedge_t)
+		|| len != (int)(sizeof(navheader_t) + nav.numnodes * sizeof(navnode_t) + nav.numedges * sizeof(navedge_t)))
+	{
+		nav.numnodes = nav.numedges = 0;
+		return false;
+	}
+
+	nav.nodes = (navnode_t *) Q_malloc (max(nav.numnodes, 1) * sizeof(navnode_t));
+	nav.edges = (navedge_t *) Q_malloc (max(nav.numedges, 1) * sizeof(navedge_t));
+	memcpy (nav.nodes, buf + sizeof(navheader_t), nav.numnodes * sizeof(navnode_t));
+	memcpy (nav.edges, buf + sizeof(navheader_t) + nav.numnodes * sizeof(navnode_t), nav.numedges * sizeof(navedge_t));
+
+	// searches index by these without checking, a bad file is built again
+	for (i = 0; i < nav.numnodes; i++)
+	{
+		navnode_t *node = &nav.nodes[i];
+
+		if (node->firstedge < 0 || node->numedges < 0 || node->firstedge > nav.numedges - node->numedges
+			|| IS_NAN(node->origin[0]) || IS_NAN(node->origin[1]) || IS_NAN(node->origin[2]))
+			goto bad;
+	}
+	for (i = 0; i < nav.numedges; i++)
+	{
+		if (nav.edges[i].node < 0 || nav.edges[i].node >= nav.numnodes || !(nav.edges[i].cost >= 0))
+			goto bad;
+	}
+
+	// nodes were stored sorted by column, rebuild column index
+	nav.colstart = (int *) Q_malloc ((nav.gridx * nav.gridy + 1) * sizeof(int));
+	for (c = 0, n = 0; c < nav.gridx * nav.gridy; c++)
+	{
+		nav.colstart[c] = n;
+		while (n < nav.numnodes && SV_NavColumn (nav.nodes[n].origin) == c)
+			n++;
+	}
+	nav.colstart[nav.gridx * nav.gridy] = nav.numnodes;
+	if (n != nav.numnodes)
+		goto bad;
+
+	nav.checksum = sv.map_checksum;
+	nav.valid = true;
+	SV_NavAllocWork ();
+
+	Con_DPrintf ("Nav: loaded %s, %i nodes, %i edges\n", name, nav.numnodes, nav.numedges);
+	return true;
+
+bad:
+	Con_Printf ("Nav: %s is broken, building it again\n", name);
+	SV_NavFree ();
+	return false;
+}
+
+// whole graph now, from the cache if there is a good one
+static void SV_NavEnsure (void)
+{
+	if (nav.valid && nav.checksum == sv.map_checksum)
+		return;
+
+	if (SV_NavReadCache ())
+		return;
+
+	SV_NavBuild ();
+}
+
+/*
+==============================================================================
+
+QUERIES
+
+==============================================================================
+*/
+
+static int SV_NavNearestNode (const vec3_t p)
+{
+	int c, x, y, dx, dy, j, best = -1;
+	float dist, bestdist = 0;
+	vec3_t d;
+
+	c = SV_NavColumn (p);
+	x = c % nav.gridx;
+	y = c / nav.gridx;
+
+	for (dy = -1; dy <= 1; dy++)
+	{
+		for (dx = -1; dx <= 1; dx++)
+		{
+			if (x + dx < 0 || x + dx >= nav.gridx || y + dy < 0 || y + dy >= nav.gridy)
+				continue;
+
+			c = (y + dy) * nav.gridx + x + dx;
+			for (j = nav.colstart[c]; j < nav.colstart[c + 1]; j++)
+			{
+				VectorSubtract (nav.nodes[j].origin, p, d);
+				// prefer nodes at our feet level over ones on other floors
+				d[2] *= 4;
+				dist = DotProduct (d, d);
+				if (best < 0 || dist < bestdist)
+				{
+					best = j;
+					bestdist = dist;
+				}
+			}
+		}
+	}
+
+	return best;
+}
+
+static float SV_NavHeuristic (int n, int goal)
+{
+	vec3_t d;
+
+	VectorSubtract (nav.nodes[goal].origin, nav.nodes[n].origin, d);
+	return VectorLength (d);
+}
+
+#define NAV_F(n) (nav.g[n] + SV_NavHeuristic (n, goal))
+
+static void SV_NavHeapPush (int n, int goal)
+{
+	int i = nav.heapsize++, parent;
+	float f = NAV_F(n);
+
+	while (i > 0)
+	{
+		parent = (i - 1) / 2;
+		if (NAV_F(nav.heap[parent]) <= f)
+			break;
+		nav.heap[i] = nav.heap[parent];
+		i = parent;
+	}
+	nav.heap[i] = n;
+}
+
+static int SV_NavHeapPop (int goal)
+{
+	int top = nav.heap[0], last, i, child;
+	float f;
+
+	last = nav.heap[--nav.heapsize];
+	f = NAV_F(last);
+
+	for (i = 0; (child = 2 * i + 1) < nav.heapsize; i = child)
+	{
+		if (child + 1 < nav.heapsize && NAV_F(nav.heap[child + 1]) < NAV_F(nav.heap[child]))
+			child++;
+		if (f <= NAV_F(nav.heap[child]))
+			break;
+		nav.heap[i] = nav.heap[child];
+	}
+	nav.heap[i] = last;
+
+	return top;
+}
+
+/*
+=================
+SV_NavFindPath
+
+writes up to maxpoints waypoints from start towards end into path (vec3 each).
+returns number of points, 0 if there is no path, -1 if the per frame budget
+is used up and the query should be repeated next frame. a graph which is not
+loaded yet is built with the budget over as many frames as it takes, -1 is
+returned meanwhile. the search is kept
+and goes on where it stopped when the same start and goal nodes are asked
+for again, other queries are deferred meanwhile unless it is not asked for
+NAV_SEARCH_IDLE seconds
+=================
+*/
+int SV_NavFindPath (vec3_t start, vec3_t end, float *path, int maxpoints)
+{
+	int from, goal, n, i, e, count, closedgen, opengen;
+	float g;
+
+	if (!sv.worldmodel || maxpoints <= 0)
+		return 0;
+
+	if (nav_budget_time != realtime)
+	{
+		nav_budget_time = realtime;
+		nav_budget_left = (int) sv_nav_budget.value;
+	}
+
+	navstats.queries++;
+
+	if (nav_budget_left <= 0)
+	{
+		navstats.deferred++;
+		return -1;
+	}
+
+	if (!nav.valid && nav.stage == NAVB_NONE && !SV_NavReadCache ())
+		SV_NavBuildStart ();
+
+	if (nav.stage != NAVB_NONE && !SV_NavBuildStep (&nav_budget_left))
+	{
+		navstats.deferred++;
+		return -1;
+	}
+
+	if ((from = SV_NavNearestNode (start)) < 0 || (goal = SV_NavNearestNode (end)) < 0)
+		return 0;
+
+	if (nav.searching && (nav.from != from || nav.goal != goal))
+	{
+		if (realtime - nav.searchtime < NAV_SEARCH_IDLE)
+		{
+			navstats.deferred++;
+			return -1;
+		}
+		nav.searching = false; // whoever wanted it gave up
+	}
+
+	// gen == opengen means seen, gen == closedgen means expanded
+	if (!nav.searching)
+	{
+		nav.curgen += 2;
+		nav.g[from] = 0;
+		nav.parent[from] = -1;
+		nav.gen[from] = nav.curgen - 1;
+		nav.heapsize = 0;
+		SV_NavHeapPush (from, goal);
+
+		nav.searching = true;
+		nav.from = from;
+		nav.goal = goal;
+	}
+	nav.searchtime = realtime;
+
+	opengen = nav.curgen - 1;
+	closedgen = nav.curgen;
+
+	while (nav.heapsize)
+	{
+		if (nav_budget_left <= 0)
+		{
+			navstats.deferred++;
+			return -1;
+		}
+
+		n = SV_NavHeapPop (goal);
+		if (nav.gen[n] == closedgen)
+			continue; // stale heap entry
+		nav.gen[n] = closedgen;
+
+		if (n == goal)
+			break;
+
+		navstats.expanded++;
+		nav_budget_left--;
+
+		for (i = 0; i < nav.nodes[n].numedges; i++)
+		{
+			e = nav.nodes[n].firstedge + i;
+			g = nav.g[n] + nav.edges[e].cost;
+
+			if (nav.gen[nav.edges[e].node] == closedgen)
+				continue;
+			if (nav.gen[nav.edges[e].node] == opengen && g >= nav.g[nav.edges[e].node])
+				continue;
+
+			nav.gen[nav.edges[e].node] = opengen;
+			nav.g[nav.edges[e].node] = g;
+			nav.parent[nav.edges[e].node] = n;
+			SV_NavHeapPush (nav.edges[e].node, goal);
+		}
+	}
+
+	nav.searching = false;
+
+	if (nav.gen[goal] != closedgen)
+		return 0;
+
+	// path is stored goal to start, count it first
+	for (count = 0, n = goal; n >= 0; n = nav.parent[n])
+		count++;
+
+	// skip far end if caller gave less room than needed, first points matter most
+	for (n = goal; count > maxpoints; n = nav.parent[n])
+		count--;
+
+	for (i = count - 1; i >= 0; i--, n = nav.parent[n])
+		VectorCopy (nav.nodes[n].origin, (path + i * 3));
+
+	navstats.found++;
+	return count;
+}
+
+/*
+==============================================================================
+
+COMMANDS
+
+==============================================================================
+*/
+
+static void SV_NavBuild_f (void)
+{
+	if (sv.state != ss_active)
+	{
+		Con_Printf ("No map loaded\n");
+		return;
+	}
+
+	SV_NavBuild ();
+	Con_Printf ("Nav: %i nodes, %i edges, built in %.0f ms\n", nav.numnodes, nav.numedges, navstats.buildtime * 1000);
+}
+
+static void SV_NavInfo_f (void)
+{
+	Con_Printf ("graph   : %s, %i nodes, %i edges\n", nav.valid ? "loaded" : (nav.stage != NAVB_NONE ? "building" : "none"),
+		nav.numnodes, nav.numedges);
+	Con_Printf ("build   : %.0f ms\n", navstats.buildtime * 1000);
+	Con_Printf ("queries : %i, %i found, %i deferred\n", navstats.queries, navstats.found, navstats.deferred);
+	Con_Printf ("expanded: %i nodes\n", navstats.expanded);
+}
+
+/*
+=================
+SV_NavNewMap
+
+called after the world model of a new map is loaded
+=================
+*/
+void SV_NavNewMap (void)
+{
+	// a graph of another map, built or half built
+	if (nav.checksum != sv.map_checksum)
+		SV_NavFree ();
+
+	memset (&navstats, 0, sizeof(navstats));
+
+	if ((int)sv_nav.value)
+		SV_NavEnsure ();
+}
+
+void SV_NavInit (void)
+{
+	Cvar_Register (&sv_nav);
+	Cvar_Register (&sv_nav_budget);
+
+	Cmd_AddCommand ("nav_build", SV_NavBuild_f);
+	Cmd_AddCommand ("nav_info", SV_NavInfo_f);
+}
@@ -151,7 +151,7 @@ qbool SV_RunThink (edict_t *ent)
 		pr_global_struct->other = EDICT_TO_PROG(sv.edicts);
 		PR_EdictThink(ent->v.think);
 
-		if (ent->e->free)
+		if (EDICT_SV(ent)->free)
 			return false;
 	} while (1);
 
@@ -302,7 +302,7 @@ int SV_FlyMove (edict_t *ent, float time1, trace_t *steptrace, int type)
 		// run the impact function
 		//
 		SV_Impact (ent, trace.e.ent);
-		if (ent->e->free)
+		if (EDICT_SV(ent)->free)
 			break;	 // removed by the impact function
 
 
@@ -454,7 +454,7 @@ qbool SV_Push (edict_t *pusher, vec3_t move)
 	check = NEXT_EDICT(sv.edicts);
 	for (e=1 ; e<sv.num_edicts ; e++, check = NEXT_EDICT(check))
 	{
-		if (check->e->free)
+		if (EDICT_SV(check)->free)
 			continue;
 		if (check->v.movetype == MOVETYPE_PUSH
 		|| check->v.movetype == MOVETYPE_NONE
@@ -617,7 +617,7 @@ void SV_Physics_Pusher (edict_t *ent)
 		pr_global_struct->other = EDICT_TO_PROG(sv.edicts);
 		PR_EdictThink(ent->v.think);
 
-		if (ent->e->free)
+		if (EDICT_SV(ent)->free)
 			return;
 		VectorSubtract (ent->v.origin, oldorg, move);
 
@@ -748,7 +748,7 @@ void SV_Physics_Toss (edict_t *ent)
 	trace = SV_PushEntity (ent, move, (sv_antilag.value == 2 && sv_antilag_projectiles.value) ? MOVE_LAGGED:0);
 	if (trace.fraction == 1)
 		return;
-	if (ent->e->free)
+	if (EDICT_SV(ent)->free)
 		return;
 
 	if (ent->v.movetype == MOVETYPE_BOUNCE)
@@ -848,9 +848,9 @@ SV_RunEntity
 */
 void SV_RunEntity (edict_t *ent)
 {
-	if (ent->e->lastruntime == sv.time)
+	if (EDICT_SV(ent)->lastruntime == sv.time)
 		return;
-	ent->e->lastruntime = sv.time;
+	EDICT_SV(ent)->lastruntime = sv.time;
 
 	switch ((int)ent->v.movetype)
 	{
@@ -893,9 +893,9 @@ void SV_RunNQNewmis (void)
 	ent = NEXT_EDICT(sv.edicts);
 	for (i=1 ; i<sv.num_edicts ; i++, ent = NEXT_EDICT(ent))
 	{
-		if (ent->e->free)
+		if (EDICT_SV(ent)->free)
 			continue;
-		if (ent->e->lastruntime || ent->v.owner != pl)
+		if (EDICT_SV(ent)->lastruntime || ent->v.owner != pl)
 			continue;
 		if (ent->v.movetype != MOVETYPE_FLY &&
 			ent->v.movetype != MOVETYPE_FLYMISSILE && 
@@ -983,7 +983,7 @@ void SV_Physics (void)
 	ent = sv.edicts;
 	for (i=0 ; i<sv.num_edicts ; i++, ent = NEXT_EDICT(ent))
 	{
-		if (ent->e->free)
+		if (EDICT_SV(ent)->free)
 			continue;
 
 		if (PR_GLOBAL(force_retouch))
@@ -0,0 +1,310 @@
+/*
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+//	sv_preload.c - preloading of the next map
+//
+//	sv_preloadmap command, preloadmap builtin and G_PRELOADMAP syscall start a
+//	thread doing the slow part of the next map change while the current map
+//	still runs, intermission is a good time: the bsp is compiled into the map
+//	cache (checksums, PVS, PHS, see cmodel.c) and models SV_CheckModel wants
+//	are checksummed. map change then only maps the compiled map, and takes
+//	model checksums as they are, as long as files are the same as they were.
+//	anything missing or changed since is loaded the usual way.
+
+#include "qwsvdef.h"
+
+#ifdef _WIN32
+#define PRELOAD_BARRIER()	MemoryBarrier()
+#else
+#define PRELOAD_BARRIER()	__sync_synchronize()
+#endif
+
+#define PRELOAD_IDLE		0
+#define PRELOAD_RUNNING		1
+#define PRELOAD_DONE		2		// thread is done, results not collected yet
+
+static char *preload_modelnames[] = { "progs/player.mdl", "progs/newplayer.mdl", "progs/eyes.mdl" };
+#define NUM_PRELOAD_MODELS	(sizeof(preload_modelnames) / sizeof(preload_modelnames[0]))
+
+typedef struct
+{
+	char			name[MAX_QPATH];
+	char			path[MAX_OSPATH];	// file on disk, pak for pak entries
+	unsigned long	offset, len;
+	int				mtime;
+
+	unsigned		crc;
+	qbool			valid;
+} preloadmodel_t;
+
+static struct
+{
+	volatile int	state;
+
+	// owned by the thread while it runs
+	cmpreload_t		map;
+	qbool			compile;			// map is not in the cache yet
+	qbool			compiled;
+	preloadmodel_t	models[NUM_PRELOAD_MODELS];
+	double			time;
+
+	char			pending[MAX_QPATH];	// preloaded map the next map change should be
+	unsigned int	requests, used, unused, waits;
+	double			lastwait;
+} preload;
+
+static preloadmodel_t	preload_crcs[NUM_PRELOAD_MODELS];	// what SV_CheckModel can take
+
+// where model is on disk, false if it is not a file or pak entry there
+static qbool SV_PreloadModelKey (char *name, preloadmodel_t *m)
+{
+	qbool copyprotected;
+
+	memset (m, 0, sizeof(*m));
+	strlcpy (m->name, name, sizeof(m->name));
+
+	if (!FS_DiskRange (name, m->path, sizeof(m->path), &m->offset, &m->len, &copyprotected) || !m->len)
+		return false;
+
+	return Sys_FileSizeTime (m->path, &m->mtime) > 0;
+}
+
+static qbool SV_PreloadModelSame (preloadmodel_t *a, preloadmodel_t *b)
+{
+	return a->offset == b->offset && a->len == b->len && a->mtime == b->mtime && !strcmp (a->path, b->path);
+}
+
+static void SV_PreloadModel (preloadmodel_t *m)
+{
+	byte *buf;
+	FILE *f;
+
+	if (!m->path[0] || !(f = fopen (m->path, "rb")))
+		return;
+
+	buf = (byte *) Q_malloc (m->len);
+	if (!fseek (f, m->offset, SEEK_SET) && fread (buf, 1, m->len, f) == m->len)
+	{
+		m->crc = CRC_Block (buf, m->len);
+		m->valid = true;
+	}
+
+	fclose (f);
+	Q_free (buf);
+}
+
+static DWORD WINAPI SV_Preload_Thread (void *unused)
+{
+	double start = Sys_DoubleTime ();
+	int i;
+
+	if (preload.compile)
+		preload.compiled = CM_PreloadCompile (&preload.map);
+
+	for (i = 0; i < (int) NUM_PRELOAD_MODELS; i++)
+		SV_PreloadModel (&preload.models[i]);
+
+	preload.time = Sys_DoubleTime () - start;
+
+	// results have to be there before anyone sees we are done
+	PRELOAD_BARRIER ();
+	preload.state = PRELOAD_DONE;
+
+	return 0;
+}
+
+// take over what the thread did, if it is done
+static void SV_PreloadCollect (void)
+{
+	int i;
+
+	if (preload.state != PRELOAD_DONE)
+		return;
+
+	PRELOAD_BARRIER ();
+
+	for (i = 0; i < (int) NUM_PRELOAD_MODELS; i++)
+	{
+		if (preload.models[i].valid)
+			preload_crcs[i] = preload.models[i];
+	}
+
+	if (preload.compile && !preload.compiled)
+		Con_Printf ("SV_PreloadMap: couldn't compile %s\n", preload.map.name);
+	else
+		Con_DPrintf ("SV_PreloadMap: %s preloaded in %.1f ms\n", preload.map.name, preload.time * 1000);
+
+	preload.state = PRELOAD_IDLE;
+}
+
+/*
+====================
+SV_PreloadMap
+
+start preloading of given map (name as for map command), returns false if
+it can't be preloaded: another preload is running or the map is not there
+====================
+*/
+qbool SV_PreloadMap (char *mapname)
+{
+	char name[MAX_QPATH];
+	qbool models = false;
+	int i;
+
+	SV_PreloadCollect ();
+
+	if (preload.state != PRELOAD_IDLE || !mapname[0] || strstr (mapname, ".."))
+		return false;
+
+	snprintf (name, sizeof(name), "maps/%s.bsp", mapname);
+
+	preload.compile = CM_PreloadPrepare (name, &preload.map);
+	preload.compiled = false;
+	if (!preload.compile && !preload.map.cached)
+		return false;
+
+	// models which did not change since we have their checksum are skipped
+	for (i = 0; i < (int) NUM_PRELOAD_MODELS; i++)
+	{
+		if (SV_PreloadModelKey (preload_modelnames[i], &preload.models[i])
+			&& !(preload_crcs[i].valid && SV_PreloadModelSame (&preload.models[i], &preload_crcs[i])))
+			models = true;
+		else
+			preload.models[i].path[0] = 0;
+	}
+
+	strlcpy (preload.pending, name, sizeof(preload.pending));
+	preload.requests++;
+
+	if (!preload.compile && !models)
+		return true;
+
+	preload.state = PRELOAD_RUNNING;
+	if (!Sys_CreateThread (SV_Preload_Thread, NULL))
+	{
+		Con_Printf ("SV_PreloadMap: can't create thread\n");
+		preload.state = PRELOAD_IDLE;
+		preload.pending[0] = 0;
+		return false;
+	}
+
+	return true;
+}
+
+/*
+====================
+SV_PreloadFinish
+
+called by SV_SpawnServer before the map of given bsp name is loaded, waits
+for the preload if it is of this map and still running
+====================
+*/
+void SV_PreloadFinish (char *name)
+{
+	double start;
+
+	if (preload.state == PRELOAD_RUNNING && !strcmp (preload.map.name, name))
+	{
+		start = Sys_DoubleTime ();
+		while (preload.state != PRELOAD_DONE)
+			Sys_Sleep (1);
+
+		preload.waits++;
+		preload.lastwait = Sys_DoubleTime () - start;
+	}
+
+	SV_PreloadCollect ();
+
+	if (!preload.pending[0])
+		return;
+
+	if (!strcmp (preload.pending, name))
+		preload.used++;
+	else
+		preload.unused++;
+	preload.pending[0] = 0;
+}
+
+/*
+====================
+SV_PreloadModelChecksum
+
+checksum of model preloaded before, false if there is none or file changed
+====================
+*/
+qbool SV_PreloadModelChecksum (char *name, unsigned *crc)
+{
+	preloadmodel_t key;
+	int i;
+
+	SV_PreloadCollect ();
+
+	for (i = 0; i < (int) NUM_PRELOAD_MODELS; i++)
+	{
+		if (preload_crcs[i].valid && !strcmp (preload_crcs[i].name, name))
+			break;
+	}
+
+	if (i == (int) NUM_PRELOAD_MODELS || !SV_PreloadModelKey (name, &key) || !SV_PreloadModelSame (&key, &preload_crcs[i]))
+		return false;
+
+	*crc = preload_crcs[i].crc;
+	return true;
+}
+
+static void SV_PreloadMap_f (void)
+{
+	int i;
+
+	if (Cmd_Argc () > 1)
+	{
+		if (!SV_PreloadMap (Cmd_Argv (1)))
+			Con_Printf ("can't preload %s\n", Cmd_Argv (1));
+		return;
+	}
+
+	SV_PreloadCollect ();
+
+	Con_Printf ("usage: %s <map>\n", Cmd_Argv (0));
+	if (preload.map.name[0])
+	{
+		Con_Printf ("last      : %s", preload.map.name);
+		if (preload.state != PRELOAD_IDLE)
+			Con_Printf (", running\n");
+		else if (!preload.compile)
+			Con_Printf (", was in map cache already\n");
+		else
+			Con_Printf (preload.compiled ? ", compiled in %.1f ms\n" : ", failed\n", preload.time * 1000);
+	}
+	Con_Printf ("preloads  : %u requested, %u used, %u not used, %u waited for",
+	            preload.requests, preload.used, preload.unused, preload.waits);
+	if (preload.waits)
+		Con_Printf (" (last %.1f ms)", preload.lastwait * 1000);
+	Con_Printf ("\n");
+
+	for (i = 0; i < (int) NUM_PRELOAD_MODELS; i++)
+	{
+		if (preload_crcs[i].valid)
+			Con_Printf ("model     : %s %u\n", preload_crcs[i].name, preload_crcs[i].crc);
+	}
+}
+
+void SV_PreloadInit (void)
+{
+	Cmd_AddCommand ("sv_preloadmap", SV_PreloadMap_f);
+}
@@ -0,0 +1,344 @@
+/*
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+//	sv_profile.c - frame profiler
+//
+//	SV_Frame stages are timed every frame and go to histograms with
+//	logarithmic buckets (exact below 32 us, then 16 buckets per power of two,
+//	so about 6% error) which give p50/p99 without keeping the frames. frames
+//	slower than sv_frameprofile_slow go to a ring with time of each stage,
+//	so a hitch once a minute shows up with what it was spent on.
+//	QC/QVM time is counted from PR_ExecuteProgram and VM_Call, outermost
+//	call only, physics gets it split off.
+//	off by default, nothing is timed then.
+
+#include "qwsvdef.h"
+
+#define PROF_SUB			16			// buckets per power of two
+#define PROF_SUB_BITS		4
+#define PROF_MAX_BITS		27			// 2^28 us, 268 s and longer all go to the last bucket
+#define PROF_BUCKETS		(2 * PROF_SUB + (PROF_MAX_BITS - PROF_SUB_BITS) * PROF_SUB)
+#define PROF_SLOWFRAMES		32
+
+typedef struct
+{
+	unsigned int	count[PROF_BUCKETS];
+	unsigned int	max;
+	double			total;				// us
+} profhist_t;
+
+typedef struct
+{
+	double			realtime;
+	unsigned int	frame;
+	char			map[MAX_QPATH];
+	unsigned int	us[PROF_NUM];
+} profframe_t;
+
+static char *prof_names[PROF_NUM] =
+{
+	"cbuf", "mvdstream", "qtvdemo", "readpackets", "physics_qc", "physics", "send", "demo", "other", "frame"
+};
+
+// for columns of frameprofile frames
+static char *prof_shortnames[PROF_NUM] =
+{
+	"cbuf", "mvd", "qtvd", "read", "qc", "phys", "send", "demo", "other", "frame"
+};
+
+static struct
+{
+	qbool			on;					// sv_frameprofile when frame began
+	double			start;				// of frame
+	double			enter[PROF_NUM];
+	double			spent[PROF_NUM];	// in this frame, seconds
+
+	int				qcdepth;
+	double			qcstart, qcspent;	// qcspent grows all the time, stages take differences
+	double			qcenter[PROF_NUM];
+
+	unsigned int	frames;
+	double			since;				// realtime of reset
+	profhist_t		hist[PROF_NUM];
+
+	profframe_t		slow[PROF_SLOWFRAMES];
+	unsigned int	numslow;			// ever put to slow, slow[numslow % PROF_SLOWFRAMES] is next
+} prof;
+
+cvar_t	sv_frameprofile = {"sv_frameprofile", "0"};
+cvar_t	sv_frameprofile_slow = {"sv_frameprofile_slow", "20"};	// ms
+
+static int SV_ProfileBucket (unsigned int us)
+{
+	int bits;
+
+	if (us < 2 * PROF_SUB)
+		return us;
+
+	for (bits = PROF_SUB_BITS + 1; bits < PROF_MAX_BITS && (us >> (bits + 1)); bits++)
+		;
+
+	if (us >> (bits + 1))
+		return PROF_BUCKETS - 1;
+
+	return 2 * PROF_SUB + (bits - PROF_SUB_BITS - 1) * PROF_SUB + ((us >> (bits - PROF_SUB_BITS)) & (PROF_SUB - 1));
+}
+
+// highest value which goes to bucket
+static unsigned int SV_ProfileBucketValue (int bucket)
+{
+	int bits, sub;
+
+	if (bucket < 2 * PROF_SUB)
+		return bucket;
+
+	bits = (bucket - 2 * PROF_SUB) / PROF_SUB + PROF_SUB_BITS + 1;
+	sub = (bucket - 2 * PROF_SUB) % PROF_SUB;
+
+	return ((PROF_SUB + sub + 1) << (bits - PROF_SUB_BITS)) - 1;
+}
+
+static unsigned int SV_ProfilePercentile (profhist_t *h, double p)
+{
+	unsigned int rank = (unsigned int) ceil (prof.frames * p), n = 0;
+	int i;
+
+	if (!prof.frames)
+		return 0;
+
+	for (i = 0; i < PROF_BUCKETS; i++)
+	{
+		n += h->count[i];
+		if (n >= max(rank, 1))
+			return min(SV_ProfileBucketValue (i), h->max);
+	}
+
+	return h->max;
+}
+
+static void SV_ProfileReset (void)
+{
+	memset (prof.hist, 0, sizeof(prof.hist));
+	prof.frames = 0;
+	prof.numslow = 0;
+	prof.since = realtime;
+}
+
+void SV_ProfileFrameBegin (void)
+{
+	if (!(prof.on = ((int)sv_frameprofile.value != 0)))
+		return;
+
+	memset (prof.spent, 0, sizeof(prof.spent));
+	SV_ProfileQCAbort ();
+	prof.start = Sys_DoubleTime ();
+}
+
+void SV_ProfileEnter (profstage_t stage)
+{
+	if (!prof.on)
+		return;
+
+	prof.qcenter[stage] = prof.qcspent;
+	prof.enter[stage] = Sys_DoubleTime ();
+}
+
+void SV_ProfileLeave (profstage_t stage)
+{
+	double qc;
+
+	if (!prof.on)
+		return;
+
+	prof.spent[stage] += Sys_DoubleTime () - prof.enter[stage];
+
+	if (stage == PROF_PHYSICS)
+	{
+		qc = prof.qcspent - prof.qcenter[stage];
+		prof.spent[PROF_PHYSICS_QC] += qc;
+		prof.spent[PROF_PHYSICS] -= qc;
+	}
+}
+
+void SV_ProfileQCEnter (void)
+{
+	if (prof.on && !prof.qcdepth++)
+		prof.qcstart = Sys_DoubleTime ();
+}
+
+void SV_ProfileQCLeave (void)
+{
+	if (prof.on && prof.qcdepth > 0 && !--prof.qcdepth)
+		prof.qcspent += Sys_DoubleTime () - prof.qcstart;
+}
+
+// QC error jumps out of PR_ExecuteProgram without leaving, what it ran until then still counts
+void SV_ProfileQCAbort (void)
+{
+	if (prof.on && prof.qcdepth > 0)
+		prof.qcspent += Sys_DoubleTime () - prof.qcstart;
+	prof.qcdepth = 0;
+}
+
+void SV_ProfileFrameEnd (void)
+{
+	profframe_t *f;
+	unsigned int us[PROF_NUM];
+	double other;
+	int i;
+
+	if (!prof.on)
+		return;
+
+	prof.spent[PROF_FRAME] = Sys_DoubleTime () - prof.start;
+
+	other = prof.spent[PROF_FRAME];
+	for (i = 0; i < PROF_OTHER; i++)
+		other -= prof.spent[i];
+	prof.spent[PROF_OTHER] = max(0, other);
+
+	for (i = 0; i < PROF_NUM; i++)
+	{
+		us[i] = (unsigned int) (max(0, prof.spent[i]) * 1000000);
+		prof.hist[i].count[SV_ProfileBucket (us[i])]++;
+		prof.hist[i].max = max(prof.hist[i].max, us[i]);
+		prof.hist[i].total += us[i];
+	}
+	prof.frames++;
+
+	if (sv_frameprofile_slow.value > 0 && us[PROF_FRAME] >= sv_frameprofile_slow.value * 1000)
+	{
+		f = &prof.slow[prof.numslow++ % PROF_SLOWFRAMES];
+		f->realtime = realtime;
+		f->frame = prof.frames;
+		strlcpy (f->map, sv.mapname, sizeof(f->map));
+		memcpy (f->us, us, sizeof(f->us));
+	}
+}
+
+static void SV_ProfileSummary (void)
+{
+	profhist_t *h;
+	int i;
+
+	Con_Printf ("%u frames in %.0f s, %u slower than %g ms\n", prof.frames, realtime - prof.since,
+	            prof.numslow, sv_frameprofile_slow.value);
+	Con_Printf ("%-12s %8s %8s %8s %8s %8s\n", "stage (ms)", "avg", "p50", "p99", "p99.9", "max");
+
+	for (i = 0; i < PROF_NUM; i++)
+	{
+		h = &prof.hist[i];
+		Con_Printf ("%-12s %8.3f %8.3f %8.3f %8.3f %8.3f\n", prof_names[i],
+		            prof.frames ? h->total / prof.frames / 1000 : 0,
+		            SV_ProfilePercentile (h, 0.5) / 1000.0, SV_ProfilePercentile (h, 0.99) / 1000.0,
+		            SV_ProfilePercentile (h, 0.999) / 1000.0, h->max / 1000.0);
+	}
+}
+
+static void SV_ProfileSlowFrames (void)
+{
+	profframe_t *f;
+	unsigned int n;
+	int i;
+
+	if (!prof.numslow)
+	{
+		Con_Printf ("no frames slower than %g ms\n", sv_frameprofile_slow.value);
+		return;
+	}
+
+	// newest first
+	Con_Printf ("%9s %-10s", "time", "map");
+	for (i = 0; i < PROF_NUM; i++)
+		Con_Printf (" %6s", prof_shortnames[i]);
+	Con_Printf ("\n");
+
+	for (n = prof.numslow; n > 0 && n + PROF_SLOWFRAMES > prof.numslow; n--)
+	{
+		f = &prof.slow[(n - 1) % PROF_SLOWFRAMES];
+		Con_Printf ("%9.1f %-10.10s", f->realtime, f->map);
+		for (i = 0; i < PROF_NUM; i++)
+			Con_Printf (" %6.1f", f->us[i] / 1000.0);
+		Con_Printf ("\n");
+	}
+}
+
+// everything as one JSON object, times in us
+static void SV_ProfileDump (void)
+{
+	profhist_t *h;
+	profframe_t *f;
+	unsigned int n;
+	int i, j;
+
+	Con_Printf ("{\"frames\":%u,\"seconds\":%.1f,\"slow_ms\":%g,\"stages\":{", prof.frames, realtime - prof.since,
+	            sv_frameprofile_slow.value);
+	for (i = 0; i < PROF_NUM; i++)
+	{
+		h = &prof.hist[i];
+		Con_Printf ("%s\"%s\":{\"avg\":%.1f,\"p50\":%u,\"p90\":%u,\"p99\":%u,\"p999\":%u,\"max\":%u}",
+		            i ? "," : "", prof_names[i], prof.frames ? h->total / prof.frames : 0,
+		            SV_ProfilePercentile (h, 0.5), SV_ProfilePercentile (h, 0.9), SV_ProfilePercentile (h, 0.99),
+		            SV_ProfilePercentile (h, 0.999), h->max);
+	}
+
+	Con_Printf ("},\"slow\":[");
+	for (n = prof.numslow; n > 0 && n + PROF_SLOWFRAMES > prof.numslow; n--)
+	{
+		f = &prof.slow[(n - 1) % PROF_SLOWFRAMES];
+		Con_Printf ("%s{\"time\":%.3f,\"frame\":%u,\"map\":\"%s\"", n == prof.numslow ? "" : ",", f->realtime, f->frame, f->map);
+		for (j = 0; j < PROF_NUM; j++)
+			Con_Printf (",\"%s\":%u", prof_names[j], f->us[j]);
+		Con_Printf ("}");
+	}
+	Con_Printf ("]}\n");
+}
+
+/*
+====================
+SV_FrameProfile_f
+
+frameprofile [frames|dump|reset]
+====================
+*/
+static void SV_FrameProfile_f (void)
+{
+	char *arg = Cmd_Argv (1);
+
+	if (!arg[0])
+		SV_ProfileSummary ();
+	else if (!strcmp (arg, "frames"))
+		SV_ProfileSlowFrames ();
+	else if (!strcmp (arg, "dump"))
+		SV_ProfileDump ();
+	else if (!strcmp (arg, "reset"))
+		SV_ProfileReset ();
+	else
+		Con_Printf ("usage: %s [frames|dump|reset]\n"
+		            "no argument: time of frame stages since reset\n"
+		            "frames: last %d frames slower than sv_frameprofile_slow ms\n"
+		            "dump: all of it in JSON, times in microseconds\n", Cmd_Argv (0), PROF_SLOWFRAMES);
+}
+
+void SV_ProfileInit (void)
+{
+	Cvar_Register (&sv_frameprofile);
+	Cvar_Register (&sv_frameprofile_slow);
+
+	Cmd_AddCommand ("frameprofile", SV_FrameProfile_f);
+}
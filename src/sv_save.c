@@ -240,6 +240,7 @@ void SV_LoadGame_f (void) {
 		sv.lightstyles[i] = (char *) Hunk_Alloc (len);
 		strlcpy (sv.lightstyles[i], str, len);
 	}
+	SV_GamestateInvalidate ();
 
 	// pause until all clients connect
 	if (!(sv.paused & 1))
@@ -281,7 +282,7 @@ void SV_LoadGame_f (void) {
 			ED_ParseEdict (start, ent);
 	
 			// link it into the bsp tree
-			if (!ent->e->free)
+			if (!EDICT_SV(ent)->free)
 				SV_LinkEdict (ent, false);
 		}
 		entnum++;
@@ -52,7 +52,7 @@ int	Sys_FileTime (const char *path)
 	return stat(path, &buf) == -1 ? -1 : buf.st_mtime;
 }
 
-int Sys_FileSizeTime (char *path, int *time1)
+int Sys_FileSizeTime (const char *path, int *time1)
 {
 	struct stat buf;
 	if (stat(path, &buf) == -1)
@@ -341,6 +341,7 @@ void Sys_Error (const char *error, ...)
 		SV_Write_Log (ERROR_LOG, 1, va ("ERROR: %s\n", text));
 //		fclose (logs[ERROR_LOG].sv_logfile);
 	}
+	SV_LogFlush ();
 
 // FIXME: hack - checking SV_Shutdown with net_socket set in -1 NET_Shutdown
 	if (svs.socketip != -1)
@@ -533,13 +534,23 @@ int Sys_CreateThread(DWORD (WINAPI *func)(void *), void *param)
 {
     pthread_t thread;
     pthread_attr_t attr;
+    int err;
 
     pthread_attr_init(&attr);
     pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
     pthread_attr_setschedpolicy(&attr, SCHED_OTHER);   // ale gowno
 
-    pthread_create(&thread, &attr, (void *)func, param);
-    return 1;
+    err = pthread_create(&thread, &attr, (void *)func, param);
+    pthread_attr_destroy(&attr);
+
+    return !err;
+}
+
+int Sys_CPUCount(void)
+{
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+
+	return n > 0 ? n : 1;
 }
 
 // Function only_digits was copied from bind (DNS server) sources.
@@ -123,6 +123,21 @@ int	Sys_FileTime (const char *path)
 	return _stat (path, &buf) == -1 ? -1 : buf.st_mtime;
 }
 
+int Sys_FileSizeTime (const char *path, int *time1)
+{
+	struct _stat buf;
+	if (_stat (path, &buf) == -1)
+	{
+		*time1 = -1;
+		return 0;
+	}
+	else
+	{
+		*time1 = buf.st_mtime;
+		return buf.st_size;
+	}
+}
+
 /*
 ================
 Sys_mkdir
@@ -415,6 +430,7 @@ void Sys_Error (const char *error, ...)
 		SV_Write_Log (ERROR_LOG, 1, va ("ERROR: %s\n", text));
 //		fclose (logs[ERROR_LOG].sv_logfile);
 	}
+	SV_LogFlush ();
 
 // FIXME: hack - checking SV_Shutdown with svs.socketip set in -1 NET_Shutdown
 	if (svs.socketip != -1)
@@ -703,12 +719,24 @@ int Sys_CreateThread(DWORD (WINAPI *func)(void *), void *param)
         CREATE_SUSPENDED,   // creation flags
         &threadid);         // pointer to receive thread ID
 
+    if (!thread)
+        return 0;
+
     SetThreadPriority(thread, THREAD_PRIORITY_HIGHEST);
     ResumeThread(thread);
+    CloseHandle(thread);
 
     return 1;
 }
 
+int Sys_CPUCount(void)
+{
+	SYSTEM_INFO si;
+
+	GetSystemInfo (&si);
+	return si.dwNumberOfProcessors ? si.dwNumberOfProcessors : 1;
+}
+
 #ifdef _CONSOLE
 /*
 ==================
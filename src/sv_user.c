@@ -343,8 +343,7 @@ static void Cmd_New_f (void)
 	MSG_WriteByte (&sv_client->netchan.message, sv.edicts->v.sounds);
 
 	// send server info string
-	MSG_WriteByte (&sv_client->netchan.message, svc_stufftext);
-	MSG_WriteString (&sv_client->netchan.message, va("fullserverinfo \"%s\"\n", svs.info) );
+	SV_GamestateServerinfo (&sv_client->netchan.message);
 
 	//bliP: player logging
 	SV_LogPlayer(sv_client, "connect", 1);
@@ -357,7 +356,6 @@ Cmd_Soundlist_f
 */
 static void Cmd_Soundlist_f (void)
 {
-	char		**s;
 	unsigned	n;
 
 	if (sv_client->state != cs_connected)
@@ -394,20 +392,8 @@ static void Cmd_Soundlist_f (void)
 		SZ_Clear(&sv_client->netchan.message);
 	}
 
-	MSG_WriteByte (&sv_client->netchan.message, svc_soundlist);
-	MSG_WriteByte (&sv_client->netchan.message, n);
-	for (s = sv.sound_precache+1 + n ;
-	        *s && sv_client->netchan.message.cursize < (MAX_MSGLEN/2);
-	        s++, n++)
-		MSG_WriteString (&sv_client->netchan.message, *s);
-
-	MSG_WriteByte (&sv_client->netchan.message, 0);
-
-	// next msg
-	if (*s)
-		MSG_WriteByte (&sv_client->netchan.message, n);
-	else
-		MSG_WriteByte (&sv_client->netchan.message, 0);
+	if (!SV_GamestateList (&sv_client->netchan.message, svc_soundlist, n))
+		SV_WriteList (&sv_client->netchan.message, svc_soundlist, n);
 }
 
 static char *TrimModelName (const char *full)
@@ -494,19 +480,8 @@ static void Cmd_Modellist_f (void)
 		SZ_Clear(&sv_client->netchan.message);
 	}
 
-	MSG_WriteByte (&sv_client->netchan.message, svc_modellist);
-	MSG_WriteByte (&sv_client->netchan.message, n);
-	for (s = sv.model_precache+1+n ;
-	        *s && sv_client->netchan.message.cursize < (MAX_MSGLEN/2);
-	        s++, n++)
-		MSG_WriteString (&sv_client->netchan.message, *s);
-	MSG_WriteByte (&sv_client->netchan.message, 0);
-
-	// next msg
-	if (*s)
-		MSG_WriteByte (&sv_client->netchan.message, n);
-	else
-		MSG_WriteByte (&sv_client->netchan.message, 0);
+	if (!SV_GamestateList (&sv_client->netchan.message, svc_modellist, n))
+		SV_WriteList (&sv_client->netchan.message, svc_modellist, n);
 }
 
 /*
@@ -639,12 +614,15 @@ static void Cmd_Spawn_f (void)
 	}
 
 	// send all current light styles
-	for (i=0 ; i<MAX_LIGHTSTYLES ; i++)
+	if (!SV_GamestateLightstyles (sv_client))
 	{
-		ClientReliableWrite_Begin (sv_client, svc_lightstyle,
-		                           3 + (sv.lightstyles[i] ? strlen(sv.lightstyles[i]) : 1));
-		ClientReliableWrite_Byte (sv_client, (char)i);
-		ClientReliableWrite_String (sv_client, sv.lightstyles[i]);
+		for (i=0 ; i<MAX_LIGHTSTYLES ; i++)
+		{
+			ClientReliableWrite_Begin (sv_client, svc_lightstyle,
+			                           3 + (sv.lightstyles[i] ? strlen(sv.lightstyles[i]) : 1));
+			ClientReliableWrite_Byte (sv_client, (char)i);
+			ClientReliableWrite_String (sv_client, sv.lightstyles[i]);
+		}
 	}
 
 	if (sv.loadgame)
@@ -919,7 +897,6 @@ Cmd_NextDownload_f
 void SV_NextChunkedDownload(int chunknum, int percent, int chunked_download_number)
 {
 #define CHUNKSIZE 1024
-	char buffer[CHUNKSIZE];
 	int i;
 
 	sv_client->file_percent = bound(0, percent, 100); //bliP: file percent
@@ -945,12 +922,11 @@ void SV_NextChunkedDownload(int chunknum, int percent, int chunked_download_numb
 	if (VFS_SEEK(sv_client->download, chunknum*CHUNKSIZE, SEEK_SET))
 		return; // FIXME: ERROR of some kind
 
-	i = VFS_READ(sv_client->download, buffer, CHUNKSIZE, NULL);
-
-	if (i > 0)
 	{
 		byte data[1+ (sizeof("\\chunk")-1) + 4 + 1 + 4 + CHUNKSIZE]; // byte + (sizeof("\\chunk")-1) + long + byte + long + CHUNKSIZE
 		sizebuf_t *msg, msg_oob;
+		byte *chunk;
+		int start;
 
 		if (sv_client->download_chunks_perframe)
 		{
@@ -965,18 +941,29 @@ void SV_NextChunkedDownload(int chunknum, int percent, int chunked_download_numb
 		else
 			msg = &sv_client->datagram;
 
-		if (i != CHUNKSIZE)
-			memset(buffer+i, 0, CHUNKSIZE-i);
-
+		start = msg->cursize;
 		MSG_WriteByte(msg, svc_download);
 		MSG_WriteLong(msg, chunknum);
-		SZ_Write(msg, buffer, CHUNKSIZE);
 
-		if (sv_client->download_chunks_perframe)
-			Netchan_OutOfBand (NS_SERVER, sv_client->netchan.remote_address, msg->cursize, msg->data);
-	}
-	else {
-		; // FIXME: EOF/READ ERROR
+		// read straight into the message, from a download cache mapping that is the only copy
+		chunk = (byte *) SZ_GetSpace(msg, CHUNKSIZE);
+		i = VFS_READ(sv_client->download, chunk, CHUNKSIZE, NULL);
+
+		if (i > 0)
+		{
+			if (i != CHUNKSIZE)
+				memset(chunk + i, 0, CHUNKSIZE-i);
+
+			if (sv_client->download_chunks_perframe)
+				Netchan_OutOfBand (NS_SERVER, sv_client->netchan.remote_address, msg->cursize, msg->data);
+
+			SV_DownloadSent(i);
+		}
+		else {
+			// FIXME: EOF/READ ERROR
+			if (!msg->overflowed)
+				msg->cursize = start;
+		}
 	}
 
 	sv_client->download_chunks_perframe++;
@@ -1038,6 +1025,7 @@ static void Cmd_NextDownload_f (void)
 	ClientReliableWrite_Byte (sv_client, percent);
 	ClientReliableWrite_SZ (sv_client, buffer, r);
 	sv_client->file_percent = percent; //bliP: file percent
+	SV_DownloadSent(r);
 
 	if (sv_client->downloadcount == sv_client->downloadsize)
 		SV_CompleteDownoload();
@@ -1306,7 +1294,7 @@ static void Cmd_Download_f(void)
 	// techlogin download uses simple path from quake folder
 	if (sv_client->special)
 	{
-		sv_client->download = FS_OpenVFS(name, "rb", FS_GAME); // FIXME: Should we use FS_BASE ???
+		sv_client->download = SV_DownloadOpen(name); // FIXME: Should we use FS_BASE ???
 		if (sv_client->download)
 		{
 			if ((int) developer.value)
@@ -1316,7 +1304,7 @@ static void Cmd_Download_f(void)
 	}
 	else
 	{
-		sv_client->download = FS_OpenVFS(name, "rb", FS_GAME);
+		sv_client->download = SV_DownloadOpen(name);
 		if (sv_client->download)
 			sv_client->downloadsize = VFS_GETLEN(sv_client->download);
 
@@ -53,6 +53,7 @@ typedef struct
 } dir_t;
 
 int		Sys_FileTime (const char *path);
+int		Sys_FileSizeTime (const char *path, int *time1);
 void	Sys_mkdir (const char *path);
 int		Sys_rmdir (const char *path);
 int		Sys_remove (const char *path);
@@ -146,5 +147,6 @@ void *Sys_DLProc (DL_t dl, const char *name);
 #endif
 
 int  Sys_CreateThread(DWORD (WINAPI *func)(void *), void *param);
+int  Sys_CPUCount(void);
 
 #endif /* !__SYS_H__ */
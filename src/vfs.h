@@ -88,6 +88,9 @@ typedef struct
 	int		(*GeneratePureCRC) (void *handle, int seed, int usepure);
 
 	vfsfile_t *(*OpenVFS)(void *handle, flocation_t *loc, char *mode);
+
+	// OS file holding located file and offset of its data in there
+	qbool	(*DiskRange)(void *handle, flocation_t *loc, char *ospath, int ospathlen, unsigned long *offset);
 } searchpathfuncs_t;
 
 typedef struct searchpath_s
@@ -133,9 +136,11 @@ typedef enum
 } relativeto_t;
 
 void FS_FlushFSHash(void);
+void FS_AddFileToHash(const char *filename);
 
 vfsfile_t *FS_OpenVFS(const char *filename, char *mode, relativeto_t relativeto);
 int FS_FLocateFile(const char *filename, FSLF_ReturnType_e returntype, flocation_t *loc);
+qbool FS_DiskRange(const char *filename, char *ospath, int ospathlen, unsigned long *offset, unsigned long *len, qbool *copyprotected);
 
 //=================================
 // STDIO Files (OS)
@@ -255,6 +255,13 @@ static int FSOS_EnumerateFiles (void *handle, char *match, int (*func)(char *, i
 	return Sys_EnumerateFiles(handle, match, func, parm);
 }
 
+static qbool FSOS_DiskRange(void *handle, flocation_t *loc, char *ospath, int ospathlen, unsigned long *offset)
+{
+	snprintf(ospath, ospathlen, "%s/%s", (char *)handle, loc->rawname);
+	*offset = 0;
+	return true;
+}
+
 searchpathfuncs_t osfilefuncs = {
 	FSOS_PrintPath,
 	FSOS_ClosePath,
@@ -264,5 +271,6 @@ searchpathfuncs_t osfilefuncs = {
 	FSOS_EnumerateFiles,
 	NULL,
 	NULL,
-	FSOS_OpenVFS
+	FSOS_OpenVFS,
+	FSOS_DiskRange
 };
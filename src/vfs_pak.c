@@ -360,6 +360,15 @@ static void *FSPAK_LoadPackFile (vfsfile_t *file, const char *desc)
 
 extern void FSOS_ReadFile(void *handle, flocation_t *loc, char *buffer);
 
+static qbool FSPAK_DiskRange(void *handle, flocation_t *loc, char *ospath, int ospathlen, unsigned long *offset)
+{
+	pack_t *pak = (pack_t *)handle;
+
+	strlcpy(ospath, pak->filename, ospathlen);
+	*offset = loc->offset;
+	return true;
+}
+
 searchpathfuncs_t packfilefuncs = {
 	FSPAK_PrintPath,
 	FSPAK_ClosePath,
@@ -369,5 +378,6 @@ searchpathfuncs_t packfilefuncs = {
 	FSPAK_EnumerateFiles,
 	FSPAK_LoadPackFile,
 	NULL,
-	FSPAK_OpenVFS
+	FSPAK_OpenVFS,
+	FSPAK_DiskRange
 };
@@ -0,0 +1,170 @@
+/*
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+//	visrow.c - operations on PVS/PHS rows
+//
+//	scalar versions work everywhere. SSE2 ones are built when the compiler
+//	targets SSE2 anyway (any x86_64), AVX2 ones are built with a target
+//	attribute and only picked when cpu and OS support it, so the binary
+//	still runs on any cpu it ran on before.
+
+#include "qwsvdef.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define VISROW_SSE2
+#include <emmintrin.h>
+
+#if defined(__clang__) || (defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)))
+#define VISROW_AVX2
+#define VISROW_TARGET_AVX2	__attribute__((target("avx2")))
+#elif defined(_MSC_VER) && _MSC_VER >= 1700
+#define VISROW_AVX2
+#define VISROW_TARGET_AVX2
+#include <intrin.h>
+#endif
+
+#ifdef VISROW_AVX2
+#include <immintrin.h>
+#endif
+#endif
+
+static void VisRow_OrScalar (unsigned *dest, const unsigned *src, int longs)
+{
+	int i;
+
+	for (i = 0; i < longs; i++)
+		dest[i] |= src[i];
+}
+
+static qbool VisRow_AnyScalar (const unsigned *row, int longs)
+{
+	int i;
+
+	for (i = 0; i < longs; i++)
+	{
+		if (row[i])
+			return true;
+	}
+
+	return false;
+}
+
+#ifdef VISROW_SSE2
+static void VisRow_OrSSE2 (unsigned *dest, const unsigned *src, int longs)
+{
+	int i;
+
+	for (i = 0; i + 4 <= longs; i += 4)
+		_mm_storeu_si128 ((__m128i *)(dest + i), _mm_or_si128 (_mm_loadu_si128 ((__m128i *)(dest + i)), _mm_loadu_si128 ((__m128i *)(src + i))));
+
+	for ( ; i < longs; i++)
+		dest[i] |= src[i];
+}
+
+static qbool VisRow_AnySSE2 (const unsigned *row, int longs)
+{
+	__m128i acc = _mm_setzero_si128 ();
+	int i;
+
+	for (i = 0; i + 4 <= longs; i += 4)
+		acc = _mm_or_si128 (acc, _mm_loadu_si128 ((__m128i *)(row + i)));
+
+	if (_mm_movemask_epi8 (_mm_cmpeq_epi8 (acc, _mm_setzero_si128 ())) != 0xffff)
+		return true;
+
+	return VisRow_AnyScalar (row + i, longs - i);
+}
+#endif
+
+#ifdef VISROW_AVX2
+VISROW_TARGET_AVX2 static void VisRow_OrAVX2 (unsigned *dest, const unsigned *src, int longs)
+{
+	int i;
+
+	for (i = 0; i + 8 <= longs; i += 8)
+		_mm256_storeu_si256 ((__m256i *)(dest + i), _mm256_or_si256 (_mm256_loadu_si256 ((__m256i *)(dest + i)), _mm256_loadu_si256 ((__m256i *)(src + i))));
+
+	for ( ; i < longs; i++)
+		dest[i] |= src[i];
+}
+
+VISROW_TARGET_AVX2 static qbool VisRow_AnyAVX2 (const unsigned *row, int longs)
+{
+	__m256i acc = _mm256_setzero_si256 ();
+	int i;
+
+	for (i = 0; i + 8 <= longs; i += 8)
+		acc = _mm256_or_si256 (acc, _mm256_loadu_si256 ((__m256i *)(row + i)));
+
+	if (!_mm256_testz_si256 (acc, acc))
+		return true;
+
+	return VisRow_AnyScalar (row + i, longs - i);
+}
+
+static qbool VisRow_HaveAVX2 (void)
+{
+#ifdef _MSC_VER
+	int info[4];
+
+	__cpuid (info, 1);
+	// cpu has AVX and OS saves its registers
+	if ((info[2] & (1 << 27 | 1 << 28)) != (1 << 27 | 1 << 28) || (_xgetbv (0) & 6) != 6)
+		return false;
+
+	__cpuidex (info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#else
+	__builtin_cpu_init ();
+	return __builtin_cpu_supports ("avx2");
+#endif
+}
+#endif
+
+static visrow_t visrow_list[] =
+{
+	{"scalar", VisRow_OrScalar, VisRow_AnyScalar},
+#ifdef VISROW_SSE2
+	{"sse2", VisRow_OrSSE2, VisRow_AnySSE2},
+#endif
+#ifdef VISROW_AVX2
+	{"avx2", VisRow_OrAVX2, VisRow_AnyAVX2},
+#endif
+};
+
+static int visrow_available = 1;
+
+visrow_t visrow = {"scalar", VisRow_OrScalar, VisRow_AnyScalar};
+
+int VisRow_Available (visrow_t **list)
+{
+	*list = visrow_list;
+	return visrow_available;
+}
+
+void VisRow_Init (void)
+{
+	visrow_available = sizeof(visrow_list) / sizeof(visrow_list[0]);
+
+#ifdef VISROW_AVX2
+	if (!VisRow_HaveAVX2 ())
+		visrow_available--;
+#endif
+
+	visrow = visrow_list[visrow_available - 1];
+}
@@ -0,0 +1,36 @@
+/*
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+/* visrow.h - operations on PVS/PHS rows */
+
+#ifndef __VISROW_H__
+#define __VISROW_H__
+
+// rows are arrays of 32-bit longs, no alignment is needed
+typedef struct
+{
+	char	*name;
+	void	(*Or) (unsigned *dest, const unsigned *src, int longs);
+	qbool	(*Any) (const unsigned *row, int longs);
+} visrow_t;
+
+extern visrow_t visrow;			// fastest one this cpu can run
+
+int VisRow_Available (visrow_t **list);	// all this cpu can run, scalar first
+void VisRow_Init (void);
+
+#endif /* !__VISROW_H__ */
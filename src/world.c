@@ -148,6 +148,8 @@ typedef struct world_s
 static world_t w;
 
 areanode_t sv_areanodes[AREA_NODES];
+
+int sv_linkcount;	// bumped on every link/unlink, lets callers cache area queries
 int sv_numareanodes;
 
 /*
@@ -214,10 +216,11 @@ SV_UnlinkEdict
 */
 void SV_UnlinkEdict (edict_t *ent)
 {
-	if (!ent->e->area.prev)
+	if (!EDICT_SV(ent)->area.prev)
 		return;		// not linked in anywhere
-	RemoveLink (&ent->e->area);
-	ent->e->area.prev = ent->e->area.next = NULL;
+	RemoveLink (&EDICT_SV(ent)->area);
+	sv_linkcount++;
+	EDICT_SV(ent)->area.prev = EDICT_SV(ent)->area.next = NULL;
 }
 
 /*
@@ -289,6 +292,87 @@ checkstack:
 	return count;
 }
 
+/*
+====================
+SV_AreaEdictsRadius
+
+same walk as SV_AreaEdicts, but keeps only edicts whose bbox center is
+within rad of org
+====================
+*/
+int SV_AreaEdictsRadius (vec3_t org, float rad, edict_t **edicts, int max_edicts, int area)
+{
+	link_t		*l, *start;
+	edict_t		*touch;
+	int			i, stackdepth = 0, count = 0;
+	areanode_t	*localstack[AREA_NODES], *node = sv_areanodes;
+	vec3_t		mins, maxs, eorg;
+	float		rad_2 = rad * rad;
+
+	for (i = 0; i < 3; i++)
+	{
+		mins[i] = org[i] - rad - 1;		// enlarge the bbox a bit
+		maxs[i] = org[i] + rad + 1;
+	}
+
+	while (1)
+	{
+		start = (area == AREA_SOLID) ? &node->solid_edicts : &node->trigger_edicts;
+
+		for (l = start->next ; l != start ; l = l->next)
+		{
+			touch = EDICT_FROM_AREA(l);
+			if (touch->v.solid == SOLID_NOT)
+				continue;
+
+			if (mins[0] > touch->v.absmax[0]
+						 || mins[1] > touch->v.absmax[1]
+						 || mins[2] > touch->v.absmax[2]
+						 || maxs[0] < touch->v.absmin[0]
+						 || maxs[1] < touch->v.absmin[1]
+						 || maxs[2] < touch->v.absmin[2])
+				continue;
+
+			for (i = 0; i < 3; i++)
+				eorg[i] = org[i] - (touch->v.origin[i] + (touch->v.mins[i] + touch->v.maxs[i]) * 0.5);
+			if (DotProduct (eorg, eorg) > rad_2)
+				continue;
+
+			if (count == max_edicts)
+				return count;
+			edicts[count++] = touch;
+		}
+
+		if (node->axis == -1)
+			goto checkstack;		// terminal node
+
+		// recurse down both sides
+		if (maxs[node->axis] > node->dist)
+		{
+			if (mins[node->axis] < node->dist)
+			{
+				localstack[stackdepth++] = node->children[0];
+				node = node->children[1];
+				continue;
+			}
+			node = node->children[0];
+			continue;
+		}
+		if (mins[node->axis] < node->dist)
+		{
+			node = node->children[1];
+			continue;
+		}
+
+checkstack:
+		if (!stackdepth)
+			return count;
+		node = localstack[--stackdepth];
+	}
+
+	return count;
+}
+
 /*
 ====================
 SV_TouchLinks
@@ -333,11 +417,11 @@ void SV_LinkToLeafs (edict_t *ent)
 {
 	int	i, leafnums[MAX_ENT_LEAFS];
 
-	ent->e->num_leafs = CM_FindTouchedLeafs (ent->v.absmin, ent->v.absmax, leafnums,
+	EDICT_SV(ent)->num_leafs = CM_FindTouchedLeafs (ent->v.absmin, ent->v.absmax, leafnums,
 					      MAX_ENT_LEAFS, 0, NULL);
-	for (i = 0; i < ent->e->num_leafs; i++) {
-		// ent->e->leafnums are real leafnum minus one (for pvs checks)
-		ent->e->leafnums[i] = leafnums[i] - 1;
+	for (i = 0; i < EDICT_SV(ent)->num_leafs; i++) {
+		// EDICT_SV(ent)->leafnums are real leafnum minus one (for pvs checks)
+		EDICT_SV(ent)->leafnums[i] = leafnums[i] - 1;
 	}
 }
 
@@ -352,13 +436,13 @@ void SV_LinkEdict (edict_t *ent, qbool touch_triggers)
 {
 	areanode_t	*node;
 	
-	if (ent->e->area.prev)
+	if (EDICT_SV(ent)->area.prev)
 		SV_UnlinkEdict (ent);	// unlink from old position
 		
 	if (ent == sv.edicts)
 		return;		// don't add the world
 
-	if (ent->e->free)
+	if (EDICT_SV(ent)->free)
 		return;
 
 // set the abs box
@@ -391,7 +475,7 @@ void SV_LinkEdict (edict_t *ent, qbool touch_triggers)
 	if (ent->v.modelindex)
 		SV_LinkToLeafs (ent);
 	else
-		ent->e->num_leafs = 0;
+		EDICT_SV(ent)->num_leafs = 0;
 
 	if (ent->v.solid == SOLID_NOT)
 		return;
@@ -413,9 +497,10 @@ void SV_LinkEdict (edict_t *ent, qbool touch_triggers)
 // link it in	
 
 	if (ent->v.solid == SOLID_TRIGGER)
-		InsertLinkBefore (&ent->e->area, &node->trigger_edicts);
+		InsertLinkBefore (&EDICT_SV(ent)->area, &node->trigger_edicts);
 	else
-		InsertLinkBefore (&ent->e->area, &node->solid_edicts);
+		InsertLinkBefore (&EDICT_SV(ent)->area, &node->solid_edicts);
+	sv_linkcount++;
 	
 // if touch_triggers, touch all entities at this node and decend for more
 	if (touch_triggers)
@@ -547,8 +632,8 @@ void SV_ClipToLinks ( areanode_t *node, moveclip_t *clip )
 		if (clip->type & MOVE_LAGGED)
 		{
 			//can't touch lagged ents - we do an explicit test for them later in SV_AntilagClipCheck.
-			if (touch->e->entnum - 1 < w.maxlagents)
-				if (w.lagents[touch->e->entnum - 1].present)
+			if (EDICT_SV(touch)->entnum - 1 < w.maxlagents)
+				if (w.lagents[EDICT_SV(touch)->entnum - 1].present)
 					continue;
 		}
 
@@ -617,10 +702,10 @@ void SV_MoveBounds (vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end, vec3_t b
 
 void SV_AntilagReset (edict_t *ent)
 {
-	if (ent->e->entnum == 0 || ent->e->entnum > MAX_CLIENTS)
+	if (EDICT_SV(ent)->entnum == 0 || EDICT_SV(ent)->entnum > MAX_CLIENTS)
 		return;
 
-	svs.clients[ent->e->entnum - 1].antilag_position_next = 0;
+	svs.clients[EDICT_SV(ent)->entnum - 1].antilag_position_next = 0;
 }
 
 void SV_AntilagClipSetUp ( areanode_t *node, moveclip_t *clip )
@@ -629,16 +714,16 @@ void SV_AntilagClipSetUp ( areanode_t *node, moveclip_t *clip )
 
 	clip->type &= ~MOVE_LAGGED;
 
-	if (passedict->e->entnum && passedict->e->entnum <= MAX_CLIENTS)
+	if (EDICT_SV(passedict)->entnum && EDICT_SV(passedict)->entnum <= MAX_CLIENTS)
 	{
 		clip->type |= MOVE_LAGGED;
-		w.lagents = svs.clients[passedict->e->entnum-1].laggedents;
-		w.maxlagents = svs.clients[passedict->e->entnum-1].laggedents_count;
-		w.lagentsfrac = svs.clients[passedict->e->entnum-1].laggedents_frac;
+		w.lagents = svs.clients[EDICT_SV(passedict)->entnum-1].laggedents;
+		w.maxlagents = svs.clients[EDICT_SV(passedict)->entnum-1].laggedents_count;
+		w.lagentsfrac = svs.clients[EDICT_SV(passedict)->entnum-1].laggedents_frac;
 	}
 	else if (passedict->v.owner)
 	{
-		int owner = PROG_TO_EDICT(passedict->v.owner)->e->entnum;
+		int owner = EDICT_SV(PROG_TO_EDICT(passedict->v.owner))->entnum;
 
 		if (owner && owner <= MAX_CLIENTS)
 		{
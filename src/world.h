@@ -79,6 +79,9 @@ trace_t SV_Trace (vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end, int type,
 // passedict is explicitly excluded from clipping checks (normally NULL)
 
 int SV_AreaEdicts (vec3_t mins, vec3_t maxs, edict_t **edicts, int max_edicts, int area);
+int SV_AreaEdictsRadius (vec3_t org, float rad, edict_t **edicts, int max_edicts, int area);
+
+extern int sv_linkcount;
 
 void SV_AntilagReset (edict_t *ent);
 
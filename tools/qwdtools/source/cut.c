@@ -0,0 +1,198 @@
+/*
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+    $Id$
+*/
+
+// cut.c - cuts time range of an mvd using .idx written by the server,
+// only the index and the range itself are read
+
+#include "defs.h"
+
+static char *IndexName (char *demoname)
+{
+	static char name[MAX_OSPATH];
+	int len;
+
+	strlcpy(name, demoname, sizeof(name));
+	len = strlen(name);
+	if (len > 4 && !strcasecmp(name + len - 4, ".mvd"))
+		name[len - 4] = 0;
+	strlcat(name, MVD_INDEX_EXT, sizeof(name));
+
+	return name;
+}
+
+/*
+===================
+CutDemo
+
+writes gamestate snapshot at or before 'from' followed by demo data
+up to the first keyframe at or after 'to'
+===================
+*/
+qbool CutDemo (char *demoname, char *outname, float from, float to)
+{
+	FILE	*idxf, *demof, *outf;
+	char	buf[0x10000], magic[4];
+	int		version, offset, len, n;
+	int		snapoffset = 0, snaplen = 0, endoffset = -1;
+	long	snappos = 0;
+	float	t, snaptime = 0;
+	byte	type;
+
+	if (FileOpenRead(IndexName(demoname), &idxf) == -1)
+	{
+		Sys_Printf("couldn't open index: %s\n", IndexName(demoname));
+		return false;
+	}
+
+	if (fread(magic, 1, 4, idxf) != 4 || memcmp(magic, MVD_INDEX_MAGIC, 4)
+		|| fread(&version, 4, 1, idxf) != 1 || LittleLong(version) != MVD_INDEX_VERSION)
+	{
+		Sys_Printf("bad index: %s\n", IndexName(demoname));
+		fclose(idxf);
+		return false;
+	}
+
+	while (fread(&type, 1, 1, idxf) == 1 && fread(&offset, 4, 1, idxf) == 1 && fread(&t, 4, 1, idxf) == 1)
+	{
+		offset = LittleLong(offset);
+		t = LittleFloat(t);
+
+		if (type == MVD_INDEX_SNAPSHOT)
+		{
+			if (fread(&len, 4, 1, idxf) != 1)
+				break;
+			len = LittleLong(len);
+
+			if (t <= from)
+			{
+				snapoffset = offset;
+				snaplen = len;
+				snappos = ftell(idxf);
+				snaptime = t;
+			}
+
+			if (fseek(idxf, len, SEEK_CUR))
+				break;
+		}
+
+		if (t >= to)
+		{
+			endoffset = offset;
+			break;
+		}
+	}
+
+	if (FileOpenRead(demoname, &demof) == -1)
+	{
+		Sys_Printf("couldn't open for reading: %s\n", demoname);
+		fclose(idxf);
+		return false;
+	}
+
+	if (!(outf = fopen(outname, "wb")))
+	{
+		Sys_Printf("couldn't open for writing: %s\n", outname);
+		fclose(idxf);
+		fclose(demof);
+		return false;
+	}
+
+	Sys_Printf("source: %s\n cutting to: %s\n", demoname, outname);
+
+	len = 0;
+	if (snaplen)
+	{
+		fseek(idxf, snappos, SEEK_SET);
+		for (len = snaplen; len > 0; len -= n)
+		{
+			if ((n = fread(buf, 1, min(len, (int) sizeof(buf)), idxf)) <= 0)
+				break;
+			fwrite(buf, 1, n, outf);
+		}
+	}
+
+	fseek(demof, snapoffset, SEEK_SET);
+	for (offset = snapoffset; len <= 0 && (endoffset < 0 || offset < endoffset); offset += n)
+	{
+		n = sizeof(buf);
+		if (endoffset >= 0)
+			n = min(n, endoffset - offset);
+		if ((n = fread(buf, 1, n, demof)) <= 0)
+			break;
+		fwrite(buf, 1, n, outf);
+	}
+
+	if (len > 0 || ferror(outf))
+		Sys_Printf("error while cutting %s\n", demoname);
+	else
+		Sys_Printf(" %d KB written, starts at %.1f\n", (snaplen + offset - snapoffset) / 1024, snaptime);
+
+	fclose(outf);
+	fclose(idxf);
+	fclose(demof);
+
+	return len <= 0;
+}
+
+/*
+===================
+CutDemos
+
+-cut mode, runs instead of the usual jobs
+===================
+*/
+void CutDemos (void)
+{
+	flist_t	*source;
+	char	name[MAX_OSPATH], out[MAX_OSPATH];
+	int		i;
+
+	if (sworld.cutto <= sworld.cutfrom)
+	{
+		Sys_Printf("-cut_to must be greater than -cut\n");
+		return;
+	}
+
+	for (source = sworld.filelist; source->count; source++)
+	{
+		for (i = 0; i < source->count; i++)
+		{
+			if (sworld.options & O_SHUTDOWN)
+				return;
+
+			if (strcmp(currentDir, source->path))
+				snprintf(name, sizeof(name), "%s%s", source->path, source->list[i]);
+			else
+				strlcpy(name, source->list[i], sizeof(name));
+
+			strlcpy(out, TemplateName(source->list[i], sworld.demo.name, "*"), sizeof(out));
+			if (!strcmp(sworld.demo.name, "*"))
+				strlcat(out, va("_%d-%d", sworld.cutfrom, sworld.cutto), sizeof(out));
+			ForceExtension(out, ".mvd");
+
+			if (outputDir[0])
+			{
+				Sys_mkdir(outputDir);
+				strlcpy(out, va("%s/%s", outputDir, out), sizeof(out));
+			}
+
+			CutDemo(name, out, sworld.cutfrom, sworld.cutto);
+		}
+	}
+}
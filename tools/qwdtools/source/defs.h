@@ -84,6 +84,7 @@ typedef vec_t vec3_t[3];
 #define O_STDIN			2048
 #define O_STDOUT		4096
 #define O_QWDSYNC		8192
+#define O_CUT			16384
 
 #define JOB_TODO (O_MARGE | O_CONVERT | O_ANALYSE | O_LOG | O_DEBUG)
 
@@ -96,6 +97,16 @@ typedef vec_t vec3_t[3];
 
 extern	sizebuf_t net_message;
 
+// demo index written by the server, see src/sv_demo_index.c
+#define MVD_INDEX_EXT		".idx"
+#define MVD_INDEX_MAGIC		"MVDI"
+#define MVD_INDEX_VERSION	1
+#define MVD_INDEX_KEYFRAME	'K'
+#define MVD_INDEX_SNAPSHOT	'S'
+
+qbool CutDemo (char *demoname, char *outname, float from, float to);
+void CutDemos (void);
+
 #define MAX_UDP_PACKET (MAX_MSGLEN*2) // one more than msg + header
 #define MAX_SOURCES 50
 
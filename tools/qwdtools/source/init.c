@@ -53,6 +53,7 @@ void Help (void)
 	Sys_Printf("-msg                   msg level (same as QW's msg command)\n");
 	Sys_Printf("-c                     converts to mvd (assumed if no options are given)\n");
 	Sys_Printf("-m                     marges multiple demos to one mvd demo\n");
+	Sys_Printf("-cut sec -cut_to sec   cuts time range of mvd demos using their .idx\n");
 	//Sys_Printf("-analyse/-a            - analysing demo\n");
 	Sys_Printf("-log                   creates log file\n");
 	Sys_Printf("-debug                 prints way too much messages\n");
@@ -221,6 +222,8 @@ param_t params[] =
 		{"-msglevel",			"-msg",	TYPE_I, {(char *) &sworld.msglevel}},
 		{"-marge",				"-m",	TYPE_O, {(char *) O_MARGE}},
 		{"-range",				"-r",	TYPE_I, {(char *) &sworld.range}},
+		{"-cut",				NULL,	(type_t) (TYPE_O | TYPE_I), {(char *) &sworld.cutfrom}, 0, (int) O_CUT},
+		{"-cut_to",				NULL,	TYPE_I, {(char *) &sworld.cutto}},
 		{NULL}
 	};
 
@@ -1184,6 +1184,13 @@ int main (int argc, char **argv)
 	Load_ini();
 	ParseArgv();
 
+	if (sworld.options & O_CUT)
+	{
+		CutDemos();
+		Sys_Printf("\nDone.\n");
+		Sys_Exit(0);
+	}
+
 	options = sworld.options & JOB_TODO;
 
 	if (sworld.options & O_FC)
@@ -92,6 +92,10 @@ SOURCE=..\bothtools.c
 # End Source File
 # Begin Source File
 
+SOURCE=cut.c
+# End Source File
+# Begin Source File
+
 SOURCE=dem_parse.c
 # End Source File
 # Begin Source File
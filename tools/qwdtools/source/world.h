@@ -185,6 +185,8 @@ typedef struct
 	int			fromcount;
 	flist_t		filelist[50];
 	int			range;
+	int			cutfrom;
+	int			cutto;
 } static_world_state_t;
 
 extern char		qizmoDir[MAX_OSPATH];